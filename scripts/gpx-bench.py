@@ -0,0 +1,357 @@
+#!/usr/bin/python
+#
+#  gpx-bench.py
+#
+#  Measure gpx conversion throughput over synthetic gcode
+#
+#  Generates a set of gcode files that each stress a different part of the
+#  converter, converts each of them with gpx a number of times and reports
+#  the best time as lines and megabytes per second, along with the size of
+#  the x3g output and the peak resident set size of the conversion.
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software Foundation,
+#  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+import getopt
+import json
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+import time
+
+# each workload writes lines * scale lines of gcode
+
+LINES = 100000
+
+START = [
+    'M136 (enable build)',
+    'M73 P0',
+    'G162 X Y F2000 (home XY axes maximum)',
+    'G161 Z F900 (home Z axis minimum)',
+    'G92 X0 Y0 Z0 A0 B0 (set zero)',
+    'G1 Z5 F900',
+    'G21',
+    'G90',
+    'M83',
+]
+
+END = [
+    'M18 A B (turn off extruder)',
+    'M104 S0 T0',
+    'M104 S0 T1',
+    'M140 S0',
+    'G162 Z F900',
+    'M73 P100',
+    'M137 (build end notification)',
+]
+
+def layer_moves(out, rnd, lines, layer_lines, step, write_line):
+    """Write lines of moves in layers of layer_lines, each move step mm"""
+    x = y = 0.0
+    z = 0.2
+    n = 0
+    while n < lines:
+        out.write('G1 Z%.2f F1200\n' % z)
+        n += 1
+        for i in range(layer_lines):
+            angle = rnd.uniform(0, 2 * math.pi)
+            x = max(-100.0, min(100.0, x + step * math.cos(angle)))
+            y = max(-70.0, min(70.0, y + step * math.sin(angle)))
+            write_line(out, rnd, x, y, step)
+            n += 1
+        z += 0.2
+
+def move(out, rnd, x, y, step):
+    out.write('G1 X%.3f Y%.3f E%.5f\n' % (x, y, step * 0.033))
+
+def dense(out, rnd, lines):
+    """Short segments, the bulk of a finely detailed model"""
+    out.write('G1 F3600\n')
+    layer_moves(out, rnd, lines, 2000, 0.05, move)
+
+def arcs(out, rnd, lines):
+    """Circles broken up into polylines, as slicers write curved perimeters"""
+    n = 0
+    z = 0.2
+    out.write('G1 F2400\n')
+    while n < lines:
+        out.write('G1 Z%.2f\n' % z)
+        n += 1
+        cx = rnd.uniform(-50, 50)
+        cy = rnd.uniform(-30, 30)
+        r = rnd.uniform(2, 20)
+        segments = rnd.randint(32, 360)
+        for i in range(segments + 1):
+            angle = 2 * math.pi * i / segments
+            out.write('G1 X%.3f Y%.3f E%.5f\n' % (cx + r * math.cos(angle), cy + r * math.sin(angle), 2 * math.pi * r / segments * 0.033))
+            n += 1
+        z += 0.2
+
+def comments(out, rnd, lines):
+    """Big settings blocks and a comment on most lines"""
+    letters = 'abcdefghijklmnopqrstuvwxyz_ =:.0123456789'
+    n = 0
+    while n < lines // 2:
+        out.write(';SETTING_3 %s\n' % ''.join(rnd.choice(letters) for i in range(2000)))
+        for i in range(40):
+            out.write(';   %s,%d\n' % (''.join(rnd.choice(letters) for i in range(40)), i))
+        n += 41
+
+    def commented(out, rnd, x, y, step):
+        out.write('G1 X%.3f Y%.3f E%.5f ; perimeter\n' % (x, y, step * 0.033))
+        if rnd.random() < 0.3:
+            out.write('(feature: outer wall, width %.2f)\n' % rnd.uniform(0.3, 0.5))
+    out.write('G1 F3600\n')
+    layer_moves(out, rnd, lines // 2, 200, 0.5, commented)
+
+def dual(out, rnd, lines):
+    """Both extruders, changing tools every few moves"""
+    tool = [0]
+    def tool_change(out, rnd, x, y, step):
+        if rnd.random() < 0.02:
+            tool[0] = 1 - tool[0]
+            out.write('T%d\n' % tool[0])
+            out.write('M104 S%d T%d\n' % (rnd.choice((215, 220, 230)), tool[0]))
+        move(out, rnd, x, y, step)
+    out.write('M104 S220 T0\nM104 S220 T1\nG1 F3000\n')
+    layer_moves(out, rnd, lines, 500, 0.5, tool_change)
+
+def rewrite5d(out, rnd, lines):
+    """Absolute extrusion, converted with -w"""
+    e = [0.0]
+    def absolute(out, rnd, x, y, step):
+        e[0] += step * 0.033
+        out.write('G1 X%.3f Y%.3f E%.5f\n' % (x, y, e[0]))
+        if rnd.random() < 0.01:
+            out.write('G1 E%.5f F1800\nG1 E%.5f\n' % (e[0] - 1, e[0]))
+    out.write('M82\nG92 E0\nG1 F3000\n')
+    layer_moves(out, rnd, lines, 500, 0.5, absolute)
+
+# gpx holds at most COMMAND_AT_MAX (128) @pause and @temp macros, keep
+# below it so the workload measures macro expansion, not the overflow error
+
+MACROS_MAX = 100
+
+def macros(out, rnd, lines):
+    """Filament definitions and pause and temperature macros spread over the layers"""
+    colours = ('red', 'green', 'blue', 'white', 'black')
+    for name in colours:
+        out.write(';@filament %s 1.75mm %dc #%06X\n' % (name, rnd.randint(200, 240), rnd.randint(0, 0xFFFFFF)))
+    out.write(';@right red\n;@left blue\n')
+    layers = lines // 200 + 1
+    count = min(layers - 1, MACROS_MAX)
+    every = max(1, layers // (count + 1))
+    for i in range(1, count + 1):
+        z = i * every * 0.2
+        if i % 2:
+            out.write(';@temp %.2f %dc\n' % (z, rnd.randint(200, 240)))
+        else:
+            out.write(';@pause %.2f %s\n' % (z, rnd.choice(colours)))
+    out.write('G1 F3000\n')
+    layer_moves(out, rnd, lines - count, 200, 0.5, move)
+
+# name, generator, gpx options
+
+WORKLOADS = [
+    ('dense', dense, []),
+    ('arcs', arcs, []),
+    ('comments', comments, []),
+    ('dual', dual, []),
+    ('rewrite5d', rewrite5d, ['-w']),
+    ('macros', macros, []),
+]
+
+def generate(path, generator, lines):
+    rnd = random.Random(1)
+    with open(path, 'w') as out:
+        out.write('\n'.join(START) + '\n')
+        generator(out, rnd, lines)
+        out.write('\n'.join(END) + '\n')
+
+def count_lines(path):
+    with open(path, 'rb') as f:
+        return sum(block.count(b'\n') for block in iter(lambda: f.read(65536), b''))
+
+# how often the peak RSS of a running conversion is read from /proc
+
+POLL_SECONDS = 0.002
+
+def high_water(pid):
+    """The peak RSS in KB of the program pid is running, or None once it
+    has exited"""
+    try:
+        with open('/proc/%d/status' % pid) as status:
+            for line in status:
+                if line.startswith('VmHWM:'):
+                    return int(line.split()[1])
+    except (IOError, OSError, ValueError):
+        pass
+    return None
+
+# without /proc only ru_maxrss is left
+
+HAVE_PROC = high_water(os.getpid()) is not None
+
+def run(command, check=True):
+    """Run command and return the wall time and peak RSS in KB"""
+    with open(os.devnull, 'w') as devnull:
+        start = time.time()
+        process = subprocess.Popen(command, stdout=devnull, stderr=devnull)
+        if HAVE_PROC:
+            # Popen returns once the command has been exec'd, so VmHWM is
+            # the peak of gpx alone, where ru_maxrss would also count this
+            # interpreter's pages the child had before the exec
+            rss = None
+            while process.poll() is None:
+                hwm = high_water(process.pid)
+                if hwm is not None and (rss is None or hwm > rss):
+                    rss = hwm
+                time.sleep(POLL_SECONDS)
+        elif hasattr(os, 'wait4'):
+            pid, status, usage = os.wait4(process.pid, 0)
+            process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+            rss = usage.ru_maxrss
+            # macOS reports bytes, everything else kilobytes
+            if sys.platform == 'darwin':
+                rss //= 1024
+        else:
+            process.wait()
+            rss = None
+        seconds = time.time() - start
+    if check and process.returncode != 0:
+        raise RuntimeError('%s exited with %d' % (' '.join(command), process.returncode))
+    return seconds, rss
+
+# words in gpx's messages that mean the conversion went wrong
+
+ERROR_PATTERN = re.compile(r'\berror\b|overflow', re.IGNORECASE)
+
+def check(command):
+    """Convert once with messages on and fail if gpx reports an error"""
+    process = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = process.communicate()[0].decode('utf-8', 'replace')
+    errors = [line for line in output.splitlines() if ERROR_PATTERN.search(line)]
+    if process.returncode != 0 or errors:
+        raise RuntimeError('%s exited with %d\n%s' % (' '.join(command), process.returncode, '\n'.join(errors[:5])))
+
+def usage():
+    print('Usage: gpx-bench.py -g GPX [-d DIR] [-s SCALE] [-r REPEAT] [-j FILE] [-k] [WORKLOAD...]')
+    print('\t-g GPX\t\tthe gpx executable to measure')
+    print('\t-d DIR\t\twrite the gcode and x3g files to DIR (default bench)')
+    print('\t-s SCALE\tmultiply the size of each workload by SCALE (default 1)')
+    print('\t-r REPEAT\tconvert each file REPEAT times and keep the best (default 3)')
+    print('\t-j FILE\t\twrite the results to FILE as JSON')
+    print('\t-k\t\tkeep the gcode and x3g files')
+    print('')
+    print('Workloads: ' + ' '.join(w[0] for w in WORKLOADS))
+    sys.exit(2)
+
+def main(argv):
+    gpx = None
+    directory = 'bench'
+    scale = 1.0
+    repeat = 3
+    results_file = None
+    keep = False
+
+    try:
+        opts, args = getopt.getopt(argv, 'g:d:s:r:j:kh')
+    except getopt.GetoptError:
+        usage()
+    for opt, arg in opts:
+        if opt == '-g':
+            gpx = arg
+        elif opt == '-d':
+            directory = arg
+        elif opt == '-s':
+            scale = float(arg)
+        elif opt == '-r':
+            repeat = max(1, int(arg))
+        elif opt == '-j':
+            results_file = arg
+        elif opt == '-k':
+            keep = True
+        else:
+            usage()
+    if gpx is None:
+        usage()
+    names = [w[0] for w in WORKLOADS]
+    for name in args:
+        if name not in names:
+            print('Unknown workload: ' + name)
+            usage()
+    workloads = [w for w in WORKLOADS if not args or w[0] in args]
+
+    if not os.path.isdir(directory):
+        os.makedirs(directory)
+
+    # without /proc the peak RSS of a child includes what it inherited from
+    # this process before it started gpx, so measure that floor with a run
+    # that stops straight away
+    floor = None
+    if not HAVE_PROC:
+        seconds, floor = run([gpx, '-?'], False)
+        if floor is not None:
+            print('RSS floor: %d KB' % floor)
+
+    results = []
+    print('%-10s %10s %10s %12s %10s %8s %12s %10s' % ('workload', 'lines', 'MB', 'x3g bytes', 'seconds', 'MB/s', 'lines/s', 'peak RSS'))
+    for name, generator, options in workloads:
+        gcode = os.path.join(directory, name + '.gcode')
+        x3g = os.path.join(directory, name + '.x3g')
+        generate(gcode, generator, int(LINES * scale))
+        lines = count_lines(gcode)
+        size = os.path.getsize(gcode)
+
+        command = [gpx, '-I', '-q', '-m', 'r2x'] + options + [gcode, x3g]
+        check([c for c in command if c != '-q'])
+        best = None
+        peak = None
+        for i in range(repeat):
+            seconds, rss = run(command)
+            if best is None or seconds < best:
+                best = seconds
+            if rss is not None and (peak is None or rss > peak):
+                peak = rss
+        output = os.path.getsize(x3g)
+
+        result = {
+            'workload': name,
+            'options': options,
+            'lines': lines,
+            'input_bytes': size,
+            'output_bytes': output,
+            'seconds': best,
+            'lines_per_second': lines / best if best > 0 else None,
+            'mb_per_second': size / 1048576.0 / best if best > 0 else None,
+            'peak_rss_kb': peak,
+        }
+        results.append(result)
+        print('%-10s %10d %10.2f %12d %10.4f %8.1f %12.0f %10s' % (name, lines, size / 1048576.0, output, best,
+              result['mb_per_second'] or 0, result['lines_per_second'] or 0, '%d KB' % peak if peak is not None else '-'))
+
+        if not keep:
+            os.remove(gcode)
+            os.remove(x3g)
+
+    if results_file:
+        with open(results_file, 'w') as f:
+            json.dump({'gpx': gpx, 'scale': scale, 'repeat': repeat, 'rss_floor_kb': floor, 'results': results}, f, indent=2, sort_keys=True)
+            f.write('\n')
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
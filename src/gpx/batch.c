@@ -0,0 +1,345 @@
+//  batch.c
+//
+//  Convert a batch of gcode files in one process
+//
+//  The configuration is loaded once and every file is converted by a
+//  clone of it, files are shared out between a pool of worker threads.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+typedef struct tBatchJob {
+    char *input;
+    char *output;
+    int rval;
+    double seconds;         // time taken to convert
+    unsigned long bytes;    // x3g output size
+    double filament;        // extrusion length in mm
+    double estimate;        // estimated print time in seconds
+    FILE *log;              // messages from the conversion
+    int done;
+} BatchJob;
+
+typedef struct tBatch {
+    const Gpx *gpx;         // configuration shared by every job
+    BatchJob *job;
+    unsigned count;
+    unsigned size;
+    unsigned next;          // next job to start
+    int truncate;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+#endif
+} Batch;
+
+static double elapsed(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+    return (double)time(NULL);
+}
+
+// the filename without any leading directories
+
+static const char *leaf_name(const char *filename)
+{
+    const char *leaf = strrchr(filename, PATH_DELIM);
+#ifdef _WIN32
+    const char *other = strrchr(filename, '/');
+    if(other > leaf) leaf = other;
+#endif
+    return leaf ? leaf + 1 : filename;
+}
+
+// the input filename with a .x3g extension, the same as gpx does for a
+// single file without an output filename
+
+static char *output_name(const char *input, int truncate)
+{
+    size_t length = strlen(input);
+    char *output = malloc(length + 5);
+    if(output == NULL) return NULL;
+
+    const char *leaf = leaf_name(input);
+    const char *ext = strrchr(leaf, '.');
+    size_t l = ext ? (size_t)(ext - input) : length;
+    memcpy(output, input, l);
+    char *end = output + l;
+
+    if(truncate) {
+        // truncate, replace all non alnum with '_' and uppercase
+        char *s = output + (leaf - input);
+        int i;
+        for(i = 0; s < end && i < 8; i++, s++) {
+            *s = isalnum((unsigned char)*s) ? toupper((unsigned char)*s) : '_';
+        }
+        strcpy(s, ".X3G");
+    }
+    else {
+        strcpy(end, ".x3g");
+    }
+    return output;
+}
+
+static int add_job(Batch *batch, const char *input)
+{
+    if(batch->count == batch->size) {
+        unsigned size = batch->size ? batch->size * 2 : 64;
+        BatchJob *job = realloc(batch->job, size * sizeof(BatchJob));
+        if(job == NULL) return ERROR;
+        batch->job = job;
+        batch->size = size;
+    }
+    BatchJob *job = batch->job + batch->count;
+    memset(job, 0, sizeof(BatchJob));
+    job->input = strdup(input);
+    job->output = job->input ? output_name(input, batch->truncate) : NULL;
+    if(job->output == NULL) {
+        free(job->input);
+        return ERROR;
+    }
+    batch->count++;
+    return SUCCESS;
+}
+
+// add every filename listed in the manifest
+
+static int load_manifest(Batch *batch, const char *filename, FILE *log)
+{
+    char line[BUFFER_MAX + 1];
+    FILE *manifest = fopen(filename, "r");
+    if(manifest == NULL) {
+        fprintf(log, "Error opening manifest %s: %s" EOL, filename, strerror(errno));
+        return ERROR;
+    }
+    while(fgets(line, sizeof(line), manifest)) {
+        char *s = line;
+        char *e = line + strlen(line);
+        while(isspace((unsigned char)*s)) s++;
+        while(e > s && isspace((unsigned char)e[-1])) e--;
+        *e = 0;
+        if(*s == 0 || *s == '#') continue;
+        if(add_job(batch, s) != SUCCESS) {
+            fclose(manifest);
+            fputs("Error: insufficient memory for the batch" EOL, log);
+            return ERROR;
+        }
+    }
+    fclose(manifest);
+    return SUCCESS;
+}
+
+static void run_job(Batch *batch, BatchJob *job)
+{
+    Gpx *gpx = malloc(sizeof(Gpx));
+    FILE *in = NULL;
+    FILE *out = NULL;
+    double start = elapsed();
+
+    job->rval = ERROR;
+    job->log = tmpfile();
+    if(gpx == NULL) {
+        if(job->log) fputs("Error: insufficient memory for the conversion" EOL, job->log);
+        return;
+    }
+    gpx_clone(gpx, batch->gpx);
+    if(job->log) gpx->log = job->log;
+
+    if((in = fopen(job->input, "r")) == NULL) {
+        fprintf(gpx->log, "Error opening input %s: %s" EOL, job->input, strerror(errno));
+        goto L_ABORT;
+    }
+    if((out = fopen(job->output, "wb")) == NULL) {
+        fprintf(gpx->log, "Error creating output %s: %s" EOL, job->output, strerror(errno));
+        goto L_ABORT;
+    }
+
+    // the build name is the input filename without its extension
+    char *buildName = strdup(leaf_name(job->input));
+    if(buildName) {
+        char *dot = strrchr(buildName, '.');
+        if(dot) *dot = 0;
+    }
+    gpx_start_convert(gpx, buildName, 0);
+    free(buildName);
+
+    job->rval = gpx_convert(gpx, in, out, NULL);
+    gpx_end_convert(gpx);
+
+    if(fclose(out) != 0 && job->rval == SUCCESS) {
+        fprintf(gpx->log, "Error writing output %s: %s" EOL, job->output, strerror(errno));
+        job->rval = ERROR;
+    }
+    out = NULL;
+    job->bytes = gpx->accumulated.bytes;
+    job->filament = gpx->accumulated.a + gpx->accumulated.b;
+    job->estimate = gpx->accumulated.time;
+
+L_ABORT:
+    if(in) fclose(in);
+    if(out) fclose(out);
+    gpx_release_clone(gpx);
+    free(gpx);
+    job->seconds = elapsed() - start;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+static void *batch_thread(void *arg)
+{
+    Batch *batch = (Batch *)arg;
+
+    pthread_mutex_lock(&batch->lock);
+    while(batch->next < batch->count) {
+        BatchJob *job = batch->job + batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        run_job(batch, job);
+        pthread_mutex_lock(&batch->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&batch->finished);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+#endif // HAVE_PTHREAD_H
+
+static void report_job(BatchJob *job, FILE *summary, FILE *log)
+{
+    if(job->rval == SUCCESS) {
+        long seconds = round(job->estimate);
+        fprintf(summary, "%s -> %s: %lu bytes, %0.3f m filament, %ld:%02ld:%02ld print time, converted in %0.3f s" EOL,
+                job->input, job->output, job->bytes, job->filament / 1000,
+                seconds / 3600, seconds / 60 % 60, seconds % 60, job->seconds);
+    }
+    else {
+        fprintf(summary, "%s: conversion failed" EOL, job->input);
+    }
+    fflush(summary);
+
+    // pass on the messages from the conversion
+    if(job->log) {
+        char buffer[4096];
+        size_t length;
+        rewind(job->log);
+        while((length = fread(buffer, 1, sizeof(buffer), job->log)) > 0) {
+            fwrite(buffer, 1, length, log);
+        }
+        fclose(job->log);
+        job->log = NULL;
+    }
+}
+
+int gpx_batch(Gpx *gpx, int count, char * const *input, int jobs, int truncate, FILE *summary)
+{
+    Batch batch;
+    unsigned i, failed = 0;
+    int rval = SUCCESS;
+    double start = elapsed();
+
+    memset(&batch, 0, sizeof(batch));
+    batch.gpx = gpx;
+    batch.truncate = truncate;
+
+    for(i = 0; i < count; i++) {
+        if(input[i][0] == '@') {
+            if(load_manifest(&batch, input[i] + 1, gpx->log) != SUCCESS) {
+                rval = ERROR;
+                goto L_ABORT;
+            }
+        }
+        else if(add_job(&batch, input[i]) != SUCCESS) {
+            fputs("Error: insufficient memory for the batch" EOL, gpx->log);
+            rval = ERROR;
+            goto L_ABORT;
+        }
+    }
+
+    if(jobs < 1) jobs = 1;
+    if(jobs > batch.count) jobs = batch.count;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_t *thread = NULL;
+    int threads = 0;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+    if(jobs > 1 && (thread = calloc(jobs, sizeof(pthread_t))) != NULL) {
+        for(threads = 0; threads < jobs; threads++) {
+            if(pthread_create(thread + threads, NULL, batch_thread, &batch) != 0) break;
+        }
+    }
+
+    // report in input order as the jobs finish, if no worker started the
+    // jobs are run here as they are reported
+    for(i = 0; i < batch.count; i++) {
+        BatchJob *job = batch.job + i;
+        pthread_mutex_lock(&batch.lock);
+        if(threads == 0 && batch.next == i) {
+            batch.next++;
+            pthread_mutex_unlock(&batch.lock);
+            run_job(&batch, job);
+        }
+        else {
+            while(!job->done) {
+                pthread_cond_wait(&batch.finished, &batch.lock);
+            }
+            pthread_mutex_unlock(&batch.lock);
+        }
+        if(job->rval != SUCCESS) failed++;
+        report_job(job, summary, gpx->log);
+    }
+
+    while(threads > 0) {
+        pthread_join(thread[--threads], NULL);
+    }
+    free(thread);
+    pthread_cond_destroy(&batch.finished);
+    pthread_mutex_destroy(&batch.lock);
+#else
+    for(i = 0; i < batch.count; i++) {
+        BatchJob *job = batch.job + i;
+        run_job(&batch, job);
+        if(job->rval != SUCCESS) failed++;
+        report_job(job, summary, gpx->log);
+    }
+#endif
+
+    fprintf(summary, "Converted %u of %u files in %0.3f s" EOL, batch.count - failed, batch.count, elapsed() - start);
+    if(failed) rval = ERROR;
+
+L_ABORT:
+    for(i = 0; i < batch.count; i++) {
+        free(batch.job[i].input);
+        free(batch.job[i].output);
+    }
+    free(batch.job);
+    return rval;
+}
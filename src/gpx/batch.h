@@ -0,0 +1,36 @@
+//  batch.h
+//
+//  Convert a batch of gcode files in one process
+//
+//  The configuration is loaded once and every file is converted by a
+//  clone of it, files are shared out between a pool of worker threads.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __batch_h__
+#define __batch_h__
+
+#include "gpx.h"
+
+// convert each of the count input files to an x3g file alongside it using
+// up to jobs threads, an argument of the form @FILE names a manifest with
+// one input filename per line (blank lines and lines starting with # are
+// skipped), when truncate is set output filenames are truncated to DOS 8.3
+// a summary line per file is written to summary in input order, messages
+// from each conversion follow on gpx->log
+// returns SUCCESS if every file converted, otherwise ERROR
+int gpx_batch(Gpx *gpx, int count, char * const *input, int jobs, int truncate, FILE *summary);
+
+#endif /* __batch_h__ */
@@ -0,0 +1,667 @@
+//  cache.c
+//
+//  Conversion cache
+//
+//  Keeps the x3g output and log of each conversion in a directory, keyed
+//  on a hash of the gcode input and of every setting that changes the
+//  output, so converting the same gcode for the same printer again copies
+//  the earlier result instead of converting it. The least recently used
+//  entries are evicted when the directory grows past its size limit.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "cache.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define BLOCK 65536
+
+// an entry is KEY.x3g and KEY.log, the x3g is renamed into place last so
+// an entry with no x3g is incomplete, entries are written as tmp-XXXXXX
+// first
+
+#define X3G_SUFFIX ".x3g"
+#define LOG_SUFFIX ".log"
+
+// 64 bit hash after XXH64, fed a piece at a time
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+typedef struct tHash {
+    uint64_t seed;
+    uint64_t v[4];
+    uint64_t length;
+    unsigned char pending[32];  // the start of a stripe
+    size_t used;
+} Hash;
+
+static uint64_t rotate(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read_64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read_32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    return rotate(acc, 31) * PRIME1;
+}
+
+static uint64_t hash_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= hash_round(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+static void hash_init(Hash *hash, uint64_t seed)
+{
+    hash->seed = seed;
+    hash->v[0] = seed + PRIME1 + PRIME2;
+    hash->v[1] = seed + PRIME2;
+    hash->v[2] = seed;
+    hash->v[3] = seed - PRIME1;
+    hash->length = 0;
+    hash->used = 0;
+}
+
+static void hash_stripe(Hash *hash, const unsigned char *p)
+{
+    int i;
+    for(i = 0; i < 4; i++) {
+        hash->v[i] = hash_round(hash->v[i], read_64(p + 8 * i));
+    }
+}
+
+static void hash_update(Hash *hash, const void *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    hash->length += length;
+    if(hash->used) {
+        size_t n = 32 - hash->used;
+        if(n > length) n = length;
+        memcpy(hash->pending + hash->used, p, n);
+        hash->used += n;
+        p += n;
+        length -= n;
+        if(hash->used < 32) return;
+        hash_stripe(hash, hash->pending);
+        hash->used = 0;
+    }
+    for(; length >= 32; p += 32, length -= 32) {
+        hash_stripe(hash, p);
+    }
+    memcpy(hash->pending, p, length);
+    hash->used = length;
+}
+
+static uint64_t hash_final(Hash *hash)
+{
+    const unsigned char *p = hash->pending;
+    size_t n = hash->used;
+    uint64_t h;
+    int i;
+
+    if(hash->length >= 32) {
+        h = rotate(hash->v[0], 1) + rotate(hash->v[1], 7) + rotate(hash->v[2], 12) + rotate(hash->v[3], 18);
+        for(i = 0; i < 4; i++) {
+            h = hash_merge(h, hash->v[i]);
+        }
+    }
+    else {
+        h = hash->seed + PRIME5;
+    }
+    h += hash->length;
+
+    for(; n >= 8; p += 8, n -= 8) {
+        h ^= hash_round(0, read_64(p));
+        h = rotate(h, 27) * PRIME1 + PRIME4;
+    }
+    if(n >= 4) {
+        h ^= (uint64_t)read_32(p) * PRIME1;
+        h = rotate(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        n -= 4;
+    }
+    for(; n; p++, n--) {
+        h ^= *p * PRIME5;
+        h = rotate(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// SETTINGS
+
+#define HASH(hash, value) hash_update(hash, &(value), sizeof(value))
+
+static void hash_string(Hash *hash, const char *s)
+{
+    uint32_t length = s ? (uint32_t)strlen(s) : UINT32_MAX;
+    HASH(hash, length);
+    if(s) hash_update(hash, s, length);
+}
+
+static void hash_axis(Hash *hash, const Axis *axis)
+{
+    HASH(hash, axis->max_feedrate);
+    HASH(hash, axis->max_accel);
+    HASH(hash, axis->max_speed_change);
+    HASH(hash, axis->home_feedrate);
+    HASH(hash, axis->length);
+    HASH(hash, axis->steps_per_mm);
+    HASH(hash, axis->endstop);
+}
+
+static void hash_extruder(Hash *hash, const Extruder *extruder)
+{
+    HASH(hash, extruder->max_feedrate);
+    HASH(hash, extruder->max_accel);
+    HASH(hash, extruder->max_speed_change);
+    HASH(hash, extruder->steps_per_mm);
+    HASH(hash, extruder->motor_steps);
+    HASH(hash, extruder->has_heated_build_platform);
+}
+
+// everything gpx_start_convert and gpx_convert read from the configuration,
+// the command line and the macros in the ini files
+
+static void hash_settings(Hash *hash, const Gpx *gpx, const char *buildName, int item_code)
+{
+    int i;
+
+    hash_string(hash, PACKAGE_VERSION);
+    hash_string(hash, buildName);
+    HASH(hash, item_code);
+
+    const Machine *machine = &gpx->machine;
+    hash_string(hash, machine->type);
+    hash_axis(hash, &machine->x);
+    hash_axis(hash, &machine->y);
+    hash_axis(hash, &machine->z);
+    hash_extruder(hash, &machine->a);
+    hash_extruder(hash, &machine->b);
+    HASH(hash, machine->nominal_filament_diameter);
+    HASH(hash, machine->nominal_packing_density);
+    HASH(hash, machine->nozzle_diameter);
+    HASH(hash, machine->toolhead_offsets);
+    HASH(hash, machine->jkn);
+    HASH(hash, machine->extruder_count);
+    HASH(hash, machine->timeout);
+    HASH(hash, machine->id);
+
+    for(i = 0; i < 2; i++) {
+        const Override *override = gpx->override + i;
+        HASH(hash, override->actual_filament_diameter);
+        HASH(hash, override->filament_scale);
+        HASH(hash, override->packing_density);
+        HASH(hash, override->standby_temperature);
+        HASH(hash, override->active_temperature);
+        HASH(hash, override->build_platform_temperature);
+        HASH(hash, override->extrusion_factor);
+        HASH(hash, gpx->tool[i].nozzle_temperature);
+        HASH(hash, gpx->tool[i].build_platform_temperature);
+    }
+
+    HASH(hash, gpx->user.offset);
+    HASH(hash, gpx->user.scale);
+    HASH(hash, gpx->coalesce);
+
+    unsigned flags = gpx->flag.relativeCoordinates
+        | gpx->flag.extruderIsRelative << 1
+        | gpx->flag.reprapFlavor << 2
+        | gpx->flag.dittoPrinting << 3
+        | gpx->flag.buildProgress << 4
+        | gpx->flag.verboseMode << 5
+        | gpx->flag.logMessages << 6
+        | gpx->flag.rewrite5D << 7
+        | gpx->flag.M106AlwaysValve << 8
+        | gpx->flag.onlyExplicitToolChange << 9
+        | gpx->flag.framingEnabled << 10;
+    HASH(hash, flags);
+    HASH(hash, gpx->nostart);
+    HASH(hash, gpx->noend);
+    hash_string(hash, gpx->preamble);
+    hash_string(hash, gpx->sdCardPath);
+
+    // @eeprom mappings from the ini decide what the eeprom macros write
+    int mappings = gpx->eepromMappingVector ? gpx->eepromMappingVector->c : 0;
+    HASH(hash, mappings);
+    for(i = 0; i < mappings; i++) {
+        const EepromMapping *mapping = vector_get(gpx->eepromMappingVector, i);
+        hash_string(hash, mapping->id);
+        HASH(hash, mapping->address);
+        HASH(hash, mapping->et);
+        HASH(hash, mapping->len);
+        HASH(hash, mapping->minValue);
+        HASH(hash, mapping->maxValue);
+    }
+
+    HASH(hash, gpx->filamentLength);
+    for(i = 0; i < gpx->filamentLength; i++) {
+        const Filament *filament = gpx->filament + i;
+        hash_string(hash, filament->colour);
+        HASH(hash, filament->diameter);
+        HASH(hash, filament->temperature);
+        HASH(hash, filament->LED);
+    }
+    HASH(hash, gpx->commandAtLength);
+    for(i = 0; i < gpx->commandAtLength; i++) {
+        const CommandAt *commandAt = gpx->commandAt + i;
+        HASH(hash, commandAt->z);
+        HASH(hash, commandAt->filament_index);
+        HASH(hash, commandAt->nozzle_temperature);
+        HASH(hash, commandAt->build_platform_temperature);
+    }
+}
+
+// the key is the hash of the input followed by the hash of its length and
+// the settings, returns ERROR if the input isn't a regular file
+// the input is hashed in a pass of its own, as the key has to be known
+// before converting for a hit to skip the conversion, the pass leaves the
+// input in the file cache for the conversion that follows a miss
+
+static int make_key(Cache *cache, const Gpx *gpx, const char *buildName, int item_code, FILE *in)
+{
+    struct stat st;
+    int fd = fileno(in);
+    Hash input, settings;
+    uint64_t length = 0;
+
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return ERROR;
+    char *block = malloc(BLOCK);
+    if(block == NULL) return ERROR;
+
+    // nothing has been read through the stream yet, so read the descriptor
+    // and put it back at the start
+    hash_init(&input, 0);
+    for(;;) {
+        ssize_t bytes = read(fd, block, BLOCK);
+        if(bytes < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        if(bytes == 0) break;
+        hash_update(&input, block, bytes);
+        length += bytes;
+    }
+    free(block);
+    if(lseek(fd, 0, SEEK_SET) != 0 || length != (uint64_t)st.st_size) return ERROR;
+
+    hash_init(&settings, 1);
+    HASH(&settings, length);
+    hash_settings(&settings, gpx, buildName, item_code);
+
+    snprintf(cache->key, sizeof(cache->key), "%016llx%016llx",
+             (unsigned long long)hash_final(&input), (unsigned long long)hash_final(&settings));
+    return SUCCESS;
+}
+
+// FILES
+
+static char *entry_path(Cache *cache, const char *name, const char *suffix)
+{
+    size_t length = strlen(cache->dir) + strlen(name) + strlen(suffix) + 2;
+    char *path = malloc(length);
+    if(path) snprintf(path, length, "%s%c%s%s", cache->dir, PATH_DELIM, name, suffix);
+    return path;
+}
+
+// create a temporary file in the cache directory, returns its descriptor
+// and sets path, or returns -1
+
+static int temp_file(Cache *cache, char **path)
+{
+    int fd = -1;
+    *path = entry_path(cache, "tmp-XXXXXX", "");
+    if(*path) {
+#if !defined(_WIN32) && !defined(_WIN64)
+        fd = mkstemp(*path);
+#else
+        if(_mktemp(*path)) fd = open(*path, O_RDWR | O_CREAT | O_EXCL | O_BINARY, 0600);
+#endif
+        if(fd < 0) {
+            free(*path);
+            *path = NULL;
+        }
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *p, size_t length)
+{
+    while(length) {
+        ssize_t bytes = write(fd, p, length);
+        if(bytes < 0) {
+            if(errno == EINTR) continue;
+            return ERROR;
+        }
+        p += bytes;
+        length -= bytes;
+    }
+    return SUCCESS;
+}
+
+// copy all of from to the empty file to, sharing the blocks instead when
+// the filesystem supports it
+
+static int copy_file(int from, int to)
+{
+    int rval = SUCCESS;
+#if defined(FICLONE)
+    if(ioctl(to, FICLONE, from) == 0) return SUCCESS;
+#endif
+    char *block = malloc(BLOCK);
+    if(block == NULL || lseek(from, 0, SEEK_SET) != 0) {
+        free(block);
+        return ERROR;
+    }
+    for(;;) {
+        ssize_t bytes = read(from, block, BLOCK);
+        if(bytes < 0) {
+            if(errno == EINTR) continue;
+            rval = ERROR;
+            break;
+        }
+        if(bytes == 0) break;
+        if(write_all(to, block, bytes) != SUCCESS) {
+            rval = ERROR;
+            break;
+        }
+    }
+    free(block);
+    return rval;
+}
+
+static void copy_stream(FILE *from, FILE *to)
+{
+    char block[4096];
+    size_t bytes;
+    while((bytes = fread(block, 1, sizeof(block), from)) > 0) {
+        fwrite(block, 1, bytes, to);
+    }
+    fflush(to);
+}
+
+// HIT
+
+// copy the entry for the key to the output and the log, returns END_OF_FILE
+// if there is no entry
+
+static int fetch(Cache *cache, Gpx *gpx, FILE *out, FILE *out2)
+{
+    int rval = END_OF_FILE;
+    char *x3g = entry_path(cache, cache->key, X3G_SUFFIX);
+    char *log = entry_path(cache, cache->key, LOG_SUFFIX);
+    int fd = x3g ? open(x3g, O_RDONLY | O_BINARY) : -1;
+
+    if(fd >= 0 && log) {
+        rval = ERROR;
+        if(fflush(out) == 0 && copy_file(fd, fileno(out)) == SUCCESS
+           && (out2 == NULL || (fflush(out2) == 0 && copy_file(fd, fileno(out2)) == SUCCESS))) {
+            rval = SUCCESS;
+        }
+        else {
+            SHOW( fprintf(gpx->log, "Error copying cached conversion %s: %s" EOL, x3g, strerror(errno)) );
+        }
+        close(fd);
+
+        if(rval == SUCCESS) {
+            FILE *in = fopen(log, "rb");
+            if(in) {
+                copy_stream(in, gpx->log);
+                fclose(in);
+            }
+            VERBOSE( fprintf(gpx->log, "Conversion copied from cache: %s" EOL, cache->key) );
+            // the modification time orders entries for eviction
+            utime(x3g, NULL);
+            utime(log, NULL);
+        }
+    }
+    else if(fd >= 0) {
+        close(fd);
+    }
+    free(x3g);
+    free(log);
+    return rval;
+}
+
+// EVICTION
+
+typedef struct tCacheEntry {
+    char key[CACHE_KEY_LENGTH + 1];
+    time_t used;
+    unsigned long long bytes;
+} CacheEntry;
+
+static int least_recently_used(const void *a, const void *b)
+{
+    time_t ua = ((const CacheEntry *)a)->used;
+    time_t ub = ((const CacheEntry *)b)->used;
+    return ua < ub ? -1 : ua > ub;
+}
+
+// remove the least recently used entries until the cache is within its limit
+
+static void evict(Cache *cache)
+{
+    struct dirent *d;
+    struct stat st;
+    unsigned long long total = 0;
+    int i;
+    DIR *dir = opendir(cache->dir);
+    vector *entries = vector_create(sizeof(CacheEntry), 64, 64);
+
+    if(dir == NULL || entries == NULL) goto L_ABORT;
+    while((d = readdir(dir)) != NULL) {
+        CacheEntry entry;
+        if(strlen(d->d_name) != CACHE_KEY_LENGTH + strlen(X3G_SUFFIX)
+           || strcmp(d->d_name + CACHE_KEY_LENGTH, X3G_SUFFIX) != 0) continue;
+        memcpy(entry.key, d->d_name, CACHE_KEY_LENGTH);
+        entry.key[CACHE_KEY_LENGTH] = 0;
+
+        char *x3g = entry_path(cache, entry.key, X3G_SUFFIX);
+        char *log = entry_path(cache, entry.key, LOG_SUFFIX);
+        if(x3g && log && stat(x3g, &st) == 0) {
+            entry.used = st.st_mtime;
+            entry.bytes = st.st_size;
+            if(stat(log, &st) == 0) entry.bytes += st.st_size;
+            if(vector_append(entries, &entry) >= 0) total += entry.bytes;
+        }
+        free(x3g);
+        free(log);
+    }
+
+    if(total > cache->limit) {
+        qsort(entries->pb, entries->c, sizeof(CacheEntry), least_recently_used);
+        for(i = 0; i < entries->c && total > cache->limit; i++) {
+            CacheEntry *entry = (CacheEntry *)vector_get(entries, i);
+            char *x3g = entry_path(cache, entry->key, X3G_SUFFIX);
+            char *log = entry_path(cache, entry->key, LOG_SUFFIX);
+            if(x3g && log) {
+                unlink(x3g);
+                unlink(log);
+                total -= entry->bytes;
+            }
+            free(x3g);
+            free(log);
+        }
+    }
+
+L_ABORT:
+    if(dir) closedir(dir);
+    if(entries) vector_free(entries);
+}
+
+// MISS
+
+// is the file open on fd a regular file of length bytes, and the same file
+// as other if that isn't NULL
+
+static int is_output(int fd, long length, const struct stat *other)
+{
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size != length) return 0;
+    return other == NULL || (st.st_dev == other->st_dev && st.st_ino == other->st_ino);
+}
+
+// add the output that was written to out and the captured log to the
+// cache, out is read back through outName, so only a regular file that
+// holds exactly the written bytes is stored, a device such as /dev/null
+// or a name that isn't out's file is skipped
+
+static int store(Cache *cache, FILE *out, long written, const char *outName, char *logTemp)
+{
+    int rval = ERROR;
+    struct stat st;
+    char *x3gTemp = NULL;
+    char *x3g = entry_path(cache, cache->key, X3G_SUFFIX);
+    char *log = entry_path(cache, cache->key, LOG_SUFFIX);
+
+    if(fstat(fileno(out), &st) != 0 || !is_output(fileno(out), written, NULL)) {
+        free(x3g);
+        free(log);
+        return ERROR;
+    }
+
+    int from = open(outName, O_RDONLY | O_BINARY);
+    int to = temp_file(cache, &x3gTemp);
+
+    if(x3g && log && is_output(from, written, &st) && to >= 0
+       && copy_file(from, to) == SUCCESS && is_output(to, written, NULL)) {
+        close(to);
+        to = -1;
+        if(rename(logTemp, log) == 0 && rename(x3gTemp, x3g) == 0) {
+            rval = SUCCESS;
+        }
+    }
+
+    if(from >= 0) close(from);
+    if(to >= 0) close(to);
+    if(x3gTemp) {
+        if(rval != SUCCESS) unlink(x3gTemp);
+        free(x3gTemp);
+    }
+    free(x3g);
+    free(log);
+    if(rval == SUCCESS) evict(cache);
+    return rval;
+}
+
+int cache_initialize(Cache *cache, const char *dir, unsigned long megabytes)
+{
+    struct stat st;
+    cache->dir = dir;
+    cache->limit = (unsigned long long)megabytes << 20;
+    cache->key[0] = 0;
+    if(stat(dir, &st) == 0) {
+        return S_ISDIR(st.st_mode) ? SUCCESS : ERROR;
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    return mkdir(dir, 0777) == 0 ? SUCCESS : ERROR;
+#else
+    return mkdir(dir) == 0 ? SUCCESS : ERROR;
+#endif
+}
+
+int cache_convert(Cache *cache, Gpx *gpx, char *buildName, int item_code,
+                  FILE *in, FILE *out, FILE *out2, const char *outName)
+{
+    int rval;
+    FILE *log = gpx->log;
+    FILE *captured = NULL;
+    char *logTemp = NULL;
+    long start = -1;
+
+    if(make_key(cache, gpx, buildName, item_code, in) == SUCCESS) {
+        rval = fetch(cache, gpx, out, out2);
+        if(rval != END_OF_FILE) return rval;
+
+        // capture the log of the conversion to keep it with the output
+        int fd = temp_file(cache, &logTemp);
+        if(fd >= 0) {
+            captured = fdopen(fd, "w+");
+            if(captured == NULL) {
+                close(fd);
+                unlink(logTemp);
+                free(logTemp);
+                logTemp = NULL;
+            }
+        }
+        if(captured) gpx->log = captured;
+        // the bytes the conversion writes, for checking what is stored
+        start = ftell(out);
+    }
+    else {
+        cache->key[0] = 0;
+    }
+
+    gpx_start_convert(gpx, buildName, item_code, 0);
+    rval = gpx_convert(gpx, in, out, out2);
+    gpx_end_convert(gpx);
+
+    if(captured) {
+        gpx->log = log;
+        rewind(captured);
+        copy_stream(captured, log);
+        int error = ferror(captured);
+        fclose(captured);
+        if(rval != SUCCESS || error || outName == NULL || start < 0 || fflush(out) != 0
+           || store(cache, out, ftell(out) - start, outName, logTemp) != SUCCESS) {
+            unlink(logTemp);
+        }
+        free(logTemp);
+    }
+    return rval;
+}
@@ -0,0 +1,53 @@
+//  cache.h
+//
+//  Conversion cache
+//
+//  Keeps the x3g output and log of each conversion in a directory, keyed
+//  on a hash of the gcode input and of every setting that changes the
+//  output, so converting the same gcode for the same printer again copies
+//  the earlier result instead of converting it. The least recently used
+//  entries are evicted when the directory grows past its size limit.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __cache_h__
+#define __cache_h__
+
+#include "gpx.h"
+
+#define CACHE_KEY_LENGTH 32
+#define CACHE_DEFAULT_LIMIT 1024    // megabytes
+
+typedef struct tCache {
+    const char *dir;                // directory holding the entries
+    unsigned long long limit;       // bytes kept before entries are evicted
+    char key[CACHE_KEY_LENGTH + 1]; // key of the current conversion
+} Cache;
+
+// set up a cache in dir holding up to megabytes of entries, the directory
+// is created if it doesn't exist
+// returns SUCCESS, or ERROR if the directory can't be created
+int cache_initialize(Cache *cache, const char *dir, unsigned long megabytes);
+
+// convert in to out like gpx_start_convert, gpx_convert and gpx_end_convert,
+// copying the x3g output and the log from the cache when it holds the same
+// conversion, otherwise converting and then adding the output written to
+// the file outName to the cache, only regular input files are cached and
+// only output to a regular file that holds just what was written is stored
+// returns the result of the conversion
+int cache_convert(Cache *cache, Gpx *gpx, char *buildName, int item_code,
+                  FILE *in, FILE *out, FILE *out2, const char *outName);
+
+#endif /* __cache_h__ */
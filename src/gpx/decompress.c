@@ -0,0 +1,449 @@
+//  decompress.c
+//
+//  Streaming decompression of gzip and zstd input
+//
+//  Compressed gcode is decompressed a block at a time on a helper thread,
+//  so decompressing the next blocks overlaps with converting the current
+//  one. Rewinding starts the decompression over from the start of the
+//  file, which is cheap next to converting it again.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#define DECOMPRESS_WITH_ZLIB 1
+#include <zlib.h>
+#endif
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define DECOMPRESS_WITH_ZSTD 1
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "decompress.h"
+
+#ifndef EBADMSG
+#define EBADMSG EIO
+#endif
+
+#ifndef ENOTSUP
+#define ENOTSUP EINVAL
+#endif
+
+// compressed input is read INPUT_SIZE bytes at a time, and decompressed
+// into BLOCKS blocks of BLOCK_SIZE bytes that the helper thread fills
+// while the reader empties them
+
+#define INPUT_SIZE (128 * 1024)
+#define BLOCK_SIZE (256 * 1024)
+#define BLOCKS 4
+
+struct tDecompressor {
+    int format;
+    FILE *in;
+    int error;                  // errno of the failure that stopped decompression
+
+    unsigned char *prefix;      // input read before the format was known
+    size_t prefix_length;
+    unsigned char *input;       // compressed input
+    const unsigned char *next;  // next compressed byte to decompress
+    size_t available;           // compressed bytes from next
+    int eof;                    // all the compressed input has been read
+    int complete;               // the last gzip member or zstd frame is complete
+
+#ifdef DECOMPRESS_WITH_ZLIB
+    z_stream z;
+#endif
+#ifdef DECOMPRESS_WITH_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+
+#ifdef HAVE_PTHREAD_H
+    char *block[BLOCKS];
+    size_t length[BLOCKS];
+    unsigned produced;          // blocks filled by the helper thread
+    unsigned consumed;          // blocks emptied by the reader
+    size_t offset;              // bytes already read from the block being emptied
+    int finished;               // the helper thread has stopped
+    int stop;                   // ask the helper thread to stop
+    int running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+#endif
+};
+
+int decompress_format(const void *p, size_t length)
+{
+    const unsigned char *b = (const unsigned char *)p;
+    if(length >= 2 && b[0] == 0x1F && b[1] == 0x8B)
+        return DECOMPRESS_GZIP;
+    if(length >= 4 && b[0] == 0x28 && b[1] == 0xB5 && b[2] == 0x2F && b[3] == 0xFD)
+        return DECOMPRESS_ZSTD;
+    return DECOMPRESS_NONE;
+}
+
+// DECODERS
+
+// returns 0 on success or -1 with error set
+
+static int decoder_open(Decompressor *d)
+{
+    d->error = ENOMEM;
+    switch(d->format) {
+#ifdef DECOMPRESS_WITH_ZLIB
+        case DECOMPRESS_GZIP:
+            memset(&d->z, 0, sizeof(d->z));
+            // gzip header and trailer
+            if(inflateInit2(&d->z, 16 + MAX_WBITS) != Z_OK) return -1;
+            return 0;
+#endif
+#ifdef DECOMPRESS_WITH_ZSTD
+        case DECOMPRESS_ZSTD:
+            d->zstd = ZSTD_createDStream();
+            if(d->zstd == NULL) return -1;
+            if(ZSTD_isError(ZSTD_initDStream(d->zstd))) {
+                ZSTD_freeDStream(d->zstd);
+                return -1;
+            }
+            return 0;
+#endif
+    }
+    // not built with support for the format
+    d->error = ENOTSUP;
+    return -1;
+}
+
+static int decoder_reset(Decompressor *d)
+{
+    switch(d->format) {
+#ifdef DECOMPRESS_WITH_ZLIB
+        case DECOMPRESS_GZIP:
+            return inflateReset(&d->z) == Z_OK ? 0 : -1;
+#endif
+#ifdef DECOMPRESS_WITH_ZSTD
+        case DECOMPRESS_ZSTD:
+            return ZSTD_isError(ZSTD_initDStream(d->zstd)) ? -1 : 0;
+#endif
+    }
+    return -1;
+}
+
+static void decoder_close(Decompressor *d)
+{
+    switch(d->format) {
+#ifdef DECOMPRESS_WITH_ZLIB
+        case DECOMPRESS_GZIP:
+            inflateEnd(&d->z);
+            break;
+#endif
+#ifdef DECOMPRESS_WITH_ZSTD
+        case DECOMPRESS_ZSTD:
+            ZSTD_freeDStream(d->zstd);
+            break;
+#endif
+    }
+}
+
+// decompress from the available input into out, sets made to the number
+// of bytes written, returns 0 on success or -1 if the input is corrupt
+
+static int decoder_step(Decompressor *d, char *out, size_t room, size_t *made)
+{
+    *made = 0;
+    switch(d->format) {
+#ifdef DECOMPRESS_WITH_ZLIB
+        case DECOMPRESS_GZIP: {
+            if(d->complete) {
+                // another member follows the one that just ended
+                if(d->available == 0) return 0;
+                if(inflateReset(&d->z) != Z_OK) break;
+                d->complete = 0;
+            }
+            d->z.next_in = (unsigned char *)d->next;
+            d->z.avail_in = (uInt)d->available;
+            d->z.next_out = (unsigned char *)out;
+            d->z.avail_out = (uInt)room;
+            int rval = inflate(&d->z, Z_NO_FLUSH);
+            *made = room - d->z.avail_out;
+            d->next = d->z.next_in;
+            d->available = d->z.avail_in;
+            if(rval == Z_STREAM_END) {
+                d->complete = 1;
+                return 0;
+            }
+            // a buffer error only means more input is needed
+            if(rval == Z_OK || rval == Z_BUF_ERROR) return 0;
+            d->error = rval == Z_MEM_ERROR ? ENOMEM : EBADMSG;
+            return -1;
+        }
+#endif
+#ifdef DECOMPRESS_WITH_ZSTD
+        case DECOMPRESS_ZSTD: {
+            ZSTD_inBuffer in = { d->next, d->available, 0 };
+            ZSTD_outBuffer o = { out, room, 0 };
+            size_t rval = ZSTD_decompressStream(d->zstd, &o, &in);
+            if(ZSTD_isError(rval)) break;
+            *made = o.pos;
+            d->next += in.pos;
+            d->available -= in.pos;
+            // zero when a frame is decoded and flushed, the next frame
+            // starts by itself, a call with nothing to do leaves it be
+            if(in.pos || o.pos) d->complete = (rval == 0);
+            return 0;
+        }
+#endif
+    }
+    d->error = EBADMSG;
+    return -1;
+}
+
+// read more compressed input, returns -1 if the read fails
+
+static int refill(Decompressor *d)
+{
+    if(d->prefix_length) {
+        d->next = d->prefix;
+        d->available = d->prefix_length;
+        d->prefix_length = 0;
+        return 0;
+    }
+    size_t bytes = fread(d->input, 1, INPUT_SIZE, d->in);
+    if(bytes == 0) {
+        if(ferror(d->in)) {
+            d->error = errno ? errno : EIO;
+            return -1;
+        }
+        d->eof = 1;
+    }
+    d->next = d->input;
+    d->available = bytes;
+    return 0;
+}
+
+// decompress up to room bytes into out, returns the number of bytes, 0 at
+// the end of the input or -1 on error
+
+static long produce(Decompressor *d, char *out, size_t room)
+{
+    size_t done = 0;
+    while(done < room) {
+        size_t made;
+        if(d->available == 0 && !d->eof && refill(d) != 0)
+            return -1;
+        if(decoder_step(d, out + done, room - done, &made) != 0)
+            return -1;
+        done += made;
+        if(made == 0 && d->available == 0 && d->eof) {
+            // the input ends part way through a member or frame
+            if(!d->complete) {
+                d->error = EBADMSG;
+                return -1;
+            }
+            break;
+        }
+    }
+    return (long)done;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+// HELPER THREAD
+
+static void *decompress_thread(void *arg)
+{
+    Decompressor *d = (Decompressor *)arg;
+
+    pthread_mutex_lock(&d->lock);
+    while(!d->stop) {
+        if(d->produced - d->consumed == BLOCKS) {
+            pthread_cond_wait(&d->changed, &d->lock);
+            continue;
+        }
+        unsigned i = d->produced % BLOCKS;
+        pthread_mutex_unlock(&d->lock);
+        long bytes = produce(d, d->block[i], BLOCK_SIZE);
+        pthread_mutex_lock(&d->lock);
+        if(bytes <= 0) break;
+        d->length[i] = (size_t)bytes;
+        d->produced++;
+        pthread_cond_broadcast(&d->changed);
+    }
+    d->finished = 1;
+    pthread_cond_broadcast(&d->changed);
+    pthread_mutex_unlock(&d->lock);
+    return NULL;
+}
+
+static int start_thread(Decompressor *d)
+{
+    d->produced = 0;
+    d->consumed = 0;
+    d->offset = 0;
+    d->finished = 0;
+    d->stop = 0;
+    d->running = pthread_create(&d->thread, NULL, decompress_thread, d) == 0;
+    return d->running ? 0 : -1;
+}
+
+static void stop_thread(Decompressor *d)
+{
+    if(d->running) {
+        pthread_mutex_lock(&d->lock);
+        d->stop = 1;
+        pthread_cond_broadcast(&d->changed);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+        d->running = 0;
+    }
+}
+
+#endif // HAVE_PTHREAD_H
+
+Decompressor *decompress_open(int format, FILE *in, const void *prefix, size_t prefix_length)
+{
+    Decompressor *d = calloc(1, sizeof(Decompressor));
+    int i;
+
+    if(d == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    d->format = format;
+    d->in = in;
+    if(decoder_open(d) != 0) {
+        errno = d->error;
+        free(d);
+        return NULL;
+    }
+    d->error = 0;
+
+    d->input = malloc(INPUT_SIZE);
+    if(prefix_length) {
+        d->prefix = malloc(prefix_length);
+        if(d->prefix) {
+            memcpy(d->prefix, prefix, prefix_length);
+            d->prefix_length = prefix_length;
+        }
+    }
+    int failed = d->input == NULL || (prefix_length && d->prefix == NULL);
+
+#ifdef HAVE_PTHREAD_H
+    for(i = 0; i < BLOCKS; i++) {
+        d->block[i] = malloc(BLOCK_SIZE);
+        if(d->block[i] == NULL) failed = 1;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->changed, NULL);
+    if(!failed && start_thread(d) != 0) failed = 1;
+#else
+    (void)i;
+#endif
+
+    if(failed) {
+        decompress_close(d);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return d;
+}
+
+long decompress_read(Decompressor *d, char *buffer, size_t length)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&d->lock);
+    while(d->produced == d->consumed && !d->finished) {
+        pthread_cond_wait(&d->changed, &d->lock);
+    }
+    if(d->produced == d->consumed) {
+        pthread_mutex_unlock(&d->lock);
+        if(d->error) {
+            errno = d->error;
+            return -1;
+        }
+        return 0;
+    }
+    unsigned i = d->consumed % BLOCKS;
+    pthread_mutex_unlock(&d->lock);
+
+    // the block belongs to the reader until it is marked consumed
+    size_t bytes = d->length[i] - d->offset;
+    if(bytes > length) bytes = length;
+    memcpy(buffer, d->block[i] + d->offset, bytes);
+    d->offset += bytes;
+    if(d->offset == d->length[i]) {
+        pthread_mutex_lock(&d->lock);
+        d->offset = 0;
+        d->consumed++;
+        pthread_cond_broadcast(&d->changed);
+        pthread_mutex_unlock(&d->lock);
+    }
+    return (long)bytes;
+#else
+    long bytes = produce(d, buffer, length);
+    if(bytes < 0) errno = d->error;
+    return bytes;
+#endif
+}
+
+int decompress_rewind(Decompressor *d)
+{
+#ifdef HAVE_PTHREAD_H
+    stop_thread(d);
+#endif
+    clearerr(d->in);
+    if(fseek(d->in, 0L, SEEK_SET) != 0 || decoder_reset(d) != 0)
+        return -1;
+    // the prefix was read from the start of the stream
+    d->prefix_length = 0;
+    d->next = NULL;
+    d->available = 0;
+    d->eof = 0;
+    d->complete = 0;
+    d->error = 0;
+#ifdef HAVE_PTHREAD_H
+    return start_thread(d);
+#else
+    return 0;
+#endif
+}
+
+void decompress_close(Decompressor *d)
+{
+    int i;
+#ifdef HAVE_PTHREAD_H
+    stop_thread(d);
+    for(i = 0; i < BLOCKS; i++) {
+        free(d->block[i]);
+    }
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->changed);
+#else
+    (void)i;
+#endif
+    decoder_close(d);
+    free(d->input);
+    free(d->prefix);
+    free(d);
+}
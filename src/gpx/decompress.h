@@ -0,0 +1,58 @@
+//  decompress.h
+//
+//  Streaming decompression of gzip and zstd input
+//
+//  Compressed gcode is decompressed a block at a time on a helper thread,
+//  so decompressing the next blocks overlaps with converting the current
+//  one. Rewinding starts the decompression over from the start of the
+//  file, which is cheap next to converting it again.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __decompress_h__
+#define __decompress_h__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define DECOMPRESS_NONE 0
+#define DECOMPRESS_GZIP 1
+#define DECOMPRESS_ZSTD 2
+
+typedef struct tDecompressor Decompressor;
+
+// return the compression format whose magic number starts the length bytes
+// at p, or DECOMPRESS_NONE
+int decompress_format(const void *p, size_t length);
+
+// start decompressing the stream in, the first prefix_length bytes of it
+// have already been read into prefix
+// returns NULL and sets errno if the format isn't supported by this build
+// or there isn't enough memory
+Decompressor *decompress_open(int format, FILE *in, const void *prefix, size_t prefix_length);
+
+// read up to length bytes of decompressed input into buffer
+// returns the number of bytes read, 0 at the end of the input or -1 if the
+// input can't be read or is corrupt, in which case errno is set
+long decompress_read(Decompressor *decompressor, char *buffer, size_t length);
+
+// start again from the start of the stream
+// returns 0 on success or -1 if the stream can't be rewound
+int decompress_rewind(Decompressor *decompressor);
+
+// stop decompressing and release the decompressor, the stream remains open
+void decompress_close(Decompressor *decompressor);
+
+#endif /* __decompress_h__ */
@@ -0,0 +1,186 @@
+//  estimate.c
+//
+//  Print time estimate for a stream of moves
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <math.h>
+
+#include "estimate.h"
+
+#define PLANNED(i) (estimate->move + ((estimate->first + (i)) % ESTIMATE_LOOKAHEAD))
+
+void estimate_initialize(Estimate *estimate)
+{
+    estimate->first = 0;
+    estimate->count = 0;
+}
+
+// the fastest the machine can go from moving along a to moving along b,
+// changing the speed of each axis by no more than its max_speed_change,
+// a zero direction is standing still
+
+static double junction_speed(const double a[5], const double b[5], const double max_speed_change[5])
+{
+    double speed = INFINITY;
+    int k;
+    for(k = 0; k < 5; k++) {
+        double change = fabs(b[k] - a[k]);
+        if(change > 0.0 && max_speed_change[k] > 0.0 && max_speed_change[k] < speed * change) {
+            speed = max_speed_change[k] / change;
+        }
+    }
+    return speed;
+}
+
+// the fastest speed a move can reach from speed over distance
+
+static double reachable(double speed, double acceleration, double distance)
+{
+    if(acceleration <= 0.0) return INFINITY;
+    return sqrt(speed * speed + 2.0 * acceleration * distance);
+}
+
+// the seconds a move takes to go from entry to exit speed, cruising at its
+// nominal speed if it's long enough to reach it
+
+static double move_time(const PlannedMove *move, double exit)
+{
+    double v0 = move->entry, v1 = exit, vc = move->nominal, a = move->acceleration;
+    if(move->distance <= 0.0 || vc <= 0.0) return 0.0;
+    if(a <= 0.0) return move->distance / vc;
+    double accelerating = (vc * vc - v0 * v0) / (2.0 * a);
+    double decelerating = (vc * vc - v1 * v1) / (2.0 * a);
+    if(accelerating + decelerating <= move->distance) {
+        return (vc - v0) / a + (vc - v1) / a + (move->distance - accelerating - decelerating) / vc;
+    }
+    // a triangle, peaking where accelerating from v0 meets decelerating to v1
+    double peak = sqrt((2.0 * a * move->distance + v0 * v0 + v1 * v1) / 2.0);
+    if(peak < v0) peak = v0;
+    if(peak < v1) peak = v1;
+    return (peak - v0) / a + (peak - v1) / a;
+}
+
+// plan the entry speeds of the moves after the first, whose entry speed
+// was fixed when the move before it was counted. Working back from the
+// stop after the last move, the limit the moves after each move set on
+// its entry speed goes up, until a move's limit doesn't change, then the
+// speed each move can reach from the one before it is planned forward
+// from there.
+
+static void replan(Estimate *estimate)
+{
+    unsigned i, n = estimate->count;
+    double exit = PLANNED(n - 1)->maxExit;
+    for(i = n - 1; i > 0; i--) {
+        PlannedMove *move = PLANNED(i);
+        double limit = reachable(exit, move->acceleration, move->distance);
+        if(limit > move->maxEntry) limit = move->maxEntry;
+        if(i < n - 1 && limit == move->limit) break;
+        move->limit = limit;
+        exit = limit;
+    }
+    for(i++; i < n; i++) {
+        PlannedMove *previous = PLANNED(i - 1);
+        PlannedMove *move = PLANNED(i);
+        double entry = reachable(previous->entry, previous->acceleration, previous->distance);
+        move->entry = entry < move->limit ? entry : move->limit;
+    }
+}
+
+// count the time of the oldest move, which ends at the planned entry
+// speed of the next one, or as fast as it can stop from
+
+static double count_first(Estimate *estimate, double exit)
+{
+    const PlannedMove *move = PLANNED(0);
+    double fastest = reachable(move->entry, move->acceleration, move->distance);
+    double seconds = move_time(move, exit < fastest ? exit : fastest);
+    estimate->first = (estimate->first + 1) % ESTIMATE_LOOKAHEAD;
+    estimate->count--;
+    return seconds;
+}
+
+double estimate_move(Estimate *estimate, const Machine *machine, const double delta[5], double distance, double feedrate)
+{
+    const double max_speed_change[5] = {
+        machine->x.max_speed_change, machine->y.max_speed_change, machine->z.max_speed_change,
+        machine->a.max_speed_change, machine->b.max_speed_change
+    };
+    const double max_accel[5] = {
+        machine->x.max_accel, machine->y.max_accel, machine->z.max_accel,
+        machine->a.max_accel, machine->b.max_accel
+    };
+    static const double still[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+    double seconds = 0.0;
+    int k;
+
+    if(distance <= 0.0 || feedrate <= 0.0) return 0.0;
+    if(estimate->count == ESTIMATE_LOOKAHEAD) {
+        seconds = count_first(estimate, PLANNED(1)->entry);
+    }
+
+    PlannedMove *move = PLANNED(estimate->count);
+    move->distance = distance;
+    move->nominal = feedrate;
+    move->acceleration = 0.0;
+    for(k = 0; k < 5; k++) {
+        move->unit[k] = delta[k] / distance;
+        // the axis that moves furthest for its acceleration limits the move
+        if(move->unit[k] != 0.0 && max_accel[k] > 0.0) {
+            double acceleration = max_accel[k] / fabs(move->unit[k]);
+            if(move->acceleration == 0.0 || acceleration < move->acceleration) {
+                move->acceleration = acceleration;
+            }
+        }
+    }
+
+    // the corner from the move before, or from standing still
+    if(estimate->count) {
+        const PlannedMove *previous = PLANNED(estimate->count - 1);
+        move->maxEntry = junction_speed(previous->unit, move->unit, max_speed_change);
+        if(move->maxEntry > previous->nominal) move->maxEntry = previous->nominal;
+    }
+    else {
+        move->maxEntry = junction_speed(still, move->unit, max_speed_change);
+    }
+    if(move->maxEntry > move->nominal) move->maxEntry = move->nominal;
+    move->maxExit = junction_speed(move->unit, still, max_speed_change);
+    if(move->maxExit > move->nominal) move->maxExit = move->nominal;
+    estimate->count++;
+
+    if(estimate->count > 1) {
+        replan(estimate);
+    }
+    else {
+        // starting from standing still, the entry speed is fixed now
+        double limit = reachable(move->maxExit, move->acceleration, move->distance);
+        move->limit = limit < move->maxEntry ? limit : move->maxEntry;
+        move->entry = move->limit;
+    }
+    return seconds;
+}
+
+double estimate_stop(Estimate *estimate)
+{
+    double seconds = 0.0;
+    while(estimate->count > 1) {
+        seconds += count_first(estimate, PLANNED(1)->entry);
+    }
+    if(estimate->count) {
+        seconds += count_first(estimate, PLANNED(0)->maxExit);
+    }
+    return seconds;
+}
@@ -0,0 +1,64 @@
+//  estimate.h
+//
+//  Print time estimate for a stream of moves
+//
+//  The moves are planned the way the firmware plans them. Each move
+//  accelerates and decelerates at the rate its slowest axis allows, and
+//  goes round the corner into the next move no faster than the
+//  max_speed_change of every axis allows. The last ESTIMATE_LOOKAHEAD moves
+//  are held, so the speed a move can end at is known before its time is
+//  counted, and the planner assumes the machine stops after the last one.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __estimate_h__
+#define __estimate_h__
+
+#include "machine.h"
+
+#define ESTIMATE_LOOKAHEAD 16   // the moves planned ahead, as many as the firmware buffers
+
+typedef struct tPlannedMove {
+    double distance;        // mm
+    double nominal;         // the feedrate in mm/s
+    double acceleration;    // mm/s^2, 0 if no axis limits it
+    double maxEntry;        // the fastest the corner into the move can be taken in mm/s
+    double limit;           // the fastest entry the moves after it allow, at most maxEntry
+    double entry;           // the planned speed at the start of the move in mm/s
+    double maxExit;         // the fastest the machine can stop from at the end of the move
+    double unit[5];         // the direction of the move, per mm of distance
+} PlannedMove;
+
+typedef struct tEstimate {
+    PlannedMove move[ESTIMATE_LOOKAHEAD];
+    unsigned first;         // the oldest move planned
+    unsigned count;         // moves planned
+} Estimate;
+
+// forget the moves planned, the machine is standing still
+
+void estimate_initialize(Estimate *estimate);
+
+// plan a move of delta mm along each axis, that goes distance mm at
+// feedrate mm/s, returns the seconds taken by the moves that could no
+// longer be planned any faster
+
+double estimate_move(Estimate *estimate, const Machine *machine, const double delta[5], double distance, double feedrate);
+
+// the machine stops after the moves planned, returns the seconds they take
+
+double estimate_stop(Estimate *estimate);
+
+#endif /* __estimate_h__ */
@@ -34,6 +34,9 @@
 #include <unistd.h>
 
 #include "gpx.h"
+#include "batch.h"
+#include "cache.h"
+#include "stats.h"
 #include "machine_config.h"
 
 // Global variables
@@ -44,6 +47,7 @@ static FILE *file_in = NULL;
 static FILE *file_out = NULL;
 static FILE *file_out2 = NULL;
 static int sio_port = -1;
+static SerialTrace serial_trace;
 static char temp_config_name[24];
 
 // cleanup code in case we encounter an error that causes the program to exit
@@ -78,6 +82,12 @@ static void exit_handler(void)
 	sio_port = -1;
     }
 
+    if(gpx.trace != NULL) {
+        if(trace_close(gpx.trace))
+            perror("Error writing the serial trace");
+        gpx.trace = NULL;
+    }
+
     if(temp_config_name[0]) {
 	 unlink(temp_config_name);
 	 temp_config_name[0] = '\0';
@@ -123,20 +133,38 @@ static void usage(int err)
     fputs("GNU General Public License for more details." EOL, fp);
 
     fputs(EOL "Usage:" EOL, fp);
-    fputs("gpx [-CFIdgilpqr" SERIAL_MSG1 "tvw] " SERIAL_MSG2 "[-L LOGFILE] [-D NEWPORT] [-E EXISTINGPORT] [-c CONFIG] [-e EEPROM] [-f DIAMETER] [-m MACHINE] [-N h|t|ht] [-n SCALE] [-x X] [-y Y] [-z Z] [-W S] IN [OUT]" EOL, fp);
+    fputs("gpx [-BCFITdgilpqr" SERIAL_MSG1 "tvw] " SERIAL_MSG2 "[-L LOGFILE] [-D NEWPORT] [-E EXISTINGPORT] [-G TOLERANCE] [-K CACHEDIR] [-M MEGABYTES] [-c CONFIG] [-e EEPROM] [-f DIAMETER] [-j JOBS] [-m MACHINE] [-N h|t|ht] [-n SCALE] [-R TRACE] [-S text|json] [-x X] [-y Y] [-z Z] [-W S] IN [OUT]" EOL, fp);
     fputs(EOL "Options:" EOL, fp);
+    fputs("\t-B\tbatch mode, convert each IN file (or each file listed in an @MANIFEST)" EOL, fp);
+    fputs("\t  \tto an X3G file alongside it" EOL, fp);
     fputs("\t-C\tcreate temporary file with a copy of the machine configuration" EOL, fp);
     fputs("\t-D\trun in daemon mode and create the named virtual port" EOL, fp);
     fputs("\t-E\trun in daemon mode and open the named psuedo-terminal" EOL, fp);
     fputs("\t-F\twrite X3G on-wire framing data to output file" EOL, fp);
+    fputs("\t-G\tmerge runs of moves that are collinear to within TOLERANCE mm," EOL, fp);
+    fputs("\t  \thave the same feedrate and extrude as much per mm" EOL, fp);
     fputs("\t-I\tignore default .ini files" EOL, fp);
+    fputs("\t-K\tkeep conversions in CACHEDIR and copy the X3G from there when the" EOL, fp);
+    fputs("\t  \tsame gcode is converted again with the same settings" EOL, fp);
+    fputs("\t-M\tevict the least recently used conversions from CACHEDIR when it" EOL, fp);
+    fputs("\t  \tholds more than MEGABYTES (default is 1024)" EOL, fp);
     fputs("\t-N\tdisable writing of the X3G header (start build notice)," EOL, fp);
     fputs("\t  \ttail (end build notice), or both" EOL, fp);
+#if defined(SERIAL_SUPPORT)
+    fputs("\t-R\trecord the packets sent to the printer and its responses in TRACE," EOL, fp);
+    fputs("\t  \tgpxreplay answers gpx from it to reproduce the session" EOL, fp);
+#endif
+    fputs("\t-S\tprofile the conversion and log command counts, bytes and stage" EOL, fp);
+    fputs("\t  \ttimings as text or json when it ends" EOL, fp);
+    fputs("\t-T\ttokenize IN and write it to OUT (default is IN with a .gir" EOL, fp);
+    fputs("\t  \textension) as binary gcode that converts without being parsed again" EOL, fp);
 	fputs("\t-W\twait S seconds after opening the serial connection" EOL, fp);
 	fputs("\t  \tbefore reading or writing (default is 2 seconds)" EOL, fp);
     fputs("\t-d\tsimulated ditto printing" EOL, fp);
     fputs("\t-g\tMakerbot/ReplicatorG GCODE flavor" EOL, fp);
     fputs("\t-i\tenable stdin and stdout support for command line pipes" EOL, fp);
+    fputs("\t-j\tuse JOBS threads to tokenize the input, or to convert files" EOL, fp);
+    fputs("\t  \tin batch mode (default is 1)" EOL, fp);
     fputs("\t-l\tlog to file" EOL, fp);
     fputs("\t-L\tlog to named [LOGFILE] file" EOL, fp);
     fputs("\t-p\toverride build percentage" EOL, fp);
@@ -144,6 +172,7 @@ static void usage(int err)
     fputs("\t-r\tReprap GCODE flavor" EOL, fp);
 #if defined(SERIAL_SUPPORT)
     fputs("\t-s\tenable USB serial I/O and send x3G output to 3D printer" EOL, fp);
+    fputs("\t  \tthe serial link statistics are logged on SIGUSR1, and at the end with -v" EOL, fp);
 #endif
     fputs("\t-t\ttruncate filename (DOS 8.3 format)" EOL, fp);
     fputs("\t-v\tverbose mode" EOL, fp);
@@ -154,6 +183,12 @@ static void usage(int err)
     fputs("CONFIG: the filename of a custom machine definition (ini file)" EOL, fp);
     fputs("EEPROM: the filename of an eeprom settings definition (ini file)" EOL, fp);
     fputs("DIAMETER: the actual filament diameter in the printer" EOL, fp);
+    fputs("JOBS: the number of tokenizer threads, or of files converted at once" EOL, fp);
+    fputs("TOLERANCE: how far in mm a dropped point can be from the merged move" EOL, fp);
+    fputs("MANIFEST: a file listing one gcode input filename per line" EOL, fp);
+#if defined(SERIAL_SUPPORT)
+    fputs("TRACE: the filename of a binary serial trace" EOL, fp);
+#endif
     fputs(EOL "MACHINE: the predefined machine type" EOL, fp);
     fputs("\tsome machine definitions have been updated with corrected steps per mm" EOL, fp);
     fputs("\tthe original can be selected by prefixing o to the machine id" EOL, fp);
@@ -164,7 +199,7 @@ static void usage(int err)
     fputs("\tX = the x axis offset" EOL, fp);
     fputs("\tY = the y axis offset" EOL, fp);
     fputs("\tZ = the z axis offset" EOL, fp);
-    fputs(EOL "IN: the name of the sliced gcode input filename" EOL, fp);
+    fputs(EOL "IN: the name of the sliced gcode or tokenized (.gir) input filename" EOL, fp);
     fputs("OUT: the name of the X3G output filename"
 #if defined(SERIAL_SUPPORT)
 	  "or the serial I/O port"
@@ -175,6 +210,7 @@ static void usage(int err)
     fputs("\tgpx -p -m r2 my-sliced-model.gcode" EOL, fp);
     fputs("\tgpx -c custom-tom.ini example.gcode /volumes/things/example.x3g" EOL, fp);
     fputs("\tgpx -x 3 -y -3 offset-model.gcode" EOL, fp);
+    fputs("\tgpx -B -j 4 -m r2 part1.gcode part2.gcode @more-parts.txt" EOL, fp);
 #if defined(SERIAL_SUPPORT)
     fputs("\tgpx -m c4 -s sio-example.gcode /dev/tty.usbmodem" EOL EOL, fp);
 #endif
@@ -266,7 +302,9 @@ int gpx_sio_open(Gpx *gpx, const char *filename, speed_t baud_rate,
     }
 
     if(gpx->open_delay > 0) {
-		sleep(gpx->open_delay);
+		// sleep the rest of the delay if a signal cuts it short
+		unsigned left = gpx->open_delay;
+		while(left > 0) left = sleep(left);
 	}
     if(tcflush(port, TCIOFLUSH) < 0) {
         perror("Error flushing port");
@@ -283,6 +321,9 @@ int gpx_sio_open(Gpx *gpx, const char *filename, speed_t baud_rate,
 
 void sio_open(const char *filename, speed_t baud_rate)
 {
+    // before opening the port, as SIGUSR1 would otherwise end gpx while it
+    // waits out the open delay
+    link_stats_install_signal();
     if (!gpx_sio_open(&gpx, filename, baud_rate, &sio_port))
         exit(-1);
 }
@@ -348,12 +389,19 @@ int main(int argc, char * const argv[])
     int standard_io = 0;
     int serial_io = 0;
     int truncate_filename = 0;
+    int batch = 0;
+    int tokenize = 0;
+    int stats_format = -1;
+    char *cache_dir = NULL;
+    unsigned long cache_size = CACHE_DEFAULT_LIMIT;
+    char *output_name = NULL;
     char *daemon_port = NULL;
     char *config = NULL;
     char *eeprom = NULL;
     double filament_diameter = 0;
     char *buildname = PACKAGE_STRING;
     char *logname = NULL;
+    char *trace_name = NULL;
     char *filename;
     speed_t baud_rate = B115200;
     int make_temp_config = 0;
@@ -377,7 +425,7 @@ int main(int argc, char * const argv[])
     // the ini file from the default locations and whether to be verbose about it
     // we need to load the ini file before parsing the rest so that the command line
     // overrides the default ini in the standard case
-    while ((c = getopt(argc, argv, "CD:E:FIL:N:W:b:c:de:gf:ilm:n:pqrstu:vwx:y:z:?")) != -1) {
+    while ((c = getopt(argc, argv, "BCD:E:FG:IK:L:M:N:R:S:TW:b:c:de:gf:ij:lm:n:pqrstu:vwx:y:z:?")) != -1) {
         switch (c) {
             case 'I':
                 ignore_default_ini = 1;
@@ -414,8 +462,11 @@ int main(int argc, char * const argv[])
     // error message should they be attempted when the code
     // is compiled without serial I/O support.
 
-    while ((c = getopt(argc, argv, "CD:E:FIL:N:W:b:c:de:gf:ilm:n:pqrstu:vwx:y:z:?")) != -1) {
+    while ((c = getopt(argc, argv, "BCD:E:FG:IK:L:M:N:R:S:TW:b:c:de:gf:ij:lm:n:pqrstu:vwx:y:z:?")) != -1) {
         switch (c) {
+            case 'B':
+                batch = 1;
+                break;
 	    case 'C':
 		 // Write config data to a temp file
 		 // Write output to stdout
@@ -443,6 +494,14 @@ int main(int argc, char * const argv[])
 	    case 'F':
 		 force_framing = ITEM_FRAMING_ENABLE;
 		 break;
+            case 'G':
+                gpx.coalesce.tolerance = strtod(optarg, NULL);
+                if(gpx.coalesce.tolerance <= 0.0) {
+                    fputs("Command line error: the coalescing tolerance must be greater than zero" EOL, stderr);
+                    usage(1);
+                    goto done;
+                }
+                break;
             case 'I':
                  break; // handled in first getopt loop
             case 'L':
@@ -454,6 +513,15 @@ int main(int argc, char * const argv[])
 		 if(optarg[0] == 't' || optarg[1] == 't')
 		      gpx_set_end(&gpx, 0);
 		 break;
+            case 'R':
+#if !defined(SERIAL_SUPPORT)
+                fprintf(stderr, NO_SERIAL_SUPPORT_MSG EOL);
+                usage(1);
+                goto done;
+#else
+                trace_name = optarg;
+#endif
+                break;
 	    case 'b':
 #if !defined(SERIAL_SUPPORT)
 		fprintf(stderr, NO_SERIAL_SUPPORT_MSG EOL);
@@ -530,6 +598,13 @@ int main(int argc, char * const argv[])
             case 'i':
                 standard_io = 1;
                 break;
+            case 'j':
+                gpx.jobs = atoi(optarg);
+                if(gpx.jobs < 1) {
+                    usage(1);
+                    goto done;
+                }
+                break;
             case 'l':
                 break; // handled in first getopt loop
             case 'm':
@@ -573,6 +648,31 @@ int main(int argc, char * const argv[])
             case 'z':
                 gpx.user.offset.z = strtod(optarg, NULL);
                 break;
+            case 'K':
+                cache_dir = optarg;
+                break;
+            case 'M':
+                cache_size = strtoul(optarg, NULL, 10);
+                if(cache_size == 0) {
+                    fputs("Command line error: the cache size must be at least one megabyte" EOL, stderr);
+                    usage(1);
+                    goto done;
+                }
+                break;
+            case 'S':
+                if(strcasecmp(optarg, "text") == 0)
+                    stats_format = STATS_TEXT;
+                else if(strcasecmp(optarg, "json") == 0)
+                    stats_format = STATS_JSON;
+                else {
+                    fprintf(stderr, "Command line error: unknown statistics format '%s'" EOL, optarg);
+                    usage(1);
+                    goto done;
+                }
+                break;
+            case 'T':
+                tokenize = 1;
+                break;
             case 'W':
                 gpx.open_delay = strtod(optarg, NULL);
                 break;
@@ -592,7 +692,7 @@ int main(int argc, char * const argv[])
     // LOG TO FILE
 
     if(log_to_file && logname == NULL && argc > 0) {
-        filename = (argc > 1 && !serial_io) ? argv[1] : argv[0];
+        filename = (argc > 1 && !serial_io && !batch) ? argv[1] : argv[0];
         // or use the input filename with a .log extension
         char *dot = strrchr(filename, '.');
         if(dot) {
@@ -668,6 +768,19 @@ int main(int argc, char * const argv[])
         if(gpx.flag.verboseMode) fputs("WARNING: a 57600 bps baud rate will cause problems with Repicator 2/2X Mightyboards" EOL, gpx.log);
     }
 
+    if(trace_name != NULL) {
+        if(!serial_io) {
+            fputs("Command line error: recording a trace requires serial I/O" EOL, stderr);
+            usage(1);
+            goto done;
+        }
+        if(trace_create(&serial_trace, trace_name)) {
+            perror("Error creating trace");
+            goto done;
+        }
+        gpx.trace = &serial_trace;
+    }
+
     // OPEN FILES AND PORTS FOR INPUT AND OUTPUT
 
     if(daemon_port != NULL) {
@@ -684,9 +797,27 @@ int main(int argc, char * const argv[])
 
         // create the bi-directional virtual port for other processes
         // and read and write from there until somebody tells us to quit
+        link_stats_install_signal();
         gpx_daemon(&gpx, create_daemon_port, daemon_port, argv[0], baud_rate);
         goto done;
     }
+    else if(tokenize && (batch || serial_io)) {
+        fputs("Command line error: tokenizing is incompatible with batch mode and serial I/O" EOL, stderr);
+        usage(1);
+        goto done;
+    }
+    else if(batch) {
+        if(standard_io || serial_io) {
+            fputs("Command line error: batch mode is incompatible with standard and serial I/O" EOL, stderr);
+            usage(1);
+            goto done;
+        }
+        if(argc == 0) {
+            fputs("Command line error: provide the input files to convert in batch mode" EOL, stderr);
+            usage(1);
+            goto done;
+        }
+    }
     else if(standard_io) {
         if(daemon_port != NULL) {
             fprintf(stderr, "Using standard in/out is incompatible with daemon mode\n");
@@ -776,10 +907,10 @@ int main(int argc, char * const argv[])
                         *s++ = '_';
                     }
                 }
-                strcpy(s, ".X3G");
+                strcpy(s, tokenize ? ".GIR" : ".X3G");
             }
             else {
-                strcpy(ext, ".x3g");
+                strcpy(ext, tokenize ? ".gir" : ".x3g");
             }
         }
 
@@ -792,13 +923,15 @@ int main(int argc, char * const argv[])
         }
         else {
 	    if(filename[0] != '-' || filename[1] != '-' || filename[2] != '\0') {
+              // keep the name, filename can point into gpx.buffer.out
+              output_name = strdup(filename);
               if((file_out = fopen(filename, "wb")) == NULL) {
                   perror("Error creating output");
 		  goto done;
               }
               if(gpx.flag.verboseMode) fprintf(gpx.log, "Writing to: %s" EOL, filename);
               // write a second copy to the SD Card
-              if(gpx.sdCardPath) {
+              if(gpx.sdCardPath && !tokenize) {
                   long sl = strlen(gpx.sdCardPath);
                   if(sl > 0 && gpx.sdCardPath[sl - 1] == PATH_DELIM) {
                       gpx.sdCardPath[--sl] = 0;
@@ -841,6 +974,7 @@ int main(int argc, char * const argv[])
         if(serial_io) fputs("Serial IO: enabled" EOL, gpx.log);
         fprintf(gpx.log, "GCode flavor: %s" EOL, gpx.flag.reprapFlavor ? "Reprap" : "Makerbot");
         if(gpx.flag.rewrite5D) fputs("Rewrite 5D: enabled" EOL, gpx.log);
+        if(gpx.coalesce.tolerance > 0.0) fprintf(gpx.log, "Coalesce moves: %g mm" EOL, gpx.coalesce.tolerance);
     }
 
     /* at this point we have read the command line, set the machine definition
@@ -850,7 +984,20 @@ int main(int argc, char * const argv[])
     if(make_temp_config)
 	 gpx_set_preamble(&gpx, temp_config_name);
 
-    if(serial_io) {
+    if(stats_format >= 0) {
+        gpx.stats = stats_create(stats_format);
+        if(gpx.stats == NULL) {
+            fprintf(stderr, "Error: not enough memory for the conversion statistics" EOL);
+            goto done;
+        }
+    }
+
+    if(batch) {
+        // CONVERT EACH INPUT FILE TO ITS OWN OUTPUT
+
+        rval = gpx_batch(&gpx, argc, argv, gpx.jobs, truncate_filename, stdout);
+    }
+    else if(serial_io) {
         // READ CONFIG AND WRITE EEPROM SETTINGS
         if(eeprom) {
             if(gpx.flag.verboseMode) fprintf(gpx.log, "Loading eeprom config: %s" EOL, eeprom);
@@ -876,6 +1023,21 @@ int main(int argc, char * const argv[])
             gpx_end_convert(&gpx);
         }
     }
+    else if(tokenize) {
+        // TOKENIZE INPUT FOR LATER CONVERSIONS
+
+        rval = gpx_tokenize(&gpx, file_in, file_out);
+    }
+    else if(cache_dir && file_in != stdin && file_out != stdout && !gpx.stats && !make_temp_config) {
+        // READ INPUT AND CONVERT TO OUTPUT THROUGH THE CACHE
+
+        Cache cache;
+        if(cache_initialize(&cache, cache_dir, cache_size) != SUCCESS) {
+            fprintf(stderr, "Error opening cache %s: %s" EOL, cache_dir, strerror(errno));
+            goto done;
+        }
+        rval = cache_convert(&cache, &gpx, buildname, force_framing, file_in, file_out, file_out2, output_name);
+    }
     else {
         // READ INPUT AND CONVERT TO OUTPUT
 
@@ -885,6 +1047,11 @@ int main(int argc, char * const argv[])
     }
 
 done:
+    free(output_name);
+    if(gpx.stats) {
+        stats_free(gpx.stats);
+        gpx.stats = NULL;
+    }
     if (temp_config_name[0])
     {
 	 if (rval != SUCCESS)
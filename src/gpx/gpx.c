@@ -32,14 +32,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdint.h>
 
 #include <libgen.h>
 
+#if defined(SERIAL_SUPPORT) && !defined(_WIN32) && !defined(_WIN64)
+#include <sys/ioctl.h>
+#endif
+
+#include "crc8.h"
 #include "portable_endian.h"
 #include "gpx.h"
+#include "ir.h"
+#include "kinematics.h"
+#include "number.h"
+#include "reader.h"
+#include "ring.h"
+#include "s3g_pack.h"
+#include "scan.h"
+#include "stats.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <signal.h>
+#endif
 
 #define A 0
 #define B 1
@@ -204,16 +224,6 @@ int gpx_set_machine(Gpx *gpx, const char *machine_type, int init)
 static double get_home_feedrate(Gpx *gpx, int flag);
 static int pause_at_zpos(Gpx *gpx, float z_positon);
 
-// initialization of global variables
-
-// 02 - Get available buffer size
-char buffer_size_query[] = {
-    0xD5,   // start byte
-    1,      // length
-    2,      // query command
-    0       // crc
-};
-static unsigned char calculate_crc(unsigned char *addr, long len);
 
 void gpx_initialize(Gpx *gpx, int firstTime)
 {
@@ -341,6 +351,12 @@ void gpx_initialize(Gpx *gpx, int firstTime)
         gpx->iniPath = NULL;
         gpx->buildName = NULL;
         gpx->selectedFilename = NULL;
+        gpx->jobs = 1;
+        gpx->coalesce.tolerance = 0.0;
+        gpx->coalesce.length = 0.0;
+        gpx->coalesce.time = 0.0;
+        gpx->stats = NULL;
+        gpx->moves = NULL;
 	gpx->preamble = NULL;
 	gpx->nostart = 0;
 	gpx->noend = 0;
@@ -394,6 +410,8 @@ void gpx_initialize(Gpx *gpx, int firstTime)
     gpx->accumulated.b = 0.0;
     gpx->accumulated.time = 0.0;
     gpx->accumulated.bytes = 0;
+    gpx->accumulated.coalesced = 0;
+    estimate_initialize(&gpx->estimate);
 
     if(firstTime) {
         gpx->total.length = 0.0;
@@ -407,13 +425,47 @@ void gpx_initialize(Gpx *gpx, int firstTime)
     gpx->callbackData = NULL;
     gpx->resultHandler = NULL;
     gpx->sio = NULL;
+    if(firstTime) gpx->tio = NULL;
 
     // LOGGING
 
     if(firstTime) gpx->log = stderr;
+    if(firstTime) gpx->trace = NULL;
+}
+
+// copy the configuration of gpx (machine, overrides, flags and macros) into
+// clone so that it can run a conversion of its own, on another thread if
+// need be, the clone doesn't share anything a conversion frees or replaces
 
-    // CANNED COMMANDS
-    buffer_size_query[3] = calculate_crc((unsigned char *)buffer_size_query + 2, 1);
+void gpx_clone(Gpx *clone, const Gpx *gpx)
+{
+    *clone = *gpx;
+    clone->buildName = NULL;
+    clone->selectedFilename = NULL;
+    clone->eepromMappingVector = NULL;
+    clone->eepromMap = NULL;
+    clone->callbackHandler = NULL;
+    clone->callbackData = NULL;
+    clone->resultHandler = NULL;
+    clone->sio = NULL;
+    clone->tio = NULL;
+    clone->jobs = 1;
+    clone->stats = NULL;
+    clone->moves = NULL;
+}
+
+// release what a clone allocated during its conversion
+
+void gpx_release_clone(Gpx *clone)
+{
+    free(clone->buildName);
+    clone->buildName = NULL;
+    free(clone->selectedFilename);
+    clone->selectedFilename = NULL;
+    if(clone->eepromMappingVector != NULL) {
+        free(clone->eepromMappingVector);
+        clone->eepromMappingVector = NULL;
+    }
 }
 
 // PRINT STATE
@@ -560,50 +612,11 @@ static long write_string(Gpx *gpx, const char *string, long length)
 
 // FRAMING
 
-static unsigned char calculate_crc(unsigned char *addr, long len)
-{
-    unsigned char data, crc = 0;
-    while(len--) {
-        data = *addr++;
-        // 8-bit iButton/Maxim/Dallas CRC loop unrolled
-        crc = crc ^ data;
-        // 1
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 2
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 3
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 4
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 5
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 6
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 7
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-
-        // 8
-        if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-        else crc >>= 1;
-    }
-    return crc;
-}
-
 static void begin_frame(Gpx *gpx)
 {
+    // held back moves have to be converted before anything else is
+    assert(gpx->moves == NULL || gpx->moves->count == 0 || gpx->moves->converting);
+    STATS( stats_enter(gpx->stats, STATS_ENCODE) );
     gpx->buffer.ptr = gpx->buffer.out;
     if(gpx->flag.framingEnabled) {
         gpx->buffer.out[0] = 0xD5;  // synchronization byte
@@ -618,21 +631,48 @@ static int end_frame(Gpx *gpx)
         unsigned char *end = (unsigned char *)gpx->buffer.ptr;
         size_t payload_length = end - start;
         gpx->buffer.out[1] = (unsigned char)payload_length;
-        *gpx->buffer.ptr++ = calculate_crc(start, payload_length);
+        *gpx->buffer.ptr++ = crc8(start, payload_length);
     }
     size_t length = gpx->buffer.ptr - gpx->buffer.out;
     gpx->accumulated.bytes += length;
+    STATS( stats_leave(gpx->stats) );
     if(gpx->callbackHandler) {
-        return gpx->callbackHandler(gpx, gpx->callbackData, gpx->buffer.out, length);
+        STATS( stats_enter(gpx->stats, STATS_WRITE) );
+        int rval = gpx->callbackHandler(gpx, gpx->callbackData, gpx->buffer.out, length);
+        STATS( stats_leave(gpx->stats) );
+        return rval;
     }
     return SUCCESS;
 }
 
+// finish a frame whose command was packed by one of the encoders generated
+// from the command schema in s3g_commands.h, end is what the encoder
+// returned
+
+static int pack_frame(Gpx *gpx, unsigned char *end)
+{
+    if(end == NULL) {
+        STATS( stats_leave(gpx->stats) );
+        gcodeResult(gpx, "(line %u) Error: x3g command is too long for the output buffer" EOL, gpx->lineNumber);
+        return ERROR;
+    }
+    gpx->buffer.ptr = (char *)end;
+    return end_frame(gpx);
+}
+
+// pack the command NAME into the frame with a single copy, leaving room
+// for the CRC, and finish the frame
+#define PACK(NAME, ...) pack_frame(gpx, x3g_pack_##NAME((unsigned char *)gpx->buffer.ptr, \
+        (unsigned char *)gpx->buffer.out + BUFFER_MAX, __VA_ARGS__))
+
 // no x3g to emit, but the callback might want to look at the parsed command
 static int empty_frame(Gpx *gpx)
 {
     if(gpx->callbackHandler) {
-        return gpx->callbackHandler(gpx, gpx->callbackData, gpx->buffer.out, 0);
+        STATS( stats_enter(gpx->stats, STATS_WRITE) );
+        int rval = gpx->callbackHandler(gpx, gpx->callbackData, gpx->buffer.out, 0);
+        STATS( stats_leave(gpx->stats) );
+        return rval;
     }
     return SUCCESS;
 }
@@ -1366,6 +1406,14 @@ int get_advanced_version_number(Gpx *gpx)
 
 // X3G COMMANDS
 
+// the machine comes to a stop before the next command, count the time of
+// the moves planned ahead
+
+static void stop_moving(Gpx *gpx)
+{
+    gpx->accumulated.time += estimate_stop(&gpx->estimate);
+}
+
 // 131 - Find axes minimums
 // 132 - Find axes maximums
 
@@ -1420,36 +1468,31 @@ static int home_axes(Gpx *gpx, unsigned axes, unsigned direction)
     // time between steps for longest axis = microseconds / longestStep
     unsigned step_delay = (unsigned)round(microseconds / longestAxis);
 
+    stop_moving(gpx);
     gpx->accumulated.time += distance / feedrate * 60;
 
     begin_frame(gpx);
 
-    write_8(gpx, direction == ENDSTOP_IS_MIN ? 131 :132);
-
     // uint8: Axes bitfield. Axes whose bits are set will be moved.
-    write_8(gpx, axes);
-
     // uint32: Feedrate, in microseconds between steps on the max delta. (DDA)
-    write_32(gpx, step_delay);
-
     // uint16: Timeout, in seconds.
-    write_16(gpx, gpx->machine.timeout);
-
-    return end_frame(gpx);
+    if(direction == ENDSTOP_IS_MIN) {
+        return PACK(find_axes_minimum, axes, step_delay, gpx->machine.timeout);
+    }
+    return PACK(find_axes_maximum, axes, step_delay, gpx->machine.timeout);
 }
 
 // 133 - delay
 
 int delay(Gpx *gpx, unsigned milliseconds)
 {
-    begin_frame(gpx);
+    stop_moving(gpx);
+    gpx->accumulated.time += milliseconds / 1000.0;
 
-    write_8(gpx, 133);
+    begin_frame(gpx);
 
     // uint32: delay, in milliseconds
-    write_32(gpx, milliseconds);
-
-    return end_frame(gpx);
+    return PACK(delay, milliseconds);
 }
 
 // 134 - Change extruder offset
@@ -1463,12 +1506,8 @@ static int change_extruder_offset(Gpx *gpx, unsigned extruder_id)
 
     begin_frame(gpx);
 
-    write_8(gpx, 134);
-
     // uint8: ID of the extruder to switch to
-    write_8(gpx, extruder_id);
-
-    return end_frame(gpx);
+    return PACK(change_tool, extruder_id);
 }
 
 // 135 - Wait for extruder ready
@@ -1477,20 +1516,13 @@ static int wait_for_extruder(Gpx *gpx, unsigned extruder_id, unsigned timeout)
 {
     assert(extruder_id < gpx->machine.extruder_count);
 
+    stop_moving(gpx);
     begin_frame(gpx);
 
-    write_8(gpx, 135);
-
     // uint8: ID of the extruder to wait for
-    write_8(gpx, extruder_id);
-
     // uint16: delay between query packets sent to the extruder, in ms (nominally 100 ms)
-    write_16(gpx, 100);
-
     // uint16: Timeout before continuing without extruder ready, in seconds (nominally 1 minute)
-    write_16(gpx, timeout);
-
-    return end_frame(gpx);
+    return PACK(wait_for_tool, extruder_id, 100, timeout);
 }
 
 // 136 - extruder action command
@@ -1671,12 +1703,8 @@ static int set_steppers(Gpx *gpx, unsigned axes, unsigned state)
 
     begin_frame(gpx);
 
-    write_8(gpx, 137);
-
     // uint8: Bitfield codifying the command (see below)
-    write_8(gpx, bitfield);
-
-    return end_frame(gpx);
+    return PACK(enable_axes, bitfield);
 }
 
 // 139 - Queue absolute point
@@ -1723,32 +1751,21 @@ static int queue_absolute_point(Gpx *gpx)
     // the bot to step as fast as it possibly can
     if (longestDDA <= 0) longestDDA = 200;
 
-    begin_frame(gpx);
+    // reset current position
+    gpx->axis.positionKnown = gpx->axis.mask;
 
-    write_8(gpx, 139);
+    // an unaccelerated move starts and ends standing still
+    stop_moving(gpx);
+    begin_frame(gpx);
 
     // int32: X coordinate, in steps
-    write_32(gpx, (int)steps.x);
-
     // int32: Y coordinate, in steps
-    write_32(gpx, (int)steps.y);
-
     // int32: Z coordinate, in steps
-    write_32(gpx, (int)steps.z);
-
     // int32: A coordinate, in steps
-    write_32(gpx, -(int)steps.a);
-
     // int32: B coordinate, in steps
-    write_32(gpx, -(int)steps.b);
-
     // uint32: Feedrate, in microseconds between steps on the max delta. (DDA)
-    write_32(gpx, (int)longestDDA);
-
-    // reset current position
-    gpx->axis.positionKnown = gpx->axis.mask;
-
-    return end_frame(gpx);
+    return PACK(queue_point_ext, (int)steps.x, (int)steps.y, (int)steps.z,
+                -(int)steps.a, -(int)steps.b, (int)longestDDA);
 }
 
 // 140 - Set extended position
@@ -1759,24 +1776,13 @@ int set_position(Gpx *gpx)
 
     begin_frame(gpx);
 
-    write_8(gpx, 140);
-
     // int32: X position, in steps
-    write_32(gpx, (int)steps.x);
-
     // int32: Y position, in steps
-    write_32(gpx, (int)steps.y);
-
     // int32: Z position, in steps
-    write_32(gpx, (int)steps.z);
-
     // int32: A position, in steps
-    write_32(gpx, (int)steps.a);
-
     // int32: B position, in steps
-    write_32(gpx, (int)steps.b);
-
-    return end_frame(gpx);
+    return PACK(set_position_ext, (int)steps.x, (int)steps.y, (int)steps.z,
+                (int)steps.a, (int)steps.b);
 }
 
 // 141 - Wait for build platform ready
@@ -1785,20 +1791,13 @@ static int wait_for_build_platform(Gpx *gpx, unsigned extruder_id, int timeout)
 {
     assert(extruder_id < gpx->machine.extruder_count);
 
+    stop_moving(gpx);
     begin_frame(gpx);
 
-    write_8(gpx, 141);
-
     // uint8: ID of the extruder platform to wait for
-    write_8(gpx, extruder_id);
-
     // uint16: delay between query packets sent to the extruder, in ms (nominally 100 ms)
-    write_16(gpx, 100);
-
     // uint16: Timeout before continuing without extruder ready, in seconds (nominally 1 minute)
-    write_16(gpx, timeout);
-
-    return end_frame(gpx);
+    return PACK(wait_for_platform, extruder_id, 100, timeout);
 }
 
 // 142 - Queue extended point, new style
@@ -1846,34 +1845,20 @@ static int queue_new_point(Gpx *gpx, unsigned milliseconds)
 
     Point5d steps = mm_to_steps(gpx, &target, &gpx->excess);
 
-    gpx->accumulated.time += (milliseconds / 1000.0) * ACCELERATION_TIME;
+    stop_moving(gpx);
+    gpx->accumulated.time += milliseconds / 1000.0;
 
     begin_frame(gpx);
 
-    write_8(gpx, 142);
-
     // int32: X coordinate, in steps
-    write_32(gpx, (int)steps.x);
-
     // int32: Y coordinate, in steps
-    write_32(gpx, (int)steps.y);
-
     // int32: Z coordinate, in steps
-    write_32(gpx, (int)steps.z);
-
     // int32: A coordinate, in steps
-    write_32(gpx, (int)steps.a);
-
     // int32: B coordinate, in steps
-    write_32(gpx, (int)steps.b);
-
     // uint32: Duration of the movement, in microseconds
-    write_32(gpx, milliseconds * 1000.0);
-
     // uint8: Axes bitfield to specify which axes are relative. Any axis with a bit set should make a relative movement.
-    write_8(gpx, AXES_BIT_MASK);
-
-    return end_frame(gpx);
+    return PACK(queue_point_new, (int)steps.x, (int)steps.y, (int)steps.z,
+                (int)steps.a, (int)steps.b, milliseconds * 1000.0, AXES_BIT_MASK);
 }
 #endif
 
@@ -1883,13 +1868,9 @@ static int store_home_positions(Gpx *gpx)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 143);
-
     // uint8: Axes bitfield to specify which axes' positions to store.
     // Any axis with a bit set should have its position stored.
-    write_8(gpx, gpx->command.flag & AXES_BIT_MASK);
-
-    return end_frame(gpx);
+    return PACK(store_home_position, gpx->command.flag & AXES_BIT_MASK);
 }
 
 // 144 - Recall home positions
@@ -1898,13 +1879,9 @@ static int recall_home_positions(Gpx *gpx)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 144);
-
     // uint8: Axes bitfield to specify which axes' positions to recall.
     // Any axis with a bit set should have its position recalled.
-    write_8(gpx, gpx->command.flag & AXES_BIT_MASK);
-
-    return end_frame(gpx);
+    return PACK(recall_home_position, gpx->command.flag & AXES_BIT_MASK);
 }
 
 // 145 - Set digital potentiometer value
@@ -1915,15 +1892,9 @@ static int set_pot_value(Gpx *gpx, unsigned axis, unsigned value)
 
     begin_frame(gpx);
 
-    write_8(gpx, 145);
-
     // uint8: axis value (valid range 0-4) which axis pot to set
-    write_8(gpx, axis);
-
     // uint8: value (valid range 0-255)
-    write_8(gpx, value);
-
-    return end_frame(gpx);
+    return PACK(set_pot_value, axis, value);
 }
 
 // 146 - Set RGB LED value
@@ -1932,48 +1903,24 @@ static int set_LED(Gpx *gpx, unsigned red, unsigned green, unsigned blue, unsign
 {
     begin_frame(gpx);
 
-    write_8(gpx, 146);
-
     // uint8: red value (all pix are 0-255)
-    write_8(gpx, red);
-
     // uint8: green
-    write_8(gpx, green);
-
     // uint8: blue
-    write_8(gpx, blue);
-
     // uint8: blink rate (0-255 valid)
-    write_8(gpx, blink);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(set_rgb_led, red, green, blue, blink, 0);
 }
 
 static int set_LED_RGB(Gpx *gpx, unsigned rgb, unsigned blink)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 146);
-
     // uint8: red value (all pix are 0-255)
-    write_8(gpx, (rgb >> 16) & 0xFF);
-
     // uint8: green
-    write_8(gpx, (rgb >> 8) & 0xFF);
-
     // uint8: blue
-    write_8(gpx, rgb & 0xFF);
-
     // uint8: blink rate (0-255 valid)
-    write_8(gpx, blink);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(set_rgb_led, (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, blink, 0);
 }
 
 // 147 - Set Beep
@@ -1982,18 +1929,10 @@ static int set_beep(Gpx *gpx, unsigned frequency, unsigned milliseconds)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 147);
-
     // uint16: frequency
-    write_16(gpx, frequency);
-
     // uint16: buzz length in ms
-    write_16(gpx, milliseconds);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(set_beep, frequency, milliseconds, 0);
 }
 
 // 148 - Pause for button
@@ -2016,18 +1955,10 @@ static int wait_for_button(Gpx *gpx, int button, unsigned timeout, int button_op
 {
     begin_frame(gpx);
 
-    write_8(gpx, 148);
-
     // uint8: Bit field of buttons to wait for
-    write_8(gpx, button);
-
     // uint16: Timeout, in seconds. A value of 0 indicates that the command should not time out.
-    write_16(gpx, timeout);
-
     // uint8: Options bitfield
-    write_8(gpx, button_options);
-
-    return end_frame(gpx);
+    return PACK(pause_for_button, button, timeout, button_options);
 }
 #endif // FUTURE
 
@@ -2067,23 +1998,18 @@ static int display_message(Gpx *gpx, char *message, unsigned vPos, unsigned hPos
             bitfield |= 0x01; //do not clear flag
         }
 
-        begin_frame(gpx);
+        long rowLength = length - bytesSent;
+        if(rowLength > maxLength) rowLength = maxLength;
 
-        write_8(gpx, 149);
+        begin_frame(gpx);
 
         // uint8: Options bitfield (see below)
-        write_8(gpx, bitfield);
         // uint8: Horizontal position to display the message at (commonly 0-19)
-        write_8(gpx, hPos);
         // uint8: Vertical position to display the message at (commonly 0-3)
-        write_8(gpx, vPos);
         // uint8: Timeout, in seconds. If 0, this message will left on the screen
-        write_8(gpx, seconds);
         // 1+N bytes: Message to write to the screen, in ASCII, terminated with a null character.
-        long rowLength = length - bytesSent;
-        bytesSent += write_string(gpx, message + bytesSent, rowLength < maxLength ? rowLength : maxLength);
-
-        CALL( end_frame(gpx) );
+        CALL( PACK(display_message, bitfield, hPos, vPos, seconds, message + bytesSent, rowLength) );
+        bytesSent += rowLength;
     }
     return SUCCESS;
 }
@@ -2097,15 +2023,9 @@ int set_build_progress(Gpx *gpx, unsigned percent)
 
     begin_frame(gpx);
 
-    write_8(gpx, 150);
-
     // uint8: percent (0-100)
-    write_8(gpx, percent);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(set_build_percent, percent, 0);
 }
 
 // 151 - Queue Song
@@ -2120,12 +2040,8 @@ static int queue_song(Gpx *gpx, unsigned song_id)
 
     begin_frame(gpx);
 
-    write_8(gpx, 151);
-
     // uint8: songID: select from a predefined list of songs
-    write_8(gpx, song_id);
-
-    return end_frame(gpx);
+    return PACK(queue_song, song_id);
 }
 
 #ifdef FUTURE
@@ -2135,12 +2051,8 @@ static int factory_defaults(Gpx *gpx)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 152);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(reset_to_factory, 0);
 }
 #endif // FUTURE
 
@@ -2151,13 +2063,6 @@ static int start_build(Gpx *gpx, const char * filename)
 {
     size_t len;
 
-    begin_frame(gpx);
-
-    write_8(gpx, 153);
-
-    // uint32: 0 (reserved for future use)
-    write_32(gpx, 0);
-
     // 1+N bytes: Name of the build, in ASCII, null terminated
     // 32 bytes max in a payload
     //  4 bytes used for "reserved"
@@ -2169,9 +2074,11 @@ static int start_build(Gpx *gpx, const char * filename)
 	 filename = PACKAGE_STRING;
     len = strlen(filename);
     if(len > 24) len = 24;
-    write_string(gpx, filename, len);
 
-    return end_frame(gpx);
+    begin_frame(gpx);
+
+    // uint32: 0 (reserved for future use)
+    return PACK(build_start, 0, filename, len);
 }
 
 // 154 - Build end notification
@@ -2180,19 +2087,15 @@ int end_build(Gpx *gpx)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 154);
-
     // uint8: 0 (reserved for future use)
-    write_8(gpx, 0);
-
-    return end_frame(gpx);
+    return PACK(build_end, 0);
 }
 
 // 155 - Queue extended point x3g
 
 // IMPORTANT: this command updates the parser state
 
-static int queue_ext_point(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
+static int queue_ext_point_core(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
 {
     /* If we don't know our previous position on a command axis, we can't calculate the feedrate
        or distance correctly, so we use an unaccelerated command with a fixed DDA. */
@@ -2282,6 +2185,9 @@ static int queue_ext_point(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
         gpx->accumulated.a += deltaMM.a;
         gpx->accumulated.b += deltaMM.b;
 
+        // the direction of the move, for the time estimate
+        double direction[5] = {deltaMM.x, deltaMM.y, deltaMM.z, deltaMM.a, deltaMM.b};
+
         deltaMM.x = fabs(deltaMM.x);
         deltaMM.y = fabs(deltaMM.y);
         deltaMM.z = fabs(deltaMM.z);
@@ -2305,6 +2211,8 @@ static int queue_ext_point(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
         //convert feedrate to mm/sec
         feedrate /= 60.0;
 
+        gpx->accumulated.time += estimate_move(&gpx->estimate, &gpx->machine, direction, distance, feedrate);
+
 #if ENABLE_SIMULATED_RPM
         // if either a or b is 0, but their motor is on and turning, 'simulate' a 5D extrusion distance
         if(deltaMM.a == 0.0 && gpx->tool[A].motor_enabled && gpx->tool[A].rpm) {
@@ -2355,103 +2263,237 @@ static int queue_ext_point(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
 	// steps-per-microsecond * 1000000 us/s = 1000000 * (1 / dda_interval)
         double dda_rate = 1000000.0L / dda_interval;
 
-        gpx->accumulated.time += (minutes * 60) * ACCELERATION_TIME;
-
         begin_frame(gpx);
 
-        write_8(gpx, 155);
-
         // int32: X coordinate, in steps
-        write_32(gpx, (int)steps.x);
-
         // int32: Y coordinate, in steps
-        write_32(gpx, (int)steps.y);
-
         // int32: Z coordinate, in steps
-        write_32(gpx, (int)steps.z);
-
         // int32: A coordinate, in steps
-        write_32(gpx, (int)steps.a);
-
         // int32: B coordinate, in steps
-        write_32(gpx, (int)steps.b);
-
         // uint32: DDA Feedrate, in steps/s
-        write_32(gpx, (unsigned)dda_rate);
-
         // uint8: Axes bitfield to specify which axes are relative. Any axis with a bit set should make a relative movement.
-        write_8(gpx, relative ? AXES_BIT_MASK : stillUnknown|A_IS_SET|B_IS_SET);
-
         // float (single precision, 32 bit): mm distance for this move.  normal of XYZ if any of these axes are active, and AB for extruder only moves
-        write_float(gpx, (float)distance);
-
         // uint16: feedrate in mm/s, multiplied by 64 to assist fixed point calculation on the bot
-        write_16(gpx, (unsigned)(feedrate * 64.0));
-
-        return end_frame(gpx);
+        return PACK(queue_point_new_ext, (int)steps.x, (int)steps.y, (int)steps.z,
+                    (int)steps.a, (int)steps.b, (unsigned)dda_rate,
+                    relative ? AXES_BIT_MASK : stillUnknown|A_IS_SET|B_IS_SET,
+                    (float)distance, (unsigned)(feedrate * 64.0));
 	}
     return SUCCESS;
 }
 
-// 156 - Set segment acceleration
+// update the build progress, after a line that moved or changed the
+// estimated print time
 
-static int set_acceleration(Gpx *gpx, int state)
+static int update_build_progress(Gpx *gpx)
 {
-    begin_frame(gpx);
+    int rval;
+    if(gpx->total.time > 0.0001 && gpx->accumulated.time > 0.0001 && gpx->flag.buildProgress) {
+        unsigned percent = (unsigned)round(100.0 * gpx->accumulated.time / gpx->total.time);
+        if(percent > gpx->current.percent) {
+            if(program_is_ready()) {
+                start_program();
+		if(!gpx->nostart) {
+		     CALL( start_build(gpx, gpx->buildName) );
+		}
+                CALL( set_build_progress(gpx, 0) );
+                // start extruder in a known state
+                CALL( change_extruder_offset(gpx, gpx->current.extruder) );
+            }
+            else if(percent < 100 && program_is_running()) {
+                if(gpx->current.percent) {
+                    CALL( set_build_progress(gpx, percent) );
+                }
+                // force 1%
+                else {
+                    CALL( set_build_progress(gpx, 1) );
+                }
+            }
+        }
+    }
+    return SUCCESS;
+}
 
-    write_8(gpx, 156);
+// MOVE BATCH
 
-    // uint8: 1 to enable, 0 to disable
-    write_8(gpx, state);
+// Runs of moves are held back in gpx->moves and converted together by
+// kinematics_compute. Only moves that 155 can queue knowing nothing but
+// the machine definition, the command and where the move starts are held
+// back, and the batch is converted before anything else is emitted, so
+// the x3g is the same as converting each move as it is read, unless
+// gpx->coalesce allows short collinear moves to be merged as they are added.
 
-    return end_frame(gpx);
+// can queue_ext_point_core's 155 move be held back
+
+static int can_batch_move(Gpx *gpx, int relative)
+{
+    unsigned mask = gpx->command.flag & gpx->axis.mask;
+    unsigned stillUnknown = (~(gpx->axis.positionKnown | mask)) & gpx->axis.mask;
+    // not a 139 move to an unknown position
+    if((gpx->axis.positionKnown & mask) != mask && !relative && !stillUnknown) return 0;
+    // nor a rewritten extrusion or a pause @ zPos pending
+    if(gpx->flag.rewrite5D || gpx->flag.doPauseAtZPos) return 0;
+#if ENABLE_SIMULATED_RPM
+    // nor a simulated extrusion
+    if(gpx->tool[A].rpm || gpx->tool[B].rpm) return 0;
+#endif
+    return 1;
 }
 
-#ifdef FUTURE
-// 157 - Stream Version
+#ifndef NO_STATS
+// count the line of a move held back, as execute_line counts the others
 
-static int stream_version(Gpx *gpx)
+static void count_batched_move(Gpx *gpx, unsigned i, unsigned long bytes)
 {
-    if(gpx->machine.id >= MACHINE_TYPE_REPLICATOR_1) {
-        begin_frame(gpx);
-
-        write_8(gpx, 157);
+    if(gpx->callbackHandler) {
+        Command command;
+        command.flag = gpx->moves->flag[i] & (G_IS_SET | T_IS_SET);
+        command.g = gpx->moves->g[i];
+        stats_count(gpx->stats, &command, NULL, bytes);
+    }
+}
+#endif
 
-        // uint8: x3g version high byte
-        write_8(gpx, STREAM_VERSION_HIGH);
+// convert the moves held back, emitting them and updating the build
+// progress after each one as if they were converted line by line
 
-        // uint8: x3g version low byte
-        write_8(gpx, STREAM_VERSION_LOW);
+static int flush_moves(Gpx *gpx)
+{
+    MoveBatch *batch = gpx->moves;
+    unsigned lineNumber = gpx->lineNumber;
+    unsigned long mark = gpx->accumulated.bytes;
+    unsigned i;
+    int rval = SUCCESS;
 
-        // uint8: not implemented
-        write_8(gpx, 0);
+    if(batch->count == 0) return SUCCESS;
+
+    STATS( stats_enter(gpx->stats, STATS_KINEMATICS) );
+    kinematics_compute(batch, &gpx->machine, &gpx->excess);
+    batch->converting = 1;
+    for(i = 0; i < batch->count && rval == SUCCESS; i++) {
+        gpx->lineNumber = batch->lineNumber[i];
+        if(batch->moving[i]) {
+            gpx->accumulated.a += batch->delta[3][i];
+            gpx->accumulated.b += batch->delta[4][i];
+            double direction[5] = {batch->delta[0][i], batch->delta[1][i], batch->delta[2][i],
+                                   batch->delta[3][i], batch->delta[4][i]};
+            gpx->accumulated.time += estimate_move(&gpx->estimate, &gpx->machine, direction,
+                                                   batch->distance[i], batch->safeFeedrate[i]);
+
+            begin_frame(gpx);
+            rval = PACK(queue_point_new_ext, (int)batch->steps[0][i], (int)batch->steps[1][i], (int)batch->steps[2][i],
+                        (int)batch->steps[3][i], (int)batch->steps[4][i], (unsigned)batch->ddaRate[i],
+                        batch->relative[i], (float)batch->distance[i], (unsigned)(batch->safeFeedrate[i] * 64.0));
+        }
+        if(rval == SUCCESS) rval = update_build_progress(gpx);
+        STATS( count_batched_move(gpx, i, gpx->accumulated.bytes - mark) );
+        batch->bytes += gpx->accumulated.bytes - mark;
+        mark = gpx->accumulated.bytes;
+    }
+    batch->converting = 0;
+    batch->count = 0;
+    gpx->lineNumber = lineNumber;
+    STATS( stats_leave(gpx->stats) );
+    return rval;
+}
 
-        // uint32: not implemented
-        write_32(gpx, 0);
+// hold back the move queue_ext_point_core would queue
 
-        // uint16: bot type: PID for the intended bot is sent
-        // Repliator 2/2X (Might Two)
-        if(gpx->machine.id >= MACHINE_TYPE_REPLICATOR_2) {
-            write_16(gpx, 0xB015);
-        }
-        // Replicator (Might One)
-        else {
-            write_16(gpx, 0xD314);
-        }
+static int batch_move(Gpx *gpx, Ptr5d delta, int relative)
+{
+    MoveBatch *batch = gpx->moves;
+    unsigned mask = gpx->command.flag & gpx->axis.mask;
+    unsigned stillUnknown = (~(gpx->axis.positionKnown | mask)) & gpx->axis.mask;
+    unsigned i = batch->count;
 
-        // uint16: not implemented
-        write_16(gpx, 0);
+    Point5d deltaMM;
+    if (stillUnknown || relative)
+        deltaMM = *delta;
+    else
+        deltaMM = delta_mm(gpx);
 
-        // uint32: not implemented
-        write_32(gpx, 0);
+    Point5d target = relative ? *delta : gpx->target.position;
+    if (stillUnknown & X_IS_SET)
+        target.x = 0;
+    if (stillUnknown & Y_IS_SET)
+        target.y = 0;
+    if (stillUnknown & Z_IS_SET)
+        target.z = 0;
+
+    batch->flag[i] = gpx->command.flag;
+    batch->g[i] = gpx->command.g;
+    batch->lineNumber[i] = gpx->lineNumber;
+    batch->relative[i] = relative ? AXES_BIT_MASK : stillUnknown|A_IS_SET|B_IS_SET;
+    batch->feedrate[i] = gpx->current.feedrate * ((double)gpx->current.speed_factor / 100);
+    batch->delta[0][i] = deltaMM.x;
+    batch->delta[1][i] = deltaMM.y;
+    batch->delta[2][i] = deltaMM.z;
+    batch->delta[3][i] = deltaMM.a;
+    batch->delta[4][i] = deltaMM.b;
+    batch->target[0][i] = target.x;
+    batch->target[1][i] = target.y;
+    batch->target[2][i] = target.z;
+    batch->added++;
+    if(kinematics_coalesce(batch, &gpx->coalesce, &gpx->machine)) {
+        gpx->accumulated.coalesced++;
+        STATS( count_batched_move(gpx, i - 1, 0) );
+        return SUCCESS;
+    }
+    batch->joints = 0;
+    if(++batch->count == MOVE_BATCH_MAX) {
+        return flush_moves(gpx);
+    }
+    return SUCCESS;
+}
 
-        // uint32: not implemented
-        write_32(gpx, 0);
+static int queue_ext_point(Gpx *gpx, double feedrate, Ptr5d delta, int relative)
+{
+    int rval = SUCCESS;
+    STATS( stats_enter(gpx->stats, STATS_KINEMATICS) );
+    if(gpx->moves && can_batch_move(gpx, relative)) {
+        rval = batch_move(gpx, delta, relative);
+    }
+    else {
+        if(gpx->moves) rval = flush_moves(gpx);
+        if(rval == SUCCESS) rval = queue_ext_point_core(gpx, feedrate, delta, relative);
+    }
+    STATS( stats_leave(gpx->stats) );
+    return rval;
+}
 
-        // uint8: not implemented
-        write_8(gpx, 0);
+// 156 - Set segment acceleration
 
-        return end_frame(gpx);
+static int set_acceleration(Gpx *gpx, int state)
+{
+    begin_frame(gpx);
+
+    // uint8: 1 to enable, 0 to disable
+    return PACK(set_acceleration_toggle, state);
+}
+
+#ifdef FUTURE
+// 157 - Stream Version
+
+static int stream_version(Gpx *gpx)
+{
+    if(gpx->machine.id >= MACHINE_TYPE_REPLICATOR_1) {
+        // uint16: bot type: PID for the intended bot is sent
+        // Repliator 2/2X (Might Two), otherwise Replicator (Might One)
+        unsigned bot_type = gpx->machine.id >= MACHINE_TYPE_REPLICATOR_2 ? 0xB015 : 0xD314;
+
+        begin_frame(gpx);
+
+        // uint8: x3g version high byte
+        // uint8: x3g version low byte
+        // uint8: not implemented
+        // uint32: not implemented
+        // uint16: bot type
+        // uint16: not implemented
+        // uint32: not implemented
+        // uint32: not implemented
+        // uint8: not implemented
+        return PACK(stream_version, STREAM_VERSION_HIGH, STREAM_VERSION_LOW, 0, 0,
+                    bot_type, 0, 0, 0, 0);
     }
     return SUCCESS;
 }
@@ -2463,12 +2505,8 @@ static int pause_at_zpos(Gpx *gpx, float z_positon)
 {
     begin_frame(gpx);
 
-    write_8(gpx, 158);
-
     // uint8: pause at Z coordinate or 0.0 to disable
-    write_float(gpx, z_positon);
-
-    return end_frame(gpx);
+    return PACK(pause_at_zpos, z_positon);
 }
 
 // COMMAND @ ZPOS FUNCTIONS
@@ -2984,7 +3022,7 @@ static int display_tag(Gpx *gpx) {
 
 // calculate target position
 
-static int calculate_target_position(Gpx *gpx, Ptr5d delta, int *relative)
+static int calculate_target_position_core(Gpx *gpx, Ptr5d delta, int *relative)
 {
     int rval;
     // G10 ofset
@@ -3109,6 +3147,7 @@ static int calculate_target_position(Gpx *gpx, Ptr5d delta, int *relative)
     if(gpx->flag.macrosEnabled && gpx->flag.runMacros && gpx->commandAtIndex < gpx->commandAtLength) {
         // check if the next command will cross the z threshold
         if(gpx->commandAt[gpx->commandAtIndex].z <= gpx->target.position.z) {
+            if(gpx->moves) CALL( flush_moves(gpx) );
             // is this a temperature change macro?
             if(gpx->commandAt[gpx->commandAtIndex].nozzle_temperature || gpx->commandAt[gpx->commandAtIndex].build_platform_temperature) {
                 unsigned nozzle_temperature = gpx->commandAt[gpx->commandAtIndex].nozzle_temperature;
@@ -3197,6 +3236,14 @@ static int calculate_target_position(Gpx *gpx, Ptr5d delta, int *relative)
     return SUCCESS;
 }
 
+static int calculate_target_position(Gpx *gpx, Ptr5d delta, int *relative)
+{
+    STATS( stats_enter(gpx->stats, STATS_POSITION) );
+    int rval = calculate_target_position_core(gpx, delta, relative);
+    STATS( stats_leave(gpx->stats) );
+    return rval;
+}
+
 static void update_current_position(Gpx *gpx)
 {
     // the current position to tracks where the print head currently is
@@ -3317,17 +3364,17 @@ static char *normalize_word(char* p)
     // [ a-zA-Z] [ +-]? [ 0-9]+ ('.' [ 0-9]*)?
     char *s = p + 1;
     char *e = p;
-    while(isspace(*s)) s++;
+    while(scan_isspace(*s)) s++;
     if(*s == '+' || *s == '-') {
         *e++ = *s++;
     }
     while(1) {
         // skip spaces
-        if(isspace(*s)) {
+        if(scan_isspace(*s)) {
             s++;
         }
         // append digits
-        else if(isdigit(*s)) {
+        else if(scan_isdigit(*s)) {
             *e++ = *s++;
         }
         else {
@@ -3338,11 +3385,11 @@ static char *normalize_word(char* p)
         *e++ = *s++;
         while(1) {
             // skip spaces
-            if(isspace(*s)) {
+            if(scan_isspace(*s)) {
                 s++;
             }
             // append digits
-            else if(isdigit(*s)) {
+            else if(scan_isdigit(*s)) {
                 *e++ = *s++;
             }
             else {
@@ -3359,9 +3406,9 @@ static char *normalize_word(char* p)
 static char *normalize_comment(char *p) {
     // strip white space from the end of comment
     char *e = p + strlen(p);
-    while (e > p && isspace((unsigned char)(*--e))) *e = '\0';
+    while (e > p && scan_isspace(*--e)) *e = '\0';
     // strip white space from the beginning of comment.
-    while(isspace(*p)) p++;
+    while(scan_isspace(*p)) p++;
     return p;
 }
 
@@ -4118,6 +4165,9 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("build_progress")) gpx->flag.buildProgress = atoi(value);
         else if(PROPERTY_IS("packing_density")) gpx->machine.nominal_packing_density = strtod(value, NULL);
         else if(PROPERTY_IS("recalculate_5d")) gpx->flag.rewrite5D = atoi(value);
+        else if(PROPERTY_IS("coalesce_tolerance")) gpx->coalesce.tolerance = strtod(value, NULL);
+        else if(PROPERTY_IS("coalesce_min_length")) gpx->coalesce.length = strtod(value, NULL);
+        else if(PROPERTY_IS("coalesce_min_time")) gpx->coalesce.time = strtod(value, NULL);
         else if(PROPERTY_IS("nominal_filament_diameter")
                 || PROPERTY_IS("slicer_filament_diameter")
                 || PROPERTY_IS("filament_diameter")) {
@@ -4168,9 +4218,9 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("home_feedrate")) gpx->machine.x.home_feedrate = strtod(value, NULL);
         else if(PROPERTY_IS("steps_per_mm")) gpx->machine.x.steps_per_mm = strtod(value, NULL);
         else if(PROPERTY_IS("endstop")) gpx->machine.x.endstop = atoi(value);
-		else if(PROPERTY_IS("max_acceleration") ||
-				PROPERTY_IS("max_speed_change") ||
-				PROPERTY_IS("length")) { }
+        else if(PROPERTY_IS("max_acceleration")) gpx->machine.x.max_accel = strtod(value, NULL);
+        else if(PROPERTY_IS("max_speed_change")) gpx->machine.x.max_speed_change = strtod(value, NULL);
+		else if(PROPERTY_IS("length")) { }
         else goto SECTION_ERROR;
     }
     else if(SECTION_IS("y")) {
@@ -4178,9 +4228,9 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("home_feedrate")) gpx->machine.y.home_feedrate = strtod(value, NULL);
         else if(PROPERTY_IS("steps_per_mm")) gpx->machine.y.steps_per_mm = strtod(value, NULL);
         else if(PROPERTY_IS("endstop")) gpx->machine.y.endstop = atoi(value);
-		else if(PROPERTY_IS("max_acceleration") ||
-				PROPERTY_IS("max_speed_change") ||
-				PROPERTY_IS("length")) { }
+        else if(PROPERTY_IS("max_acceleration")) gpx->machine.y.max_accel = strtod(value, NULL);
+        else if(PROPERTY_IS("max_speed_change")) gpx->machine.y.max_speed_change = strtod(value, NULL);
+		else if(PROPERTY_IS("length")) { }
         else goto SECTION_ERROR;
     }
     else if(SECTION_IS("z")) {
@@ -4188,9 +4238,9 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("home_feedrate")) gpx->machine.z.home_feedrate = strtod(value, NULL);
         else if(PROPERTY_IS("steps_per_mm")) gpx->machine.z.steps_per_mm = strtod(value, NULL);
         else if(PROPERTY_IS("endstop")) gpx->machine.z.endstop = atoi(value);
-		else if(PROPERTY_IS("max_acceleration") ||
-				PROPERTY_IS("max_speed_change") ||
-				PROPERTY_IS("length")) { }
+        else if(PROPERTY_IS("max_acceleration")) gpx->machine.z.max_accel = strtod(value, NULL);
+        else if(PROPERTY_IS("max_speed_change")) gpx->machine.z.max_speed_change = strtod(value, NULL);
+		else if(PROPERTY_IS("length")) { }
         else goto SECTION_ERROR;
     }
     else if(SECTION_IS("a")) {
@@ -4198,8 +4248,8 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("steps_per_mm")) gpx->machine.a.steps_per_mm = strtod(value, NULL);
         else if(PROPERTY_IS("motor_steps")) gpx->machine.a.motor_steps = strtod(value, NULL);
         else if(PROPERTY_IS("has_heated_build_platform")) gpx->machine.a.has_heated_build_platform = atoi(value);
-		else if(PROPERTY_IS("max_acceleration") ||
-				PROPERTY_IS("max_speed_change")) { }
+        else if(PROPERTY_IS("max_acceleration")) gpx->machine.a.max_accel = strtod(value, NULL);
+        else if(PROPERTY_IS("max_speed_change")) gpx->machine.a.max_speed_change = strtod(value, NULL);
         else goto SECTION_ERROR;
     }
     else if(SECTION_IS("right")) {
@@ -4216,8 +4266,8 @@ int gpx_set_property_inner(Gpx *gpx, const char* section, const char* property,
         else if(PROPERTY_IS("steps_per_mm")) gpx->machine.b.steps_per_mm = strtod(value, NULL);
         else if(PROPERTY_IS("motor_steps")) gpx->machine.b.motor_steps = strtod(value, NULL);
         else if(PROPERTY_IS("has_heated_build_platform")) gpx->machine.b.has_heated_build_platform = atoi(value);
-		else if(PROPERTY_IS("max_acceleration") ||
-				PROPERTY_IS("max_speed_change")) { }
+        else if(PROPERTY_IS("max_acceleration")) gpx->machine.b.max_accel = strtod(value, NULL);
+        else if(PROPERTY_IS("max_speed_change")) gpx->machine.b.max_speed_change = strtod(value, NULL);
         else goto SECTION_ERROR;
     }
     else if(SECTION_IS("left")) {
@@ -4398,36 +4448,81 @@ static int get_extruder_temperature_extended(Gpx *gpx)
     return SUCCESS;
 }
 
-int gpx_convert_line(Gpx *gpx, char *gcode_line)
+// TOKENIZER
+
+static void report_syntax_warning(Gpx *gpx, int code, int c, char *text)
 {
-    int i, rval;
-    int next_line = 0;
-    int command_emitted = 0;
+    switch(code) {
+        case SYNTAX_MISSING_DIGITS:
+            gcodeResult(gpx, "(line %u) Syntax error: line number command word 'N' is missing digits" EOL, gpx->lineNumber);
+            break;
+        case SYNTAX_COMMAND_WORD:
+            gcodeResult(gpx, "(line %u) Syntax warning: unrecognised command word '%c'" EOL, gpx->lineNumber, c);
+            break;
+        case SYNTAX_NESTED_COMMENT:
+            gcodeResult(gpx, "(line %u) Syntax warning: nested comment detected" EOL, gpx->lineNumber);
+            break;
+        case SYNTAX_UNCLOSED_COMMENT:
+            gcodeResult(gpx, "(line %u) Syntax warning: comment is missing closing ')'" EOL, gpx->lineNumber);
+            break;
+        case SYNTAX_UNRECOGNISED:
+            gcodeResult(gpx, "(line %u) Syntax error: unrecognised gcode '%s'" EOL, gpx->lineNumber, text);
+            break;
+    }
+}
+
+// report a syntax warning straight away, or when the line is tokenized
+// ahead of time on a worker thread, defer it until the line is executed
+// and the line number is known
+
+static void syntax_warning(Gpx *gpx, vector *deferred, unsigned index, int code, int c, char *text)
+{
+    if(deferred) {
+        SyntaxWarning warning;
+        warning.index = index;
+        warning.code = code;
+        warning.c = c;
+        warning.text = text;
+        vector_append(deferred, &warning);
+    }
+    else {
+        report_syntax_warning(gpx, code, c, text);
+    }
+}
+
+// split a line into its command words, comment and macro, this only touches
+// gpx to report warnings and track the line number when deferred is NULL
+
+static void tokenize_line(Gpx *gpx, char *gcode_line, GcodeLine *line, vector *deferred, unsigned index)
+{
+    Command *command = &line->command;
 
     // reset flag state
-    gpx->command.flag = 0;
+    command->flag = 0;
+    command->m = 0;
+    line->hasNumber = 0;
+    line->macro = NULL;
+    line->macroParam = NULL;
     char *digits;
     char *p = gcode_line; // current parser location
-    while(isspace(*p)) p++;
-    VERBOSESIO( if(gpx->flag.sioConnected) fprintf(gpx->log, "gcode_line: %s\n", gcode_line); )
+    while(scan_isspace(*p)) p++;
     // check for line number
     if(*p == 'n' || *p == 'N') {
         digits = p;
         p = normalize_word(p);
         if(*p == 0) {
-            gcodeResult(gpx, "(line %u) Syntax error: line number command word 'N' is missing digits" EOL, gpx->lineNumber);
-            next_line = gpx->lineNumber + 1;
+            syntax_warning(gpx, deferred, index, SYNTAX_MISSING_DIGITS, 0, NULL);
         }
         else {
-            next_line = gpx->lineNumber = atoi(digits);
+            line->hasNumber = 1;
+            line->number = word_to_int(digits);
+            // later warnings on this line report the new line number
+            if(!deferred) gpx->lineNumber = line->number;
         }
     }
-    else {
-        next_line = gpx->lineNumber + 1;
-    }
     // parse command words in command line
     while(*p != 0) {
-        if(isalpha(*p)) {
+        if(scan_isalpha(*p)) {
             int c = *p;
             digits = p;
             p = normalize_word(p);
@@ -4438,71 +4533,71 @@ int gpx_convert_line(Gpx *gpx, char *gcode_line)
                     // Xnnn	 X coordinate, usually to move to
                 case 'x':
                 case 'X':
-                    gpx->command.x = strtod(digits, NULL);
-                    gpx->command.flag |= X_IS_SET;
+                    command->x = word_to_double(digits);
+                    command->flag |= X_IS_SET;
                     break;
 
                     // Ynnn	 Y coordinate, usually to move to
                 case 'y':
                 case 'Y':
-                    gpx->command.y = strtod(digits, NULL);
-                    gpx->command.flag |= Y_IS_SET;
+                    command->y = word_to_double(digits);
+                    command->flag |= Y_IS_SET;
                     break;
 
                     // Znnn	 Z coordinate, usually to move to
                 case 'z':
                 case 'Z':
-                    gpx->command.z = strtod(digits, NULL);
-                    gpx->command.flag |= Z_IS_SET;
+                    command->z = word_to_double(digits);
+                    command->flag |= Z_IS_SET;
                     break;
 
                     // Annn	 Length of extrudate in mm.
                 case 'a':
                 case 'A':
-                    gpx->command.a = strtod(digits, NULL);
-                    gpx->command.flag |= A_IS_SET;
+                    command->a = word_to_double(digits);
+                    command->flag |= A_IS_SET;
                     break;
 
                     // Bnnn	 Length of extrudate in mm.
                 case 'b':
                 case 'B':
-                    gpx->command.b = strtod(digits, NULL);
-                    gpx->command.flag |= B_IS_SET;
+                    command->b = word_to_double(digits);
+                    command->flag |= B_IS_SET;
                     break;
 
                     // Ennn	 Length of extrudate in mm.
                 case 'e':
                 case 'E':
-                    gpx->command.e = strtod(digits, NULL);
-                    gpx->command.flag |= E_IS_SET;
+                    command->e = word_to_double(digits);
+                    command->flag |= E_IS_SET;
                     break;
 
                     // Fnnn	 Feedrate in mm per minute.
                 case 'f':
                 case 'F':
-                    gpx->command.f = strtod(digits, NULL);
-                    gpx->command.flag |= F_IS_SET;
+                    command->f = word_to_double(digits);
+                    command->flag |= F_IS_SET;
                     break;
 
                     // Pnnn	 Command parameter, such as a time in milliseconds
                 case 'p':
                 case 'P':
-                    gpx->command.p = strtod(digits, NULL);
-                    gpx->command.flag |= P_IS_SET;
+                    command->p = word_to_double(digits);
+                    command->flag |= P_IS_SET;
                     break;
 
                     // Rnnn	 Command Parameter, such as RPM
                 case 'r':
                 case 'R':
-                    gpx->command.r = strtod(digits, NULL);
-                    gpx->command.flag |= R_IS_SET;
+                    command->r = word_to_double(digits);
+                    command->flag |= R_IS_SET;
                     break;
 
                     // Snnn	 Command parameter, such as temperature
                 case 's':
                 case 'S':
-                    gpx->command.s = strtod(digits, NULL);
-                    gpx->command.flag |= S_IS_SET;
+                    command->s = word_to_double(digits);
+                    command->flag |= S_IS_SET;
                     break;
 
                     // COMMANDS
@@ -4510,28 +4605,28 @@ int gpx_convert_line(Gpx *gpx, char *gcode_line)
                     // Gnnn GCode command, such as move to a point
                 case 'g':
                 case 'G':
-                    gpx->command.g = atoi(digits);
-                    gpx->command.flag |= G_IS_SET;
+                    command->g = word_to_int(digits);
+                    command->flag |= G_IS_SET;
                     break;
                     // Mnnn	 RepRap-defined command
                 case 'm':
                 case 'M':
-                    gpx->command.m = atoi(digits);
-                    gpx->command.flag |= M_IS_SET;
-                    if(gpx->command.m == 23 || gpx->command.m == 28) {
+                    command->m = word_to_int(digits);
+                    command->flag |= M_IS_SET;
+                    if(command->m == 23 || command->m == 28) {
                         char *s = p + 1;
                         while(*s && *s != '*') s++;
                         if(*s) *s++ = 0;
-                        gpx->command.arg = normalize_comment(p + 1);
-                        gpx->command.flag |= ARG_IS_SET;
+                        command->arg = normalize_comment(p + 1);
+                        command->flag |= ARG_IS_SET;
                         p = s;
                     }
                     break;
                     // Tnnn	 Select extruder nnn.
                 case 't':
                 case 'T':
-                    gpx->command.t = atoi(digits);
-                    gpx->command.flag |= T_IS_SET;
+                    command->t = word_to_int(digits);
+                    command->flag |= T_IS_SET;
                     break;
                     // Nnnn      Line number
                 case 'n':
@@ -4539,68 +4634,72 @@ int gpx_convert_line(Gpx *gpx, char *gcode_line)
                     // this line's number was already stripped off, so this should
                     // be a parameter to an M110 which GPX does not currently implement
                     // so we'll silently ignore
-                    if((gpx->command.flag & M_IS_SET) && gpx->command.m == 110)
+                    if((command->flag & M_IS_SET) && command->m == 110)
                         break;
                     // fallthrough
 
                 default:
-                    gcodeResult(gpx, "(line %u) Syntax warning: unrecognised command word '%c'" EOL, gpx->lineNumber, c);
+                    syntax_warning(gpx, deferred, index, SYNTAX_COMMAND_WORD, c, NULL);
             }
         }
         else if(*p == ';') {
             if(*(p + 1) == '@') {
                 char *s = p + 2;
-                if(isalpha(*s)) {
+                if(scan_isalpha(*s)) {
                     char *macro = s;
                     // skip any no space characters
-                    while(*s && !isspace(*s)) s++;
+                    while(*s && !scan_isspace(*s)) s++;
                     // null terminate
                     if(*s) *s++ = 0;
-                    CALL( parse_macro(gpx, macro, normalize_comment(s)) );
+                    line->macro = macro;
+                    line->macroParam = normalize_comment(s);
                     *p = 0;
                     break;
                 }
             }
             // Comment
-            gpx->command.comment = normalize_comment(p + 1);
-            gpx->command.flag |= COMMENT_IS_SET;
+            command->comment = normalize_comment(p + 1);
+            command->flag |= COMMENT_IS_SET;
             *p = 0;
             break;
         }
         else if(*p == '(') {
             if(*(p + 1) == '@') {
                 char *s = p + 2;
-                if(isalpha(*s)) {
+                if(scan_isalpha(*s)) {
                     char *macro = s;
                     char *e = strrchr(p + 1, ')');
                     // skip any no space characters
-                    while(*s && !isspace(*s)) s++;
+                    while(*s && !scan_isspace(*s)) s++;
                     // null terminate
                     if(*s) *s++ = 0;
                     if(e) *e = 0;
-                    CALL( parse_macro(gpx, macro, normalize_comment(s)) );
+                    line->macro = macro;
+                    line->macroParam = normalize_comment(s);
                     *p = 0;
                     break;
                 }
             }
             // Comment
-            char *s = strchr(p + 1, '(');
-            char *e = strchr(p + 1, ')');
+            char *e = scan_string(p + 1, "()");
             // check for nested comment
-            if(s && e && s < e) {
-                gcodeResult(gpx, "(line %u) Syntax warning: nested comment detected" EOL, gpx->lineNumber);
-                e = strrchr(p + 1, ')');
+            if(*e == '(') {
+                e = strrchr(e, ')');
+                if(e) syntax_warning(gpx, deferred, index, SYNTAX_NESTED_COMMENT, 0, NULL);
+            }
+            else if(*e == 0) {
+                e = NULL;
             }
             if(e) {
                 *e = 0;
-                gpx->command.comment = normalize_comment(p + 1);
-                gpx->command.flag |= COMMENT_IS_SET;
+                command->comment = normalize_comment(p + 1);
+                command->flag |= COMMENT_IS_SET;
                 p = e + 1;
             }
             else {
-                gcodeResult(gpx, "(line %u) Syntax warning: comment is missing closing ')'" EOL, gpx->lineNumber);
-                gpx->command.comment = normalize_comment(p + 1);
-                gpx->command.flag |= COMMENT_IS_SET;
+                syntax_warning(gpx, deferred, index, SYNTAX_UNCLOSED_COMMENT, 0, NULL);
+                command->comment = normalize_comment(p + 1);
+                command->flag |= COMMENT_IS_SET;
                 *p = 0;
                 break;
             }
@@ -4610,14 +4709,60 @@ int gpx_convert_line(Gpx *gpx, char *gcode_line)
             *p = 0;
             break;
         }
-        else if(iscntrl(*p)) {
+        else if(scan_iscntrl(*p)) {
             break;
         }
         else {
-            gcodeResult(gpx, "(line %u) Syntax error: unrecognised gcode '%s'" EOL, gpx->lineNumber, p);
+            syntax_warning(gpx, deferred, index, SYNTAX_UNRECOGNISED, 0, p);
             break;
         }
     }
+}
+
+// EXECUTE A TOKENIZED LINE
+
+static int execute_line_core(Gpx *gpx, GcodeLine *line, SyntaxWarning *warning, size_t warnings)
+{
+    int i, rval;
+    int next_line = 0;
+    int command_emitted = 0;
+    int flag = line->command.flag;
+    unsigned long added = gpx->moves ? gpx->moves->added : 0;
+
+    if(line->hasNumber) {
+        next_line = gpx->lineNumber = line->number;
+    }
+    else {
+        next_line = gpx->lineNumber + 1;
+    }
+
+    while(warnings--) {
+        report_syntax_warning(gpx, warning->code, warning->c, warning->text);
+        warning++;
+    }
+
+    // words that aren't on the line keep their previous values
+    gpx->command.flag = flag;
+    if(flag & X_IS_SET) gpx->command.x = line->command.x;
+    if(flag & Y_IS_SET) gpx->command.y = line->command.y;
+    if(flag & Z_IS_SET) gpx->command.z = line->command.z;
+    if(flag & A_IS_SET) gpx->command.a = line->command.a;
+    if(flag & B_IS_SET) gpx->command.b = line->command.b;
+    if(flag & E_IS_SET) gpx->command.e = line->command.e;
+    if(flag & F_IS_SET) gpx->command.f = line->command.f;
+    if(flag & P_IS_SET) gpx->command.p = line->command.p;
+    if(flag & R_IS_SET) gpx->command.r = line->command.r;
+    if(flag & S_IS_SET) gpx->command.s = line->command.s;
+    if(flag & G_IS_SET) gpx->command.g = line->command.g;
+    if(flag & M_IS_SET) gpx->command.m = line->command.m;
+    if(flag & T_IS_SET) gpx->command.t = line->command.t;
+    if(flag & COMMENT_IS_SET) gpx->command.comment = line->command.comment;
+    if(flag & ARG_IS_SET) gpx->command.arg = line->command.arg;
+
+    if(line->macro) {
+        CALL( parse_macro(gpx, line->macro, line->macroParam) );
+    }
+
 
     // revert tool selection to current extruder (Makerbot Tn is not sticky)
     if(!gpx->flag.reprapFlavor || gpx->flag.onlyExplicitToolChange) gpx->target.extruder = gpx->current.extruder;
@@ -5838,44 +5983,300 @@ int gpx_convert_line(Gpx *gpx, char *gcode_line)
             CALL( pause_at_zpos(gpx, gpx->commandAt[gpx->commandAtIndex].z) );
         }
     }
-    // update progress
-    if(gpx->total.time > 0.0001 && gpx->accumulated.time > 0.0001 && gpx->flag.buildProgress && command_emitted) {
-        unsigned percent = (unsigned)round(100.0 * gpx->accumulated.time / gpx->total.time);
-        if(percent > gpx->current.percent) {
-            if(program_is_ready()) {
-                start_program();
-		if(!gpx->nostart) {
-		     CALL( start_build(gpx, gpx->buildName) );
-		}
-                CALL( set_build_progress(gpx, 0) );
-                // start extruder in a known state
-                CALL( change_extruder_offset(gpx, gpx->current.extruder) );
-            }
-            else if(percent < 100 && program_is_running()) {
-                if(gpx->current.percent) {
-                    CALL( set_build_progress(gpx, percent) );
-                }
-                // force 1%
-                else {
-                    CALL( set_build_progress(gpx, 1) );
-                }
-            }
-            command_emitted = 0;
-        }
+    // update progress, unless the move was held back, then it's updated
+    // when the move is converted
+    if(command_emitted && !(gpx->moves && gpx->moves->added != added)) {
+        CALL( update_build_progress(gpx) );
     }
     gpx->lineNumber = next_line;
     return SUCCESS;
 }
 
+// can the line do no more than move, so that the moves held back don't
+// have to be converted before it is executed
+
+static int is_plain_move(GcodeLine *line)
+{
+    int flag = line->command.flag;
+    if(line->macro) return 0;
+    if(flag & G_IS_SET) return line->command.g == 0 || line->command.g == 1;
+    return !(flag & M_IS_SET) && (flag & (AXES_BIT_MASK | E_IS_SET | F_IS_SET));
+}
+
+static int execute_line(Gpx *gpx, GcodeLine *line, SyntaxWarning *warning, size_t warnings)
+{
+    if(gpx->moves && gpx->moves->count && !is_plain_move(line)) {
+        int rval = flush_moves(gpx);
+        if(rval != SUCCESS) return rval;
+    }
+#ifndef NO_STATS
+    if(gpx->stats) {
+        unsigned long bytes = gpx->accumulated.bytes;
+        unsigned long added = 0, batched = 0;
+        if(gpx->moves) {
+            added = gpx->moves->added;
+            batched = gpx->moves->bytes;
+        }
+        stats_enter(gpx->stats, STATS_EXECUTE);
+        int rval = execute_line_core(gpx, line, warning, warnings);
+        stats_leave(gpx->stats);
+        // only count the pass that emits x3g, a move held back is counted
+        // when it is converted, along with the bytes of the moves converted
+        // while executing the line
+        if(gpx->moves) {
+            if(gpx->moves->added != added) return rval;
+            bytes += gpx->moves->bytes - batched;
+        }
+        if(gpx->callbackHandler)
+            stats_count(gpx->stats, &line->command, line->macro, gpx->accumulated.bytes - bytes);
+        return rval;
+    }
+#endif
+    return execute_line_core(gpx, line, warning, warnings);
+}
+
+int gpx_convert_line(Gpx *gpx, char *gcode_line)
+{
+    GcodeLine line;
+
+    VERBOSESIO( if(gpx->flag.sioConnected) fprintf(gpx->log, "gcode_line: %s\n", gcode_line); )
+    STATS( stats_enter(gpx->stats, STATS_TOKENIZE) );
+    tokenize_line(gpx, gcode_line, &line, NULL, 0);
+    STATS( stats_leave(gpx->stats) );
+    return execute_line(gpx, &line, NULL, 0);
+}
+
+// MACRO PRESCAN
+
+// find the macro on a single line, mirroring how gpx_convert_line finds
+// them, without tokenizing any of the gcode on the line
+// returns the macro name and sets *param, or NULL if there is no macro
+
+static char *find_macro(char *line, char **param)
+{
+    char *p = line;
+    while((p = strpbrk(p, ";(")) != NULL) {
+        if(*(p + 1) == '@' && scan_isalpha(*(p + 2))) {
+            char *macro = p + 2;
+            char *s = macro;
+            char *e = *p == '(' ? strrchr(p + 1, ')') : NULL;
+            // skip any no space characters
+            while(*s && !scan_isspace(*s)) s++;
+            // null terminate
+            if(*s) *s++ = 0;
+            if(e) *e = 0;
+            *param = normalize_comment(s);
+            return macro;
+        }
+        // the rest of the line is a comment
+        if(*p == ';') break;
+        // skip over a parenthetical comment
+        p = strchr(p + 1, ')');
+        if(p == NULL) break;
+    }
+    return NULL;
+}
+
+// load the macros from a single line without converting any of its gcode
+
+static int prescan_line(Gpx *gpx, char *line)
+{
+    char *param;
+    char *macro = find_macro(line, &param);
+    if(macro) return parse_macro(gpx, macro, param);
+    return SUCCESS;
+}
+
+// a full first pass is only needed to estimate the print time for build
+// progress, otherwise all the conversion pass needs up front are the
+// @pause and @temp tables and the @filament definitions, so only scan the
+// lines that contain macros
+
+static int prescan_macros(Gpx *gpx, Reader *reader)
+{
+    int rval = SUCCESS;
+    int logMessages = gpx->flag.logMessages;
+    char *line;
+
+    // the conversion pass reports any macro errors
+    gpx->flag.logMessages = 0;
+    gpx->flag.loadMacros = 1;
+    gpx->flag.runMacros = 0;
+    gpx->callbackHandler = NULL;
+    gpx->callbackData = NULL;
+
+    while((line = reader_next_line(reader, NULL)) != NULL) {
+        if(strchr(line, '@')) {
+            rval = prescan_line(gpx, line);
+            if(rval < 0) break;
+            rval = SUCCESS;
+        }
+        gpx->lineNumber++;
+    }
+
+    gpx->flag.logMessages = logMessages;
+    return rval;
+}
+
+// TOKENIZED INPUT
+
+static int prescan_entry(void *data, unsigned index, const char *macro, char *param)
+{
+    Gpx *gpx = (Gpx *)data;
+    gpx->lineNumber = index + 1;
+    return parse_macro(gpx, macro, param);
+}
+
+// tokenized input carries the macros the prescan would find in a table of
+// their own, so there is no need to read through the lines at all
+
+static int prescan_tokenized(Gpx *gpx, IrReader *ir)
+{
+    int rval;
+    int logMessages = gpx->flag.logMessages;
+
+    gpx->flag.logMessages = 0;
+    gpx->flag.loadMacros = 1;
+    gpx->flag.runMacros = 0;
+    gpx->callbackHandler = NULL;
+    gpx->callbackData = NULL;
+
+    rval = ir_read_macros(ir, prescan_entry, gpx);
+
+    gpx->flag.logMessages = logMessages;
+    if(rval == ERROR && ir->error) {
+        SHOW( fprintf(gpx->log, "Error: unable to read tokenized input: %s" EOL, strerror(ir->error)) );
+    }
+    return rval;
+}
+
+// convert the lines of tokenized input
+// returns SUCCESS, END_OF_FILE or an error
+
+static int convert_tokenized(Gpx *gpx, IrReader *ir)
+{
+    GcodeLine line;
+    SyntaxWarning *warning = NULL;
+    size_t warnings;
+    int rval;
+
+    for(;;) {
+        STATS( stats_enter(gpx->stats, STATS_TOKENIZE) );
+        rval = ir_next_line(ir, &line, &warning, &warnings);
+        STATS( stats_leave(gpx->stats) );
+        if(rval == END_OF_FILE) return SUCCESS;
+        if(rval != SUCCESS) {
+            SHOW( fprintf(gpx->log, "Error: unable to read tokenized input: %s" EOL, strerror(ir->error)) );
+            return ERROR;
+        }
+        rval = execute_line(gpx, &line, warning, warnings);
+        if(rval != SUCCESS) return rval;
+    }
+}
+
+// OUTPUT
+
+// frames are collected in a large output buffer and written out with a
+// single write call each time it fills, rather than one stdio call per frame
+
+#define OUTPUT_BUFFER_MAX (1024 * 1024)
+
 typedef struct tFile {
     FILE *in;
     FILE *out;
     FILE *out2;
+    char *buffer;       // frames waiting to be written, or NULL to use stdio
+    size_t length;      // bytes waiting in the buffer
+    off_t start;        // offset of the x3g output in out
+    off_t written;      // bytes written to out
+    int preallocated;   // out was extended to the predicted size
 } File;
 
+static int write_output(FILE *stream, char *p, size_t length)
+{
+    int fd = fileno(stream);
+    while(length) {
+        ssize_t bytes = write(fd, p, length);
+        if(bytes < 0) {
+            if(errno == EINTR) continue;
+            return ERROR;
+        }
+        p += bytes;
+        length -= bytes;
+    }
+    return SUCCESS;
+}
+
+static int file_flush(File *file)
+{
+    int rval;
+    if(file->length) {
+        CALL( write_output(file->out, file->buffer, file->length) );
+        if(file->out2) {
+            CALL( write_output(file->out2, file->buffer, file->length) );
+        }
+        file->written += file->length;
+        file->length = 0;
+    }
+    return SUCCESS;
+}
+
+static void file_open_buffer(File *file)
+{
+    file->length = 0;
+    file->written = 0;
+    file->preallocated = 0;
+    // anything already written through stdio has to go first
+    if(fflush(file->out) != 0 || (file->out2 && fflush(file->out2) != 0)) {
+        file->buffer = NULL;
+        return;
+    }
+    file->start = lseek(fileno(file->out), 0, SEEK_CUR);
+    file->buffer = malloc(OUTPUT_BUFFER_MAX);
+}
+
+// reserve the disk space for the output in one go when its size is known
+
+static void file_preallocate(File *file, unsigned long bytes)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+    struct stat st;
+    int fd = fileno(file->out);
+    if(file->buffer && bytes && file->start >= 0
+       && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+       && posix_fallocate(fd, file->start, (off_t)bytes) == 0) {
+        file->preallocated = 1;
+    }
+#endif
+}
+
+static int file_close_buffer(File *file)
+{
+    int rval = SUCCESS;
+    if(file->buffer) {
+        rval = file_flush(file);
+        // trim any of the reservation the output didn't use
+        if(rval == SUCCESS && file->preallocated) {
+            if(ftruncate(fileno(file->out), file->start + file->written) != 0) rval = ERROR;
+        }
+        free(file->buffer);
+        file->buffer = NULL;
+    }
+    return rval;
+}
+
 static int file_handler(Gpx *gpx, File *file, char *buffer, size_t length)
 {
+    int rval;
     if(length) {
+        if(file->buffer) {
+            if(file->length + length > OUTPUT_BUFFER_MAX) {
+                CALL( file_flush(file) );
+            }
+            memcpy(file->buffer + file->length, buffer, length);
+            file->length += length;
+            return SUCCESS;
+        }
         ssize_t bytes = fwrite(buffer, 1, length, file->out);
         if(bytes != length) return ERROR;
         if(file->out2) {
@@ -5886,22 +6287,405 @@ static int file_handler(Gpx *gpx, File *file, char *buffer, size_t length)
     return SUCCESS;
 }
 
+#ifdef HAVE_PTHREAD_H
+
+// PARALLEL TOKENIZER
+
+// Only the tokenizing runs in parallel. Every line can be tokenized on its
+// own, so a mapped input file is cut into chunks at layer changes and the
+// chunks are tokenized by a pool of worker threads. Executing the lines is
+// most of the work of a conversion, but it stays in order on the calling
+// thread: the position, the A/B rounding excess, the tool and the build
+// progress carry from one line to the next, and a layer converted from a
+// guessed starting state would not encode the same steps. So the output is
+// identical to converting the file on a single thread, and -j speeds up a
+// single file by no more than the tokenizer's share of the time (about a
+// seventh of it with -S). Batch mode is where -j pays off.
+
+#define CHUNK_SIZE (256 * 1024)         // target size of a chunk of gcode
+#define CHUNK_LAYER_SEARCH (64 * 1024)  // how far past the target to look for a layer change
+
+#define CHUNK_EMPTY 0
+#define CHUNK_QUEUED 1
+#define CHUNK_BUSY 2
+#define CHUNK_READY 3
+
+typedef struct tChunk {
+    const char *start;  // gcode in the input mapping
+    size_t length;
+    char *text;         // tokenized copy of the gcode
+    size_t textSize;
+    GcodeLine *line;    // the tokenized lines
+    unsigned count;
+    unsigned lineSize;
+    vector *deferred;   // syntax warnings in line order
+    unsigned sequence;  // position of the chunk in the file
+    int state;
+    int failed;         // ran out of memory
+} Chunk;
+
+typedef struct tTokenizer {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;  // signalled when a chunk is queued or on stop
+    pthread_cond_t ready;   // signalled when a chunk has been tokenized
+    pthread_t *thread;
+    int threads;
+    Chunk *chunk;           // ring of chunks in flight
+    unsigned chunks;
+    unsigned claim;         // sequence number of the next chunk to tokenize
+    int stop;
+} Tokenizer;
+
+// does the line start a new layer, either a ;LAYER comment or a G0/G1 with
+// a Z word
+
+static int is_layer_change(const char *p, const char *end)
+{
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    if(end - p >= 6 && strncmp(p, ";LAYER", 6) == 0) return 1;
+    if(end - p >= 2 && (*p == 'G' || *p == 'g') && (p[1] == '0' || p[1] == '1')
+       && (end - p == 2 || !scan_isdigit(p[2]))) {
+        // a Z word before any comment
+        const char *z = scan_memory(p + 2, end - p - 2, "Zz;(");
+        if(z && (*z == 'Z' || *z == 'z')) return 1;
+    }
+    return 0;
+}
+
+// find the end of the chunk that starts at p, preferring to cut at a
+// layer change shortly after the target size, otherwise at a line boundary
+
+static const char *find_chunk_end(const char *p, const char *end)
+{
+    if(end - p <= CHUNK_SIZE) return end;
+    const char *target = p + CHUNK_SIZE;
+    const char *search = end - target > CHUNK_LAYER_SEARCH ? target + CHUNK_LAYER_SEARCH : end;
+    const char *eol = memchr(target, '\n', end - target);
+    const char *first = eol ? eol + 1 : end;
+    while(eol && eol + 1 < search) {
+        const char *line = eol + 1;
+        eol = memchr(line, '\n', end - line);
+        if(is_layer_change(line, eol ? eol : end)) return line;
+    }
+    return first;
+}
+
+static void tokenize_chunk(Chunk *chunk)
+{
+    const char *p = chunk->start;
+    const char *end = p + chunk->length;
+    char *t;
+
+    chunk->count = 0;
+    chunk->deferred->c = 0;
+    chunk->failed = 0;
+
+    // room for the gcode plus a terminator for every line
+    if(chunk->textSize < chunk->length * 2 + 1) {
+        char *text = realloc(chunk->text, chunk->length * 2 + 1);
+        if(text == NULL) {
+            chunk->failed = 1;
+            return;
+        }
+        chunk->text = text;
+        chunk->textSize = chunk->length * 2 + 1;
+    }
+    t = chunk->text;
+
+    while(p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        size_t length = eol ? (size_t)(eol - p) + 1 : (size_t)(end - p);
+        if(chunk->count == chunk->lineSize) {
+            unsigned size = chunk->lineSize ? chunk->lineSize * 2 : 4096;
+            GcodeLine *line = realloc(chunk->line, size * sizeof(GcodeLine));
+            if(line == NULL) {
+                chunk->failed = 1;
+                return;
+            }
+            chunk->line = line;
+            chunk->lineSize = size;
+        }
+        memcpy(t, p, length);
+        t[length] = 0;
+        tokenize_line(NULL, t, chunk->line + chunk->count, chunk->deferred, chunk->count);
+        chunk->count++;
+        t += length + 1;
+        p += length;
+    }
+}
+
+static void *tokenizer_thread(void *arg)
+{
+    Tokenizer *tokenizer = (Tokenizer *)arg;
+
+    pthread_mutex_lock(&tokenizer->lock);
+    while(!tokenizer->stop) {
+        Chunk *chunk = tokenizer->chunk + tokenizer->claim % tokenizer->chunks;
+        if(chunk->state == CHUNK_QUEUED && chunk->sequence == tokenizer->claim) {
+            tokenizer->claim++;
+            chunk->state = CHUNK_BUSY;
+            pthread_mutex_unlock(&tokenizer->lock);
+            tokenize_chunk(chunk);
+            pthread_mutex_lock(&tokenizer->lock);
+            chunk->state = CHUNK_READY;
+            pthread_cond_broadcast(&tokenizer->ready);
+        }
+        else {
+            pthread_cond_wait(&tokenizer->queued, &tokenizer->lock);
+        }
+    }
+    pthread_mutex_unlock(&tokenizer->lock);
+    return NULL;
+}
+
+// queue the next chunk of the input in the given slot, or mark it empty at
+// the end of the input, called with the lock held
+
+static void queue_chunk(Tokenizer *tokenizer, Chunk *chunk, unsigned sequence, const char **p, const char *end)
+{
+    if(*p < end) {
+        const char *chunk_end = find_chunk_end(*p, end);
+        chunk->start = *p;
+        chunk->length = chunk_end - *p;
+        chunk->sequence = sequence;
+        chunk->state = CHUNK_QUEUED;
+        *p = chunk_end;
+    }
+    else {
+        chunk->state = CHUNK_EMPTY;
+    }
+}
+
+static void tokenizer_free(Tokenizer *tokenizer)
+{
+    unsigned i;
+    for(i = 0; i < tokenizer->chunks; i++) {
+        Chunk *chunk = tokenizer->chunk + i;
+        free(chunk->text);
+        free(chunk->line);
+        if(chunk->deferred) vector_free(chunk->deferred);
+    }
+    free(tokenizer->chunk);
+    free(tokenizer->thread);
+    pthread_cond_destroy(&tokenizer->ready);
+    pthread_cond_destroy(&tokenizer->queued);
+    pthread_mutex_destroy(&tokenizer->lock);
+}
+
+static void tokenizer_stop(Tokenizer *tokenizer)
+{
+    int i;
+    pthread_mutex_lock(&tokenizer->lock);
+    tokenizer->stop = 1;
+    pthread_cond_broadcast(&tokenizer->queued);
+    pthread_mutex_unlock(&tokenizer->lock);
+    for(i = 0; i < tokenizer->threads; i++) {
+        pthread_join(tokenizer->thread[i], NULL);
+    }
+    tokenizer_free(tokenizer);
+}
+
+// convert the mapped input with the given number of tokenizer threads
+// returns SUCCESS, END_OF_FILE, an error, or NOT_STARTED if the pool could
+// not be set up and nothing has been converted
+
+#define NOT_STARTED 2
+
+static int convert_in_parallel(Gpx *gpx, Reader *reader, int threads)
+{
+    Tokenizer tokenizer;
+    const char *p = reader->map;
+    const char *end = reader->map + reader->size;
+    unsigned i, next;
+    int rval = SUCCESS;
+
+    memset(&tokenizer, 0, sizeof(tokenizer));
+    pthread_mutex_init(&tokenizer.lock, NULL);
+    pthread_cond_init(&tokenizer.queued, NULL);
+    pthread_cond_init(&tokenizer.ready, NULL);
+    tokenizer.chunks = threads * 2;
+    tokenizer.chunk = calloc(tokenizer.chunks, sizeof(Chunk));
+    tokenizer.thread = calloc(threads, sizeof(pthread_t));
+    if(tokenizer.chunk == NULL || tokenizer.thread == NULL) {
+        tokenizer.chunks = 0;
+        tokenizer_free(&tokenizer);
+        return NOT_STARTED;
+    }
+    for(i = 0; i < tokenizer.chunks; i++) {
+        tokenizer.chunk[i].deferred = vector_create(sizeof(SyntaxWarning), 16, 64);
+        if(tokenizer.chunk[i].deferred == NULL) {
+            tokenizer_free(&tokenizer);
+            return NOT_STARTED;
+        }
+        queue_chunk(&tokenizer, tokenizer.chunk + i, i, &p, end);
+    }
+    for(i = 0; i < threads; i++) {
+        if(pthread_create(tokenizer.thread + i, NULL, tokenizer_thread, &tokenizer) != 0) break;
+        tokenizer.threads++;
+    }
+    if(tokenizer.threads == 0) {
+        tokenizer_free(&tokenizer);
+        return NOT_STARTED;
+    }
+
+    for(next = 0;; next++) {
+        Chunk *chunk = tokenizer.chunk + next % tokenizer.chunks;
+
+        // the lines are tokenized on the worker threads, so only the time
+        // spent waiting for them counts as tokenizing
+        STATS( stats_enter(gpx->stats, STATS_TOKENIZE) );
+        pthread_mutex_lock(&tokenizer.lock);
+        while(chunk->state == CHUNK_QUEUED || chunk->state == CHUNK_BUSY) {
+            pthread_cond_wait(&tokenizer.ready, &tokenizer.lock);
+        }
+        pthread_mutex_unlock(&tokenizer.lock);
+        STATS( stats_leave(gpx->stats) );
+        if(chunk->state == CHUNK_EMPTY) break;
+
+        if(chunk->failed) {
+            SHOW( fputs("Error: out of memory tokenizing input" EOL, gpx->log) );
+            rval = ERROR;
+            break;
+        }
+        // the chunk has been copied out of the mapping, as have those before it
+        reader_release(reader, chunk->start + chunk->length);
+
+        SyntaxWarning *warning = (SyntaxWarning *)chunk->deferred->pb;
+        size_t w = 0, warnings = chunk->deferred->c;
+        for(i = 0; i < chunk->count; i++) {
+            size_t first = w;
+            while(w < warnings && warning[w].index == i) w++;
+            rval = execute_line(gpx, chunk->line + i, warning + first, w - first);
+            if(rval == END_OF_FILE || rval < 0) goto L_STOP;
+        }
+        rval = SUCCESS;
+
+        // reuse the slot for the chunk that follows those in flight
+        pthread_mutex_lock(&tokenizer.lock);
+        queue_chunk(&tokenizer, chunk, next + tokenizer.chunks, &p, end);
+        pthread_cond_broadcast(&tokenizer.queued);
+        pthread_mutex_unlock(&tokenizer.lock);
+    }
+
+L_STOP:
+    tokenizer_stop(&tokenizer);
+    return rval;
+}
+
+#endif // HAVE_PTHREAD_H
+
+// report an input read that failed, returns ERROR
+
+static int read_error(Gpx *gpx, Reader *reader)
+{
+    SHOW( fprintf(gpx->log, "Error: unable to read input: %s" EOL, strerror(reader->error)) );
+    return ERROR;
+}
+
+// copy a stream that can't be rewound to an anonymous temporary file so it
+// can be read more than once, returns NULL if the temporary file could not
+// be created and in is untouched, or sets *rval to ERROR if in was consumed
+// but could not be copied
+
+static FILE *spill_input(Gpx *gpx, FILE *in, int *rval)
+{
+    FILE *spill = tmpfile();
+    size_t bytes;
+
+    if(spill == NULL) return NULL;
+    while((bytes = fread(gpx->buffer.in, 1, BUFFER_MAX, in)) > 0) {
+        if(fwrite(gpx->buffer.in, 1, bytes, spill) != bytes) break;
+    }
+    if(ferror(in) || ferror(spill) || fflush(spill) != 0) {
+        SHOW( fputs("Error: unable to copy input to a temporary file" EOL, gpx->log) );
+        fclose(spill);
+        *rval = ERROR;
+        return NULL;
+    }
+    rewind(spill);
+    return spill;
+}
+
 int gpx_convert(Gpx *gpx, FILE *file_in, FILE *file_out, FILE *file_out2)
 {
-    int i, rval;
+    int i, rval = SUCCESS;
     File file;
+    Reader reader;
+    IrReader ir;
+    int tokenized = 0;
+    FILE *spill = NULL;
     file.in = stdin;
     file.out = stdout;
     file.out2 = NULL;
     int logMessages = gpx->flag.logMessages;
 
     if(file_in && file_in != stdin) {
-        // Multi-pass
         file.in = file_in;
+    }
+    else {
+        // stdin can't be rewound, so spill it to a temporary file to get
+        // macro support and build progress
+        spill = spill_input(gpx, stdin, &rval);
+        if(rval != SUCCESS) return rval;
+        if(spill) file.in = spill;
+    }
+
+    if(file_out) {
+        file.out = file_out;
+    }
+
+    file.out2 = file_out2;
+    file_open_buffer(&file);
+
+    // runs of moves are converted together, the batch is only used when
+    // converting a file so callers of gpx_convert_line see each move
+    // emitted as it's converted
+    gpx->moves = calloc(1, sizeof(MoveBatch));
+
+    // regular files are memory mapped, stdin and pipes are read with stdio,
+    // tokenized input is read a record at a time
+    if(file.in != stdin && ir_detect(file.in)) {
+        tokenized = 1;
+        if(ir_reader_open(&ir, file.in) != SUCCESS) {
+            SHOW( fprintf(gpx->log, "Error: unable to read tokenized input: %s" EOL, strerror(ir.error)) );
+            rval = ERROR;
+            goto L_ABORT;
+        }
+    }
+    else {
+        reader_open(&reader, file.in);
+    }
+
+    if(file.in != stdin) {
+        // Multi-pass
         i = 0;
         gpx->flag.runMacros = 0;
         gpx->callbackHandler = NULL;
         gpx->callbackData = NULL;
+        if(!gpx->flag.buildProgress) {
+            if(tokenized) {
+                rval = prescan_tokenized(gpx, &ir);
+                if(rval != SUCCESS) goto L_ABORT;
+                rval = ir_rewind(&ir);
+                if(rval != SUCCESS) goto L_ABORT;
+            }
+            else {
+                rval = prescan_macros(gpx, &reader);
+                if(rval != SUCCESS) goto L_ABORT;
+                reader_rewind(&reader);
+            }
+            gpx_initialize(gpx, 0);
+            gpx->flag.loadMacros = 0;
+            // go straight to the conversion pass unless a macro enabled
+            // build progress, which needs the estimated print time
+            if(!gpx->flag.buildProgress) {
+                i = 1;
+                gpx->flag.runMacros = 1;
+                gpx->flag.pausePending = (gpx->commandAtLength > 0);
+                gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))file_handler;
+                gpx->callbackData = &file;
+            }
+        }
     }
     else {
         // Single-pass
@@ -5910,47 +6694,49 @@ int gpx_convert(Gpx *gpx, FILE *file_in, FILE *file_out, FILE *file_out2)
         gpx->callbackData = &file;
     }
 
-    if(file_out) {
-        file.out = file_out;
-    }
-
-    file.out2 = file_out2;
-
     for(;;) {
-        int overflow = 0;
+        char *line;
 
 	if(gpx->preamble)
 	     start_build(gpx, gpx->preamble);
 
-        while(fgets(gpx->buffer.in, BUFFER_MAX, file.in) != NULL) {
-            // detect input buffer overflow and ignore overflow input
-            if(overflow) {
-                if(strlen(gpx->buffer.in) != BUFFER_MAX - 1) {
-                    overflow = 0;
-                }
-                continue;
+        rval = NOT_STARTED;
+        if(tokenized) {
+            rval = convert_tokenized(gpx, &ir);
+            if(rval < 0) goto L_ABORT;
+        }
+#ifdef HAVE_PTHREAD_H
+        else if(gpx->jobs > 1 && reader.map) {
+            rval = convert_in_parallel(gpx, &reader, gpx->jobs);
+            if(rval < 0) goto L_ABORT;
+        }
+#endif
+        if(rval == NOT_STARTED) {
+            while((line = reader_next_line(&reader, NULL)) != NULL) {
+                rval = gpx_convert_line(gpx, line);
+                // normal exit
+                if(rval == END_OF_FILE) break;
+                // error
+                if(rval < 0) goto L_ABORT;
             }
-            if(strlen(gpx->buffer.in) == BUFFER_MAX - 1) {
-                overflow = 1;
-                // ignore run-on comments, this is actually a little too permissive
-                // since technically we should ignore ';' contained within a
-                // parenthetical comment
-                if(!strchr(gpx->buffer.in, ';'))
-                    gcodeResult(gpx, "(line %u) Buffer overflow: input exceeds %u character limit, remaining characters in line will be ignored" EOL, gpx->lineNumber, BUFFER_MAX);
+            if(reader.error) {
+                rval = read_error(gpx, &reader);
+                goto L_ABORT;
             }
-
-            rval = gpx_convert_line(gpx, gpx->buffer.in);
-            // normal exit
-            if(rval == END_OF_FILE) break;
-            // error
-            if(rval < 0) return rval;
         }
+        if(gpx->moves) {
+            rval = flush_moves(gpx);
+            if(rval != SUCCESS) goto L_ABORT;
+        }
+        stop_moving(gpx);
+        rval = SUCCESS;
 
         if(program_is_running()) {
             end_program();
 	    if(!gpx->noend) {
-		 CALL( set_build_progress(gpx, 100) );
-		 CALL( end_build(gpx) );
+		 if((rval = set_build_progress(gpx, 100)) == SUCCESS)
+		      rval = end_build(gpx);
+		 if(rval != SUCCESS) goto L_ABORT;
 	    }
         }
 
@@ -5969,7 +6755,13 @@ int gpx_convert(Gpx *gpx, FILE *file_in, FILE *file_out, FILE *file_out2)
         if(++i > 1) break;
 
         // rewind for second pass
-        fseek(file.in, 0L, SEEK_SET);
+        if(tokenized) {
+            rval = ir_rewind(&ir);
+            if(rval != SUCCESS) goto L_ABORT;
+        }
+        else {
+            reader_rewind(&reader);
+        }
         gpx_initialize(gpx, 0);
         gpx->flag.loadMacros = 0;
         gpx->flag.runMacros = 1;
@@ -5977,9 +6769,93 @@ int gpx_convert(Gpx *gpx, FILE *file_in, FILE *file_out, FILE *file_out2)
         //gpx->flag.logMessages = 0;
         gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))file_handler;
         gpx->callbackData = &file;
+        // the first pass predicts the size of the output
+        file_preallocate(&file, gpx->total.bytes);
     }
     gpx->flag.logMessages = logMessages;;
-    return SUCCESS;
+
+L_ABORT:
+    if(file_close_buffer(&file) != SUCCESS && rval == SUCCESS) {
+        SHOW( fputs("Error: unable to write x3g output" EOL, gpx->log) );
+        rval = ERROR;
+    }
+    if(tokenized) {
+        ir_reader_close(&ir);
+    }
+    else {
+        reader_close(&reader);
+    }
+    if(spill) fclose(spill);
+    free(gpx->moves);
+    gpx->moves = NULL;
+    return rval;
+}
+
+// tokenize the gcode read from file_in and write it to file_out, so it
+// can be converted for any number of machines without tokenizing it again
+
+int gpx_tokenize(Gpx *gpx, FILE *file_in, FILE *file_out)
+{
+    int rval = SUCCESS;
+    Reader reader;
+    IrWriter writer;
+    GcodeLine line;
+    vector *deferred;
+    char *copy = NULL;
+    size_t copySize = 0;
+    size_t length;
+    char *gcode_line;
+
+    deferred = vector_create(sizeof(SyntaxWarning), 16, 64);
+    if(deferred == NULL || ir_writer_open(&writer, file_out) != SUCCESS) {
+        SHOW( fputs("Error: not enough memory to tokenize input" EOL, gpx->log) );
+        if(deferred) vector_free(deferred);
+        return ERROR;
+    }
+    reader_open(&reader, file_in);
+
+    while((gcode_line = reader_next_line(&reader, &length)) != NULL) {
+        char *macro = NULL;
+        char *param = NULL;
+        // find the macro the prescan would on a copy, as tokenizing
+        // modifies the line
+        if(strchr(gcode_line, '@')) {
+            if(length + 1 > copySize) {
+                char *p = realloc(copy, length + 1);
+                if(p == NULL) {
+                    SHOW( fputs("Error: not enough memory to tokenize input" EOL, gpx->log) );
+                    rval = ERROR;
+                    break;
+                }
+                copy = p;
+                copySize = length + 1;
+            }
+            memcpy(copy, gcode_line, length + 1);
+            macro = find_macro(copy, &param);
+        }
+        deferred->c = 0;
+        STATS( stats_enter(gpx->stats, STATS_TOKENIZE) );
+        tokenize_line(NULL, gcode_line, &line, deferred, 0);
+        STATS( stats_leave(gpx->stats) );
+        if(ir_write_line(&writer, &line, (SyntaxWarning *)deferred->pb, deferred->c, macro, param) != SUCCESS) {
+            rval = ERROR;
+            break;
+        }
+    }
+    if(reader.error) {
+        rval = read_error(gpx, &reader);
+    }
+    if(ir_writer_close(&writer) != SUCCESS && rval == SUCCESS) {
+        SHOW( fprintf(gpx->log, "Error: unable to write tokenized output: %s" EOL, strerror(writer.error)) );
+        rval = ERROR;
+    }
+    else if(rval == ERROR && writer.error) {
+        SHOW( fprintf(gpx->log, "Error: unable to write tokenized output: %s" EOL, strerror(writer.error)) );
+    }
+    reader_close(&reader);
+    vector_free(deferred);
+    free(copy);
+    return rval;
 }
 
 char *sd_status[] = {
@@ -6363,26 +7239,203 @@ size_t readport(int port, char *buffer, size_t bytes)
     tv.tv_sec = 1;
     tv.tv_usec = 0;
 
-    // wait up to one second for the first byte
-    rval = select(port + 1, &fds, NULL, NULL, &tv);
+    // wait up to one second for the first byte, a signal such as SIGUSR1
+    // asking for the link statistics interrupts select, which isn't an error
+    do {
+        rval = select(port + 1, &fds, NULL, NULL, &tv);
+    } while(rval < 0 && errno == EINTR);
     if(rval <= 0)
         return rval;
 
     // wait up to 1/10th intercharacter (from VTIME)
-    return read(port, buffer, bytes);
+    do {
+        rval = read(port, buffer, bytes);
+    } while(rval < 0 && errno == EINTR);
+    return rval;
 }
 #endif
 
+#define RECEIVED(i) sio->receive.data[(sio->receive.tail + (i)) & (SIO_RECEIVE_MAX - 1)]
+
+// read what the port has into the receive ring, waiting for at least
+// wanted bytes, returns the bytes read, 0 on a timeout or -1
+
+static long receive(Gpx *gpx, Sio *sio, size_t wanted)
+{
+    size_t space = SIO_RECEIVE_MAX - (sio->receive.head - sio->receive.tail);
+    size_t offset = sio->receive.head & (SIO_RECEIVE_MAX - 1);
+    size_t bytes = wanted;
+#ifdef FIONREAD
+    // asking for more than has arrived would wait out the intercharacter
+    // timeout, so only ask for more when it's already there
+    int available = 0;
+    if(ioctl(sio->port, FIONREAD, &available) == 0 && (size_t)available > bytes) {
+        bytes = (size_t)available;
+    }
+#endif
+    if(bytes > space) bytes = space;
+    if(bytes > SIO_RECEIVE_MAX - offset) bytes = SIO_RECEIVE_MAX - offset;
+    long n = (long)readport(sio->port, (char *)sio->receive.data + offset, bytes);
+    if(n > 0) {
+        VERBOSESIO( hexdump(gpx->log, (char *)sio->receive.data + offset, n) );
+        if(gpx->trace) trace_record(gpx->trace, TRACE_RECEIVED, sio->receive.data + offset, n);
+        sio->receive.head += n;
+        sio->bytes_in += n;
+    }
+    return n;
+}
+
+// parse the next response packet into gpx->buffer.in, reading from the port
+// only when the bytes already received don't hold a whole packet. A start
+// byte whose packet fails its crc may have been noise, so parsing resumes
+// at the next start byte received rather than dropping what follows it.
+
+static int read_response(Gpx *gpx, Sio *sio)
+{
+    int crc_error = 0;
+    for(;;) {
+        size_t available = sio->receive.head - sio->receive.tail;
+        // loop until we get a valid start byte
+        while(available && RECEIVED(0) != 0xD5) {
+            sio->receive.tail++;
+            available--;
+        }
+        size_t wanted = 2;
+        if(available >= 2) {
+            // a repeated start byte starts the packet again
+            if(RECEIVED(1) == 0xD5) {
+                sio->receive.tail++;
+                continue;
+            }
+            wanted = RECEIVED(1) + 3;
+            if(available >= wanted) {
+                size_t i;
+                for(i = 0; i < wanted; i++) {
+                    gpx->buffer.in[i] = (char)RECEIVED(i);
+                }
+                size_t payload_length = wanted - 3;
+                if((unsigned char)gpx->buffer.in[2 + payload_length] == crc8(gpx->buffer.in + 2, payload_length)) {
+                    sio->receive.tail += wanted;
+                    return SUCCESS;
+                }
+                crc_error = 1;
+                sio->receive.tail++;
+                continue;
+            }
+        }
+        // the rest of a corrupt packet isn't coming, the packet is resent
+        if(crc_error && available == 0) return ESIOCRC;
+        long bytes = receive(gpx, sio, wanted - available);
+        if(bytes == -1) return EOSERROR;
+        if(bytes == 0) {
+            VERBOSESIO( fprintf(gpx->log, EOL "want %u bytes = %u" EOL, (unsigned)wanted, (unsigned)available) );
+            if(crc_error) return ESIOCRC;
+            return available ? ESIOREAD : ESIOTIMEOUT;
+        }
+    }
+}
+
+// 02 - Get available buffer size
+
+static int query_buffer_size(Gpx *gpx, Sio *sio)
+{
+    char query[] = {
+        0xD5,   // start byte
+        1,      // length
+        2,      // query command
+        0       // crc
+    };
+    query[3] = crc8(query + 2, 1);
+    return port_handler(gpx, sio, query, 4);
+}
+
+#define QUEUE_WAIT_MIN 0.001    // the shortest wait for the firmware to free buffer space, in seconds
+#define QUEUE_WAIT_MAX 0.1      // and the longest, as long as the 0x82 retries ever waited
+#define QUEUE_REFILL 128        // the bytes to let the firmware free before asking again, room for a few moves
+
+// wait until the firmware's command buffer has room for payload bytes.
+// The space left is only queried when the actions sent since the last
+// query might have filled it, after waiting long enough for the firmware
+// to free room for a few more at the rate it has been freeing space. If
+// it frees nothing, say while it heats up, the wait doubles each time.
+
+static int wait_for_buffer_space(Gpx *gpx, Sio *sio, size_t payload)
+{
+    int rval;
+    double idle = 0.0;
+    long want = payload > QUEUE_REFILL ? (long)payload : QUEUE_REFILL;
+    double start = link_clock();
+    while(sio->queue.space < (long)payload) {
+        if(sio->queue.space >= 0) {
+            double wait = idle;
+            if(sio->queue.rate > 0.0) {
+                double refill = (want - sio->queue.space) / sio->queue.rate - (link_clock() - sio->queue.queried);
+                if(refill > wait) wait = refill;
+            }
+            if(wait > QUEUE_WAIT_MAX) wait = QUEUE_WAIT_MAX;
+            if(wait > 0.0) {
+                VERBOSESIO( fprintf(gpx->log, "buffer space %ld, waiting %0.3f seconds" EOL, sio->queue.space, wait) );
+                short_sleep((long)(wait * 1000000000.0));
+            }
+        }
+        CALL( query_buffer_size(gpx, sio) );
+        double now = link_clock();
+        long space = (long)sio->response.bufferSize;
+        // the model took off every byte sent since the last query, so the
+        // difference is what the firmware freed since then
+        if(sio->queue.space >= 0 && now > sio->queue.queried) {
+            double rate = (space - sio->queue.space) / (now - sio->queue.queried);
+            if(rate > 0.0) {
+                sio->queue.rate = sio->queue.rate > 0.0 ? (3.0 * sio->queue.rate + rate) / 4.0 : rate;
+                idle = 0.0;
+            }
+            else {
+                idle = idle > 0.0 ? 2.0 * idle : QUEUE_WAIT_MIN;
+            }
+        }
+        sio->queue.space = space;
+        sio->queue.queried = now;
+        sio->stats.overflowWait += now - start;
+        start = now;
+    }
+    return SUCCESS;
+}
+
+// wait before sending a packet again, briefly after the first failure and
+// four times longer after each one after that, up to 2 seconds
+
+static void retry_sleep(Sio *sio, int retry_count)
+{
+    long ms = 10L << (2 * retry_count);
+    double start = link_clock();
+    if(ms >= 2000) {
+        long_sleep(2);
+    }
+    else {
+        short_sleep(ms * 1000000L);
+    }
+    sio->stats.retryWait += link_clock() - start;
+}
+
 int port_handler(Gpx *gpx, Sio *sio, char *buffer, size_t length)
 {
     int rval = SUCCESS;
     if(length) {
         size_t bytes;
         int retry_count = 0;
+        unsigned command = (unsigned char)buffer[COMMAND_OFFSET];
+        // the firmware queues the payload of an action, without the start
+        // byte, length and crc
+        size_t payload = length - 3;
+        int paced = (command & 0x80) && sio->flag.retryBufferOverflow && !sio->flag.shortRetryBufferOverflowOnly;
         do {
+            if(paced) {
+                CALL( wait_for_buffer_space(gpx, sio, payload) );
+            }
             VERBOSESIO( fprintf(gpx->log, "port_handler write: %lu" EOL, (unsigned long)length) );
             VERBOSESIO( hexdump(gpx->log, buffer, length) );
             // send the packet
+            double sent = link_clock();
             if((bytes = write(sio->port, buffer, length)) == -1) {
                 return EOSERROR;
             }
@@ -6390,55 +7443,27 @@ int port_handler(Gpx *gpx, Sio *sio, char *buffer, size_t length)
                 return ESIOWRITE;
             }
             sio->bytes_out += length;
+            sio->stats.packets++;
+            if(gpx->trace) trace_record(gpx->trace, TRACE_SENT, buffer, length);
 
             VERBOSESIO( fprintf(gpx->log, EOL "port_handler read:" EOL) );
-            for(;;) {
-                // read start byte
-                if((bytes = readport(sio->port, gpx->buffer.in, 1)) == -1) {
-                    return EOSERROR;
-                }
-                else if(bytes != 1) {
-                    VERBOSESIO( fprintf(gpx->log, EOL "want 1 bytes = %u" EOL, (unsigned)bytes) );
-                    if(bytes == 0)
-                        return ESIOTIMEOUT;
-                    return ESIOREAD;
-                }
-                VERBOSESIO( hexdump(gpx->log, gpx->buffer.in, bytes) );
-                // loop until we get a valid start byte
-                if((unsigned char)gpx->buffer.in[0] == 0xD5) break;
-            }
-            size_t payload_length = 0;
-            do {
-                // read length
-                if((bytes = readport(sio->port, gpx->buffer.in + 1, 1)) == -1) {
-                    return EOSERROR;
-                }
-                else if(bytes != 1) {
-                    VERBOSESIO( fprintf(gpx->log, EOL "want 1 bytes = %u" EOL, (unsigned)bytes) );
-                    return ESIOREAD;
-                }
-                VERBOSESIO( hexdump(gpx->log, gpx->buffer.in, bytes) );
-                payload_length = gpx->buffer.in[1];
-            } while ((unsigned char)gpx->buffer.in[1] == 0xd5);
-            // recieve payload
-            if((bytes = readport(sio->port, gpx->buffer.in + 2, payload_length + 1)) == -1) {
-                return EOSERROR;
-            }
-            VERBOSESIO( hexdump(gpx->log, gpx->buffer.in + 2, bytes) );
+            rval = read_response(gpx, sio);
             VERBOSESIO( fprintf(gpx->log, EOL) );
-            if(bytes != payload_length + 1) {
-                VERBOSESIO( fprintf(gpx->log, EOL "want %u bytes = %u" EOL, (unsigned)payload_length + 1, (unsigned)bytes) );
-                return ESIOREAD;
-            }
-            // check CRC
-            unsigned crc = (unsigned char)gpx->buffer.in[2 + payload_length];
-            if(crc != calculate_crc((unsigned char*)gpx->buffer.in + 2, payload_length)) {
+            if(rval == ESIOCRC) {
+                sio->stats.crcErrors++;
                 fprintf(gpx->log, "(retry %u) Input CRC mismatch: packet discarded" EOL, retry_count);
-                rval = ESIOCRC;
                 goto L_RETRY;
             }
+            if(rval != SUCCESS) {
+                if(rval == ESIOTIMEOUT) sio->stats.timeouts++;
+                return rval;
+            }
             // check response code
             rval = (int)(unsigned char)gpx->buffer.in[2];
+            link_stats_response(&sio->stats, rval, link_clock() - sent);
+            if(link_stats_requested()) {
+                link_stats_report(&sio->stats, sio->bytes_out, sio->bytes_in, gpx->log);
+            }
             switch(rval) {
                     // 0x80 - Generic Packet error, packet discarded (retry)
                 case 0x80:
@@ -6446,13 +7471,14 @@ int port_handler(Gpx *gpx, Sio *sio, char *buffer, size_t length)
                     break;
 
                     // 0x81 - Success
-                case 0x81: {
-                    unsigned command = (unsigned)buffer[COMMAND_OFFSET];
+                case 0x81:
                     if((command & 0x80) == 0) {
                         read_query_response(gpx, sio, command, buffer);
                     }
+                    else if(sio->queue.space >= 0) {
+                        sio->queue.space -= sio->queue.space > (long)payload ? (long)payload : sio->queue.space;
+                    }
                     return SUCCESS;
-                }
 
                     // 0x82 - Action buffer overflow, entire packet discarded
                 case 0x82:
@@ -6460,45 +7486,35 @@ int port_handler(Gpx *gpx, Sio *sio, char *buffer, size_t length)
                     if(!sio->flag.retryBufferOverflow)
                         goto L_ABORT;
 
-                    // first, harass the bot in a tight loop in case we're
-                    // doing lots of short movements. On the one hand, we're
-                    // making it worse by making the bot take time on serial
-                    // i/o. On the other hand we want to make sure we send the
-                    // next command into the buffer as soon as possible so we
-                    // don't get a zit because of a sleep on our side
+                    // the firmware had less room than the model allowed for,
+                    // so it has to be queried again
+                    sio->queue.space = -1;
+                    if(paced) continue;
+
+                    // harass the bot in a tight loop in case we're doing
+                    // lots of short movements, so the command goes into the
+                    // buffer as soon as there is room for it
                     //
                     // twenty times, check for room every 10ms
                     int i;
+                    double waited = link_clock();
                     for(i = 0; i < 20; i++) {
                         short_sleep(NS_10MS);
 
                         // query buffer size
-                        CALL( port_handler(gpx, sio, buffer_size_query, 4) );
+                        CALL( query_buffer_size(gpx, sio) );
 
                         // if we now have room, let's go again
-                        if (sio->response.bufferSize >= length)
-                            goto L_REPEATSEND;
-                    }
-
-                    if(sio->flag.shortRetryBufferOverflowOnly) {
-                        rval = 0x82; // recursion cleared it, put it back
-                        goto L_ABORT;
+                        if (sio->response.bufferSize >= payload) {
+                            VERBOSE( fprintf(gpx->log, "(%u) Query buffer size: %u\n", i, sio->response.bufferSize) );
+                            break;
+                        }
                     }
+                    sio->stats.overflowWait += link_clock() - waited;
+                    if(i < 20) continue;
 
-                    // now, wait until we've got room for the command, checking
-                    // every 1/10 second
-                    do {
-                        short_sleep(NS_100MS);
-                        // query buffer size
-                        buffer_size_query[3] = calculate_crc((unsigned char *)buffer_size_query + 2, 1);
-                        CALL( port_handler(gpx, sio, buffer_size_query, 4) );
-                        i++;
-                        // loop until buffer has space for the next command
-                    } while(sio->response.bufferSize < length);
-L_REPEATSEND:
-                    VERBOSE( fprintf(gpx->log, "(%u) Query buffer size: %u\n", i, sio->response.bufferSize) );
-                    // we just did all the waiting we needed, skip the 2 second timeout
-                    continue;
+                    rval = 0x82; // recursion cleared it, put it back
+                    goto L_ABORT;
 
                     // 0x83 - CRC mismatch, packet discarded. (retry)
                 case 0x83:
@@ -6549,8 +7565,7 @@ L_REPEATSEND:
                     break;
             }
 L_RETRY:
-            // wait for 2 seconds
-            long_sleep(2);
+            retry_sleep(sio, retry_count);
         } while(++retry_count < 5);
     }
 
@@ -6558,17 +7573,151 @@ L_ABORT:
     return rval;
 }
 
+#ifdef HAVE_PTHREAD_H
+
+// SENDER THREAD
+
+// The frames of the pass sent to the printer are pushed onto a ring and
+// sent from a thread of their own, so converting the next lines overlaps
+// with waiting for the printer to take the frames before them
+
+typedef struct tSender {
+    Gpx gpx;            // the sender's own copy, port_handler reads the responses into its buffer
+    Sio *sio;
+    FrameRing ring;
+    pthread_t thread;
+} Sender;
+
+static void *sender_thread(void *arg)
+{
+    Sender *sender = (Sender *)arg;
+    char *frame;
+    size_t length;
+    while((frame = ring_peek(&sender->ring, &length)) != NULL) {
+        int rval = port_handler(&sender->gpx, sender->sio, frame, length);
+        if(rval != SUCCESS) {
+            // drop the frames queued behind the one that failed
+            ring_abort(&sender->ring, rval);
+            break;
+        }
+        ring_release(&sender->ring);
+    }
+    return NULL;
+}
+
+// queue an action to be sent, a query is sent as soon as the frames before
+// it have been, as its response is read into gpx
+
+static int send_frame(Gpx *gpx, Sender *sender, char *buffer, size_t length)
+{
+    if(length == 0) return SUCCESS;
+    if((buffer[COMMAND_OFFSET] & 0x80) == 0) {
+        int rval = ring_drain(&sender->ring);
+        if(rval != SUCCESS) return rval;
+        return port_handler(gpx, sender->sio, buffer, length);
+    }
+    return ring_push(&sender->ring, buffer, length);
+}
+
+// returns NULL if the frames can't be sent from a thread of their own
+
+static Sender *start_sender(Gpx *gpx, Sio *sio)
+{
+    Sender *sender = malloc(sizeof(Sender));
+    if(sender == NULL) return NULL;
+    gpx_clone(&sender->gpx, gpx);
+    sender->sio = sio;
+    if(ring_initialize(&sender->ring) != 0) {
+        free(sender);
+        return NULL;
+    }
+#ifdef SIGUSR1
+    // the thread is started with SIGUSR1 blocked, so the signal asking for
+    // the link statistics is taken by the main thread and doesn't interrupt
+    // the sender waiting on the port
+    sigset_t block, saved;
+    sigemptyset(&block);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &saved);
+#endif
+    int rval = pthread_create(&sender->thread, NULL, sender_thread, sender);
+#ifdef SIGUSR1
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+#endif
+    if(rval != 0) {
+        ring_destroy(&sender->ring);
+        free(sender);
+        return NULL;
+    }
+    return sender;
+}
+
+// wait for the sender to send the frames left on the ring, or if rval
+// isn't SUCCESS drop them, returns the error that stopped the sender
+
+static int stop_sender(Sender *sender, int rval)
+{
+    if(rval == SUCCESS) {
+        ring_close(&sender->ring);
+    }
+    else {
+        ring_abort(&sender->ring, rval);
+    }
+    pthread_join(sender->thread, NULL);
+    rval = sender->ring.error;
+    ring_destroy(&sender->ring);
+    free(sender);
+    return rval;
+}
+
+#else
+
+typedef struct tSender Sender;
+
+#endif // HAVE_PTHREAD_H
+
+// send the frames converted from now on to the printer
+
+static void connect_port(Gpx *gpx, Sio *sio, Sender *sender)
+{
+#ifdef HAVE_PTHREAD_H
+    if(sender) {
+        // the sender was cloned before the passes started, when a first
+        // pass has logging turned off, no frame has been pushed yet so
+        // the sender thread isn't reading them
+        sender->gpx.flag.logMessages = gpx->flag.logMessages;
+        sender->gpx.flag.verboseMode = gpx->flag.verboseMode;
+        sender->gpx.flag.verboseSioMode = gpx->flag.verboseSioMode;
+        gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))send_frame;
+        gpx->callbackData = sender;
+    }
+    else
+#endif
+    {
+        gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))port_handler;
+        gpx->callbackData = sio;
+    }
+    gpx->sio = sio;
+    gpx->flag.sioConnected = 1;
+}
+
 int gpx_convert_and_send(Gpx *gpx, FILE *file_in, int sio_port,
 			 int item_code, ...)
 {
-    int i, rval;
+    int i, rval = SUCCESS;
     Sio sio;
+    Reader reader;
+    Sender *sender = NULL;
     sio.in = stdin;
     sio.port = -1;
     sio.bytes_out = 0;
     sio.bytes_in = 0;
     sio.flag.retryBufferOverflow = 1;
     sio.flag.shortRetryBufferOverflowOnly = 0;
+    sio.queue.space = -1;
+    sio.queue.rate = 0.0;
+    sio.receive.head = sio.receive.tail = 0;
+    link_stats_initialize(&sio.stats);
     int logMessages = gpx->flag.logMessages;
 
     if(file_in && file_in != stdin) {
@@ -6584,10 +7733,7 @@ int gpx_convert_and_send(Gpx *gpx, FILE *file_in, int sio_port,
         // Single-pass
         i = 1;
         gpx->flag.framingEnabled = 1;
-        gpx->flag.sioConnected = 1;
-        gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))port_handler;;
-        gpx->callbackData = &sio;
-        gpx->sio = &sio;
+        connect_port(gpx, &sio, NULL);
     }
 
     if(item_code) {
@@ -6605,34 +7751,63 @@ int gpx_convert_and_send(Gpx *gpx, FILE *file_in, int sio_port,
         sio.port = sio_port;
     }
 
-    for(;;) {
-        int overflow = 0;
+#ifdef HAVE_PTHREAD_H
+    sender = start_sender(gpx, &sio);
+    if(i == 1) connect_port(gpx, &sio, sender);
+#endif
 
-        while(fgets(gpx->buffer.in, BUFFER_MAX, sio.in) != NULL) {
-            // detect input buffer overflow and ignore overflow input
-            if(overflow) {
-                if(strlen(gpx->buffer.in) != BUFFER_MAX - 1) {
-                    overflow = 0;
-                }
-                continue;
-            }
-            if(strlen(gpx->buffer.in) == BUFFER_MAX - 1) {
-                overflow = 1;
-                gcodeResult(gpx, "(line %u) Buffer overflow: input exceeds %u character limit, remaining characters in line will be ignored" EOL, gpx->lineNumber, BUFFER_MAX);
-            }
+    // moves read from a file can be held back to be merged before they
+    // are sent, moves typed at stdin are sent as soon as they are read
+    if(sio.in != stdin && (gpx->coalesce.tolerance > 0.0 || gpx->coalesce.length > 0.0 || gpx->coalesce.time > 0.0)) {
+        gpx->moves = calloc(1, sizeof(MoveBatch));
+    }
+
+    reader_open(&reader, sio.in);
+
+    // without build progress the first pass only needs the macros
+    if(i == 0 && !gpx->flag.buildProgress) {
+        rval = prescan_macros(gpx, &reader);
+        if(rval != SUCCESS) goto L_ABORT;
+        reader_rewind(&reader);
+        gpx_initialize(gpx, 0);
+        gpx->flag.loadMacros = 0;
+        if(!gpx->flag.buildProgress) {
+            i = 1;
+            gpx->flag.runMacros = 1;
+            gpx->flag.pausePending = (gpx->commandAtLength > 0);
+            gpx->flag.logMessages = 1;
+            gpx->flag.framingEnabled = 1;
+            connect_port(gpx, &sio, sender);
+        }
+    }
+
+    for(;;) {
+        char *line;
 
-            rval = gpx_convert_line(gpx, gpx->buffer.in);
+        while((line = reader_next_line(&reader, NULL)) != NULL) {
+            rval = gpx_convert_line(gpx, line);
             // normal exit
             if(rval > 0) break;
             // error
-            if(rval < 0) return rval;
+            if(rval < 0) goto L_ABORT;
+        }
+        if(reader.error) {
+            rval = read_error(gpx, &reader);
+            goto L_ABORT;
         }
+        if(gpx->moves) {
+            rval = flush_moves(gpx);
+            if(rval != SUCCESS) goto L_ABORT;
+        }
+        stop_moving(gpx);
+        rval = SUCCESS;
 
         if(program_is_running()) {
             end_program();
 	    if(!gpx->noend) {
-		 CALL( set_build_progress(gpx, 100) );
-		 CALL( end_build(gpx) );
+		 if((rval = set_build_progress(gpx, 100)) == SUCCESS)
+		      rval = end_build(gpx);
+		 if(rval != SUCCESS) goto L_ABORT;
 	    }
         }
 
@@ -6651,22 +7826,35 @@ int gpx_convert_and_send(Gpx *gpx, FILE *file_in, int sio_port,
         if(++i > 1) break;
 
         // rewind for second pass
-        fseek(sio.in, 0L, SEEK_SET);
+        reader_rewind(&reader);
         gpx_initialize(gpx, 0);
 
         gpx->flag.logMessages = 1;
         gpx->flag.framingEnabled = 1;
-        gpx->callbackHandler = (int (*)(Gpx*, void*, char*, size_t))port_handler;;
-        gpx->callbackData = &sio;
-        gpx->sio = &sio;
-        gpx->flag.sioConnected = 1;
+        connect_port(gpx, &sio, sender);
     }
     gpx->flag.logMessages = logMessages;;
-    return SUCCESS;
+
+L_ABORT:
+#ifdef HAVE_PTHREAD_H
+    if(sender) {
+        // on an error the frames still queued are dropped, not sent
+        int error = stop_sender(sender, rval);
+        if(rval == SUCCESS) rval = error;
+    }
+#endif
+    if(gpx->flag.verboseMode && sio.stats.packets) {
+        link_stats_report(&sio.stats, sio.bytes_out, sio.bytes_in, gpx->log);
+    }
+    reader_close(&reader);
+    free(gpx->moves);
+    gpx->moves = NULL;
+    return rval;
 }
 
 void gpx_end_convert(Gpx *gpx)
 {
+    stop_moving(gpx);
     if(gpx->flag.verboseMode && gpx->flag.logMessages) {
         long seconds = round(gpx->accumulated.time);
         long minutes = seconds / 60;
@@ -6679,6 +7867,10 @@ void gpx_end_convert(Gpx *gpx)
         if(minutes) fprintf(gpx->log, "%lu minutes ", minutes);
         fprintf(gpx->log, "%lu seconds" EOL, seconds);
         fprintf(gpx->log, "X3G output filesize: %lu bytes" EOL, gpx->accumulated.bytes);
+        if(gpx->accumulated.coalesced) fprintf(gpx->log, "Moves coalesced: %lu" EOL, gpx->accumulated.coalesced);
+    }
+    if(gpx->stats) {
+        stats_report(gpx->stats, gpx->log);
     }
 }
 
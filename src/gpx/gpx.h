@@ -90,7 +90,6 @@ typedef long speed_t;
 #define HBP_MAX 130
 #define HBP_TIME 6
 #define AMBIENT_TEMP 24
-#define ACCELERATION_TIME 1.15
 
 #define MAX_TIMEOUT 0xFFFF
 
@@ -195,6 +194,39 @@ typedef long speed_t;
         char *arg;
     } Command, *PtrCommand;
 
+    // a tokenized line of gcode
+
+    typedef struct tGcodeLine {
+        Command command;        // the words, comment and argument on the line
+        unsigned number;        // the line number word
+        unsigned hasNumber;     // the line starts with a line number word
+        char *macro;            // the ;@ or (@ macro name or NULL
+        char *macroParam;       // the rest of the macro
+    } GcodeLine;
+
+    // syntax warnings found while tokenizing a line
+
+#define SYNTAX_MISSING_DIGITS 1
+#define SYNTAX_COMMAND_WORD 2
+#define SYNTAX_NESTED_COMMENT 3
+#define SYNTAX_UNCLOSED_COMMENT 4
+#define SYNTAX_UNRECOGNISED 5
+
+    typedef struct tSyntaxWarning {
+        unsigned index;     // line the warning belongs to
+        int code;           // SYNTAX_*
+        int c;              // the unrecognised command word
+        char *text;         // the unrecognised gcode
+    } SyntaxWarning;
+
+    // when moves held back to be converted together are merged
+
+    typedef struct tCoalesce {
+        double tolerance;   // how far in mm a dropped point can be from the merged move, 0 to keep them all
+        double length;      // moves shorter than this in mm are merged with the next one, 0 to disable
+        double time;        // moves shorter than this in seconds are merged with the next one, 0 to disable
+    } Coalesce;
+
 // tool id
 
 #define MAX_TOOL_ID 1
@@ -208,6 +240,9 @@ typedef long speed_t;
 
 #include "machine.h"
 #include "eeprominfo.h"
+#include "estimate.h"
+#include "linkstats.h"
+#include "sertrace.h"
 
     typedef struct tTool {
         unsigned motor_enabled;
@@ -247,6 +282,7 @@ typedef long speed_t;
 #define COMMAND_AT_MAX 128
 
 #define BUFFER_MAX 1023
+#define SIO_RECEIVE_MAX 1024    // bytes read from the port ahead of parsing, a power of two
 
     // GPX CONTEXT
 
@@ -321,6 +357,8 @@ typedef long speed_t;
         char *sdCardPath;
         char *buildName;
         char *iniPath;
+        int jobs;               // tokenizer threads used by gpx_convert, 1 converts on the calling thread
+        Coalesce coalesce;      // merging of short collinear moves, all zero to convert every move
 
         struct {
             unsigned relativeCoordinates:1; // signals relative or absolute coordinates
@@ -361,24 +399,32 @@ typedef long speed_t;
             double b;
             double time;
             unsigned long bytes;
+            unsigned long coalesced;    // moves merged into the move before them
         } accumulated;
 
+        Estimate estimate;      // the moves planned ahead to estimate the accumulated time
+
         struct {
             double length;
             double time;
             unsigned long bytes;
         } total;
 
+        struct tStats *stats;   // profiling counters, NULL unless enabled
+        struct tMoveBatch *moves; // moves held back to be converted together, only set while converting a file
+
         // CALLBACK
 
         int (*callbackHandler)(Gpx *gpx, void *callbackData, char *buffer, size_t length);
         void *callbackData;
         int (*resultHandler)(Gpx *gpx, void *callbackData, const char *fmt, va_list ap);
         struct tSio *sio;
+        struct tTio *tio;       // translated serial io, set by tio_initialize
 
         // LOGGING
 
         FILE *log;
+        SerialTrace *trace;     // records the packets sent to the bot and its responses, NULL unless enabled
     };
 
     struct tSio {
@@ -391,6 +437,23 @@ typedef long speed_t;
             unsigned shortRetryBufferOverflowOnly : 1;
         } flag;
 
+        // the firmware's command buffer as port_handler models it, so an
+        // action is only sent once the buffer has room for it
+        struct {
+            long space;         // bytes free at most, -1 until it's been queried
+            double rate;        // bytes per second the firmware has been freeing, 0 until measured
+            double queried;     // when space was last queried, in seconds
+        } queue;
+
+        LinkStats stats;        // what the packets sent and their responses took
+
+        // bytes read from the port but not yet parsed into a response
+        struct {
+            unsigned char data[SIO_RECEIVE_MAX];
+            unsigned head;      // bytes read
+            unsigned tail;      // bytes parsed
+        } receive;
+
         union {
             struct {
                 unsigned short version;
@@ -593,6 +656,8 @@ typedef long speed_t;
     };
 
     void gpx_initialize(Gpx *gpx, int firstTime);
+    void gpx_clone(Gpx *clone, const Gpx *gpx);
+    void gpx_release_clone(Gpx *clone);
     int gpx_set_machine(Gpx *gpx, const char *machine, int init);
 
     int gpx_set_property(Gpx *gpx, const char* section, const char* property, char* value);
@@ -609,6 +674,7 @@ typedef long speed_t;
     int gpx_daemon(Gpx *gpx, int create_daemon_port, const char *daemon_port, const char *printer_port, speed_t baudrate);
     int gpx_convert_line(Gpx *gpx, char *gcode_line);
     int gpx_convert(Gpx *gpx, FILE *file_in, FILE *file_out, FILE *file_out2);
+    int gpx_tokenize(Gpx *gpx, FILE *file_in, FILE *file_out);
     int gpx_convert_and_send(Gpx *gpx, FILE *file_in, int sio_port, int item_code, ...);
 
     void gpx_end_convert(Gpx *gpx);
@@ -659,7 +725,7 @@ typedef long speed_t;
     int write_eeprom_float(Gpx *gpx, Sio *sio, unsigned address, float value);
     int read_eeprom_float(Gpx *gpx, Sio *sio, unsigned address, float *value);
 
-    Tio *tio_initialize(Gpx *gpx);
+    Tio *tio_initialize(Tio *tio, Gpx *gpx);
     void tio_cleanup(Tio *tio);
     void tio_clear_state_for_cancel(Tio *tio);
     int tio_printf(Tio *tio, char const* fmt, ...);
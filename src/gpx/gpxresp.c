@@ -40,6 +40,7 @@
 #endif
 
 #include "gpx.h"
+#include "reader.h"
 
 // make a new string table
 // cs_chunk -- count of strings -- grow the string array in chunks of this many strings
@@ -110,8 +111,6 @@ long sttb_find_nocase(Sttb *psttb, char *s)
     return -1;
 }
 
-static Tio tio;
-
 int tio_vprintf(Tio *tio, const char *fmt, va_list ap)
 {
     size_t result;
@@ -150,20 +149,25 @@ int tio_log_printf(Tio *tio, char const* fmt, ...)
     return result;
 }
 
-Tio *tio_initialize(Gpx *gpx)
+// initialize the translation state for gpx and attach it, the caller owns
+// the Tio and it must outlive any connection made with it
+
+Tio *tio_initialize(Tio *tio, Gpx *gpx)
 {
-    tio.cur = 0;
-    tio.translation[0] = 0;
-    tio.sio.port = -1;
-    tio.flags = 0;
-    tio.waiting = 0;
-    tio.sec = 0;
-    tio.gpx = gpx;
-    sttb_init(&tio.sttb, 10);
+    gpx->tio = tio;
+    tio->cur = 0;
+    tio->translation[0] = 0;
+    tio->sio.port = -1;
+    link_stats_initialize(&tio->sio.stats);
+    tio->flags = 0;
+    tio->waiting = 0;
+    tio->sec = 0;
+    tio->gpx = gpx;
+    sttb_init(&tio->sttb, 10);
     gpx->axis.positionKnown = 0;
     gpx->flag.M106AlwaysValve = 1;
-    tio.upstream = -1;
-    return &tio;
+    tio->upstream = -1;
+    return tio;
 }
 
 void tio_cleanup(Tio *tio)
@@ -703,7 +707,8 @@ static int translate_result(Gpx *gpx, Tio *tio, const char *fmt, va_list ap)
 
 int gpx_return_translation(Gpx *gpx, int rval)
 {
-    int waiting = tio.waiting;
+    Tio *tio = gpx->tio;
+    int waiting = tio->waiting;
 
     // ENDED -> READY
     if (gpx->flag.programState > RUNNING_STATE)
@@ -712,7 +717,7 @@ int gpx_return_translation(Gpx *gpx, int rval)
 
     // if we're waiting for something and we haven't produced any output
     // give back current temps
-    if (rval == SUCCESS && tio.waiting && tio.cur == 0) {
+    if (rval == SUCCESS && tio->waiting && tio->cur == 0) {
         if(gpx->flag.verboseMode)
             fprintf(gpx->log, "implicit M105\n");
         strncpy(gpx->buffer.in, "M105", sizeof(gpx->buffer.in));
@@ -730,58 +735,58 @@ int gpx_return_translation(Gpx *gpx, int rval)
             break;
 
         case EOSERROR:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: OS error trying to access X3G port");
+            tio->cur = 0;
+            tio_printf(tio, "Error: OS error trying to access X3G port");
             break;
         case ERROR:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: GPX error");
+            tio->cur = 0;
+            tio_printf(tio, "Error: GPX error");
             break;
         case ESIOWRITE:
         case ESIOREAD:
         case ESIOFRAME:
         case ESIOCRC:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: Serial communication error on X3G port. code = %d", rval);
+            tio->cur = 0;
+            tio_printf(tio, "Error: Serial communication error on X3G port. code = %d", rval);
             break;
         case ESIOTIMEOUT:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: Timeout on X3G port");
+            tio->cur = 0;
+            tio_printf(tio, "Error: Timeout on X3G port");
             break;
         case 0x80:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G generic packet error");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G generic packet error");
             break;
         case 0x82: // Action buffer overflow
-            tio.waitflag.waitForBuffer = 1;
-            tio.cur = 0;
-            tio_printf(&tio, "Status: Buffer full");
+            tio->waitflag.waitForBuffer = 1;
+            tio->cur = 0;
+            tio_printf(tio, "Status: Buffer full");
             break;
         case 0x83:
             // TODO resend?
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G checksum mismatch");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G checksum mismatch");
             break;
         case 0x84:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G query packet too big");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G query packet too big");
             break;
         case 0x85:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G command not supported or recognized");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G command not supported or recognized");
             break;
         case 0x87:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G timeout downstream");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G timeout downstream");
             break;
         case 0x88:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: X3G timeout for tool lock");
+            tio->cur = 0;
+            tio_printf(tio, "Error: X3G timeout for tool lock");
             break;
         case 0x89:
-            if (tio.waitflag.waitForBotCancel) {
+            if (tio->waitflag.waitForBotCancel) {
                 // ah, we told the bot to abort, and this 0x89 means that it did
-                tio.waitflag.waitForBotCancel = 0;
+                tio->waitflag.waitForBotCancel = 0;
                 if(gpx->flag.verboseMode)
                     fprintf(gpx->log, "cleared waitForBotCancel\n");
                 rval = SUCCESS;
@@ -794,73 +799,93 @@ int gpx_return_translation(Gpx *gpx, int rval)
             // we'll only get a @clear_cancel from the host loop, an M112
             // won't come through because the event layer will eat the next
             // event (because it's anticipating this event)
-            tio.flag.cancelPending = 1;
-            tio_clear_state_for_cancel(&tio);
-            tio_printf(&tio, "\nBuild cancelled");
+            tio->flag.cancelPending = 1;
+            tio_clear_state_for_cancel(tio);
+            tio_printf(tio, "\nBuild cancelled");
             break;
         case 0x8A:
-            tio.cur = 0;
-            tio_printf(&tio, "SD printing");
+            tio->cur = 0;
+            tio_printf(tio, "SD printing");
             break;
         case 0x8B:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: RC_BOT_OVERHEAT Printer reports overheat condition");
+            tio->cur = 0;
+            tio_printf(tio, "Error: RC_BOT_OVERHEAT Printer reports overheat condition");
             break;
         case 0x8C:
-            tio.cur = 0;
-            tio_printf(&tio, "Error: timeout");
+            tio->cur = 0;
+            tio_printf(tio, "Error: timeout");
             break;
 
         default:
             if (gpx->flag.verboseMode)
                 fprintf(gpx->log, "Error: Unknown error code: %d", rval);
-            tio.cur = 0;
-            tio_printf(&tio, "Error: Unknown error code: %d", rval);
+            tio->cur = 0;
+            tio_printf(tio, "Error: Unknown error code: %d", rval);
             break;
     }
 
     // if the rval cleared the wait state, we need an ok
-    if(waiting && !tio.waiting) {
+    if(waiting && !tio->waiting) {
         if(gpx->flag.verboseMode)
             fprintf(gpx->log, "add ok for wait cleared\n");
-        if (tio.cur > 0 && tio.translation[tio.cur - 1] != '\n')
-            tio_printf(&tio, "\n");
-        tio_printf(&tio, "ok");
+        if (tio->cur > 0 && tio->translation[tio->cur - 1] != '\n')
+            tio_printf(tio, "\n");
+        tio_printf(tio, "ok");
     }
-    else if (tio.cur > 0 && tio.translation[tio.cur - 1] == '\n')
-        tio.translation[--tio.cur] = 0;
+    else if (tio->cur > 0 && tio->translation[tio->cur - 1] == '\n')
+        tio->translation[--tio->cur] = 0;
 
     fflush(gpx->log);
     return rval;
 }
 
-int gpx_write_string_core(Gpx *gpx, const char *s)
+// convert a line in place, the line is modified
+
+static int write_line_core(Gpx *gpx, char *line)
 {
-    unsigned waiting = tio.waiting;
+    Tio *tio = gpx->tio;
+    unsigned waiting = tio->waiting;
     if (waiting && gpx->flag.verboseMode)
         fprintf(gpx->log, "waiting in gpx_write_string\n");
 
-    strncpy(gpx->buffer.in, s, sizeof(gpx->buffer.in));
-    int rval = gpx_convert_line(gpx, gpx->buffer.in);
+    int rval = gpx_convert_line(gpx, line);
 
     if (gpx->flag.verboseMode)
         fprintf(gpx->log, "gpx_write_string_core rval = %d\n", rval);
 
-    if (tio.flag.okPending) {
-        tio_printf(&tio, "ok");
+    if (tio->flag.okPending) {
+        tio_printf(tio, "ok");
         // ok means: I'm ready for another command, not necessarily that everything worked
     }
     // if we were waiting, but now we're not, throw an ok on there
-    else if (!tio.waiting && waiting)
-        tio_printf(&tio, "\nok");
-    tio.flag.okPending = 0;
+    else if (!tio->waiting && waiting)
+        tio_printf(tio, "\nok");
+    tio->flag.okPending = 0;
     if (waiting && gpx->flag.verboseMode)
-        fprintf(gpx->log, "leaving gpx_write_string_core %d\n", tio.waiting);
+        fprintf(gpx->log, "leaving gpx_write_string_core %d\n", tio->waiting);
     fflush(gpx->log);
 
     return rval;
 }
 
+int gpx_write_string_core(Gpx *gpx, const char *s)
+{
+    // convert a copy, lines too long for the input buffer get their own
+    size_t length = strlen(s);
+    if(length < sizeof(gpx->buffer.in)) {
+        memcpy(gpx->buffer.in, s, length + 1);
+        return write_line_core(gpx, gpx->buffer.in);
+    }
+    char *line = strdup(s);
+    if(line == NULL) {
+        fprintf(gpx->log, "Error: insufficient memory for the line\n");
+        return ERROR;
+    }
+    int rval = write_line_core(gpx, line);
+    free(line);
+    return rval;
+}
+
 int gpx_write_string(Gpx *gpx, const char *s)
 {
     return gpx_return_translation(gpx, gpx_write_string_core(gpx, s));
@@ -906,7 +931,7 @@ speed_t speed_from_long(long *baudrate)
             speed=B115200;
             break;
         default:
-            tio_log_printf(&tio, "Error: Unsupported baud rate '%ld'\n", *baudrate);
+            // unsupported, the caller reports the error
             break;
     }
     return speed;
@@ -914,64 +939,70 @@ speed_t speed_from_long(long *baudrate)
 
 int gpx_do_wait(Gpx *gpx)
 {
+    Tio *tio = gpx->tio;
     int rval = SUCCESS;
 
     if (gpx->flag.verboseMode)
-        fprintf(gpx->log, "tio.waiting = %u\n", tio.waiting);
-    if (!tio.waitflag.waitForCancelSync) {
-        if (tio.waitflag.waitForUnpause)
+        fprintf(gpx->log, "tio.waiting = %u\n", tio->waiting);
+    if (!tio->waitflag.waitForCancelSync) {
+        if (tio->waitflag.waitForUnpause)
             rval = get_build_statistics(gpx);
         // if we're waiting for the queue to drain, do that before checking on
         // anything else
-        if (rval == SUCCESS && (tio.waitflag.waitForEmptyQueue || tio.waitflag.waitForButton))
+        if (rval == SUCCESS && (tio->waitflag.waitForEmptyQueue || tio->waitflag.waitForButton))
             rval = is_ready(gpx);
-        if (rval == SUCCESS && !tio.waitflag.waitForEmptyQueue) {
-            if (tio.waitflag.waitForStart || tio.waitflag.waitForBotCancel)
+        if (rval == SUCCESS && !tio->waitflag.waitForEmptyQueue) {
+            if (tio->waitflag.waitForStart || tio->waitflag.waitForBotCancel)
                 rval = get_build_statistics(gpx);
-            if (rval == SUCCESS && tio.waitflag.waitForPlatform)
+            if (rval == SUCCESS && tio->waitflag.waitForPlatform)
                 rval = is_build_platform_ready(gpx, 0);
-            if (rval == SUCCESS && tio.waitflag.waitForExtruderA)
+            if (rval == SUCCESS && tio->waitflag.waitForExtruderA)
                 rval = is_extruder_ready(gpx, 0);
-            if (rval == SUCCESS && tio.waitflag.waitForExtruderB)
+            if (rval == SUCCESS && tio->waitflag.waitForExtruderB)
                 rval = is_extruder_ready(gpx, 1);
         }
     }
     if (gpx->flag.verboseMode)
-        fprintf(gpx->log, "tio.waiting = %u and rval = %d\n", tio.waiting, rval);
+        fprintf(gpx->log, "tio.waiting = %u and rval = %d\n", tio->waiting, rval);
     if (rval == SUCCESS) {
-        if (tio.waiting) {
+        if (tio->waiting) {
             if (gpx->flag.verboseMode) {
-                tio_printf(&tio, "// echo: tio.waiting = 0x%x\n", tio.waiting);
+                tio_printf(tio, "// echo: tio.waiting = 0x%x\n", tio->waiting);
             }
             return gpx_write_string_core(gpx, "M105");
         }
-        tio.cur = 0;
-        tio_printf(&tio, "ok");
+        tio->cur = 0;
+        tio_printf(tio, "ok");
     }
     return rval;
 }
 
 int gpx_connect(Gpx *gpx, const char *printer_port, speed_t speed)
 {
+    Tio *tio = gpx->tio;
     // open the port
     if (speed == B0)
         return ESIOBADBAUD;
-    if (!gpx_sio_open(gpx, printer_port, speed, &tio.sio.port))
+    if (!gpx_sio_open(gpx, printer_port, speed, &tio->sio.port))
         return EOSERROR;
 
     // initialize tio
-    tio.gpx = gpx;
-    tio.sio.in = NULL;
-    tio.sio.bytes_out = tio.sio.bytes_in = 0;
-    tio.sio.flag.retryBufferOverflow = 1;
-    tio.sio.flag.shortRetryBufferOverflowOnly = 0;
+    tio->gpx = gpx;
+    tio->sio.in = NULL;
+    tio->sio.bytes_out = tio->sio.bytes_in = 0;
+    tio->sio.flag.retryBufferOverflow = 1;
+    tio->sio.flag.shortRetryBufferOverflowOnly = 0;
+    tio->sio.queue.space = -1;
+    tio->sio.queue.rate = 0.0;
+    tio->sio.receive.head = tio->sio.receive.tail = 0;
+    link_stats_initialize(&tio->sio.stats);
 
     // set up gpx
     gpx_start_convert(gpx, "", 0);
     gpx->flag.framingEnabled = 1;
     gpx->flag.sioConnected = 1;
-    gpx->sio = &tio.sio;
-    gpx_register_callback(gpx, (int (*)(Gpx*, void*, char*, size_t))translate_handler, &tio);
+    gpx->sio = &tio->sio;
+    gpx_register_callback(gpx, (int (*)(Gpx*, void*, char*, size_t))translate_handler, tio);
     gpx->resultHandler = (int (*)(Gpx*, void*, const char*, va_list))translate_result;
 
     fprintf(gpx->log, "gpx connected to %s\n", printer_port);
@@ -979,7 +1010,7 @@ int gpx_connect(Gpx *gpx, const char *printer_port, speed_t speed)
     // if the user has CLEAR_FOR_ESTOP set, then we shouldn't send absolute moves
     // to the bot after cancel (ESTOP) until a new coordinate system is defined
     // with G92 or M132.
-    tio.flag.clear_on_estop_set = 0;
+    tio->flag.clear_on_estop_set = 0;
     EepromMap *map = find_eeprom_map(gpx);
     if (map != NULL) {
         gpx->eepromMap = map;
@@ -989,36 +1020,38 @@ int gpx_connect(Gpx *gpx, const char *printer_port, speed_t speed)
             unsigned char b = 0;
             int rval = read_eeprom_8(gpx, gpx->sio, mapping->address, &b);
             if (rval == SUCCESS) {
-                tio.flag.clear_on_estop_set = 1;
+                tio->flag.clear_on_estop_set = 1;
             }
         }
     }
 
-    tio.cur = 0;
-    tio_printf(&tio, "start\n");
+    tio->cur = 0;
+    tio_printf(tio, "start\n");
     return SUCCESS;
 }
 
 static int gpx_create_daemon_port(Gpx *gpx, const char *daemon_port)
 {
 #ifdef HAVE_POSIX_OPENPT
+    Tio *tio = gpx->tio;
+
     // create the master/slave psuedo-terminal pair
-    if ((tio.upstream = posix_openpt(O_RDWR|O_NOCTTY)) < 0) {
+    if ((tio->upstream = posix_openpt(O_RDWR|O_NOCTTY)) < 0) {
         fprintf(gpx->log, "Error: Unable to create psuedo terminal (posix_openpt failed). errno = %d\n", errno);
         return EOSERROR;
     }
 
     // grant and unlock
-    if (grantpt(tio.upstream) < 0) {
+    if (grantpt(tio->upstream) < 0) {
         fprintf(gpx->log, "Warning: Unable to grant psuedo terminal. errno = %d\n", errno);
     }
-    if (unlockpt(tio.upstream) < 0) {
+    if (unlockpt(tio->upstream) < 0) {
         fprintf(gpx->log, "Warning: Unable to unlock psuedo terminal. errno = %d\n", errno);
     }
 
     // figure out the slave end's name
     char *pn = NULL;
-    if ((pn = ptsname(tio.upstream)) == NULL) {
+    if ((pn = ptsname(tio->upstream)) == NULL) {
         fprintf(gpx->log, "Error: Unable to create virtual port (ptsname returned NULL). errno = %d\n", errno);
         return EOSERROR;
     }
@@ -1036,12 +1069,12 @@ static int gpx_create_daemon_port(Gpx *gpx, const char *daemon_port)
 
     // attempt to set it to raw
     struct termios ti;
-    if(tcgetattr(tio.upstream, &ti) < 0) {
+    if(tcgetattr(tio->upstream, &ti) < 0) {
         fprintf(gpx->log, "Warn: Unable to get virtual port attributes. errno = %d\n", errno);
     }
     else {
         cfmakeraw(&ti);
-        if(tcsetattr(tio.upstream, TCSANOW, &ti) < 0) {
+        if(tcsetattr(tio->upstream, TCSANOW, &ti) < 0) {
             fprintf(gpx->log, "Warn: Unable to set virtual port attributes. errno = %d\n", errno);
         }
     }
@@ -1055,13 +1088,14 @@ static int gpx_create_daemon_port(Gpx *gpx, const char *daemon_port)
 
 static void gpx_write_upstream_translation(Gpx *gpx)
 {
-    tio_printf(&tio, "\n");
-    VERBOSE( fprintf(gpx->log, "write: %s", tio.translation); )
-    int len = strlen(tio.translation);
-    if(len != write(tio.upstream, tio.translation, strlen(tio.translation))) {
+    Tio *tio = gpx->tio;
+    tio_printf(tio, "\n");
+    VERBOSE( fprintf(gpx->log, "write: %s", tio->translation); )
+    int len = strlen(tio->translation);
+    if(len != write(tio->upstream, tio->translation, strlen(tio->translation))) {
         VERBOSE( fprintf(gpx->log, "write on upstream failed to write all bytes.  errno = %d.\n", errno) );
     }
-    tio.translation[tio.cur = 0] = 0;
+    tio->translation[tio->cur = 0] = 0;
     fflush(gpx->log);
 }
 
@@ -1100,29 +1134,37 @@ int ready_to_read(int fd)
 {
     fd_set rfds;
     FD_ZERO(&rfds);
-    FD_SET(tio.upstream, &rfds);
+    FD_SET(fd, &rfds);
 
     struct timeval timeout;
     timeout.tv_sec = 1;
     timeout.tv_usec = 0;
 
-    return (select(tio.upstream + 1, &rfds, NULL, NULL, &timeout) > 0);
+    return (select(fd + 1, &rfds, NULL, NULL, &timeout) > 0);
 }
 #endif
 
-int gpx_daemon(Gpx *gpx, int create_port, const char *daemon_port, const char *printer_port, speed_t speed)
+// port_handler writes the link statistics SIGUSR1 asks for after the
+// packet it's sending, this writes them while the daemon is idle
+
+static void report_link_stats(Gpx *gpx, Tio *tio)
 {
-    int rval = SUCCESS;
-    int overflow = 0;
+    if(link_stats_requested()) {
+        link_stats_report(&tio->sio.stats, tio->sio.bytes_out, tio->sio.bytes_in, gpx->log);
+    }
+}
 
-    tio_initialize(gpx);
+static int run_daemon(Gpx *gpx, Tio *tio, int create_port, const char *daemon_port, const char *printer_port, speed_t speed)
+{
+    int rval = SUCCESS;
+    Reader reader;
 
     if (create_port) {
         if ((rval = gpx_create_daemon_port(gpx, daemon_port)) != SUCCESS)
             return rval;
     }
     else {
-        if ((tio.upstream = open(daemon_port, O_RDWR)) < 0) {
+        if ((tio->upstream = open(daemon_port, O_RDWR)) < 0) {
             fprintf(gpx->log, "Error: Unable to open psuedo terminal (%s). errno = %d\n", daemon_port, errno);
             return EOSERROR;
         }
@@ -1133,87 +1175,92 @@ int gpx_daemon(Gpx *gpx, int create_port, const char *daemon_port, const char *p
     }
     gpx_write_upstream_translation(gpx);
 
-    int bytes_read;
+    reader_open_fd(&reader, tio->upstream);
     for (;;) {
-        char *p = gpx->buffer.in;
-        int remaining = BUFFER_MAX;
+        char *line;
+        size_t length;
 
         // simulate wait loop, if we are waiting
-        tio.waitflag.waitForBuffer = 0;
-        while (tio.waiting) {
+        tio->waitflag.waitForBuffer = 0;
+        while (tio->waiting) {
             rval = gpx_return_translation(gpx, gpx_do_wait(gpx));
             if(rval != SUCCESS)
                 fprintf(gpx->log, "wait test failed. gpx_do_wait returned %d.", rval);
-            if(tio.cur > 0)
+            if(tio->cur > 0)
                 gpx_write_upstream_translation(gpx);
-            if(ready_to_read(tio.upstream))
+            if(reader_pending(&reader) || ready_to_read(tio->upstream))
                 break;
+            report_link_stats(gpx, tio);
         }
 
+        // wait for the next line, select returns when SIGUSR1 interrupts it
+        while (!reader_pending(&reader) && !ready_to_read(tio->upstream))
+            report_link_stats(gpx, tio);
+
         // read a line
-        for(; remaining; remaining--, p++) {
-            while ((bytes_read = read(tio.upstream, p, 1)) != 1) {
-                if (bytes_read < 0) {
-                    switch (errno) {
-                        case EIO:
-                            wait_for_hup_clear(gpx, tio.upstream);
-                            break;
-                        case EINTR:
-                            break;
-                        default:
-                            fprintf(gpx->log, "read upstream failed. errno = %d, %s\n", errno, strerror(errno));
-                            return EOSERROR;
-                    }
-                    VERBOSE( fprintf(gpx->log, "read upstream failed. errno = %d, %s\n", errno, strerror(errno)); )
-                }
-                else {
-                    VERBOSE( fprintf(gpx->log, "read upstream returned 0 bytes.\n"); )
+        while ((line = reader_next_line(&reader, &length)) == NULL) {
+            if (reader.error) {
+                switch (reader.error) {
+                    case EIO:
+                        wait_for_hup_clear(gpx, tio->upstream);
+                        break;
+                    case EINTR:
+                        report_link_stats(gpx, tio);
+                        break;
+                    default:
+                        fprintf(gpx->log, "read upstream failed. errno = %d, %s\n", reader.error, strerror(reader.error));
+                        reader_close(&reader);
+                        return EOSERROR;
                 }
+                VERBOSE( fprintf(gpx->log, "read upstream failed. errno = %d, %s\n", reader.error, strerror(reader.error)); )
             }
-            if(*p == '\n')
-                break;
-        }
-        *p = '\0';
-        VERBOSE( fprintf(gpx->log, "read a line: %s\n", gpx->buffer.in); )
-
-        // detect input buffer overflow and ignore overflow input
-        if(overflow) {
-            if(strlen(gpx->buffer.in) != BUFFER_MAX - 1) {
-                overflow = 0;
+            else {
+                VERBOSE( fprintf(gpx->log, "read upstream returned 0 bytes.\n"); )
             }
-            continue;
-        }
-        if(strlen(gpx->buffer.in) == BUFFER_MAX - 1) {
-            overflow = 1;
-            // ignore run-on comments, this is actually a little too permissive
-            // since technically we should ignore ';' contained within a
-            // parenthetical comment
-            if(!strchr(gpx->buffer.in, ';'))
-                tio_printf(&tio, "(line %u) Buffer overflow: input exceeds %u character limit, remaining characters in line will be ignored" EOL, gpx->lineNumber, BUFFER_MAX);
         }
+        if(line[length - 1] == '\n')
+            line[length - 1] = '\0';
+        VERBOSE( fprintf(gpx->log, "read a line: %s\n", line); )
 
-        tio.flag.okPending = !tio.waiting;
-        rval = gpx_write_string(gpx, gpx->buffer.in);
+        tio->flag.okPending = !tio->waiting;
+        rval = gpx_return_translation(gpx, write_line_core(gpx, line));
         gpx_write_upstream_translation(gpx);
 
         if(rval == EOSERROR && access(printer_port, R_OK)) {
-            tio_printf(&tio, "Error: GPX shutting down, printer disconnected.\n");
+            tio_printf(tio, "Error: GPX shutting down, printer disconnected.\n");
             break;
         }
 
-        while(tio.flag.listingFiles) {
+        while(tio->flag.listingFiles) {
             get_next_filename(gpx, 0);
             gpx_write_upstream_translation(gpx);
         }
 
-        if (tio.flag.waitClearedByCancel) {
+        if (tio->flag.waitClearedByCancel) {
             if(gpx->flag.verboseMode)
                 fprintf(gpx->log, "adding ok for wait cleared by cancel\n");
-            tio.flag.waitClearedByCancel = 0;
-            tio_printf(&tio, "ok");
+            tio->flag.waitClearedByCancel = 0;
+            tio_printf(tio, "ok");
             gpx_write_upstream_translation(gpx);
         }
     }
 
+    reader_close(&reader);
+    return rval;
+}
+
+int gpx_daemon(Gpx *gpx, int create_port, const char *daemon_port, const char *printer_port, speed_t speed)
+{
+    Tio tio;
+
+    tio_initialize(&tio, gpx);
+    int rval = run_daemon(gpx, &tio, create_port, daemon_port, printer_port, speed);
+    if(gpx->flag.verboseMode && tio.sio.stats.packets) {
+        link_stats_report(&tio.sio.stats, tio.sio.bytes_out, tio.sio.bytes_in, gpx->log);
+    }
+
+    // don't leave gpx pointing at the daemon's stack
+    gpx->tio = NULL;
+    gpx->sio = NULL;
     return rval;
 }
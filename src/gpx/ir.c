@@ -0,0 +1,780 @@
+//  ir.c
+//
+//  Tokenized gcode intermediate representation
+//
+//  The stream starts with a header holding the magic number and version,
+//  followed by a record for each line and a zero length record after the
+//  last one, then the macro table and a footer holding the offset of the
+//  table. The header and footer are little endian, everything else is a
+//  LEB128 varint.
+//
+//  A record is its length, a bitmask of the words set on the line (the
+//  command flag bits plus IR_NUMBER, IR_MACRO and IR_WARNINGS), then only
+//  the fields that are set, in the order they are declared in Command.
+//  A double that is a decimal with up to six places is written as its
+//  digits, sign and number of places, which gives back exactly the same
+//  double as parsing the word did, anything else is written as is.
+//  Strings are written in full with a terminator the first time they are
+//  seen, and by their id after that. Strings too long to be worth
+//  interning, and all strings once the table is full, are always written
+//  in full.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "portable_endian.h"
+#include "ir.h"
+
+static const char magic[8] = "\x89GPXIR\r\n";
+static const char footer_magic[4] = "GIR\x1a";
+
+#define IR_HEADER_SIZE 16
+#define IR_FOOTER_SIZE 16
+
+// record bits beyond the command flags
+
+#define IR_NUMBER 0x100000
+#define IR_MACRO 0x200000
+#define IR_WARNINGS 0x400000
+
+// string references, any other reference is the id of the string plus
+// IR_FIRST_ID
+
+#define IR_NEW_STRING 0             // followed by a string that takes the next id
+#define IR_LITERAL 1                // followed by a string that isn't interned
+#define IR_FIRST_ID 2
+
+// doubles are written as (digits << 4) | (negative << 3) | places, or as
+// IR_RAW_DOUBLE followed by the 8 bytes of the double
+
+#define IR_PLACES_MAX 6
+#define IR_RAW_DOUBLE 7
+
+#define IR_STRINGS_MAX 65536        // ids handed out before strings are written in full
+#define IR_INTERN_MAX 256           // longest string interned
+
+#define IR_BLOCK (1024 * 1024)
+
+// an interned string in the writer's hash table
+
+typedef struct tIrString {
+    char *s;                // NULL when the slot is empty
+    size_t length;
+    unsigned hash;
+    unsigned id;
+} IrString;
+
+// an entry in the writer's macro table
+
+typedef struct tIrMacro {
+    unsigned index;
+    char *macro;
+    char *param;
+} IrMacro;
+
+static const double power_of_ten[IR_PLACES_MAX + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6
+};
+
+static unsigned string_hash(const char *s, size_t length)
+{
+    unsigned h = 2166136261u;
+    while(length--) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int ir_detect(FILE *in)
+{
+    char header[sizeof(magic)];
+    size_t bytes = fread(header, 1, sizeof(header), in);
+    rewind(in);
+    return bytes == sizeof(header) && memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+// WRITER
+
+// the number of hash slots, always a power of two
+static unsigned slots(IrWriter *writer)
+{
+    unsigned n = 1024;
+    while(n < writer->strings * 2) n *= 2;
+    return n;
+}
+
+static int flush(IrWriter *writer)
+{
+    if(writer->length) {
+        if(fwrite(writer->buffer, 1, writer->length, writer->out) != writer->length) {
+            writer->error = errno ? errno : EIO;
+            return ERROR;
+        }
+        writer->offset += writer->length;
+        writer->length = 0;
+    }
+    return SUCCESS;
+}
+
+// make room for length more bytes in the buffer
+
+static char *reserve(IrWriter *writer, size_t length)
+{
+    if(writer->length + length > writer->capacity) {
+        size_t capacity = writer->capacity;
+        if(flush(writer) != SUCCESS) return NULL;
+        while(capacity < length) capacity *= 2;
+        if(capacity != writer->capacity) {
+            char *buffer = realloc(writer->buffer, capacity);
+            if(buffer == NULL) {
+                writer->error = ENOMEM;
+                return NULL;
+            }
+            writer->buffer = buffer;
+            writer->capacity = capacity;
+        }
+    }
+    return writer->buffer + writer->length;
+}
+
+#define VARINT_MAX 10
+#define DOUBLE_MAX (VARINT_MAX + 8)
+#define LENGTH_MAX 5                // a 32 bit varint
+
+static void put_32(char **p, uint32_t value)
+{
+    value = htole32(value);
+    memcpy(*p, &value, 4);
+    *p += 4;
+}
+
+static void put_varint(char **p, uint64_t value)
+{
+    while(value >= 0x80) {
+        *(*p)++ = (char)(value | 0x80);
+        value >>= 7;
+    }
+    *(*p)++ = (char)value;
+}
+
+static void put_double(char **p, double value)
+{
+    double magnitude = fabs(value);
+    uint64_t bits;
+    int places;
+
+    if(magnitude < 1e9) {
+        for(places = 0; places <= IR_PLACES_MAX; places++) {
+            uint64_t digits = (uint64_t)llround(magnitude * power_of_ten[places]);
+            double decoded = (double)digits / power_of_ten[places];
+            if(signbit(value)) decoded = -decoded;
+            if(memcmp(&decoded, &value, sizeof(double)) == 0) {
+                put_varint(p, digits << 4 | (signbit(value) ? 8 : 0) | places);
+                return;
+            }
+        }
+    }
+    put_varint(p, IR_RAW_DOUBLE);
+    memcpy(&bits, &value, 8);
+    bits = htole64(bits);
+    memcpy(*p, &bits, 8);
+    *p += 8;
+}
+
+static void put_bytes(char **p, const char *s, size_t length)
+{
+    put_varint(p, length);
+    memcpy(*p, s, length);
+    (*p)[length] = 0;
+    *p += length + 1;
+}
+
+// the bytes a string reference takes at most
+
+static size_t string_size(const char *s)
+{
+    return VARINT_MAX + VARINT_MAX + strlen(s) + 1;
+}
+
+// double the hash table when it is half full
+
+static int grow_strings(IrWriter *writer)
+{
+    unsigned size = slots(writer);
+    unsigned i, old = writer->slot ? size / 2 : 0;
+    IrString *slot = calloc(size, sizeof(IrString));
+    if(slot == NULL) {
+        writer->error = ENOMEM;
+        return ERROR;
+    }
+    for(i = 0; i < old; i++) {
+        IrString *string = writer->slot + i;
+        if(string->s) {
+            unsigned j = string->hash & (size - 1);
+            while(slot[j].s) j = (j + 1) & (size - 1);
+            slot[j] = *string;
+        }
+    }
+    free(writer->slot);
+    writer->slot = slot;
+    return SUCCESS;
+}
+
+// write a reference to the string s, interning it when it's new
+
+static int put_string(IrWriter *writer, char **p, const char *s)
+{
+    size_t length = strlen(s);
+    if(length <= IR_INTERN_MAX && writer->strings < IR_STRINGS_MAX) {
+        unsigned size = slots(writer);
+        unsigned hash = string_hash(s, length);
+        unsigned i = hash & (size - 1);
+        IrString *string;
+        while((string = writer->slot + i)->s) {
+            if(string->hash == hash && string->length == length && memcmp(string->s, s, length) == 0) {
+                put_varint(p, string->id + IR_FIRST_ID);
+                return SUCCESS;
+            }
+            i = (i + 1) & (size - 1);
+        }
+        string->s = malloc(length + 1);
+        if(string->s == NULL) {
+            writer->error = ENOMEM;
+            return ERROR;
+        }
+        memcpy(string->s, s, length + 1);
+        string->length = length;
+        string->hash = hash;
+        string->id = writer->strings++;
+        put_varint(p, IR_NEW_STRING);
+        put_bytes(p, s, length);
+        // keep the table at most half full
+        if(slots(writer) != size) return grow_strings(writer);
+        return SUCCESS;
+    }
+    put_varint(p, IR_LITERAL);
+    put_bytes(p, s, length);
+    return SUCCESS;
+}
+
+int ir_writer_open(IrWriter *writer, FILE *out)
+{
+    char *p;
+    memset(writer, 0, sizeof(IrWriter));
+    writer->out = out;
+    writer->capacity = IR_BLOCK;
+    writer->buffer = malloc(writer->capacity);
+    writer->macros = vector_create(sizeof(IrMacro), 64, 256);
+    if(writer->buffer == NULL || writer->macros == NULL || grow_strings(writer) != SUCCESS) {
+        free(writer->buffer);
+        if(writer->macros) vector_free(writer->macros);
+        free(writer->slot);
+        return ERROR;
+    }
+    p = writer->buffer;
+    memcpy(p, magic, sizeof(magic));
+    p += sizeof(magic);
+    put_32(&p, IR_VERSION);
+    put_32(&p, 0);
+    writer->length = p - writer->buffer;
+    return SUCCESS;
+}
+
+int ir_write_line(IrWriter *writer, const GcodeLine *line, const SyntaxWarning *warning, size_t warnings,
+                  const char *rawMacro, const char *rawParam)
+{
+    const Command *command = &line->command;
+    int flag = command->flag;
+    unsigned bits = flag;
+    size_t i, size = LENGTH_MAX + 4 * VARINT_MAX + 10 * DOUBLE_MAX + 3 * VARINT_MAX;
+    char *start, *p;
+
+    if(line->hasNumber) bits |= IR_NUMBER;
+    if(line->macro) bits |= IR_MACRO;
+    if(warnings) bits |= IR_WARNINGS;
+
+    // reserve room for the largest the record can be
+    if(flag & COMMENT_IS_SET) size += string_size(command->comment);
+    if(flag & ARG_IS_SET) size += string_size(command->arg);
+    if(line->macro) size += string_size(line->macro) + string_size(line->macroParam);
+    for(i = 0; i < warnings; i++) {
+        size += 2 * VARINT_MAX;
+        if(warning[i].code == SYNTAX_UNRECOGNISED) size += string_size(warning[i].text);
+    }
+    start = p = reserve(writer, size);
+    if(p == NULL) return ERROR;
+
+    // the length goes in front once it is known
+    p += LENGTH_MAX;
+    put_varint(&p, bits);
+    if(bits & IR_NUMBER) put_varint(&p, line->number);
+    if(flag & X_IS_SET) put_double(&p, command->x);
+    if(flag & Y_IS_SET) put_double(&p, command->y);
+    if(flag & Z_IS_SET) put_double(&p, command->z);
+    if(flag & A_IS_SET) put_double(&p, command->a);
+    if(flag & B_IS_SET) put_double(&p, command->b);
+    if(flag & E_IS_SET) put_double(&p, command->e);
+    if(flag & F_IS_SET) put_double(&p, command->f);
+    if(flag & P_IS_SET) put_double(&p, command->p);
+    if(flag & R_IS_SET) put_double(&p, command->r);
+    if(flag & S_IS_SET) put_double(&p, command->s);
+    if(flag & G_IS_SET) put_varint(&p, command->g);
+    if(flag & M_IS_SET) put_varint(&p, command->m);
+    if(flag & T_IS_SET) put_varint(&p, command->t);
+    if(flag & COMMENT_IS_SET && put_string(writer, &p, command->comment) != SUCCESS) return ERROR;
+    if(flag & ARG_IS_SET && put_string(writer, &p, command->arg) != SUCCESS) return ERROR;
+    if(bits & IR_MACRO) {
+        if(put_string(writer, &p, line->macro) != SUCCESS) return ERROR;
+        if(put_string(writer, &p, line->macroParam) != SUCCESS) return ERROR;
+    }
+    if(bits & IR_WARNINGS) {
+        put_varint(&p, warnings);
+        for(i = 0; i < warnings; i++) {
+            put_varint(&p, warning[i].code);
+            put_varint(&p, (unsigned char)warning[i].c);
+            if(warning[i].code == SYNTAX_UNRECOGNISED) put_bytes(&p, warning[i].text, strlen(warning[i].text));
+        }
+    }
+    // move the record up against its length
+    size = p - start - LENGTH_MAX;
+    char *body = start + LENGTH_MAX;
+    put_varint(&start, size);
+    memmove(start, body, size);
+    writer->length = start + size - writer->buffer;
+
+    if(rawMacro) {
+        IrMacro entry;
+        entry.index = writer->lines;
+        entry.macro = strdup(rawMacro);
+        entry.param = strdup(rawParam);
+        if(entry.macro == NULL || entry.param == NULL || vector_append(writer->macros, &entry) < 0) {
+            free(entry.macro);
+            free(entry.param);
+            writer->error = ENOMEM;
+            return ERROR;
+        }
+    }
+    writer->lines++;
+    return SUCCESS;
+}
+
+int ir_writer_close(IrWriter *writer)
+{
+    int i, rval = SUCCESS;
+    unsigned long long table;
+    char *p = reserve(writer, 1);
+
+    // the end of the records
+    if(p == NULL) {
+        rval = ERROR;
+    }
+    else {
+        put_varint(&p, 0);
+        writer->length += 1;
+        table = writer->offset + writer->length;
+        p = reserve(writer, VARINT_MAX);
+        if(p) {
+            char *start = p;
+            put_varint(&p, writer->macros->c);
+            writer->length += p - start;
+        }
+        for(i = 0; p && i < writer->macros->c; i++) {
+            IrMacro *entry = (IrMacro *)vector_get(writer->macros, i);
+            p = reserve(writer, VARINT_MAX + string_size(entry->macro) + string_size(entry->param));
+            if(p) {
+                char *start = p;
+                put_varint(&p, entry->index);
+                put_bytes(&p, entry->macro, strlen(entry->macro));
+                put_bytes(&p, entry->param, strlen(entry->param));
+                writer->length += p - start;
+            }
+        }
+        if(p) p = reserve(writer, IR_FOOTER_SIZE);
+        if(p) {
+            uint64_t offset = htole64((uint64_t)table);
+            memcpy(p, &offset, 8);
+            p += 8;
+            put_32(&p, writer->lines);
+            memcpy(p, footer_magic, 4);
+            writer->length += IR_FOOTER_SIZE;
+        }
+        if(p == NULL || flush(writer) != SUCCESS) {
+            rval = ERROR;
+        }
+        else if(fflush(writer->out) != 0) {
+            writer->error = errno;
+            rval = ERROR;
+        }
+    }
+
+    for(i = 0; i < writer->macros->c; i++) {
+        IrMacro *entry = (IrMacro *)vector_get(writer->macros, i);
+        free(entry->macro);
+        free(entry->param);
+    }
+    vector_free(writer->macros);
+    if(writer->slot) {
+        unsigned size = slots(writer);
+        unsigned j;
+        for(j = 0; j < size; j++) free(writer->slot[j].s);
+        free(writer->slot);
+    }
+    free(writer->buffer);
+    return rval;
+}
+
+// READER
+
+static int corrupt(IrReader *reader)
+{
+    reader->error = EBADMSG;
+    return ERROR;
+}
+
+// make at least length bytes available from start
+
+static int fill(IrReader *reader, size_t length)
+{
+    while(reader->end - reader->start < length) {
+        if(reader->eof) return corrupt(reader);
+        if(reader->capacity - reader->start < length + IR_BLOCK) {
+            size_t capacity = reader->capacity;
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+            while(capacity < length + IR_BLOCK) capacity *= 2;
+            if(capacity != reader->capacity) {
+                char *buffer = realloc(reader->buffer, capacity);
+                if(buffer == NULL) {
+                    reader->error = ENOMEM;
+                    return ERROR;
+                }
+                reader->buffer = buffer;
+                reader->capacity = capacity;
+            }
+        }
+        size_t bytes = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->in);
+        if(bytes == 0) {
+            if(ferror(reader->in)) {
+                reader->error = errno ? errno : EIO;
+                return ERROR;
+            }
+            reader->eof = 1;
+        }
+        reader->end += bytes;
+    }
+    return SUCCESS;
+}
+
+// the fields of a record are checked against its end as they are read
+
+typedef struct tCursor {
+    char *p;
+    char *end;
+} Cursor;
+
+static int get_varint(Cursor *cursor, uint64_t *value)
+{
+    int shift = 0;
+    *value = 0;
+    while(cursor->p < cursor->end && shift < 64) {
+        unsigned char byte = *cursor->p++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if(byte < 0x80) return SUCCESS;
+        shift += 7;
+    }
+    return ERROR;
+}
+
+static int get_32(Cursor *cursor, uint32_t *value)
+{
+    uint64_t v;
+    if(get_varint(cursor, &v) != SUCCESS || v > UINT32_MAX) return ERROR;
+    *value = (uint32_t)v;
+    return SUCCESS;
+}
+
+static int get_double(Cursor *cursor, double *value)
+{
+    uint64_t v;
+    if(get_varint(cursor, &v) != SUCCESS) return ERROR;
+    if((v & 7) == IR_RAW_DOUBLE) {
+        uint64_t bits;
+        if(cursor->end - cursor->p < 8) return ERROR;
+        memcpy(&bits, cursor->p, 8);
+        bits = le64toh(bits);
+        memcpy(value, &bits, 8);
+        cursor->p += 8;
+        return SUCCESS;
+    }
+    // the same calculation word_to_double makes
+    *value = (double)(v >> 4) / power_of_ten[v & 7];
+    if(v & 8) *value = -*value;
+    return SUCCESS;
+}
+
+static int get_bytes(Cursor *cursor, char **s, uint32_t *length)
+{
+    if(get_32(cursor, length) != SUCCESS) return ERROR;
+    if((size_t)(cursor->end - cursor->p) <= *length || cursor->p[*length] != 0) return ERROR;
+    *s = cursor->p;
+    cursor->p += *length + 1;
+    return SUCCESS;
+}
+
+static int get_string(IrReader *reader, Cursor *cursor, char **s)
+{
+    uint32_t ref, length;
+    if(get_32(cursor, &ref) != SUCCESS) return ERROR;
+    if(ref == IR_NEW_STRING) {
+        if(reader->strings == IR_STRINGS_MAX || get_bytes(cursor, s, &length) != SUCCESS) return ERROR;
+        if(reader->string == NULL) {
+            reader->string = malloc(IR_STRINGS_MAX * sizeof(char *));
+            if(reader->string == NULL) return ERROR;
+        }
+        char *copy = malloc(length + 1);
+        if(copy == NULL) return ERROR;
+        memcpy(copy, *s, length + 1);
+        reader->string[reader->strings++] = copy;
+        *s = copy;
+        return SUCCESS;
+    }
+    if(ref == IR_LITERAL) {
+        return get_bytes(cursor, s, &length);
+    }
+    if(ref - IR_FIRST_ID >= reader->strings) return ERROR;
+    *s = reader->string[ref - IR_FIRST_ID];
+    return SUCCESS;
+}
+
+static void free_strings(IrReader *reader)
+{
+    while(reader->strings) free(reader->string[--reader->strings]);
+}
+
+int ir_reader_open(IrReader *reader, FILE *in)
+{
+    char header[IR_HEADER_SIZE];
+    uint32_t version;
+
+    memset(reader, 0, sizeof(IrReader));
+    reader->in = in;
+    if(fread(header, 1, sizeof(header), in) != sizeof(header)
+       || memcmp(header, magic, sizeof(magic)) != 0) {
+        return corrupt(reader);
+    }
+    memcpy(&version, header + sizeof(magic), 4);
+    if(le32toh(version) != IR_VERSION) {
+        reader->error = ENOTSUP;
+        return ERROR;
+    }
+    reader->capacity = IR_BLOCK * 2;
+    reader->buffer = malloc(reader->capacity);
+    if(reader->buffer == NULL) {
+        reader->error = ENOMEM;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+int ir_next_line(IrReader *reader, GcodeLine *line, SyntaxWarning **warning, size_t *warnings)
+{
+    Command *command = &line->command;
+    Cursor cursor;
+    uint32_t length, bits, value;
+
+    if(reader->done) return END_OF_FILE;
+    // the length is at most LENGTH_MAX bytes, but the record can be shorter
+    if(fill(reader, 1) != SUCCESS) return ERROR;
+    cursor.p = reader->buffer + reader->start;
+    cursor.end = reader->buffer + reader->end;
+    if(get_32(&cursor, &length) != SUCCESS) {
+        if(reader->end - reader->start >= LENGTH_MAX || fill(reader, LENGTH_MAX) != SUCCESS) return corrupt(reader);
+        cursor.p = reader->buffer + reader->start;
+        cursor.end = reader->buffer + reader->end;
+        if(get_32(&cursor, &length) != SUCCESS) return corrupt(reader);
+    }
+    reader->start = cursor.p - reader->buffer;
+    if(length == 0) {
+        reader->done = 1;
+        return END_OF_FILE;
+    }
+    if(fill(reader, length) != SUCCESS) return ERROR;
+    cursor.p = reader->buffer + reader->start;
+    cursor.end = cursor.p + length;
+    reader->start += length;
+
+    if(get_32(&cursor, &bits) != SUCCESS) return corrupt(reader);
+    command->flag = bits & ~(IR_NUMBER | IR_MACRO | IR_WARNINGS);
+    command->m = 0;
+    line->hasNumber = 0;
+    line->macro = NULL;
+    line->macroParam = NULL;
+    *warnings = 0;
+
+    if(bits & IR_NUMBER) {
+        if(get_32(&cursor, &value) != SUCCESS) return corrupt(reader);
+        line->number = value;
+        line->hasNumber = 1;
+    }
+    if(bits & X_IS_SET && get_double(&cursor, &command->x) != SUCCESS) return corrupt(reader);
+    if(bits & Y_IS_SET && get_double(&cursor, &command->y) != SUCCESS) return corrupt(reader);
+    if(bits & Z_IS_SET && get_double(&cursor, &command->z) != SUCCESS) return corrupt(reader);
+    if(bits & A_IS_SET && get_double(&cursor, &command->a) != SUCCESS) return corrupt(reader);
+    if(bits & B_IS_SET && get_double(&cursor, &command->b) != SUCCESS) return corrupt(reader);
+    if(bits & E_IS_SET && get_double(&cursor, &command->e) != SUCCESS) return corrupt(reader);
+    if(bits & F_IS_SET && get_double(&cursor, &command->f) != SUCCESS) return corrupt(reader);
+    if(bits & P_IS_SET && get_double(&cursor, &command->p) != SUCCESS) return corrupt(reader);
+    if(bits & R_IS_SET && get_double(&cursor, &command->r) != SUCCESS) return corrupt(reader);
+    if(bits & S_IS_SET && get_double(&cursor, &command->s) != SUCCESS) return corrupt(reader);
+    if(bits & G_IS_SET) {
+        if(get_32(&cursor, &value) != SUCCESS) return corrupt(reader);
+        command->g = value;
+    }
+    if(bits & M_IS_SET) {
+        if(get_32(&cursor, &value) != SUCCESS) return corrupt(reader);
+        command->m = value;
+    }
+    if(bits & T_IS_SET) {
+        if(get_32(&cursor, &value) != SUCCESS) return corrupt(reader);
+        command->t = value;
+    }
+    if(bits & COMMENT_IS_SET && get_string(reader, &cursor, &command->comment) != SUCCESS) return corrupt(reader);
+    if(bits & ARG_IS_SET && get_string(reader, &cursor, &command->arg) != SUCCESS) return corrupt(reader);
+    if(bits & IR_MACRO) {
+        char *param;
+        if(get_string(reader, &cursor, &line->macro) != SUCCESS
+           || get_string(reader, &cursor, &param) != SUCCESS) return corrupt(reader);
+        // the macro parser modifies its parameter
+        size_t size = strlen(param) + 1;
+        if(size > reader->paramSize) {
+            char *copy = realloc(reader->param, size);
+            if(copy == NULL) {
+                reader->error = ENOMEM;
+                return ERROR;
+            }
+            reader->param = copy;
+            reader->paramSize = size;
+        }
+        line->macroParam = memcpy(reader->param, param, size);
+    }
+    if(bits & IR_WARNINGS) {
+        uint32_t i, count, code, c, text;
+        if(get_32(&cursor, &count) != SUCCESS || count > length / 2) return corrupt(reader);
+        if(count > reader->warningSize) {
+            SyntaxWarning *w = realloc(reader->warning, count * sizeof(SyntaxWarning));
+            if(w == NULL) {
+                reader->error = ENOMEM;
+                return ERROR;
+            }
+            reader->warning = w;
+            reader->warningSize = count;
+        }
+        for(i = 0; i < count; i++) {
+            SyntaxWarning *w = reader->warning + i;
+            if(get_32(&cursor, &code) != SUCCESS || get_32(&cursor, &c) != SUCCESS) return corrupt(reader);
+            w->index = 0;
+            w->code = code;
+            w->c = c;
+            w->text = NULL;
+            if(code == SYNTAX_UNRECOGNISED && get_bytes(&cursor, &w->text, &text) != SUCCESS) return corrupt(reader);
+        }
+        *warning = reader->warning;
+        *warnings = count;
+    }
+    if(cursor.p != cursor.end) return corrupt(reader);
+    return SUCCESS;
+}
+
+int ir_read_macros(IrReader *reader, int (*handler)(void *data, unsigned index, const char *macro, char *param), void *data)
+{
+    char footer[IR_FOOTER_SIZE];
+    uint64_t table;
+    uint32_t i, count, index, length;
+    Cursor cursor;
+    int rval = SUCCESS;
+
+    // the table is read straight from the stream, so the records have to
+    // be read again from the start afterwards
+    reader->done = 1;
+    if(fseek(reader->in, -IR_FOOTER_SIZE, SEEK_END) != 0
+       || fread(footer, 1, sizeof(footer), reader->in) != sizeof(footer)) {
+        reader->error = errno ? errno : EBADMSG;
+        return ERROR;
+    }
+    if(memcmp(footer + 12, footer_magic, 4) != 0) return corrupt(reader);
+    memcpy(&table, footer, 8);
+    table = le64toh(table);
+    if(fseek(reader->in, (long)table, SEEK_SET) != 0) {
+        reader->error = errno;
+        return ERROR;
+    }
+    reader->start = reader->end = 0;
+    reader->eof = 0;
+    // the footer follows the table, so a varint is always there in full
+    if(fill(reader, IR_FOOTER_SIZE) != SUCCESS) return ERROR;
+    cursor.p = reader->buffer;
+    cursor.end = reader->buffer + reader->end;
+    if(get_32(&cursor, &count) != SUCCESS) return corrupt(reader);
+    reader->start = cursor.p - reader->buffer;
+
+    for(i = 0; i < count; i++) {
+        char *macro, *param;
+        if(fill(reader, IR_FOOTER_SIZE) != SUCCESS) return ERROR;
+        cursor.p = reader->buffer + reader->start;
+        cursor.end = reader->buffer + reader->end;
+        while(get_32(&cursor, &index) != SUCCESS || get_bytes(&cursor, &macro, &length) != SUCCESS
+              || get_bytes(&cursor, &param, &length) != SUCCESS) {
+            // the entry runs past the end of the buffer
+            if(reader->eof) return corrupt(reader);
+            if(fill(reader, reader->end - reader->start + 1) != SUCCESS) return ERROR;
+            cursor.p = reader->buffer + reader->start;
+            cursor.end = reader->buffer + reader->end;
+        }
+        reader->start = cursor.p - reader->buffer;
+        rval = handler(data, index, macro, param);
+        if(rval < 0) break;
+        rval = SUCCESS;
+    }
+    return rval;
+}
+
+int ir_rewind(IrReader *reader)
+{
+    if(fseek(reader->in, IR_HEADER_SIZE, SEEK_SET) != 0) {
+        reader->error = errno;
+        return ERROR;
+    }
+    free_strings(reader);
+    reader->start = reader->end = 0;
+    reader->eof = 0;
+    reader->done = 0;
+    return SUCCESS;
+}
+
+void ir_reader_close(IrReader *reader)
+{
+    free_strings(reader);
+    free(reader->string);
+    free(reader->buffer);
+    free(reader->param);
+    free(reader->warning);
+}
@@ -0,0 +1,108 @@
+//  ir.h
+//
+//  Tokenized gcode intermediate representation
+//
+//  A binary stream of tokenized gcode lines, written once from the text and
+//  then converted for any number of machines without splitting lines into
+//  words or parsing numbers again. Each record holds the words set on the
+//  line, its line number, its comment, argument and macro, and the syntax
+//  warnings found while tokenizing it, so the conversion and its log are
+//  the same as converting the text. Comments and macros are interned, and
+//  the macros are repeated in a table at the end so the macro prescan can
+//  skip the records altogether.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __ir_h__
+#define __ir_h__
+
+#include "gpx.h"
+
+#define IR_VERSION 1
+
+typedef struct tIrWriter {
+    FILE *out;
+    int error;              // errno of the write that failed, otherwise 0
+    char *buffer;           // records waiting to be written
+    size_t length;          // bytes waiting in the buffer
+    size_t capacity;        // size of the buffer in bytes
+    unsigned long long offset; // bytes written to out
+    unsigned lines;         // records written
+    struct tIrString *slot; // hash table of the interned strings
+    unsigned strings;       // strings interned
+    vector *macros;         // the macro table
+} IrWriter;
+
+typedef struct tIrReader {
+    FILE *in;
+    int error;              // errno of the read that failed, or EBADMSG
+    char *buffer;           // records read but not yet handed out
+    size_t capacity;        // size of the buffer in bytes
+    size_t start;           // offset of the next record in the buffer
+    size_t end;             // offset of the end of the input in the buffer
+    int eof;                // the stream has no more input
+    int done;               // the end of the records has been reached
+    char **string;          // the interned strings by id
+    unsigned strings;       // strings interned so far
+    char *param;            // copy of the macro parameter handed out
+    size_t paramSize;       // size of the copy in bytes
+    SyntaxWarning *warning; // the syntax warnings handed out
+    unsigned warningSize;   // number of warnings there is room for
+} IrReader;
+
+// is the seekable stream in tokenized gcode, the stream is left at its start
+int ir_detect(FILE *in);
+
+// start writing tokenized gcode to out
+// returns SUCCESS, or ERROR if there is not enough memory
+int ir_writer_open(IrWriter *writer, FILE *out);
+
+// write a tokenized line and the syntax warnings found on it, rawMacro and
+// rawParam are the macro the prescan would find on the text of the line,
+// or NULL if it has none
+// returns SUCCESS or ERROR, in which case error is set
+int ir_write_line(IrWriter *writer, const GcodeLine *line, const SyntaxWarning *warning, size_t warnings,
+                  const char *rawMacro, const char *rawParam);
+
+// write the macro table and flush the output, releases the writer
+// returns SUCCESS or ERROR, in which case error is set
+int ir_writer_close(IrWriter *writer);
+
+// start reading tokenized gcode from the seekable stream in
+// returns SUCCESS, or ERROR if it isn't tokenized gcode this version can
+// read or there is not enough memory, in which case error is set
+int ir_reader_open(IrReader *reader, FILE *in);
+
+// read the next line into line, the comment, argument, macro and warnings
+// stay valid until the next call
+// returns SUCCESS, END_OF_FILE after the last line, or ERROR if the input
+// can't be read or is corrupt, in which case error is set
+int ir_next_line(IrReader *reader, GcodeLine *line, SyntaxWarning **warning, size_t *warnings);
+
+// call handler with each entry in the macro table, index is the position
+// of its line in the input and param may be modified by the handler
+// returns the first negative result of the handler, ERROR if the table
+// can't be read, otherwise SUCCESS, the reader has to be rewound to read
+// the lines again
+int ir_read_macros(IrReader *reader, int (*handler)(void *data, unsigned index, const char *macro, char *param), void *data);
+
+// start again from the first line
+// returns SUCCESS or ERROR if the stream can't be rewound
+int ir_rewind(IrReader *reader);
+
+// release the reader, the stream remains open
+void ir_reader_close(IrReader *reader);
+
+#endif /* __ir_h__ */
@@ -0,0 +1,336 @@
+//  kinematics.c
+//
+//  Batched kinematics for runs of consecutive moves
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <math.h>
+#include <time.h>
+
+#include "kinematics.h"
+
+// Each step below does what queue_ext_point_core does for a single move,
+// with the same operations in the same order so the results are the same.
+// The loops over a group of MOVE_LANES moves have a fixed trip count and
+// don't branch. They only choose between values that have already been
+// stored, so the compiler can't move the arithmetic behind a branch, and
+// they vectorize without a scalar remainder. round(), sqrt() and the long
+// double DDA arithmetic can't be vectorized without changing the results,
+// so they stay in plain loops over the batch.
+
+static const int axis_bit[5] = {X_IS_SET, Y_IS_SET, Z_IS_SET, A_IS_SET, B_IS_SET};
+
+void kinematics_compute(MoveBatch *batch, const Machine *machine, Ptr2d excess)
+{
+    const double steps_per_mm[5] = {
+        machine->x.steps_per_mm, machine->y.steps_per_mm, machine->z.steps_per_mm,
+        machine->a.steps_per_mm, machine->b.steps_per_mm
+    };
+    const double max_feedrate[5] = {
+        machine->x.max_feedrate, machine->y.max_feedrate, machine->z.max_feedrate,
+        machine->a.max_feedrate, machine->b.max_feedrate
+    };
+    double length[5][MOVE_BATCH_MAX];       // distance along the axis in mm
+    double deltaSteps[5][MOVE_BATCH_MAX];   // distance along the axis in steps
+    double limit[5][MOVE_BATCH_MAX];        // the axis feedrate limit
+    double candidate[5][MOVE_BATCH_MAX];    // the feedrate if the axis limits it
+    double bound[2][MOVE_BATCH_MAX];        // candidate and
+    double scale[2][MOVE_BATCH_MAX];        // length and
+    double divisor[MOVE_BATCH_MAX];         // distance for the extruders
+    double feedrate[MOVE_BATCH_MAX];
+    double distance[MOVE_BATCH_MAX];
+    double moving[MOVE_BATCH_MAX];
+    double largest[MOVE_BATCH_MAX];
+    double minutes[MOVE_BATCH_MAX];
+    double extrusion[MOVE_BATCH_MAX];
+    double fallback[MOVE_BATCH_MAX];
+    // size_t indexes, so the compiler can tell they don't wrap
+    size_t n = (batch->count + MOVE_LANES - 1) & ~(size_t)(MOVE_LANES - 1);
+    size_t i, j, k, m;
+
+    // the feedrate used when none has been set
+    double fastest = max_feedrate[0];
+    for(k = 1; k < 5; k++) {
+        if(fastest < max_feedrate[k]) fastest = max_feedrate[k];
+    }
+
+    // pad the last group with moves that go nowhere
+    for(i = batch->count; i < n; i++) {
+        batch->flag[i] = 0;
+        batch->feedrate[i] = 0.0;
+    }
+
+    // the distance along each axis in mm and in whole steps, zero unless
+    // the axis is on the command, so an axis that isn't can never limit
+    // the feedrate, except for an extruder only move, which is limited by
+    // the extruder feedrate itself if the extruder is on the command
+    for(k = 0; k < 5; k++) {
+        int bit = axis_bit[k];
+        for(i = 0; i < n; i++) {
+            if(batch->flag[i] & bit) {
+                length[k][i] = fabs(batch->delta[k][i]);
+                deltaSteps[k][i] = round(length[k][i] * steps_per_mm[k]);
+                limit[k][i] = max_feedrate[k];
+            }
+            else {
+                length[k][i] = 0.0;
+                deltaSteps[k][i] = 0.0;
+                limit[k][i] = k < 3 ? max_feedrate[k] : INFINITY;
+            }
+        }
+    }
+
+    // is there a step on any axis, the largest step count, the xyz distance
+    // squared and the feedrate requested
+    for(i = 0; i < n; i += MOVE_LANES) {
+        for(j = 0; j < MOVE_LANES; j++) {
+            m = i + j;
+            double result = deltaSteps[0][m];
+            result = result < deltaSteps[1][m] ? deltaSteps[1][m] : result;
+            result = result < deltaSteps[2][m] ? deltaSteps[2][m] : result;
+            result = result < deltaSteps[3][m] ? deltaSteps[3][m] : result;
+            result = result < deltaSteps[4][m] ? deltaSteps[4][m] : result;
+            largest[m] = result;
+            moving[m] = deltaSteps[0][m] + deltaSteps[1][m] + deltaSteps[2][m]
+                      + deltaSteps[3][m] + deltaSteps[4][m];
+            distance[m] = length[0][m] * length[0][m] + length[1][m] * length[1][m] + length[2][m] * length[2][m];
+            feedrate[m] = batch->feedrate[m] == 0.0 ? fastest : batch->feedrate[m];
+        }
+    }
+
+    for(i = 0; i < n; i++) {
+        batch->moving[i] = moving[i] > 0;
+        distance[i] = sqrt(distance[i]);
+    }
+
+    // the feedrate at which each axis would reach its limit
+    for(k = 0; k < 5; k++) {
+        for(i = 0; i < n; i += MOVE_LANES) {
+            for(j = 0; j < MOVE_LANES; j++) {
+                m = i + j;
+                candidate[k][m] = max_feedrate[k] * distance[m] / length[k][m];
+            }
+        }
+    }
+
+    // unless the move has no xyz distance, then the feedrate of the
+    // extruders is limited directly, each of these loops makes a single
+    // choice between values it has loaded, so the compiler doesn't turn it
+    // back into a branch
+    for(i = 0; i < n; i += MOVE_LANES) {
+        for(j = 0; j < MOVE_LANES; j++) {
+            m = i + j;
+            double d = distance[m];
+            divisor[m] = d == 0 ? 1.0 : d;
+        }
+    }
+    for(k = 0; k < 2; k++) {
+        for(i = 0; i < n; i += MOVE_LANES) {
+            for(j = 0; j < MOVE_LANES; j++) {
+                m = i + j;
+                double d = distance[m], l = limit[k + 3][m], c = candidate[k + 3][m];
+                bound[k][m] = d == 0 ? l : c;
+            }
+        }
+        for(i = 0; i < n; i += MOVE_LANES) {
+            for(j = 0; j < MOVE_LANES; j++) {
+                m = i + j;
+                double d = distance[m], l = length[k + 3][m];
+                scale[k][m] = d == 0 ? 1.0 : l;
+            }
+        }
+    }
+
+    // each axis in turn lowers the feedrate to its limit, the speed along
+    // the axis is feedrate * length / distance
+    for(k = 0; k < 5; k++) {
+        const double *c = k < 3 ? candidate[k] : bound[k - 3];
+        const double *l = k < 3 ? length[k] : scale[k - 3];
+        const double *d = k < 3 ? distance : divisor;
+        for(i = 0; i < n; i += MOVE_LANES) {
+            for(j = 0; j < MOVE_LANES; j++) {
+                m = i + j;
+                double f = feedrate[m], v = c[m], speed = f * l[m] / d[m];
+                feedrate[m] = speed > limit[k][m] ? v : f;
+            }
+        }
+    }
+
+    // the time the move takes, moves with no xyz distance take as long as
+    // the longest extrusion
+    for(i = 0; i < n; i += MOVE_LANES) {
+        for(j = 0; j < MOVE_LANES; j++) {
+            m = i + j;
+            minutes[m] = distance[m] / feedrate[m];
+            extrusion[m] = length[3][m] < length[4][m] ? length[4][m] : length[3][m];
+            fallback[m] = extrusion[m] / feedrate[m];
+        }
+    }
+
+    for(i = 0; i < n; i += MOVE_LANES) {
+        for(j = 0; j < MOVE_LANES; j++) {
+            m = i + j;
+            double t = minutes[m], e = extrusion[m], d = distance[m];
+            batch->distance[m] = t == 0 ? e : d;
+        }
+    }
+    for(i = 0; i < n; i += MOVE_LANES) {
+        for(j = 0; j < MOVE_LANES; j++) {
+            m = i + j;
+            double t = minutes[m], e = fallback[m];
+            batch->minutes[m] = t == 0 ? e : t;
+            batch->safeFeedrate[m] = feedrate[m] / 60.0;
+        }
+    }
+
+    // the target in steps, carrying the rounding remainder of the a and b
+    // steps from each move to the next, and the DDA rate
+    for(i = 0; i < batch->count; i++) {
+        if(batch->moving[i]) {
+            double value;
+            batch->steps[0][i] = round(batch->target[0][i] * steps_per_mm[0]);
+            batch->steps[1][i] = round(batch->target[1][i] * steps_per_mm[1]);
+            batch->steps[2][i] = round(batch->target[2][i] * steps_per_mm[2]);
+
+            value = (-batch->delta[3][i] * steps_per_mm[3]) + excess->a;
+            batch->steps[3][i] = round(value);
+            excess->a = value - batch->steps[3][i];
+
+            value = (-batch->delta[4][i] * steps_per_mm[4]) + excess->b;
+            batch->steps[4][i] = round(value);
+            excess->b = value - batch->steps[4][i];
+
+            double usec = (60000000.0L * batch->minutes[i]);
+            double dda_interval = usec / largest[i];
+            batch->ddaRate[i] = 1000000.0L / dda_interval;
+        }
+    }
+}
+
+// COALESCING
+
+// the distance of point p from the segment from s to e
+
+static double segment_distance(const double p[3], const double s[3], const double e[3])
+{
+    double se[3], sp[3], t = 0.0, length = 0.0, d = 0.0;
+    int k;
+    for(k = 0; k < 3; k++) {
+        se[k] = e[k] - s[k];
+        sp[k] = p[k] - s[k];
+        t += sp[k] * se[k];
+        length += se[k] * se[k];
+    }
+    // the nearest point on the segment
+    t = length > 0.0 ? t / length : 0.0;
+    if(t < 0.0) t = 0.0;
+    else if(t > 1.0) t = 1.0;
+    for(k = 0; k < 3; k++) {
+        double c = sp[k] - t * se[k];
+        d += c * c;
+    }
+    return sqrt(d);
+}
+
+// the extrusion per mm of two moves is close enough for them to be merged
+
+static int same_extrusion(double a, double b)
+{
+    return fabs(a - b) <= COALESCE_EXTRUSION_TOLERANCE * fmax(fabs(a), fabs(b));
+}
+
+// the move is shorter than the shortest move that is kept
+
+static int too_short(const MoveBatch *batch, unsigned i, double length, const Coalesce *coalesce)
+{
+    if(coalesce->length > 0.0 && length < coalesce->length) return 1;
+    // the feedrate is in mm per minute, 0 for the fastest
+    if(coalesce->time > 0.0 && batch->feedrate[i] > 0.0
+       && length * 60.0 / batch->feedrate[i] < coalesce->time) return 1;
+    return 0;
+}
+
+// Only moves of the same command to the same axes at the same feedrate,
+// that extrude as much per mm, go to an absolute xyz position and carry on
+// in the same direction are merged. The xyz target of the merged move is the target of the last
+// move, so it is converted to the same steps, and the extruder distances
+// are added together, so the steps they carry over to the next move are
+// the same. The points dropped along the way are kept, so a run of moves
+// around a gentle curve can't drift further than the tolerance from them.
+
+int kinematics_coalesce(MoveBatch *batch, const Coalesce *coalesce, const Machine *machine)
+{
+    const double steps_per_mm[3] = {
+        machine->x.steps_per_mm, machine->y.steps_per_mm, machine->z.steps_per_mm
+    };
+    unsigned i = batch->count, p = i - 1, j, k;
+    double previous = 0.0, next = 0.0, along_previous = 0.0, along_next = 0.0;
+    int stepping = 0;
+
+    if(coalesce->tolerance <= 0.0 && coalesce->length <= 0.0 && coalesce->time <= 0.0) return 0;
+    if(i == 0 || batch->joints == MOVE_JOINTS_MAX) return 0;
+    if(batch->flag[i] != batch->flag[p] || batch->g[i] != batch->g[p]
+       || batch->feedrate[i] != batch->feedrate[p] || batch->relative[i] != batch->relative[p]) return 0;
+    if(batch->relative[i] != (A_IS_SET | B_IS_SET) || !(batch->flag[i] & (X_IS_SET | Y_IS_SET | Z_IS_SET))) return 0;
+
+    for(k = 0; k < 3; k++) {
+        previous += batch->delta[k][p] * batch->delta[k][p];
+        next += batch->delta[k][i] * batch->delta[k][i];
+    }
+    previous = sqrt(previous);
+    next = sqrt(next);
+    if(previous == 0.0 || next == 0.0) return 0;
+    for(k = 3; k < 5; k++) {
+        if(!same_extrusion(batch->delta[k][p] / previous, batch->delta[k][i] / next)) return 0;
+    }
+
+    // the merged move has to go on along both moves and be at least a step
+    // long, moves that double back would merge into one too short to step
+    // and kinematics_compute would drop the extrusion with it
+    for(k = 0; k < 3; k++) {
+        double merged = batch->delta[k][p] + batch->delta[k][i];
+        along_previous += merged * batch->delta[k][p];
+        along_next += merged * batch->delta[k][i];
+        if(round(fabs(merged) * steps_per_mm[k]) > 0.0) stepping = 1;
+    }
+    if(along_previous <= 0.0 || along_next <= 0.0 || !stepping) return 0;
+
+    // a move too short to keep is merged whichever way the next one goes
+    if(!too_short(batch, p, previous, coalesce)) {
+        double start[3], end[3], point[3];
+        if(coalesce->tolerance <= 0.0) return 0;
+        for(k = 0; k < 3; k++) {
+            start[k] = batch->target[k][p] - batch->delta[k][p];
+            end[k] = batch->target[k][i];
+            point[k] = batch->target[k][p];
+        }
+        if(segment_distance(point, start, end) > coalesce->tolerance) return 0;
+        for(j = 0; j < batch->joints; j++) {
+            for(k = 0; k < 3; k++) point[k] = batch->joint[k][j];
+            if(segment_distance(point, start, end) > coalesce->tolerance) return 0;
+        }
+    }
+
+    j = batch->joints++;
+    for(k = 0; k < 3; k++) {
+        batch->joint[k][j] = batch->target[k][p];
+        batch->target[k][p] = batch->target[k][i];
+    }
+    for(k = 0; k < 5; k++) {
+        batch->delta[k][p] += batch->delta[k][i];
+    }
+    batch->lineNumber[p] = batch->lineNumber[i];
+    return 1;
+}
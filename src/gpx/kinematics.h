@@ -0,0 +1,80 @@
+//  kinematics.h
+//
+//  Batched kinematics for runs of consecutive moves
+//
+//  Moves that can be converted with nothing but the machine definition and
+//  the position they start from are held back in a batch, with each
+//  quantity of the moves in an array of its own. The steps, distances,
+//  safe feedrates and DDA rates of the whole batch are then computed a
+//  group of MOVE_LANES moves at a time, in loops the compiler can turn
+//  into vector instructions, so they get the same results as converting
+//  the moves one at a time, bit for bit.
+//
+//  As each move is added, kinematics_coalesce can merge it into the move
+//  before it, so runs of short collinear segments are emitted as a single
+//  move that ends exactly where the last segment ended and extrudes exactly
+//  as much as all of them together.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __kinematics_h__
+#define __kinematics_h__
+
+#include "gpx.h"
+
+#define MOVE_BATCH_MAX 64   // moves held back before the batch is converted
+#define MOVE_LANES 8        // moves computed side by side, as many doubles as the widest vector
+#define MOVE_JOINTS_MAX 32  // points a merged move can drop, so checking them stays cheap
+
+#define COALESCE_EXTRUSION_TOLERANCE 0.01 // the relative difference in extrusion per mm of moves that can be merged
+
+typedef struct tMoveBatch {
+    unsigned count;             // moves in the batch
+    unsigned long added;        // moves ever added, so a line can tell if its move was held back
+    unsigned long bytes;        // x3g bytes emitted converting batches
+    int converting;             // the batch is being converted
+    unsigned joints;            // points dropped from the last move by merging moves into it
+    double joint[3][MOVE_JOINTS_MAX];       // and where they were
+
+    // the moves, filled in as they are added
+    int flag[MOVE_BATCH_MAX];               // the command words set
+    unsigned g[MOVE_BATCH_MAX];             // the G code, for the statistics
+    unsigned lineNumber[MOVE_BATCH_MAX];
+    unsigned relative[MOVE_BATCH_MAX];      // the relative axes bitfield
+    double feedrate[MOVE_BATCH_MAX];        // mm/min including the speed factor, 0 for the fastest
+    double delta[5][MOVE_BATCH_MAX];        // the signed distance along each axis in mm
+    double target[3][MOVE_BATCH_MAX];       // the x, y and z coordinates in mm
+
+    // the results of kinematics_compute
+    int moving[MOVE_BATCH_MAX];             // the move is at least a step on some axis
+    double steps[5][MOVE_BATCH_MAX];        // the target in steps, a and b relative
+    double distance[MOVE_BATCH_MAX];        // in mm
+    double minutes[MOVE_BATCH_MAX];
+    double safeFeedrate[MOVE_BATCH_MAX];    // in mm/s
+    double ddaRate[MOVE_BATCH_MAX];         // steps/s along the axis with the most steps
+} MoveBatch;
+
+// merge the move just filled in at batch->count into the move before it,
+// the machine's steps per mm decide if the merged move is long enough to
+// step, returns 1 if it was merged, 0 if it has to be added as a move of
+// its own
+
+int kinematics_coalesce(MoveBatch *batch, const Coalesce *coalesce, const Machine *machine);
+
+// compute the results for the moves in the batch, excess accumulates the
+// rounding remainder of the a and b steps from one move to the next
+void kinematics_compute(MoveBatch *batch, const Machine *machine, Ptr2d excess);
+
+#endif /* __kinematics_h__ */
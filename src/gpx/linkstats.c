@@ -0,0 +1,137 @@
+//  linkstats.c
+//
+//  Serial link telemetry
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpx.h"
+#include "linkstats.h"
+
+static const char *response_name[LINK_RESPONSES] = {
+    "generic packet error",
+    "success",
+    "buffer overflow",
+    "crc mismatch",
+    "query too big",
+    "not supported",
+    "0x86",
+    "downstream timeout",
+    "tool lock timeout",
+    "cancel build",
+    "building from sd",
+    "overheated",
+    "packet timeout"
+};
+
+static volatile sig_atomic_t requested;
+
+double link_clock(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+    return (double)time(NULL);
+}
+
+void link_stats_initialize(LinkStats *stats)
+{
+    memset(stats, 0, sizeof(LinkStats));
+    stats->start = link_clock();
+}
+
+void link_stats_response(LinkStats *stats, unsigned code, double rtt)
+{
+    int bucket;
+    double limit;
+    if(code >= 0x80 && code < 0x80 + LINK_RESPONSES) {
+        stats->response[code - 0x80]++;
+    }
+    for(bucket = 0, limit = 0.00025; rtt >= limit && bucket < LINK_RTT_BUCKETS - 1; limit *= 2) bucket++;
+    stats->rtt[bucket]++;
+    stats->rttTotal += rtt;
+    if(rtt > stats->rttMax) stats->rttMax = rtt;
+}
+
+void link_stats_report(const LinkStats *stats, unsigned long bytes_out, unsigned long bytes_in, FILE *out)
+{
+    double elapsed = link_clock() - stats->start;
+    unsigned long responses = 0;
+    int i;
+    double limit;
+
+    for(i = 0; i < LINK_RESPONSES; i++) responses += stats->response[i];
+    fprintf(out, "Serial link statistics" EOL);
+    fprintf(out, "%lu packets, %lu bytes out, %lu bytes in, %0.3f s" EOL, stats->packets, bytes_out, bytes_in, elapsed);
+    if(elapsed > 0) {
+        fprintf(out, "%0.1f commands/s, %0.1f bytes/s out" EOL, stats->response[1] / elapsed, bytes_out / elapsed);
+    }
+    fprintf(out, "%0.3f s waiting for buffer space, %0.3f s waiting to retry" EOL, stats->overflowWait, stats->retryWait);
+    fprintf(out, "%lu timeouts, %lu input crc errors" EOL EOL, stats->timeouts, stats->crcErrors);
+
+    fprintf(out, "%-22s %10s" EOL, "response", "count");
+    for(i = 0; i < LINK_RESPONSES; i++) {
+        if(stats->response[i] == 0) continue;
+        fprintf(out, "0x%02X %-17s %10lu" EOL, 0x80 + i, response_name[i], stats->response[i]);
+    }
+
+    if(responses) {
+        fprintf(out, EOL "round trip: %0.3f ms average, %0.3f ms max" EOL,
+                1000 * stats->rttTotal / responses, 1000 * stats->rttMax);
+        for(i = 0, limit = 0.25; i < LINK_RTT_BUCKETS; i++, limit *= 2) {
+            if(stats->rtt[i] == 0) continue;
+            if(i < LINK_RTT_BUCKETS - 1)
+                fprintf(out, "  < %7.2f ms %10lu" EOL, limit, stats->rtt[i]);
+            else
+                fprintf(out, " >= %7.2f ms %10lu" EOL, limit / 2, stats->rtt[i]);
+        }
+    }
+    fflush(out);
+}
+
+#ifdef SIGUSR1
+static void request_report(int signum)
+{
+    requested = 1;
+}
+#endif
+
+void link_stats_install_signal(void)
+{
+#ifdef SIGUSR1
+    // restart the reads and writes it interrupts, select still returns
+    // EINTR and is retried by its callers
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_report;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+#endif
+}
+
+int link_stats_requested(void)
+{
+    if(requested) {
+        requested = 0;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+//  linkstats.h
+//
+//  Serial link telemetry
+//
+//  port_handler counts every packet it sends, the response code it gets
+//  back and how long the round trip took, and the time it spends waiting
+//  for room in the firmware's command buffer or before a retry, so a slow
+//  print can be put down to the link, the host or the firmware. The report
+//  is written at the end of a print sent with -s, when gpx is sent SIGUSR1,
+//  and when the daemon stops.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __linkstats_h__
+#define __linkstats_h__
+
+#include <stdio.h>
+
+#define LINK_RTT_BUCKETS 12     // round trips under 0.25 ms, doubling up to 256 ms and over
+#define LINK_RESPONSES 13       // the response codes 0x80 to 0x8C
+
+typedef struct tLinkStats {
+    double start;               // when the port was opened, in seconds
+    unsigned long packets;      // packets written, retries included
+    unsigned long timeouts;     // packets with no response
+    unsigned long crcErrors;    // responses that failed their crc
+    unsigned long response[LINK_RESPONSES];
+    unsigned long rtt[LINK_RTT_BUCKETS];
+    double rttTotal;            // seconds from writing a packet to reading its response
+    double rttMax;
+    double overflowWait;        // seconds waiting for room in the firmware's command buffer
+    double retryWait;           // seconds sleeping before sending a packet again
+} LinkStats;
+
+// the current time in seconds, from a clock that only goes forward
+double link_clock(void);
+
+// start counting from now
+void link_stats_initialize(LinkStats *stats);
+
+// count the response code and round trip time of a packet
+void link_stats_response(LinkStats *stats, unsigned code, double rtt);
+
+// write the report to out, bytes_out and bytes_in are the bytes written
+// to and read from the port
+void link_stats_report(const LinkStats *stats, unsigned long bytes_out, unsigned long bytes_in, FILE *out);
+
+// SIGUSR1 asks for a report, which port_handler writes after the packet
+// it's sending, a no-op where there is no SIGUSR1
+void link_stats_install_signal(void);
+int link_stats_requested(void);
+
+#endif /* __linkstats_h__ */
@@ -0,0 +1,91 @@
+//  number.c
+//
+//  Number parsing for the gcode tokenizer
+//
+//  Converts the words that normalize_word produces, an optional sign,
+//  digits and an optional fraction, without going through strtod and atoi
+//  for the common short values, and with exactly the same results.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "number.h"
+#include "scan.h"
+
+// powers of ten that are exactly representable as doubles
+
+static const double exact_power_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// convert a word cleaned up by normalize_word to a double, the result is
+// identical to strtod's
+// the digits are collected as an integer, and when that integer fits in the
+// 53 bit mantissa and there are no more than 22 decimals, the value is a
+// single correctly rounded division of two exact doubles, which is also
+// what strtod returns, anything else is handed to strtod
+
+double word_to_double(const char *digits)
+{
+#if FLT_EVAL_METHOD == 0
+    const char *s = digits;
+    uint64_t mantissa = 0;
+    int negative = 0;
+    int significant = 0;
+    int integers = 0;
+    int decimals = 0;
+
+    if(*s == '+' || *s == '-') negative = *s++ == '-';
+    for(; scan_isdigit(*s); s++, integers++) {
+        if(mantissa || *s != '0') significant++;
+        mantissa = mantissa * 10 + (*s - '0');
+    }
+    if(*s == '.') {
+        for(s++; scan_isdigit(*s); s++, decimals++) {
+            if(mantissa || *s != '0') significant++;
+            mantissa = mantissa * 10 + (*s - '0');
+        }
+    }
+    // strtod doesn't accept a sign or point on its own, so it returns +0
+    if(integers + decimals == 0) return 0.0;
+    if(significant <= 19 && mantissa <= (UINT64_C(1) << 53) && decimals <= 22) {
+        double value = (double)mantissa / exact_power_of_ten[decimals];
+        return negative ? -value : value;
+    }
+#endif
+    return strtod(digits, NULL);
+}
+
+// convert a word cleaned up by normalize_word to an int, the same as atoi
+
+int word_to_int(const char *digits)
+{
+    const char *s = digits;
+    unsigned value = 0;
+    int negative = 0;
+    int n;
+
+    if(*s == '+' || *s == '-') negative = *s++ == '-';
+    for(n = 0; scan_isdigit(*s); s++, n++) {
+        value = value * 10 + (*s - '0');
+    }
+    // leave overflow to atoi
+    if(n > 9) return atoi(digits);
+    return negative ? -(int)value : (int)value;
+}
@@ -0,0 +1,33 @@
+//  number.h
+//
+//  Number parsing for the gcode tokenizer
+//
+//  Converts the words that normalize_word produces, an optional sign,
+//  digits and an optional fraction, without going through strtod and atoi
+//  for the common short values, and with exactly the same results.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __number_h__
+#define __number_h__
+
+// convert a word cleaned up by normalize_word to a double, the result is
+// bit for bit the same as strtod's
+double word_to_double(const char *digits);
+
+// convert a word cleaned up by normalize_word to an int, the same as atoi
+int word_to_int(const char *digits);
+
+#endif /* __number_h__ */
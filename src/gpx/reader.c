@@ -0,0 +1,401 @@
+//  reader.c
+//
+//  Line reader for gcode input
+//
+//  Regular files are memory mapped read only and each line is copied out
+//  of the mapping into the buffer, so the pages stay shared with the file
+//  cache and are dropped once they have been read. Everything else (stdin,
+//  pipes, ptys, platforms without mmap) is read a block at a time into a
+//  buffer that grows to hold the longest line, and lines are handed out in
+//  place from the buffer. Input that starts with
+//  the gzip or zstd magic number is decompressed into the buffer as it is
+//  read.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define READER_MMAP 1
+#include <sys/mman.h>
+#endif
+
+#include "reader.h"
+
+// size of each read, the buffer starts at twice this
+
+#define READ_BLOCK 65536
+
+// the pages of the mapping read so far are dropped a block at a time, so
+// the resident size stays the same however big the input is
+
+#define RELEASE_BLOCK (4 * 1024 * 1024)
+
+// make room for at least needed bytes plus a terminator after the input
+// returns 0 on success or -1 if the buffer can't grow
+
+static int reserve(Reader *reader, size_t needed)
+{
+    if(needed < reader->capacity)
+        return 0;
+    size_t capacity = reader->capacity ? reader->capacity : READ_BLOCK * 2;
+    while(capacity <= needed) {
+        capacity *= 2;
+        if(capacity <= reader->capacity) {
+            reader->error = ENOMEM;
+            return -1;
+        }
+    }
+    char *buffer = realloc(reader->buffer, capacity);
+    if(buffer == NULL) {
+        reader->error = ENOMEM;
+        return -1;
+    }
+    reader->buffer = buffer;
+    reader->capacity = capacity;
+    return 0;
+}
+
+#ifdef READER_MMAP
+
+// map the whole input read only, lines are copied out of it to be
+// terminated, returns 0 on success or -1 if the input can't be mapped
+
+static int map_input(Reader *reader)
+{
+    struct stat st;
+    int fd = reader->in ? fileno(reader->in) : reader->fd;
+
+    if(fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return -1;
+    if((unsigned long long)st.st_size > (size_t)-1)
+        return -1;
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED)
+        return -1;
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    reader->map = (char *)map;
+    reader->size = (size_t)st.st_size;
+    reader->next = 0;
+    reader->released = 0;
+    return 0;
+}
+
+static void unmap_input(Reader *reader)
+{
+    if(reader->map) {
+        munmap(reader->map, reader->size);
+        reader->map = NULL;
+    }
+}
+
+#endif // READER_MMAP
+
+static void reset(Reader *reader)
+{
+    reader->error = 0;
+    reader->eof = 0;
+    reader->start = 0;
+    reader->end = 0;
+    reader->scanned = 0;
+    reader->next = 0;
+    reader->released = 0;
+    reader->restore = NULL;
+}
+
+void reader_open(Reader *reader, FILE *in)
+{
+    struct stat st;
+    reader->in = in;
+    reader->fd = -1;
+    // fread waits for a whole block, which only a file has ready
+    reader->stream = fstat(fileno(in), &st) == 0 && !S_ISREG(st.st_mode);
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->map = NULL;
+    reader->size = 0;
+    reader->checked = 0;
+    reader->format = DECOMPRESS_NONE;
+    reader->decompressor = NULL;
+    reset(reader);
+#ifdef READER_MMAP
+    if(map_input(reader) == 0) {
+        reader->checked = 1;
+        reader->format = decompress_format(reader->map, reader->size);
+        // compressed input is read through the buffer
+        if(reader->format != DECOMPRESS_NONE)
+            unmap_input(reader);
+    }
+#endif
+}
+
+void reader_open_fd(Reader *reader, int fd)
+{
+    reader->in = NULL;
+    reader->fd = fd;
+    reader->stream = 1;
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->map = NULL;
+    reader->size = 0;
+    // nothing arriving on a descriptor is compressed
+    reader->checked = 1;
+    reader->format = DECOMPRESS_NONE;
+    reader->decompressor = NULL;
+    reset(reader);
+}
+
+#ifdef READER_MMAP
+
+// drop the pages before offset from the mapping, they are still in the
+// file cache if the input is read again
+
+static void release_mapped(Reader *reader, size_t offset)
+{
+#ifdef MADV_DONTNEED
+    long page_size = sysconf(_SC_PAGESIZE);
+    if(page_size <= 0)
+        return;
+    offset -= offset % (size_t)page_size;
+    if(offset > reader->released) {
+        madvise(reader->map + reader->released, offset - reader->released, MADV_DONTNEED);
+        reader->released = offset;
+    }
+#endif
+}
+
+static char *next_mapped_line(Reader *reader, size_t *length)
+{
+    if(reader->next >= reader->size)
+        return NULL;
+
+    const char *line = reader->map + reader->next;
+    size_t remaining = reader->size - reader->next;
+    const char *eol = memchr(line, '\n', remaining);
+    size_t len = eol ? (size_t)(eol - line) + 1 : remaining;
+
+    // the caller may modify the line, which the mapping doesn't allow
+    if(reserve(reader, len) != 0)
+        return NULL;
+    memcpy(reader->buffer, line, len);
+    reader->buffer[len] = 0;
+
+    reader->next += len;
+    if(reader->next - reader->released >= RELEASE_BLOCK)
+        release_mapped(reader, reader->next);
+
+    if(length) *length = len;
+    return reader->buffer;
+}
+
+#endif // READER_MMAP
+
+void reader_release(Reader *reader, const char *upto)
+{
+#ifdef READER_MMAP
+    if(reader->map && upto > reader->map + reader->released)
+        release_mapped(reader, (size_t)(upto - reader->map));
+#endif
+}
+
+// start decompressing the input, the first length bytes of which have been
+// read into prefix, returns 0 on success or -1 on error
+
+static int open_decompressor(Reader *reader, const char *prefix, size_t length)
+{
+    reader->decompressor = decompress_open(reader->format, reader->in, prefix, length);
+    if(reader->decompressor == NULL) {
+        reader->error = errno;
+        return -1;
+    }
+    return 0;
+}
+
+// read more input onto the end of the buffer, moving the partial line at
+// the start of the buffer down first
+// returns the number of bytes read, 0 at the end of the input or -1 on error
+
+static long fill(Reader *reader)
+{
+    if(reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if(reserve(reader, reader->end + READ_BLOCK) != 0)
+        return -1;
+
+    char *p = reader->buffer + reader->end;
+    size_t room = reader->capacity - reader->end - 1;
+    long bytes;
+    if(reader->format != DECOMPRESS_NONE) {
+        if(reader->decompressor == NULL && open_decompressor(reader, NULL, 0) != 0)
+            return -1;
+        bytes = decompress_read(reader->decompressor, p, room);
+        if(bytes < 0) {
+            reader->error = errno;
+            return -1;
+        }
+        if(bytes == 0)
+            reader->eof = 1;
+    }
+    else if(reader->in) {
+        if(reader->stream) {
+            // take whatever has arrived, so a line is converted as soon as
+            // it is complete instead of when the buffer is full
+            do {
+                bytes = (long)read(fileno(reader->in), p, room);
+            } while(bytes < 0 && errno == EINTR);
+            if(bytes < 0) {
+                reader->error = errno;
+                return -1;
+            }
+        }
+        else {
+            bytes = (long)fread(p, 1, room, reader->in);
+            if(bytes == 0 && ferror(reader->in)) {
+                reader->error = errno ? errno : EIO;
+                return -1;
+            }
+        }
+        if(bytes == 0)
+            reader->eof = 1;
+        if(!reader->checked) {
+            reader->checked = 1;
+            reader->format = decompress_format(p, (size_t)bytes);
+            if(reader->format != DECOMPRESS_NONE) {
+                // what was read is the start of the compressed input
+                if(open_decompressor(reader, p, (size_t)bytes) != 0)
+                    return -1;
+                return fill(reader);
+            }
+        }
+    }
+    else {
+        bytes = (long)read(reader->fd, p, room);
+        if(bytes < 0) {
+            reader->error = errno;
+            return -1;
+        }
+    }
+    reader->end += bytes;
+    return bytes;
+}
+
+static char *next_buffered_line(Reader *reader, size_t *length)
+{
+    char *eol;
+    for(;;) {
+        char *line = reader->buffer + reader->start;
+        size_t available = reader->end - reader->start;
+        eol = available > reader->scanned ? memchr(line + reader->scanned, '\n', available - reader->scanned) : NULL;
+        if(eol) break;
+        reader->scanned = available;
+        if(reader->eof) {
+            // the last line has no newline
+            if(available == 0)
+                return NULL;
+            eol = reader->buffer + reader->end - 1;
+            break;
+        }
+        long bytes = fill(reader);
+        if(bytes < 0)
+            return NULL;
+        // a descriptor with nothing to read keeps the partial line
+        if(bytes == 0 && reader->in == NULL)
+            return NULL;
+    }
+
+    char *line = reader->buffer + reader->start;
+    size_t len = (size_t)(eol - line) + 1;
+    reader->start += len;
+    reader->scanned = 0;
+
+    // there is always room for a terminator after the input
+    reader->restore = line + len;
+    reader->saved = *reader->restore;
+    *reader->restore = 0;
+
+    if(length) *length = len;
+    return line;
+}
+
+char *reader_next_line(Reader *reader, size_t *length)
+{
+    // put back the byte the previous line's terminator displaced
+    if(reader->restore) {
+        *reader->restore = reader->saved;
+        reader->restore = NULL;
+    }
+    reader->error = 0;
+#ifdef READER_MMAP
+    if(reader->map)
+        return next_mapped_line(reader, length);
+#endif
+    return next_buffered_line(reader, length);
+}
+
+int reader_pending(Reader *reader)
+{
+#ifdef READER_MMAP
+    if(reader->map)
+        return reader->next < reader->size;
+#endif
+    return reader->end > reader->start;
+}
+
+int reader_rewind(Reader *reader)
+{
+    if(reader->restore) {
+        *reader->restore = reader->saved;
+    }
+    reset(reader);
+    if(reader->decompressor)
+        return decompress_rewind(reader->decompressor);
+#ifdef READER_MMAP
+    if(reader->map)
+        return 0;
+#endif
+    if(reader->in == NULL)
+        return -1;
+    clearerr(reader->in);
+    return fseek(reader->in, 0L, SEEK_SET) == 0 ? 0 : -1;
+}
+
+void reader_close(Reader *reader)
+{
+#ifdef READER_MMAP
+    unmap_input(reader);
+#endif
+    if(reader->decompressor) {
+        decompress_close(reader->decompressor);
+        reader->decompressor = NULL;
+    }
+    free(reader->buffer);
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->restore = NULL;
+}
@@ -0,0 +1,96 @@
+//  reader.h
+//
+//  Line reader for gcode input
+//
+//  Regular files are memory mapped read only and each line is copied out
+//  of the mapping into the buffer, everything else (stdin, pipes, ptys,
+//  platforms without mmap) is read a block at a time into a buffer that
+//  grows to hold the longest line, and lines are handed out in place from
+//  the buffer. Input that starts with
+//  the gzip or zstd magic number is decompressed into the buffer as it is
+//  read.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __reader_h__
+#define __reader_h__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "decompress.h"
+
+typedef struct tReader {
+    FILE *in;           // input stream, or NULL when reading a descriptor
+    int fd;             // descriptor read when there is no stream
+    int error;          // errno of the read that failed, otherwise 0
+    int eof;            // the stream has no more input
+    int stream;         // in is a pipe or terminal, read what has arrived rather than whole blocks
+
+    char *buffer;       // input read but not yet handed out
+    size_t capacity;    // size of the buffer in bytes, grows to fit the longest line
+    size_t start;       // offset of the next line in the buffer
+    size_t end;         // offset of the end of the input in the buffer
+    size_t scanned;     // bytes after start already searched for a newline
+
+    char *map;          // mapped input or NULL when reading into the buffer
+    size_t size;        // size of the mapped input in bytes
+    size_t next;        // offset of the next line in the mapping
+    size_t released;    // offset up to which the pages of the mapping have been dropped
+    char *restore;      // location of the current line's terminator
+    char saved;         // byte displaced by the current line's terminator
+
+    int checked;        // the start of the input has been checked for compression
+    int format;         // compression of the input, DECOMPRESS_NONE if it is plain
+    Decompressor *decompressor; // decompresses compressed input, NULL until it is read
+} Reader;
+
+// open a reader on the stream in, there is no limit on the length of a line
+// and gzip or zstd compressed input is decompressed, a line from a pipe or
+// terminal is handed out as soon as its newline arrives
+void reader_open(Reader *reader, FILE *in);
+
+// open a reader on the descriptor fd, each read takes whatever input is
+// available so a line is handed out as soon as its newline arrives
+void reader_open_fd(Reader *reader, int fd);
+
+// return the next line (including any newline) as a null terminated string
+// that the caller may modify up to the terminator, the line stays valid
+// until the next call and its length is returned in length if it is not
+// NULL
+// returns NULL at the end of the input, or if a read fails, in which case
+// error is set to its errno, when reading a descriptor a partial line is
+// kept until its newline arrives, so NULL with no error only means there
+// was no input available yet
+char *reader_next_line(Reader *reader, size_t *length);
+
+// is there input that has been read but not yet handed out
+int reader_pending(Reader *reader);
+
+// drop the pages of the mapped input before upto, which has been read
+// directly from the mapping, a no-op when the input isn't mapped
+void reader_release(Reader *reader, const char *upto);
+
+// reposition the reader at the start of the input, discarding any
+// modifications made to lines returned so far, compressed input is
+// decompressed again from the start
+// returns 0 on success or -1 on failure
+int reader_rewind(Reader *reader);
+
+// release the mapping, the buffer and the decompressor, the stream or
+// descriptor remains open
+void reader_close(Reader *reader);
+
+#endif /* __reader_h__ */
@@ -0,0 +1,164 @@
+//  ring.c
+//
+//  Single producer, single consumer ring of x3g frames
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <assert.h>
+#include <string.h>
+
+#include "ring.h"
+
+#ifdef HAVE_PTHREAD_H
+
+// The indices, flags and waiting count are all sequentially consistent, so
+// a thread that stores an index and then finds nobody waiting knows that
+// any thread that starts waiting afterwards will see the index it stored
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+
+#define SLOT(i) ((i) & (RING_FRAMES - 1))
+
+int ring_initialize(FrameRing *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = 0;
+    ring->error = 0;
+    ring->waiting = 0;
+    ring->headWanted = 0;
+    ring->tailWanted = 0;
+    if(pthread_mutex_init(&ring->lock, NULL) != 0) return -1;
+    if(pthread_cond_init(&ring->changed, NULL) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        return -1;
+    }
+    return 0;
+}
+
+void ring_destroy(FrameRing *ring)
+{
+    pthread_cond_destroy(&ring->changed);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+// wait until the other side moves index on to want, or the ring is closed
+// or aborted
+
+static void wait_for(FrameRing *ring, const unsigned *index, unsigned *wanted, unsigned want)
+{
+    pthread_mutex_lock(&ring->lock);
+    STORE(wanted, want);
+    __atomic_add_fetch(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    while((int)(LOAD(index) - want) < 0 && !LOAD(&ring->closed) && !LOAD(&ring->error)) {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    __atomic_sub_fetch(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// wake the other side if it's waiting for the index just stored
+
+static void wake(FrameRing *ring, unsigned index, const unsigned *wanted)
+{
+    if(LOAD(&ring->waiting) && (int)(index - LOAD(wanted)) >= 0) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+// PRODUCER
+
+int ring_push(FrameRing *ring, const char *frame, size_t length)
+{
+    unsigned head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    assert(length <= RING_FRAME_MAX);
+    for(;;) {
+        int error = LOAD(&ring->error);
+        if(error) return error;
+        unsigned tail = LOAD(&ring->tail);
+        if(head - tail < RING_FRAMES) break;
+        wait_for(ring, &ring->tail, &ring->tailWanted, head - RING_FRAMES / 2);
+    }
+    memcpy(ring->frame[SLOT(head)], frame, length);
+    ring->length[SLOT(head)] = length;
+    STORE(&ring->head, head + 1);
+    wake(ring, head + 1, &ring->headWanted);
+    return 0;
+}
+
+int ring_drain(FrameRing *ring)
+{
+    unsigned head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for(;;) {
+        int error = LOAD(&ring->error);
+        if(error) return error;
+        unsigned tail = LOAD(&ring->tail);
+        if(tail == head) return 0;
+        wait_for(ring, &ring->tail, &ring->tailWanted, head);
+    }
+}
+
+void ring_close(FrameRing *ring)
+{
+    STORE(&ring->closed, 1);
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// CONSUMER
+
+char *ring_peek(FrameRing *ring, size_t *length)
+{
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    for(;;) {
+        if(LOAD(&ring->error)) return NULL;
+        unsigned head = LOAD(&ring->head);
+        if(head != tail) {
+            *length = ring->length[SLOT(tail)];
+            return ring->frame[SLOT(tail)];
+        }
+        if(LOAD(&ring->closed)) {
+            // the last frame is pushed before the ring is closed
+            if(LOAD(&ring->head) == tail) return NULL;
+            continue;
+        }
+        wait_for(ring, &ring->head, &ring->headWanted, tail + 1);
+    }
+}
+
+void ring_release(FrameRing *ring)
+{
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    STORE(&ring->tail, tail + 1);
+    wake(ring, tail + 1, &ring->tailWanted);
+}
+
+// EITHER SIDE
+
+void ring_abort(FrameRing *ring, int error)
+{
+    int none = 0;
+    // the first error is the one that stopped the ring
+    __atomic_compare_exchange_n(&ring->error, &none, error, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+#endif // HAVE_PTHREAD_H
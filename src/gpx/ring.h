@@ -0,0 +1,101 @@
+//  ring.h
+//
+//  Single producer, single consumer ring of x3g frames
+//
+//  The conversion pushes each frame it packs onto the ring and goes on
+//  converting, while a sender thread takes the frames off the ring and
+//  sends them. Each side only writes its own index, so while the ring is
+//  neither full nor empty pushing and taking a frame is a copy and an
+//  atomic store. A side only takes the lock to wait, when the ring is full
+//  or empty, or for the other side to finish, and a full ring only wakes
+//  the producer once half of it has been sent, so the two threads don't
+//  hand over every frame while the printer is the bottleneck.
+//
+//  Either side can abort the ring, the frames still on it are then
+//  dropped instead of being sent, and the producer is told why the
+//  next time it pushes a frame.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __ring_h__
+#define __ring_h__
+
+#include <stddef.h>
+
+#include "config.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+
+#define RING_FRAMES 256         // frames queued for the sender, a power of two
+#define RING_FRAME_MAX 1024     // the longest frame, BUFFER_MAX + 1
+
+typedef struct tFrameRing {
+    unsigned head;          // frames pushed, only the producer writes it
+    unsigned tail;          // frames sent, only the consumer writes it
+    int closed;             // no more frames will be pushed
+    int error;              // why the ring was aborted, 0 if it wasn't
+    int waiting;            // threads waiting for the other side
+    unsigned headWanted;    // the head the consumer is waiting for
+    unsigned tailWanted;    // the tail the producer is waiting for
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t length[RING_FRAMES];
+    char frame[RING_FRAMES][RING_FRAME_MAX];
+} FrameRing;
+
+// returns 0 on success or -1 if the lock can't be created
+
+int ring_initialize(FrameRing *ring);
+void ring_destroy(FrameRing *ring);
+
+// PRODUCER
+
+// copy a frame onto the ring, waiting while it's full, returns 0 or the
+// error the ring was aborted with
+
+int ring_push(FrameRing *ring, const char *frame, size_t length);
+
+// wait until every frame pushed has been sent, returns 0 or the error the
+// ring was aborted with
+
+int ring_drain(FrameRing *ring);
+
+// no more frames will be pushed, the consumer stops once it has sent the
+// frames already on the ring
+
+void ring_close(FrameRing *ring);
+
+// CONSUMER
+
+// wait for the next frame, returns NULL once the ring is closed and empty
+// or has been aborted
+
+char *ring_peek(FrameRing *ring, size_t *length);
+
+// the frame returned by ring_peek has been sent
+
+void ring_release(FrameRing *ring);
+
+// EITHER SIDE
+
+// drop the frames on the ring, error is returned to the producer and
+// must not be 0
+
+void ring_abort(FrameRing *ring, int error);
+
+#endif // HAVE_PTHREAD_H
+
+#endif /* __ring_h__ */
@@ -0,0 +1,188 @@
+//  scan.c
+//
+//  Character scanning for the gcode tokenizer
+//
+//  Searches for a small set of characters sixteen or thirty two bytes at a
+//  time with SSE2 or AVX2 when the compiler targets them, and a byte at a
+//  time everywhere else, plus a character class table to use in place of
+//  ctype in the inner loops.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <stdint.h>
+
+#include "scan.h"
+
+#define C SCAN_CNTRL
+#define S SCAN_SPACE
+#define D SCAN_DIGIT
+#define A SCAN_ALPHA
+
+// bytes from 128 up belong to no class, as in the C locale
+
+const unsigned char scan_class[256] = {
+    C, C, C, C, C, C, C, C,
+    C, C|S, C|S, C|S, C|S, C|S, C, C,
+    C, C, C, C, C, C, C, C,
+    C, C, C, C, C, C, C, C,
+    S, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    D, D, D, D, D, D, D, D,
+    D, D, 0, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A,
+    A, A, A, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A,
+    A, A, A, 0, 0, 0, 0, C,
+};
+
+#undef C
+#undef S
+#undef D
+#undef A
+
+// the set of characters to search for, unused places repeat the first
+
+typedef struct tScanSet {
+    char c[4];
+} ScanSet;
+
+static void make_set(ScanSet *set, const char *chars)
+{
+    int i;
+    for(i = 0; i < 4; i++) {
+        set->c[i] = chars[0];
+    }
+    for(i = 0; i < 4 && chars[i]; i++) {
+        set->c[i] = chars[i];
+    }
+}
+
+#define IN_SET(set, ch) ((ch) == (set).c[0] || (ch) == (set).c[1] || (ch) == (set).c[2] || (ch) == (set).c[3])
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+
+// compare a whole block of bytes against every character in the set at once,
+// each match sets the bit for its byte in the returned mask
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SCAN_WIDTH 32
+typedef __m256i Block;
+#define load_aligned(p) _mm256_load_si256((const __m256i *)(p))
+#define load_unaligned(p) _mm256_loadu_si256((const __m256i *)(p))
+#define splat(c) _mm256_set1_epi8(c)
+#define equal(a, b) _mm256_cmpeq_epi8(a, b)
+#define either(a, b) _mm256_or_si256(a, b)
+#define to_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#else
+#include <emmintrin.h>
+
+#define SCAN_WIDTH 16
+typedef __m128i Block;
+#define load_aligned(p) _mm_load_si128((const __m128i *)(p))
+#define load_unaligned(p) _mm_loadu_si128((const __m128i *)(p))
+#define splat(c) _mm_set1_epi8(c)
+#define equal(a, b) _mm_cmpeq_epi8(a, b)
+#define either(a, b) _mm_or_si128(a, b)
+#define to_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+typedef struct tScanBlocks {
+    Block c[4];
+} ScanBlocks;
+
+static void make_blocks(ScanBlocks *blocks, const ScanSet *set)
+{
+    int i;
+    for(i = 0; i < 4; i++) {
+        blocks->c[i] = splat(set->c[i]);
+    }
+}
+
+static uint32_t match(Block v, const ScanBlocks *blocks)
+{
+    Block m = either(either(equal(v, blocks->c[0]), equal(v, blocks->c[1])),
+                     either(equal(v, blocks->c[2]), equal(v, blocks->c[3])));
+    return to_mask(m);
+}
+
+char *scan_string(const char *s, const char *chars)
+{
+    ScanSet set;
+    ScanBlocks blocks;
+    make_set(&set, chars);
+    make_blocks(&blocks, &set);
+    Block zero = splat(0);
+
+    // aligned loads never cross into the next page, so reading the whole
+    // block around the terminator is safe, the bits for the bytes before
+    // s are shifted out of the first mask
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)(SCAN_WIDTH - 1));
+    unsigned skip = (unsigned)(s - p);
+    Block v = load_aligned(p);
+    uint32_t mask = (match(v, &blocks) | to_mask(equal(v, zero))) >> skip << skip;
+    while(mask == 0) {
+        p += SCAN_WIDTH;
+        v = load_aligned(p);
+        mask = match(v, &blocks) | to_mask(equal(v, zero));
+    }
+    return (char *)p + __builtin_ctz(mask);
+}
+
+char *scan_memory(const char *p, size_t length, const char *chars)
+{
+    ScanSet set;
+    ScanBlocks blocks;
+    make_set(&set, chars);
+    make_blocks(&blocks, &set);
+    const char *end = p + length;
+
+    for(; end - p >= SCAN_WIDTH; p += SCAN_WIDTH) {
+        uint32_t mask = match(load_unaligned(p), &blocks);
+        if(mask) return (char *)p + __builtin_ctz(mask);
+    }
+    for(; p < end; p++) {
+        if(IN_SET(set, *p)) return (char *)p;
+    }
+    return NULL;
+}
+
+#else
+
+char *scan_string(const char *s, const char *chars)
+{
+    ScanSet set;
+    make_set(&set, chars);
+    while(*s && !IN_SET(set, *s)) s++;
+    return (char *)s;
+}
+
+char *scan_memory(const char *p, size_t length, const char *chars)
+{
+    ScanSet set;
+    const char *end = p + length;
+    make_set(&set, chars);
+    for(; p < end; p++) {
+        if(IN_SET(set, *p)) return (char *)p;
+    }
+    return NULL;
+}
+
+#endif
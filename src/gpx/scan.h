@@ -0,0 +1,52 @@
+//  scan.h
+//
+//  Character scanning for the gcode tokenizer
+//
+//  Searches for a small set of characters sixteen or thirty two bytes at a
+//  time with SSE2 or AVX2 when the compiler targets them, and a byte at a
+//  time everywhere else, plus a character class table to use in place of
+//  ctype in the inner loops.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __scan_h__
+#define __scan_h__
+
+#include <stddef.h>
+
+// character classes, the same as ctype's in the C locale
+
+#define SCAN_SPACE 1    // isspace
+#define SCAN_DIGIT 2    // isdigit
+#define SCAN_ALPHA 4    // isalpha
+#define SCAN_CNTRL 8    // iscntrl
+
+extern const unsigned char scan_class[256];
+
+#define scan_is(c, class) (scan_class[(unsigned char)(c)] & (class))
+#define scan_isspace(c) scan_is(c, SCAN_SPACE)
+#define scan_isdigit(c) scan_is(c, SCAN_DIGIT)
+#define scan_isalpha(c) scan_is(c, SCAN_ALPHA)
+#define scan_iscntrl(c) scan_is(c, SCAN_CNTRL)
+
+// return the first of the characters in set (one to four of them) in the
+// null terminated string s, or the terminator if there are none
+char *scan_string(const char *s, const char *set);
+
+// return the first of the characters in set (one to four of them) in the
+// length bytes at p, or NULL if there are none
+char *scan_memory(const char *p, size_t length, const char *set);
+
+#endif /* __scan_h__ */
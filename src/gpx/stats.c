@@ -0,0 +1,238 @@
+//  stats.c
+//
+//  Conversion profiling counters
+//
+//  Counts the gcode commands converted and the x3g bytes each of them
+//  emitted, and times the stages of the conversion. The counters are only
+//  touched when gpx->stats is set, and compile out altogether when NO_STATS
+//  is defined.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+// commands are counted by code up to CODES, anything above that is counted
+// together, followed by tool changes, macros and lines with no command
+
+#define CODES 1000
+#define G_CODE 0
+#define M_CODE CODES
+#define G_OTHER (2 * CODES)
+#define M_OTHER (G_OTHER + 1)
+#define T_ONLY (G_OTHER + 2)
+#define MACRO (G_OTHER + 3)
+#define NO_COMMAND (G_OTHER + 4)
+#define COMMANDS (G_OTHER + 5)
+
+// bytes emitted per command: 0, 1-15, 16-31, 32-63, 64-127, 128-255, 256+
+
+#define BUCKETS 7
+static const char *bucket_name[BUCKETS] = {"0", "1-15", "16-31", "32-63", "64-127", "128-255", "256+"};
+
+static const char *stage_name[STATS_STAGES] = {
+    "other", "tokenize", "execute", "target position", "kinematics", "frame encoding", "sink write"
+};
+
+static const char *stage_key[STATS_STAGES] = {
+    "other", "tokenize", "execute", "position", "kinematics", "encode", "write"
+};
+
+#define DEPTH 16
+
+typedef struct tCommandStats {
+    unsigned long count;
+    unsigned long bytes;
+    unsigned long histogram[BUCKETS];
+} CommandStats;
+
+struct tStats {
+    int format;
+    double start;               // when the counters were created
+    double mark;                // when the current stage was entered or resumed
+    int stage[DEPTH];           // stages entered, the innermost last
+    int depth;
+    int overflow;               // stages entered beyond DEPTH
+    double seconds[STATS_STAGES];
+    unsigned long calls[STATS_STAGES];
+    unsigned long lines;
+    unsigned long bytes;
+    CommandStats command[COMMANDS];
+};
+
+static double now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+struct tStats *stats_create(int format)
+{
+    struct tStats *stats = calloc(1, sizeof(struct tStats));
+    if(stats) {
+        stats->format = format;
+        stats->start = stats->mark = now();
+        stats->stage[0] = STATS_OTHER;
+    }
+    return stats;
+}
+
+void stats_free(struct tStats *stats)
+{
+    free(stats);
+}
+
+void stats_enter(struct tStats *stats, int stage)
+{
+    if(stats->depth + 1 >= DEPTH) {
+        stats->overflow++;
+        return;
+    }
+    double t = now();
+    stats->seconds[stats->stage[stats->depth]] += t - stats->mark;
+    stats->stage[++stats->depth] = stage;
+    stats->calls[stage]++;
+    stats->mark = t;
+}
+
+void stats_leave(struct tStats *stats)
+{
+    if(stats->overflow) {
+        stats->overflow--;
+        return;
+    }
+    if(stats->depth == 0) return;
+    double t = now();
+    stats->seconds[stats->stage[stats->depth--]] += t - stats->mark;
+    stats->mark = t;
+}
+
+void stats_count(struct tStats *stats, const Command *command, const char *macro, unsigned long bytes)
+{
+    int i;
+    if(command->flag & G_IS_SET)
+        i = command->g < CODES ? G_CODE + command->g : G_OTHER;
+    else if(command->flag & M_IS_SET)
+        i = command->m < CODES ? M_CODE + command->m : M_OTHER;
+    else if(command->flag & T_IS_SET)
+        i = T_ONLY;
+    else if(macro)
+        i = MACRO;
+    else
+        i = NO_COMMAND;
+
+    int bucket = 0;
+    if(bytes) {
+        unsigned long b;
+        for(bucket = 1, b = bytes >> 4; b && bucket < BUCKETS - 1; b >>= 1) bucket++;
+    }
+
+    CommandStats *c = stats->command + i;
+    c->count++;
+    c->bytes += bytes;
+    c->histogram[bucket]++;
+    stats->lines++;
+    stats->bytes += bytes;
+}
+
+static void command_name(int i, char *name)
+{
+    if(i < M_CODE) sprintf(name, "G%d", i - G_CODE);
+    else if(i < G_OTHER) sprintf(name, "M%d", i - M_CODE);
+    else if(i == G_OTHER) strcpy(name, "G other");
+    else if(i == M_OTHER) strcpy(name, "M other");
+    else if(i == T_ONLY) strcpy(name, "T");
+    else if(i == MACRO) strcpy(name, "macro");
+    else strcpy(name, "none");
+}
+
+static void report_text(struct tStats *stats, FILE *out, double elapsed)
+{
+    int i, j;
+    char name[16];
+
+    fprintf(out, "Conversion statistics" EOL);
+    fprintf(out, "%lu lines, %lu x3g bytes, %0.3f s" EOL EOL, stats->lines, stats->bytes, elapsed);
+
+    fprintf(out, "%-16s %10s %7s %12s" EOL, "stage", "seconds", "%", "calls");
+    for(i = 1; i <= STATS_STAGES; i++) {
+        // other last
+        int s = i % STATS_STAGES;
+        fprintf(out, "%-16s %10.4f %6.1f%% %12lu" EOL, stage_name[s], stats->seconds[s],
+                elapsed > 0 ? 100 * stats->seconds[s] / elapsed : 0.0, stats->calls[s]);
+    }
+
+    fprintf(out, EOL "%-8s %10s %12s %8s", "command", "count", "bytes", "average");
+    for(j = 0; j < BUCKETS; j++) fprintf(out, " %8s", bucket_name[j]);
+    fputs(EOL, out);
+    for(i = 0; i < COMMANDS; i++) {
+        CommandStats *c = stats->command + i;
+        if(c->count == 0) continue;
+        command_name(i, name);
+        fprintf(out, "%-8s %10lu %12lu %8.1f", name, c->count, c->bytes, (double)c->bytes / c->count);
+        for(j = 0; j < BUCKETS; j++) fprintf(out, " %8lu", c->histogram[j]);
+        fputs(EOL, out);
+    }
+}
+
+static void report_json(struct tStats *stats, FILE *out, double elapsed)
+{
+    int i, j;
+    char name[16];
+    const char *separator = "";
+
+    fprintf(out, "{\"lines\": %lu, \"bytes\": %lu, \"seconds\": %0.6f," EOL, stats->lines, stats->bytes, elapsed);
+    fputs("  \"stages\": {", out);
+    for(i = 0; i < STATS_STAGES; i++) {
+        fprintf(out, "%s" EOL "    \"%s\": {\"seconds\": %0.6f, \"calls\": %lu}", separator, stage_key[i], stats->seconds[i], stats->calls[i]);
+        separator = ",";
+    }
+    fputs(EOL "  }," EOL "  \"histogram_buckets\": [", out);
+    for(j = 0; j < BUCKETS; j++) fprintf(out, "%s\"%s\"", j ? ", " : "", bucket_name[j]);
+    fputs("]," EOL "  \"commands\": {", out);
+    separator = "";
+    for(i = 0; i < COMMANDS; i++) {
+        CommandStats *c = stats->command + i;
+        if(c->count == 0) continue;
+        command_name(i, name);
+        fprintf(out, "%s" EOL "    \"%s\": {\"count\": %lu, \"bytes\": %lu, \"histogram\": [", separator, name, c->count, c->bytes);
+        for(j = 0; j < BUCKETS; j++) fprintf(out, "%s%lu", j ? ", " : "", c->histogram[j]);
+        fputs("]}", out);
+        separator = ",";
+    }
+    fputs(EOL "  }" EOL "}" EOL, out);
+}
+
+void stats_report(struct tStats *stats, FILE *out)
+{
+    // charge the time up to now to the current stage
+    double t = now();
+    stats->seconds[stats->stage[stats->depth]] += t - stats->mark;
+    stats->mark = t;
+
+    double elapsed = t - stats->start;
+    if(stats->format == STATS_JSON)
+        report_json(stats, out, elapsed);
+    else
+        report_text(stats, out, elapsed);
+    fflush(out);
+}
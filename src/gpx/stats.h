@@ -0,0 +1,67 @@
+//  stats.h
+//
+//  Conversion profiling counters
+//
+//  Counts the gcode commands converted and the x3g bytes each of them
+//  emitted, and times the stages of the conversion. The counters are only
+//  touched when gpx->stats is set, and compile out altogether when NO_STATS
+//  is defined.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef __stats_h__
+#define __stats_h__
+
+#include "gpx.h"
+
+// stages of the conversion, time spent in a nested stage is only counted
+// against the innermost one
+
+#define STATS_OTHER 0       // reading input and everything outside the stages below
+#define STATS_TOKENIZE 1    // splitting lines into command words
+#define STATS_EXECUTE 2     // interpreting the command words
+#define STATS_POSITION 3    // calculate_target_position
+#define STATS_KINEMATICS 4  // queue_ext_point, the feedrate and DDA calculations
+#define STATS_ENCODE 5      // framing the x3g command
+#define STATS_WRITE 6       // handing the x3g command to the sink
+#define STATS_STAGES 7
+
+// report formats
+
+#define STATS_TEXT 0
+#define STATS_JSON 1
+
+// create a set of counters, returns NULL if there is not enough memory
+struct tStats *stats_create(int format);
+void stats_free(struct tStats *stats);
+
+// enter or leave a stage, every stats_enter must be matched by a stats_leave
+void stats_enter(struct tStats *stats, int stage);
+void stats_leave(struct tStats *stats);
+
+// count a converted line and the x3g bytes it emitted
+void stats_count(struct tStats *stats, const Command *command, const char *macro, unsigned long bytes);
+
+// write the report to out
+void stats_report(struct tStats *stats, FILE *out);
+
+// run FN when profiling
+#ifndef NO_STATS
+#define STATS(FN) if(gpx->stats) {FN;}
+#else
+#define STATS(FN)
+#endif
+
+#endif /* __stats_h__ */
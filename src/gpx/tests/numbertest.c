@@ -0,0 +1,195 @@
+//  numbertest.c
+//
+//  Checks word_to_double and word_to_int against strtod and atoi
+//
+//  The fast paths in number.c promise results that are bit for bit the same
+//  as strtod's and atoi's. This runs them side by side over the edge cases,
+//  the boundaries of the fast paths and a few million random words in the
+//  shape normalize_word produces, and fails if any of them differ.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+#define RANDOM_WORDS 4000000
+#define WORD_MAX 400
+
+static unsigned long checked;
+static unsigned long failed;
+
+// a fixed seed so a failure can be reproduced
+
+static uint64_t state = UINT64_C(0x9E3779B97F4A7C15);
+
+static unsigned random_below(unsigned n)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned)(state % n);
+}
+
+static void check_double(const char *word)
+{
+    double expected = strtod(word, NULL);
+    double actual = word_to_double(word);
+    checked++;
+    // compare the bits so -0 and +0 differ
+    if(memcmp(&expected, &actual, sizeof(double)) != 0) {
+        if(failed++ < 10) {
+            fprintf(stderr, "word_to_double(\"%s\") = %.17g, strtod gives %.17g\n", word, actual, expected);
+        }
+    }
+}
+
+static void check_int(const char *word)
+{
+    int expected = atoi(word);
+    int actual = word_to_int(word);
+    checked++;
+    if(expected != actual) {
+        if(failed++ < 10) {
+            fprintf(stderr, "word_to_int(\"%s\") = %d, atoi gives %d\n", word, actual, expected);
+        }
+    }
+}
+
+static void check_both(const char *word)
+{
+    check_double(word);
+    if(strchr(word, '.') == NULL) check_int(word);
+}
+
+// sign, zeros and points on their own and in every combination
+
+static const char *edge_words[] = {
+    "", "+", "-", ".", "+.", "-.", "0", "+0", "-0", "0.", "-0.", ".0", "-.0",
+    "0.0", "-0.0", "00000", "-00000.00000", "1", "-1", "1.", ".1", "-.1",
+    "2147483647", "-2147483648", "999999999", "-999999999", "1000000000",
+    // 2^53 is the largest mantissa the fast path takes, 2^53 + 1 is a tie
+    // that rounds to even
+    "9007199254740992", "9007199254740993", "9007199254740994",
+    "9007199254740995", "-9007199254740993", "18014398509481986",
+    "900719925474099.3", "900719925474099.25", "0.9007199254740993",
+    // 2^52 + 1/2 and 2^52 + 3/2 are ties between neighbouring doubles
+    "4503599627370496.5", "4503599627370497.5", "-4503599627370496.5",
+    // 1/2 ulp above and below 1
+    "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203124",
+    "1.00000000000000011102230246251565404236316680908203126",
+    "0.99999999999999994448884876874217297882",
+    // 22 decimals is the most the fast path divides by, 23 goes to strtod
+    "0.0000000000000000000001", "0.00000000000000000000001",
+    "1.2345678901234567890123", "123456.0000000000000000000001",
+    "9007199254740992.0000000", "0.0000000000009007199254740992",
+    // 19 significant digits and one more
+    "1234567890123456789", "12345678901234567890", "0.1234567890123456789",
+    "0.12345678901234567890", "18446744073709551615", "18446744073709551616",
+    // typical coordinates and feed rates
+    "100.000", "-12.3456", "0.2", "0.3", "3000", "1800.0", "0.00125",
+    "210", "-0.01", "123.456789",
+    NULL
+};
+
+// builds a word from a sign, leading zeros, digits, a point and decimals
+
+static void make_word(char *p, int sign, int zeros, int digits, int point, int decimals)
+{
+    if(sign) *p++ = sign;
+    while(zeros--) *p++ = '0';
+    while(digits--) *p++ = '0' + random_below(10);
+    if(point) *p++ = '.';
+    while(decimals--) *p++ = '0' + random_below(10);
+    *p = 0;
+}
+
+int main(void)
+{
+    char word[WORD_MAX + 1];
+    const char **edge;
+    unsigned long i;
+    int n;
+
+    for(edge = edge_words; *edge; edge++) {
+        check_both(*edge);
+    }
+
+    // the largest finite double is about 1.8e308, 309 integer digits are at
+    // the overflow limit and 310 overflow to infinity
+    for(n = 300; n <= 320; n++) {
+        word[0] = '1';
+        memset(word + 1, '0', n - 1);
+        word[n] = 0;
+        check_double(word);
+        memset(word, '9', n);
+        check_double(word);
+    }
+
+    // the smallest subnormal is about 4.9e-324, decimals run past it to
+    // underflow to zero
+    for(n = 300; n <= 340; n++) {
+        strcpy(word, "-0.");
+        memset(word + 3, '0', n - 1);
+        strcpy(word + 2 + n, "49");
+        check_double(word);
+        word[2 + n] = '5';
+        check_double(word);
+    }
+
+    // many leading zeros, short and long mantissas, at every scale
+    for(i = 0; i < RANDOM_WORDS; i++) {
+        static const char signs[] = { 0, '+', '-' };
+        int sign = signs[random_below(3)];
+        int zeros = random_below(4) == 0 ? random_below(40) : 0;
+        int digits, decimals;
+        switch(random_below(4)) {
+            case 0:
+                // around the 53 bit and 19 digit limits of the fast path
+                digits = random_below(21);
+                decimals = random_below(2) ? random_below(25) : 0;
+                break;
+            case 1:
+                // long mantissas that only strtod can round
+                digits = random_below(40);
+                decimals = random_below(40);
+                break;
+            case 2:
+                // whole numbers, also checked against atoi
+                digits = 1 + random_below(12);
+                decimals = 0;
+                break;
+            default:
+                // coordinates as slicers print them
+                digits = random_below(4);
+                decimals = random_below(7);
+                break;
+        }
+        int point = decimals > 0 || random_below(8) == 0;
+        make_word(word, sign, zeros, digits, point, decimals);
+        check_both(word);
+    }
+
+    if(failed) {
+        fprintf(stderr, "numbertest: %lu of %lu words differ\n", failed, checked);
+        return EXIT_FAILURE;
+    }
+    printf("numbertest: %lu words, all the same as strtod and atoi\n", checked);
+    return EXIT_SUCCESS;
+}
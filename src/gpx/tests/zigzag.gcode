@@ -0,0 +1,93 @@
+; zig-zag: short extruding moves that double back on themselves, converted
+; with and without -G 0.05 the extruder steps have to add up the same
+; zigzag.x3g has 82 moves and zigzag-G.x3g 63, both with -15 A steps
+M136 (enable build)
+M73 P0
+G21
+G90
+M83
+G92 X0 Y0 Z0 A0 B0
+G1 Z0.2 F1200
+G1 X10 Y10 F3000
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.04 Y10 E0.002
+G1 X10 Y10 E0.002
+G1 X10.020 Y10.03 E0.002
+G1 X10.030 Y10 E0.002
+G1 X10.040 Y10.03 E0.002
+G1 X10.050 Y10 E0.002
+G1 X10.060 Y10.03 E0.002
+G1 X10.070 Y10 E0.002
+G1 X10.080 Y10.03 E0.002
+G1 X10.090 Y10 E0.002
+G1 X10.100 Y10.03 E0.002
+G1 X10.110 Y10 E0.002
+G1 X10.120 Y10.03 E0.002
+G1 X10.130 Y10 E0.002
+G1 X10.140 Y10.03 E0.002
+G1 X10.150 Y10 E0.002
+G1 X10.160 Y10.03 E0.002
+G1 X10.170 Y10 E0.002
+G1 X10.180 Y10.03 E0.002
+G1 X10.190 Y10 E0.002
+G1 X10.200 Y10.03 E0.002
+G1 X10.210 Y10 E0.002
+G1 X10.220 Y10.03 E0.002
+G1 X10.230 Y10 E0.002
+G1 X10.240 Y10.03 E0.002
+G1 X10.250 Y10 E0.002
+G1 X10.260 Y10.03 E0.002
+G1 X10.270 Y10 E0.002
+G1 X10.280 Y10.03 E0.002
+G1 X10.290 Y10 E0.002
+G1 X10.300 Y10.03 E0.002
+G1 X10.310 Y10 E0.002
+G1 X10.320 Y10.03 E0.002
+G1 X10.330 Y10 E0.002
+G1 X10.340 Y10.03 E0.002
+G1 X10.350 Y10 E0.002
+G1 X10.360 Y10.03 E0.002
+G1 X10.370 Y10 E0.002
+G1 X10.380 Y10.03 E0.002
+G1 X10.390 Y10 E0.002
+G1 X10.400 Y10.03 E0.002
+G1 X10.410 Y10 E0.002
+M73 P100
+M137 (build end notification)
@@ -16,15 +16,34 @@
 #include "eeprominfo.h"
 #include "gpx.h"
 
-// TODO at the moment the module is taking twice as much memory for Gpx as it
-// should to because gpx-main also has one. We can merge them via extern or pass
-// it one way or the other, but perhaps the best way is to drop gpx-main from
-// the module and reserve that for the CLI.  We'll need to refactor a couple of
-// things from it however
-static Gpx gpx;
-static Tio *tio;
-
-static int connected = 0;
+// TODO gpx-main is linked into the module for a couple of helpers and brings
+// its own static Gpx along, which the module never uses. Perhaps the best way
+// is to drop gpx-main from the module and reserve that for the CLI. We'll
+// need to refactor a couple of things from it however
+
+// One printer connection: the converter state, the serial translation that
+// reads and writes through it, and whether the port is open. gpx.Connection()
+// makes as many as there are printers; the module level functions drive a
+// default one so existing scripts keep working.
+typedef struct {
+    PyObject_HEAD
+    Gpx gpx;
+    Tio connection;
+    Tio *tio;
+    int connected;
+} Connection;
+
+static PyTypeObject ConnectionType;
+static Connection *default_connection;
+
+// methods called on a Connection get it as self, the module functions get
+// NULL and use the default connection
+static Connection *get_connection(PyObject *self)
+{
+    if (self != NULL && PyObject_TypeCheck(self, &ConnectionType))
+        return (Connection *)self;
+    return default_connection;
+}
 
 // Some custom python exceptions
 static PyObject *pyerrCancelBuild;
@@ -32,11 +51,11 @@ static PyObject *pyerrBufferOverflow;
 static PyObject *pyerrTimeout;
 static PyObject *pyerrUnknownFirmware;
 
-static void clear_state_for_cancel(void)
+static void clear_state_for_cancel(Connection *c)
 {
-    tio_clear_state_for_cancel(tio);
-    tio->cur = 0;
-    tio->translation[0] = 0;
+    tio_clear_state_for_cancel(c->tio);
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
 }
 
 // wrap port_handler and translate to the expect gcode response
@@ -46,9 +65,9 @@ static void clear_state_for_cancel(void)
 #define EEPROM_LENGTH_OFFSET 8
 
 // return the translation or set the error context and return NULL if failure
-static PyObject *py_return_translation(int rval)
+static PyObject *py_return_translation(Connection *c, int rval)
 {
-    rval = gpx_return_translation(&gpx, rval);
+    rval = gpx_return_translation(&c->gpx, rval);
 
     switch (rval) {
         case SUCCESS:
@@ -100,17 +119,19 @@ static PyObject *py_return_translation(int rval)
             PyErr_SetString(PyExc_IOError, "Unknown error.");
             return NULL;
     }
-    return Py_BuildValue("s", tio->translation);
+    return Py_BuildValue("s", c->tio->translation);
 }
 
-static PyObject *py_write_string(const char *s)
+static PyObject *py_write_string(Connection *c, const char *s)
 {
-    return py_return_translation(gpx_write_string_core(&gpx, s));
+    return py_return_translation(c, gpx_write_string_core(&c->gpx, s));
 }
 
 // def connect(port, baudrate, inipath, logpath)
 static PyObject *py_connect(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     const char *port = NULL;
     long baudrate = 0;
     const char *inipath = NULL;
@@ -120,43 +141,43 @@ static PyObject *py_connect(PyObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "s|lssi", &port, &baudrate, &inipath, &logpath, &verbose))
         return NULL;
 
-    tio_cleanup(tio);
-    connected = 1;
-    gpx_initialize(&gpx, 0);
-    gpx.axis.positionKnown = 0;
-    gpx.flag.M106AlwaysValve = 1;
-    gpx.flag.verboseSioMode = gpx.flag.verboseMode = verbose;
-    gpx.flag.logMessages = 1;
+    tio_cleanup(c->tio);
+    c->connected = 1;
+    gpx_initialize(&c->gpx, 0);
+    c->gpx.axis.positionKnown = 0;
+    c->gpx.flag.M106AlwaysValve = 1;
+    c->gpx.flag.verboseSioMode = c->gpx.flag.verboseMode = verbose;
+    c->gpx.flag.logMessages = 1;
 
     // open the log file
-    if (logpath != NULL && (gpx.log = fopen(logpath, "a")) == NULL) {
+    if (logpath != NULL && (c->gpx.log = fopen(logpath, "a")) == NULL) {
         fprintf(stderr, "Unable to open logfile (%s) for writing\n", logpath);
     }
-    if (gpx.log == NULL)
-        gpx.log = stderr;
+    if (c->gpx.log == NULL)
+        c->gpx.log = stderr;
 #ifdef ALWAYS_USE_STDERR
-    else if (gpx.log != stderr)
+    else if (c->gpx.log != stderr)
     {
-        fclose(gpx.log);
-        gpx.log = stderr;
+        fclose(c->gpx.log);
+        c->gpx.log = stderr;
     }
 #endif
 
     // load the config
     if (inipath != NULL)
     {
-        int lineno = gpx_load_config(&gpx, inipath);
+        int lineno = gpx_load_config(&c->gpx, inipath);
         if (lineno < 0) {
-            fprintf(gpx.log, "Unable to load configuration file (%s)\n", inipath);
-            tio_printf(tio, "Error: Unable to load configuration file (%s)\n", inipath);
+            fprintf(c->gpx.log, "Unable to load configuration file (%s)\n", inipath);
+            tio_printf(c->tio, "Error: Unable to load configuration file (%s)\n", inipath);
         }
         if (lineno > 0) {
-            tio_log_printf(tio, "(line %u) Configuration syntax error in %s: unrecognized parameters\n", lineno, inipath);
+            tio_log_printf(c->tio, "(line %u) Configuration syntax error in %s: unrecognized parameters\n", lineno, inipath);
         }
     }
 
-    int rval = gpx_connect(&gpx, port, baudrate);
-    tio->sio.flag.shortRetryBufferOverflowOnly = 1;
+    int rval = gpx_connect(&c->gpx, port, baudrate);
+    c->tio->sio.flag.shortRetryBufferOverflowOnly = 1;
     switch (rval) {
         case ESIOBADBAUD:
             PyErr_SetString(PyExc_ValueError, "Unsupported baudrate");
@@ -165,7 +186,7 @@ static PyObject *py_connect(PyObject *self, PyObject *args)
             return PyErr_SetFromErrnoWithFilename(PyExc_OSError, port);
     }
 
-    return py_return_translation(rval);
+    return py_return_translation(c, rval);
 }
 
 static PyObject *PyErr_NotConnected(void)
@@ -180,129 +201,139 @@ static PyObject *PyErr_NotConnected(void)
 //  between the calls at the python level so multithreading works.
 static PyObject *py_start(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, ""))
         return NULL;
 
-    tio->cur = 0;
-    tio->translation[0] = 0;
-    int rval = get_advanced_version_number(&gpx);
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
+    int rval = get_advanced_version_number(&c->gpx);
     if (rval >= 0) {
-        tio->waitflag.waitForEmptyQueue = 1;
-        tio_printf(tio, "\necho: gcode to x3g translation by GPX");
-        rval = gpx_write_string(&gpx, "M21");
+        c->tio->waitflag.waitForEmptyQueue = 1;
+        tio_printf(c->tio, "\necho: gcode to x3g translation by GPX");
+        rval = gpx_write_string(&c->gpx, "M21");
     }
-    return py_return_translation(rval);
+    return py_return_translation(c, rval);
 }
 
 // def write(data)
 static PyObject *py_write(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     char *line;
 
-    if (!connected)
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, "s", &line))
         return NULL;
 
-    tio->cur = 0;
-    tio->translation[0] = 0;
-    tio->waitflag.waitForBuffer = 0; // maybe clear this every time?
-    tio->flag.okPending = !tio->waiting;
-    PyObject *rval = py_write_string(line);
-    tio->flag.okPending = 0;
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
+    c->tio->waitflag.waitForBuffer = 0; // maybe clear this every time?
+    c->tio->flag.okPending = !c->tio->waiting;
+    PyObject *rval = py_write_string(c, line);
+    c->tio->flag.okPending = 0;
     return rval;
 }
 
 // def readnext()
 static PyObject *py_readnext(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     int rval = SUCCESS;
 
-    if (!connected)
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, ""))
         return NULL;
 
-    if (gpx.flag.verboseMode)
-        fprintf(gpx.log, "i");
-    tio->cur = 0;
-    tio->translation[0] = 0;
+    if (c->gpx.flag.verboseMode)
+        fprintf(c->gpx.log, "i");
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
 
-    if (tio->flag.listingFiles) {
-        rval = get_next_filename(&gpx, 0);
+    if (c->tio->flag.listingFiles) {
+        rval = get_next_filename(&c->gpx, 0);
     }
-    else if (tio->waiting) {
-        if (gpx.flag.verboseMode)
-            fprintf(gpx.log, "tio->waiting = %u\n", tio->waiting);
-        if (!tio->waitflag.waitForCancelSync) {
-            if (tio->waitflag.waitForUnpause)
-                rval = get_build_statistics(&gpx);
+    else if (c->tio->waiting) {
+        if (c->gpx.flag.verboseMode)
+            fprintf(c->gpx.log, "tio->waiting = %u\n", c->tio->waiting);
+        if (!c->tio->waitflag.waitForCancelSync) {
+            if (c->tio->waitflag.waitForUnpause)
+                rval = get_build_statistics(&c->gpx);
             // if we're waiting for the queue to drain, do that before checking on
             // anything else
-            if (rval == SUCCESS && (tio->waitflag.waitForEmptyQueue || tio->waitflag.waitForButton))
-                rval = is_ready(&gpx);
-            if (rval == SUCCESS && !tio->waitflag.waitForEmptyQueue) {
-                if (tio->waitflag.waitForStart || tio->waitflag.waitForBotCancel)
-                    rval = get_build_statistics(&gpx);
-                if (rval == SUCCESS && tio->waitflag.waitForPlatform)
-                    rval = is_build_platform_ready(&gpx, 0);
-                if (rval == SUCCESS && tio->waitflag.waitForExtruderA)
-                    rval = is_extruder_ready(&gpx, 0);
-                if (rval == SUCCESS && tio->waitflag.waitForExtruderB)
-                    rval = is_extruder_ready(&gpx, 1);
+            if (rval == SUCCESS && (c->tio->waitflag.waitForEmptyQueue || c->tio->waitflag.waitForButton))
+                rval = is_ready(&c->gpx);
+            if (rval == SUCCESS && !c->tio->waitflag.waitForEmptyQueue) {
+                if (c->tio->waitflag.waitForStart || c->tio->waitflag.waitForBotCancel)
+                    rval = get_build_statistics(&c->gpx);
+                if (rval == SUCCESS && c->tio->waitflag.waitForPlatform)
+                    rval = is_build_platform_ready(&c->gpx, 0);
+                if (rval == SUCCESS && c->tio->waitflag.waitForExtruderA)
+                    rval = is_extruder_ready(&c->gpx, 0);
+                if (rval == SUCCESS && c->tio->waitflag.waitForExtruderB)
+                    rval = is_extruder_ready(&c->gpx, 1);
             }
         }
-        if (gpx.flag.verboseMode)
-            fprintf(gpx.log, "tio->waiting = %u and rval = %d\n", tio->waiting, rval);
+        if (c->gpx.flag.verboseMode)
+            fprintf(c->gpx.log, "tio->waiting = %u and rval = %d\n", c->tio->waiting, rval);
         if (rval == SUCCESS) {
-            if (tio->waiting) {
-                if (gpx.flag.verboseMode) {
-                    tio_printf(tio, "// echo: tio->waiting = 0x%x\n", tio->waiting);
-                    fprintf(gpx.log, "o");
+            if (c->tio->waiting) {
+                if (c->gpx.flag.verboseMode) {
+                    tio_printf(c->tio, "// echo: tio->waiting = 0x%x\n", c->tio->waiting);
+                    fprintf(c->gpx.log, "o");
                 }
-                return py_write_string("M105");
+                return py_write_string(c, "M105");
             }
-            tio->cur = 0;
-            tio_printf(tio, "ok");
+            c->tio->cur = 0;
+            tio_printf(c->tio, "ok");
         }
     }
-    else if (tio->flag.waitClearedByCancel) {
-        if(gpx.flag.verboseMode)
-            fprintf(gpx.log, "adding ok for wait cleared by cancel\n");
-        tio->flag.waitClearedByCancel = 0;
-        tio_printf(tio, "ok");
+    else if (c->tio->flag.waitClearedByCancel) {
+        if(c->gpx.flag.verboseMode)
+            fprintf(c->gpx.log, "adding ok for wait cleared by cancel\n");
+        c->tio->flag.waitClearedByCancel = 0;
+        tio_printf(c->tio, "ok");
     }
-    if (gpx.flag.verboseMode)
-        fprintf(gpx.log, "o");
-    return py_return_translation(rval);
+    if (c->gpx.flag.verboseMode)
+        fprintf(c->gpx.log, "o");
+    return py_return_translation(c, rval);
 }
 
 #if !defined(_WIN32) && !defined(_WIN64)
 // def baudrate(long)
 static PyObject *py_set_baudrate(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     struct termios tp;
     long baudrate;
     speed_t speed;
 
-    if (!connected)
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, "l", &baudrate))
         return NULL;
 
-    if(tcgetattr(tio->sio.port, &tp) < 0)
+    if(tcgetattr(c->tio->sio.port, &tp) < 0)
         return PyErr_SetFromErrno(PyExc_IOError);
     speed = speed_from_long(&baudrate);
-    if (speed == B0)
+    if (speed == B0) {
+        PyErr_SetString(PyExc_ValueError, "Unsupported baudrate");
         return NULL;
+    }
     cfsetspeed(&tp, speed);
-    if(tcsetattr(tio->sio.port, TCSANOW, &tp) < 0)
+    if(tcsetattr(c->tio->sio.port, TCSANOW, &tp) < 0)
         return PyErr_SetFromErrno(PyExc_IOError);
 
     return Py_BuildValue("i", 0);
@@ -310,9 +341,11 @@ static PyObject *py_set_baudrate(PyObject *self, PyObject *args)
 #else
 static PyObject *py_set_baudrate(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     long baudrate;
 
-    if (!connected)
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, "l", &baudrate))
@@ -327,8 +360,10 @@ static PyObject *py_set_baudrate(PyObject *self, PyObject *args)
 // def disconnect()
 static PyObject *py_disconnect(PyObject *self, PyObject *args)
 {
-    tio_cleanup(tio);
-    connected = 0;
+    Connection *c = get_connection(self);
+
+    tio_cleanup(c->tio);
+    c->connected = 0;
     if (!PyArg_ParseTuple(args, ""))
         return NULL;
     return Py_BuildValue("i", 0);
@@ -338,13 +373,15 @@ static PyObject *py_disconnect(PyObject *self, PyObject *args)
 // for example: machine_info = get_machine_defaults("r1d")
 static PyObject *py_get_machine_defaults(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     char *machine_type_id;
 
     if (!PyArg_ParseTuple(args, "s", &machine_type_id))
         return NULL;
 
     Machine *machine = gpx_find_machine(machine_type_id);
-    fflush(gpx.log);
+    fflush(c->gpx.log);
     if (machine == NULL) {
         PyErr_SetString(PyExc_ValueError, "Machine id not found");
         return NULL;
@@ -389,20 +426,22 @@ static PyObject *py_get_machine_defaults(PyObject *self, PyObject *args)
 // def read_ini(ini_filepath)
 static PyObject *py_read_ini(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     const char *inipath = NULL;
 
     if (!PyArg_ParseTuple(args, "s", &inipath))
         return NULL;
 
-    int lineno = gpx_load_config(&gpx, inipath);
+    int lineno = gpx_load_config(&c->gpx, inipath);
     if (lineno == 0)
         return Py_BuildValue("i", 0); // success
 
     if (lineno < 0)
-        fprintf(gpx.log, "Unable to load configuration file (%s)\n", inipath);
+        fprintf(c->gpx.log, "Unable to load configuration file (%s)\n", inipath);
     if (lineno > 0)
-        fprintf(gpx.log, "(line %u) Configuration syntax error in %s: unrecognized parameters\n", lineno, inipath);
-    fflush(gpx.log);
+        fprintf(c->gpx.log, "(line %u) Configuration syntax error in %s: unrecognized parameters\n", lineno, inipath);
+    fflush(c->gpx.log);
 
     PyErr_SetString(PyExc_ValueError, "Unable to load ini file");
     return Py_BuildValue("i", 0);
@@ -412,28 +451,31 @@ static PyObject *py_read_ini(PyObject *self, PyObject *args)
 // reset settings to defaults
 static PyObject *py_reset_ini(PyObject *self, PyObject *args)
 {
+    Connection *c = get_connection(self);
+
     // some state survives reset_ini
-    void *callbackHandler = gpx.callbackHandler;
-    void *resultHandler = gpx.resultHandler;
-    void *callbackData = gpx.callbackData;
-    FILE *log = gpx.log;
-    unsigned verbose = gpx.flag.verboseMode;
+    void *callbackHandler = c->gpx.callbackHandler;
+    void *resultHandler = c->gpx.resultHandler;
+    void *callbackData = c->gpx.callbackData;
+    FILE *log = c->gpx.log;
+    unsigned verbose = c->gpx.flag.verboseMode;
 
     // nuke it all
-    gpx_initialize(&gpx, 1);
-    gpx.axis.positionKnown = 0;
-    gpx.flag.M106AlwaysValve = 1;
+    gpx_initialize(&c->gpx, 1);
+    c->gpx.axis.positionKnown = 0;
+    c->gpx.flag.M106AlwaysValve = 1;
 
     // restore some stuff, plus we're still in pymodule mode
-    gpx.callbackHandler = callbackHandler;
-    gpx.resultHandler = resultHandler;
-    gpx.callbackData = callbackData;
-    gpx.log = log;
-    gpx.flag.framingEnabled = 1;
-    gpx.flag.sioConnected = 1;
-    gpx.sio = &tio->sio;
-    gpx.flag.verboseMode = verbose;
-    gpx.flag.logMessages = 1;
+    c->gpx.callbackHandler = callbackHandler;
+    c->gpx.resultHandler = resultHandler;
+    c->gpx.callbackData = callbackData;
+    c->gpx.log = log;
+    c->gpx.flag.framingEnabled = 1;
+    c->gpx.flag.sioConnected = 1;
+    c->gpx.sio = &c->tio->sio;
+    c->gpx.tio = c->tio;
+    c->gpx.flag.verboseMode = verbose;
+    c->gpx.flag.logMessages = 1;
 
     return Py_BuildValue("i", 0);
 }
@@ -442,10 +484,12 @@ static PyObject *py_reset_ini(PyObject *self, PyObject *args)
 // is the bot waiting for something?
 static PyObject *py_waiting(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
-    if (tio->waiting || tio->flag.waitClearedByCancel)
+    if (c->tio->waiting || c->tio->flag.waitClearedByCancel)
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -455,7 +499,9 @@ static PyObject *py_waiting(PyObject *self, PyObject *args)
 // are we printing a build?
 static PyObject *py_build_started(PyObject *self, PyObject *args)
 {
-    if (gpx.flag.programState == RUNNING_STATE)
+    Connection *c = get_connection(self);
+
+    if (c->gpx.flag.programState == RUNNING_STATE)
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -465,17 +511,19 @@ static PyObject *py_build_started(PyObject *self, PyObject *args)
 // is the build paused on the LCD?
 static PyObject *py_build_paused(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
-    int rval = get_build_statistics(&gpx);
+    int rval = get_build_statistics(&c->gpx);
     // if we fail, is that a yes or a no?
     if (rval != SUCCESS) {
         PyErr_SetString(PyExc_IOError, "Unable to get build statistics.");
         return NULL;
     }
 
-    if (tio->waitflag.waitForUnpause)
+    if (c->tio->waitflag.waitForUnpause)
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -485,10 +533,12 @@ static PyObject *py_build_paused(PyObject *self, PyObject *args)
 // are we in the middle of listing files from the SD card?
 static PyObject *py_listing_files(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
-    if (tio->flag.listingFiles)
+    if (c->tio->flag.listingFiles)
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -497,15 +547,17 @@ static PyObject *py_listing_files(PyObject *self, PyObject *args)
 // def reprap_flavor(turn_on_reprap)
 static PyObject *py_reprap_flavor(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
     int reprap = 1;
     if (!PyArg_ParseTuple(args, "i", &reprap))
         return NULL;
 
-    int rval = gpx.flag.reprapFlavor;
-    gpx.flag.reprapFlavor = !!reprap;
+    int rval = c->gpx.flag.reprapFlavor;
+    c->gpx.flag.reprapFlavor = !!reprap;
     if (rval)
         Py_RETURN_TRUE;
     else
@@ -518,8 +570,9 @@ static PyObject *py_reprap_flavor(PyObject *self, PyObject *args)
 // the queue handling
 
 // helper for py_stop and py_abort for post abort state
-static PyObject *set_build_aborted_state(Gpx *gpx)
+static PyObject *set_build_aborted_state(Connection *c)
 {
+    Gpx *gpx = &c->gpx;
     int rval = SUCCESS;
 
     VERBOSE( fprintf(gpx->log, "set_build_aborted_state\n") );
@@ -532,19 +585,21 @@ static PyObject *set_build_aborted_state(Gpx *gpx)
         while (retries--) {
             rval = set_build_progress(gpx, 100);
             if (rval == 0x8B)
-                return py_return_translation(rval);
+                return py_return_translation(c, rval);
             if (rval == SUCCESS || rval != ESIOTIMEOUT)
                 break;
         }
         rval = end_build(gpx);
     }
-    return py_return_translation(rval);
+    return py_return_translation(c, rval);
 }
 
 // def stop(halt_steppers = True, clear_queue = True)
 static PyObject *py_stop(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
     int halt_steppers = 1;
@@ -552,60 +607,62 @@ static PyObject *py_stop(PyObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "|ii", &halt_steppers, &clear_queue))
         return NULL;
 
-    if (gpx.flag.verboseMode) fprintf(gpx.log, "py_stop\n");
-    if (!tio->waitflag.waitForCancelSync) {
-        if (gpx.flag.verboseMode) fprintf(gpx.log, "py_stop now waiting for @clear_cancel\n");
-        tio->flag.cancelPending = 1;
+    if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_stop\n");
+    if (!c->tio->waitflag.waitForCancelSync) {
+        if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_stop now waiting for @clear_cancel\n");
+        c->tio->flag.cancelPending = 1;
     }
 
-    clear_state_for_cancel();
+    clear_state_for_cancel(c);
 
     int rval = SUCCESS;
 
     // first, ask if we are SD printing
     // delay 1ms is a queuable command that will fail if SD printing
     int sdprinting = 0;
-    rval = delay(&gpx, 1);
+    rval = delay(&c->gpx, 1);
     if (rval == 0x8A) // SD printing
         sdprinting = 1;
     // ignore any other response
 
-    if (sdprinting && !gpx.flag.sd_paused) {
-        rval = pause_resume(&gpx);
+    if (sdprinting && !c->gpx.flag.sd_paused) {
+        rval = pause_resume(&c->gpx);
         if (rval != SUCCESS)
-            return py_return_translation(rval);
-        gpx.flag.sd_paused = 1;
+            return py_return_translation(c, rval);
+        c->gpx.flag.sd_paused = 1;
     }
 
-    rval = extended_stop(&gpx, halt_steppers, clear_queue);
+    rval = extended_stop(&c->gpx, halt_steppers, clear_queue);
 
     if (rval != 0x89)
-        tio->waitflag.waitForCancelSync = 0;
+        c->tio->waitflag.waitForCancelSync = 0;
 
     if (rval != SUCCESS)
-        return py_return_translation(rval);
-    gpx.flag.sd_paused = 0;
-    return set_build_aborted_state(&gpx);
+        return py_return_translation(c, rval);
+    c->gpx.flag.sd_paused = 0;
+    return set_build_aborted_state(c);
 }
 
 // def abort()
 static PyObject *py_abort(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
     if (!PyArg_ParseTuple(args, ""))
         return NULL;
 
-    if (gpx.flag.verboseMode) fprintf(gpx.log, "py_abort\n");
-    if (!tio->waitflag.waitForCancelSync) {
-        if (gpx.flag.verboseMode) fprintf(gpx.log, "py_abort now waiting for @clear_cancel\n");
-        tio->flag.cancelPending = 1;
+    if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_abort\n");
+    if (!c->tio->waitflag.waitForCancelSync) {
+        if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_abort now waiting for @clear_cancel\n");
+        c->tio->flag.cancelPending = 1;
     }
 
-    clear_state_for_cancel();
+    clear_state_for_cancel(c);
 
-    int rval = abort_immediately(&gpx);
+    int rval = abort_immediately(&c->gpx);
 
     // ESIOTIMEOUT is only returned if the write succeeded, but no bytes returned
     // I think this can happen if the bot resets immediately and doesn't respond
@@ -615,26 +672,28 @@ static PyObject *py_abort(PyObject *self, PyObject *args)
         rval = SUCCESS;
 
     if (rval != 0x89)
-        tio->waitflag.waitForCancelSync = 0;
+        c->tio->waitflag.waitForCancelSync = 0;
 
     if (rval != SUCCESS) {
-        if (gpx.flag.verboseMode) fprintf(gpx.log, "abort_immediately rval = %d\n", rval);
-        return py_return_translation(rval);
+        if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "abort_immediately rval = %d\n", rval);
+        return py_return_translation(c, rval);
     }
-    gpx.flag.sd_paused = 0;
-    return set_build_aborted_state(&gpx);
+    c->gpx.flag.sd_paused = 0;
+    return set_build_aborted_state(c);
 }
 
 // def read_eeprom(id)
 static PyObject *py_read_eeprom(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
-    tio->cur = 0;
-    tio->translation[0] = 0;
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
 
-    if (gpx.eepromMap == NULL && load_eeprom_map(&gpx) != SUCCESS) {
+    if (c->gpx.eepromMap == NULL && load_eeprom_map(&c->gpx) != SUCCESS) {
         PyErr_SetString(pyerrUnknownFirmware, "No EEPROM map found for firmware type and/or version");
         return NULL;
     }
@@ -643,8 +702,8 @@ static PyObject *py_read_eeprom(PyObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "s", &id))
         return NULL;
 
-    if (gpx.flag.verboseMode) fprintf(gpx.log, "py_read_eeprom %s\n", id);
-    EepromMapping *pem = find_any_eeprom_mapping(&gpx, id);
+    if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_read_eeprom %s\n", id);
+    EepromMapping *pem = find_any_eeprom_mapping(&c->gpx, id);
     if (pem == NULL) {
         PyErr_SetString(PyExc_ValueError, "EEPROM id mapping not found");
         return NULL;
@@ -656,44 +715,44 @@ static PyObject *py_read_eeprom(PyObject *self, PyObject *args)
     float n;
     switch (pem->et) {
         case et_boolean:
-            if (read_eeprom_8(&gpx, gpx.sio, pem->address, &b) == SUCCESS)
+            if (read_eeprom_8(&c->gpx, c->gpx.sio, pem->address, &b) == SUCCESS)
                 return Py_BuildValue("O", b ? Py_True : Py_False);
             break;
 
         case et_bitfield:
         case et_byte:
-            if (read_eeprom_8(&gpx, gpx.sio, pem->address, &b) == SUCCESS)
+            if (read_eeprom_8(&c->gpx, c->gpx.sio, pem->address, &b) == SUCCESS)
                 return Py_BuildValue("B", b);
             break;
 
         case et_ushort:
-            if (read_eeprom_16(&gpx, gpx.sio, pem->address, &us) == SUCCESS)
+            if (read_eeprom_16(&c->gpx, c->gpx.sio, pem->address, &us) == SUCCESS)
                 return Py_BuildValue("H", us);
             break;
 
         case et_fixed:
-            if (read_eeprom_fixed_16(&gpx, gpx.sio, pem->address, &n) == SUCCESS)
+            if (read_eeprom_fixed_16(&c->gpx, c->gpx.sio, pem->address, &n) == SUCCESS)
                 return Py_BuildValue("f", n);
             break;
 
         case et_long:
         case et_ulong:
-            if (read_eeprom_32(&gpx, gpx.sio, pem->address, &ul) == SUCCESS)
+            if (read_eeprom_32(&c->gpx, c->gpx.sio, pem->address, &ul) == SUCCESS)
                 return Py_BuildValue(pem->et == et_long ? "l" : "k", ul);
             break;
 
         case et_float:
-            if (read_eeprom_float(&gpx, gpx.sio, pem->address, &n) == SUCCESS)
+            if (read_eeprom_float(&c->gpx, c->gpx.sio, pem->address, &n) == SUCCESS)
                 return Py_BuildValue("f", n);
             break;
 
         case et_string:
-            memset(gpx.sio->response.eeprom.buffer, 0, sizeof(gpx.sio->response.eeprom.buffer));
+            memset(c->gpx.sio->response.eeprom.buffer, 0, sizeof(c->gpx.sio->response.eeprom.buffer));
             int len = pem->len;
-            if (len > sizeof(gpx.sio->response.eeprom.buffer))
-                len = sizeof(gpx.sio->response.eeprom.buffer);
-            if (read_eeprom(&gpx, pem->address, len) == SUCCESS)
-                return Py_BuildValue("s", gpx.sio->response.eeprom.buffer);
+            if (len > sizeof(c->gpx.sio->response.eeprom.buffer))
+                len = sizeof(c->gpx.sio->response.eeprom.buffer);
+            if (read_eeprom(&c->gpx, pem->address, len) == SUCCESS)
+                return Py_BuildValue("s", c->gpx.sio->response.eeprom.buffer);
             break;
 
         default:
@@ -707,27 +766,29 @@ static PyObject *py_read_eeprom(PyObject *self, PyObject *args)
 // def write_eeprom(id, value)
 static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
 {
-    if (!connected)
+    Connection *c = get_connection(self);
+
+    if (!c->connected)
         return PyErr_NotConnected();
 
-    tio->cur = 0;
-    tio->translation[0] = 0;
+    c->tio->cur = 0;
+    c->tio->translation[0] = 0;
 
     char *id;
     PyObject *value;
 
     if (!PyArg_ParseTuple(args, "sO", &id, &value))
         return NULL;
-    PyObject_Print(value, gpx.log, 0);
-    fprintf(gpx.log, " <- \n");
+    PyObject_Print(value, c->gpx.log, 0);
+    fprintf(c->gpx.log, " <- \n");
 
-    if (gpx.flag.verboseMode) fprintf(gpx.log, "py_write_eeprom\n");
-    if (gpx.eepromMap == NULL && load_eeprom_map(&gpx) != SUCCESS) {
+    if (c->gpx.flag.verboseMode) fprintf(c->gpx.log, "py_write_eeprom\n");
+    if (c->gpx.eepromMap == NULL && load_eeprom_map(&c->gpx) != SUCCESS) {
         PyErr_SetString(pyerrUnknownFirmware, "No EEPROM map found for firmware type and/or version");
         return NULL;
     }
 
-    EepromMapping *pem = find_any_eeprom_mapping(&gpx, id);
+    EepromMapping *pem = find_any_eeprom_mapping(&c->gpx, id);
     if (pem == NULL) {
         PyErr_SetString(PyExc_ValueError, "EEPROM id mapping not found");
         return NULL;
@@ -745,8 +806,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
         case et_boolean:
             if (!PyArg_Parse(value, "B", &b))
                 return NULL;
-            gcodeResult(&gpx, "write_eeprom_8(%u) to address %u", (unsigned)!!b, pem->address);
-            rval = write_eeprom_8(&gpx, gpx.sio, pem->address, !!b);
+            gcodeResult(&c->gpx, "write_eeprom_8(%u) to address %u", (unsigned)!!b, pem->address);
+            rval = write_eeprom_8(&c->gpx, c->gpx.sio, pem->address, !!b);
             break;
 
         case et_bitfield:
@@ -758,8 +819,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            gcodeResult(&gpx, "write_eeprom_8(%u) to address %u", (unsigned)b, pem->address);
-            rval = write_eeprom_8(&gpx, gpx.sio, pem->address, b);
+            gcodeResult(&c->gpx, "write_eeprom_8(%u) to address %u", (unsigned)b, pem->address);
+            rval = write_eeprom_8(&c->gpx, c->gpx.sio, pem->address, b);
             break;
 
         case et_ushort:
@@ -770,8 +831,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            gcodeResult(&gpx, "write_eeprom_16(%u) to address %u", us, pem->address);
-            rval = write_eeprom_16(&gpx, gpx.sio, pem->address, us);
+            gcodeResult(&c->gpx, "write_eeprom_16(%u) to address %u", us, pem->address);
+            rval = write_eeprom_16(&c->gpx, c->gpx.sio, pem->address, us);
             break;
 
         case et_fixed:
@@ -782,8 +843,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            rval = write_eeprom_fixed_16(&gpx, gpx.sio, pem->address, n);
-            gcodeResult(&gpx, "write_eeprom_fixed_16(%f) to address %u", n, pem->address);
+            rval = write_eeprom_fixed_16(&c->gpx, c->gpx.sio, pem->address, n);
+            gcodeResult(&c->gpx, "write_eeprom_fixed_16(%f) to address %u", n, pem->address);
             break;
 
         case et_long:
@@ -794,8 +855,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            rval = write_eeprom_32(&gpx, gpx.sio, pem->address, ul);
-            gcodeResult(&gpx, "write_eeprom_32(%lu) to address %u", ul, pem->address);
+            rval = write_eeprom_32(&c->gpx, c->gpx.sio, pem->address, ul);
+            gcodeResult(&c->gpx, "write_eeprom_32(%lu) to address %u", ul, pem->address);
             break;
 
         case et_ulong:
@@ -806,8 +867,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            rval = write_eeprom_32(&gpx, gpx.sio, pem->address, ul);
-            gcodeResult(&gpx, "write_eeprom_32(%lu) to address %u", ul, pem->address);
+            rval = write_eeprom_32(&c->gpx, c->gpx.sio, pem->address, ul);
+            gcodeResult(&c->gpx, "write_eeprom_32(%lu) to address %u", ul, pem->address);
             break;
 
         case et_float:
@@ -818,8 +879,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             Py_DECREF(value);
             if (!f)
                 return NULL;
-            rval = write_eeprom_float(&gpx, gpx.sio, pem->address, n);
-            gcodeResult(&gpx, "write_eeprom_float(%f) to address %u", n, pem->address);
+            rval = write_eeprom_float(&c->gpx, c->gpx.sio, pem->address, n);
+            gcodeResult(&c->gpx, "write_eeprom_float(%f) to address %u", n, pem->address);
             break;
 
         case et_string:
@@ -830,8 +891,8 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
                 PyErr_SetString(PyExc_ValueError, "String value too long for indicated EEPROM entry");
                 return NULL;
             }
-            rval = write_eeprom(&gpx, pem->address, s, len + 1);
-            gcodeResult(&gpx, "write_eeprom(%s) to address %u", s, pem->address);
+            rval = write_eeprom(&c->gpx, pem->address, s, len + 1);
+            gcodeResult(&c->gpx, "write_eeprom(%s) to address %u", s, pem->address);
             break;
 
         default:
@@ -839,7 +900,7 @@ static PyObject *py_write_eeprom(PyObject *self, PyObject *args)
             return NULL;
     }
 
-    return py_return_translation(rval);
+    return py_return_translation(c, rval);
 }
 
 
@@ -866,6 +927,39 @@ static PyMethodDef GpxMethods[] = {
     {NULL, NULL, 0, NULL} // sentinel
 };
 
+// a Connection has the same methods as the module, they just act on it
+// instead of on the default connection
+static int connection_init(Connection *c, PyObject *args, PyObject *kwds)
+{
+    if (!PyArg_ParseTuple(args, ""))
+        return -1;
+    if (c->tio != NULL)
+        tio_cleanup(c->tio);
+    c->connected = 0;
+    gpx_initialize(&c->gpx, 1);
+    c->tio = tio_initialize(&c->connection, &c->gpx);
+    return 0;
+}
+
+static void connection_dealloc(Connection *c)
+{
+    if (c->tio != NULL)
+        tio_cleanup(c->tio);
+    Py_TYPE(c)->tp_free((PyObject *)c);
+}
+
+static PyTypeObject ConnectionType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "gpx.Connection",
+    .tp_basicsize = sizeof(Connection),
+    .tp_dealloc = (destructor)connection_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Connection() A printer connection with its own converter state, for talking to more than one printer at a time",
+    .tp_methods = GpxMethods,
+    .tp_init = (initproc)connection_init,
+    .tp_new = PyType_GenericNew,
+};
+
 __attribute__ ((visibility ("default"))) PyMODINIT_FUNC initgpx(void);
 
 // python calls init<modulename> when the module is loaded
@@ -891,6 +985,11 @@ PyMODINIT_FUNC initgpx(void)
     Py_INCREF(pyerrUnknownFirmware);
     PyModule_AddObject(m, "UnknownFirmware", pyerrUnknownFirmware);
 
-    gpx_initialize(&gpx, 1);
-    tio = tio_initialize(&gpx);
+    if (PyType_Ready(&ConnectionType) < 0)
+        return;
+    Py_INCREF(&ConnectionType);
+    PyModule_AddObject(m, "Connection", (PyObject *)&ConnectionType);
+
+    // the module keeps its reference to the default connection for good
+    default_connection = (Connection *)PyObject_CallObject((PyObject *)&ConnectionType, NULL);
 }
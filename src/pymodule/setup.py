@@ -5,14 +5,40 @@ from setuptools import setup, Extension
 
 sources = [
 	'gpxmodule.c',
+	'../shared/crc8.c',
 	'../shared/machine_config.c',
 	'../shared/opt.c',
+	'../shared/sertrace.c',
 	'../gpx/gpx.c',
 	'../gpx/gpx-main.c',
+	'../gpx/batch.c',
+	'../gpx/cache.c',
+	'../gpx/decompress.c',
+	'../gpx/estimate.c',
+	'../gpx/ir.c',
+	'../gpx/kinematics.c',
+	'../gpx/linkstats.c',
+	'../gpx/number.c',
+	'../gpx/reader.c',
+	'../gpx/ring.c',
+	'../gpx/scan.c',
+	'../gpx/stats.c',
 	]
 if sys.platform == 'win32':
 	sources.append('../gpx/winsio.c')
 
+# link the compression libraries configure found
+libraries = []
+try:
+	with open('../shared/config.h') as config:
+		defines = config.read()
+	if '#define HAVE_LIBZ 1' in defines:
+		libraries.append('z')
+	if '#define HAVE_LIBZSTD 1' in defines:
+		libraries.append('zstd')
+except IOError:
+	pass
+
 def params():
 	name='gpx'
 	version='1.0'
@@ -24,6 +50,7 @@ def params():
 		Extension('gpx',
 		sources = sources,
 		extra_compile_args = ['-DSERIAL_SUPPORT', '-fvisibility=hidden', '-I../shared', '-I../gpx'],
+		libraries = libraries,
 		extra_link_args = ['-fvisibility=hidden'])
 		]
 	return locals()
@@ -0,0 +1,57 @@
+//  crc8.h
+//
+//  8-bit iButton/Maxim/Dallas CRC of x3g packets
+//
+//  The CRC is looked up a byte at a time in a 256 entry table, or with
+//  CRC8_SLICES set to 4 or 8, that many bytes at a time in as many tables.
+//  Define CRC8_SLICES when building to pick the variant, it defaults to 8
+//  which is the fastest from the 32 byte payload of a queue point up.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef CRC8_H_
+#define CRC8_H_
+
+#include <stddef.h>
+
+#ifndef CRC8_SLICES
+#define CRC8_SLICES 8
+#endif
+
+#if CRC8_SLICES != 1 && CRC8_SLICES != 4 && CRC8_SLICES != 8
+#error CRC8_SLICES must be 1, 4 or 8
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the CRC of length bytes at p, continuing from the CRC crc of the bytes
+// before them, or 0 to start a new CRC
+unsigned char crc8_update(unsigned char crc, const void *p, size_t length);
+
+// the CRC of length bytes at p
+#define crc8(p, length) crc8_update(0, p, length)
+
+// the variants crc8_update chooses between, for benchmarking
+unsigned char crc8_bytewise(unsigned char crc, const void *p, size_t length);
+unsigned char crc8_sliced4(unsigned char crc, const void *p, size_t length);
+unsigned char crc8_sliced8(unsigned char crc, const void *p, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
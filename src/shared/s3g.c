@@ -30,27 +30,11 @@
 #include <fcntl.h>
 
 #include "portable_endian.h"
+#include "s3g_pack.h"
 #include "s3g_private.h"
 #include "s3g_stdio.h"
 #include "s3g.h"
 
-typedef struct {
-     union {
-	  int32_t  i;
-	  uint32_t u;
-	  float    f;
-	  unsigned char c[4];
-     } u;
-} foo_32_t;
-
-typedef struct {
-     union {
-	  int16_t  i;
-	  uint16_t u;
-	  unsigned char c[2];
-     } u;
-} foo_16_t;
-
 typedef struct {
      uint8_t     cmd_id;
      size_t      cmd_len;
@@ -58,191 +42,109 @@ typedef struct {
      const char *cmd_desc;
 } s3g_command_info_t;
 
-static const s3g_command_info_t command_table_raw[] = {
-     /*   0 */  {HOST_CMD_VERSION, 0, 0, "version"},
-     /*   1 */  {HOST_CMD_INIT, 0, -1, "initialize"},
-     /*   2 */  {HOST_CMD_GET_BUFFER_SIZE, 0, 0, "get buffer size"},
-     /*   3 */  {HOST_CMD_CLEAR_BUFFER, 0, 0, "clear buffer"},
-     /*   4 */  {HOST_CMD_GET_POSITION, 0, -1, "get position"},
+// Command tables indexed by command id.  Ids without an entry have a NULL
+// description and are treated as unrecognized (and blocking).
+
+static const s3g_command_info_t command_table[256] = {
+     /*   0 */  [HOST_CMD_VERSION] = {HOST_CMD_VERSION, 0, 0, "version"},
+     /*   1 */  [HOST_CMD_INIT] = {HOST_CMD_INIT, 0, -1, "initialize"},
+     /*   2 */  [HOST_CMD_GET_BUFFER_SIZE] = {HOST_CMD_GET_BUFFER_SIZE, 0, 0, "get buffer size"},
+     /*   3 */  [HOST_CMD_CLEAR_BUFFER] = {HOST_CMD_CLEAR_BUFFER, 0, 0, "clear buffer"},
+     /*   4 */  [HOST_CMD_GET_POSITION] = {HOST_CMD_GET_POSITION, 0, -1, "get position"},
      /* 5,6 */  // DO NOT EXIST
-     /*   7 */  {HOST_CMD_ABORT, 0, -1, "abort"},
-     /*   8 */  {HOST_CMD_PAUSE, 0, -1, "Pause"},
-     /*   9 */  {HOST_CMD_PROBE, 0, -1, "probe"},
-     /*  10 */  {HOST_CMD_TOOL_QUERY, 0, 0, "tool query"},
-     /*  11 */  {HOST_CMD_IS_FINISHED, 0, -1, "is finished?"},
-     /*  12 */  {HOST_CMD_READ_EEPROM, 0, 0, "read EEPROM"},
-     /*  13 */  {HOST_CMD_WRITE_EEPROM, 0, 0, "write EEPROM"},
-     /*  14 */  {HOST_CMD_CAPTURE_TO_FILE, 0, -1, "capture to file"},
-     /*  15 */  {HOST_CMD_END_CAPTURE, 0, -1, "end capture"},
-     /*  16 */  {HOST_CMD_PLAYBACK_CAPTURE, 0, -1, "playback capture"},
-     /*  17 */  {HOST_CMD_RESET, 0, -1, "software reset"},
-     /*  18 */  {HOST_CMD_NEXT_FILENAME, 0, -1, "next SD card filename"},
-     /*  19 */  {HOST_CMD_GET_DBG_REG, 0, 0, "get debug register"},
-     /*  20 */  {HOST_CMD_GET_BUILD_NAME, 0, 0, "get build name"},
-     /*  21 */  {HOST_CMD_GET_POSITION_EXT, 0, -1, "get position extended"},
-     /*  22 */  {HOST_CMD_EXTENDED_STOP, 0, -1, "extended stop"},
-     /*  23 */  {HOST_CMD_BOARD_STATUS, 0, 0, "get board status"},
-     /*  24 */  {HOST_CMD_GET_BUILD_STATS, 0, -1, "get build statistics"},
+     /*   7 */  [HOST_CMD_ABORT] = {HOST_CMD_ABORT, 0, -1, "abort"},
+     /*   8 */  [HOST_CMD_PAUSE] = {HOST_CMD_PAUSE, 0, -1, "Pause"},
+     /*   9 */  [HOST_CMD_PROBE] = {HOST_CMD_PROBE, 0, -1, "probe"},
+     /*  10 */  [HOST_CMD_TOOL_QUERY] = {HOST_CMD_TOOL_QUERY, 0, 0, "tool query"},
+     /*  11 */  [HOST_CMD_IS_FINISHED] = {HOST_CMD_IS_FINISHED, 0, -1, "is finished?"},
+     /*  12 */  [HOST_CMD_READ_EEPROM] = {HOST_CMD_READ_EEPROM, 0, 0, "read EEPROM"},
+     /*  13 */  [HOST_CMD_WRITE_EEPROM] = {HOST_CMD_WRITE_EEPROM, 0, 0, "write EEPROM"},
+     /*  14 */  [HOST_CMD_CAPTURE_TO_FILE] = {HOST_CMD_CAPTURE_TO_FILE, 0, -1, "capture to file"},
+     /*  15 */  [HOST_CMD_END_CAPTURE] = {HOST_CMD_END_CAPTURE, 0, -1, "end capture"},
+     /*  16 */  [HOST_CMD_PLAYBACK_CAPTURE] = {HOST_CMD_PLAYBACK_CAPTURE, 0, -1, "playback capture"},
+     /*  17 */  [HOST_CMD_RESET] = {HOST_CMD_RESET, 0, -1, "software reset"},
+     /*  18 */  [HOST_CMD_NEXT_FILENAME] = {HOST_CMD_NEXT_FILENAME, 0, -1, "next SD card filename"},
+     /*  19 */  [HOST_CMD_GET_DBG_REG] = {HOST_CMD_GET_DBG_REG, 0, 0, "get debug register"},
+     /*  20 */  [HOST_CMD_GET_BUILD_NAME] = {HOST_CMD_GET_BUILD_NAME, 0, 0, "get build name"},
+     /*  21 */  [HOST_CMD_GET_POSITION_EXT] = {HOST_CMD_GET_POSITION_EXT, 0, -1, "get position extended"},
+     /*  22 */  [HOST_CMD_EXTENDED_STOP] = {HOST_CMD_EXTENDED_STOP, 0, -1, "extended stop"},
+     /*  23 */  [HOST_CMD_BOARD_STATUS] = {HOST_CMD_BOARD_STATUS, 0, 0, "get board status"},
+     /*  24 */  [HOST_CMD_GET_BUILD_STATS] = {HOST_CMD_GET_BUILD_STATS, 0, -1, "get build statistics"},
      /* 25-6*/  // DO NOT EXIST
-     /*  27 */  {HOST_CMD_ADVANCED_VERSION, 0, 0, "advanced version"},
+     /*  27 */  [HOST_CMD_ADVANCED_VERSION] = {HOST_CMD_ADVANCED_VERSION, 0, 0, "advanced version"},
      /* ... */  // DO NOT EXIST
-     /* 112 */  {HOST_CMD_DEBUG_ECHO, 0, -1, "debug echo"},
+     /* 112 */  [HOST_CMD_DEBUG_ECHO] = {HOST_CMD_DEBUG_ECHO, 0, -1, "debug echo"},
      /* ... */  // DO NOT EXIST
-     /* 131 */  {HOST_CMD_FIND_AXES_MINIMUM, 7, -1, "find axes minimum"},
-     /* 132 */  {HOST_CMD_FIND_AXES_MAXIMUM, 7, -1, "find axes maximum"},
-     /* 133 */  {HOST_CMD_DELAY, 4, -1, "delay"},
-     /* 134 */  {HOST_CMD_CHANGE_TOOL, 1, -1, "change tool"},
-     /* 135 */  {HOST_CMD_WAIT_FOR_TOOL, 5, -1, "wait for tool ready"},
-     /* 136 */  {HOST_CMD_TOOL_COMMAND, 0xffffffff, 0, "tool action"},
-     /* 137 */  {HOST_CMD_ENABLE_AXES, 1, -1, "enable/disable axes"},
+     /* 131 */  [HOST_CMD_FIND_AXES_MINIMUM] = {HOST_CMD_FIND_AXES_MINIMUM, X3G_LENGTH(find_axes_minimum), -1, "find axes minimum"},
+     /* 132 */  [HOST_CMD_FIND_AXES_MAXIMUM] = {HOST_CMD_FIND_AXES_MAXIMUM, X3G_LENGTH(find_axes_maximum), -1, "find axes maximum"},
+     /* 133 */  [HOST_CMD_DELAY] = {HOST_CMD_DELAY, X3G_LENGTH(delay), -1, "delay"},
+     /* 134 */  [HOST_CMD_CHANGE_TOOL] = {HOST_CMD_CHANGE_TOOL, X3G_LENGTH(change_tool), -1, "change tool"},
+     /* 135 */  [HOST_CMD_WAIT_FOR_TOOL] = {HOST_CMD_WAIT_FOR_TOOL, X3G_LENGTH(wait_for_tool), -1, "wait for tool ready"},
+     /* 136 */  [HOST_CMD_TOOL_COMMAND] = {HOST_CMD_TOOL_COMMAND, 0xffffffff, 0, "tool action"},
+     /* 137 */  [HOST_CMD_ENABLE_AXES] = {HOST_CMD_ENABLE_AXES, X3G_LENGTH(enable_axes), -1, "enable/disable axes"},
      /* 138 */  // DOES NOT EXIST
-     /* 139 */  {HOST_CMD_QUEUE_POINT_EXT, 24, -1, "queue point extended"},
-     /* 140 */  {HOST_CMD_SET_POSITION_EXT, 20, -1, "set position extended"},
-     /* 141 */  {HOST_CMD_WAIT_FOR_PLATFORM, 5, -1, "wait for platform ready"},
-     /* 142 */  {HOST_CMD_QUEUE_POINT_NEW, 25, -1, "queue new point"},
-     /* 143 */  {HOST_CMD_STORE_HOME_POSITION, 1, -1, "store home position"},
-     /* 144 */  {HOST_CMD_RECALL_HOME_POSITION, 1, -1, "recall home position"},
-     /* 145 */  {HOST_CMD_SET_POT_VALUE, 2, -1, "digital potentiometer"},
-     /* 146 */  {HOST_CMD_SET_RGB_LED, 5, -1, "RGB LED"},
-     /* 147 */  {HOST_CMD_SET_BEEP, 5, -1, "buzzer beep"},
-     /* 148 */  {HOST_CMD_PAUSE_FOR_BUTTON, 4, -1, "pause for button"},
-     /* 149 */  {HOST_CMD_DISPLAY_MESSAGE, -1, -1, "display message"},
-     /* 150 */  {HOST_CMD_SET_BUILD_PERCENT, 2, 0, "build percentage"},
-     /* 151 */  {HOST_CMD_QUEUE_SONG, 1, -1, "queue song"},
-     /* 152 */  {HOST_CMD_RESET_TO_FACTORY, 1, -1, "restore to factory settings"},
-     /* 153 */  {HOST_CMD_BUILD_START_NOTIFICATION, 4, -1, "build start notification"},
-     /* 154 */  {HOST_CMD_BUILD_END_NOTIFICATION, 1, -1, "build end notification"},
-     /* 155 */  {HOST_CMD_QUEUE_POINT_NEW_EXT, 31, 0, "queue point new extended"},
-     /* 156 */  {HOST_CMD_SET_ACCELERATION_TOGGLE, 1, -1, "set segment acceleration"},
-     /* 157 */  {HOST_CMD_STREAM_VERSION, 20, 0, "stream version"},
-     /* 158 */  {HOST_CMD_PAUSE_AT_ZPOS, 4, 0, "pause at Z position"}
+     /* 139 */  [HOST_CMD_QUEUE_POINT_EXT] = {HOST_CMD_QUEUE_POINT_EXT, X3G_LENGTH(queue_point_ext), -1, "queue point extended"},
+     /* 140 */  [HOST_CMD_SET_POSITION_EXT] = {HOST_CMD_SET_POSITION_EXT, X3G_LENGTH(set_position_ext), -1, "set position extended"},
+     /* 141 */  [HOST_CMD_WAIT_FOR_PLATFORM] = {HOST_CMD_WAIT_FOR_PLATFORM, X3G_LENGTH(wait_for_platform), -1, "wait for platform ready"},
+     /* 142 */  [HOST_CMD_QUEUE_POINT_NEW] = {HOST_CMD_QUEUE_POINT_NEW, X3G_LENGTH(queue_point_new), -1, "queue new point"},
+     /* 143 */  [HOST_CMD_STORE_HOME_POSITION] = {HOST_CMD_STORE_HOME_POSITION, X3G_LENGTH(store_home_position), -1, "store home position"},
+     /* 144 */  [HOST_CMD_RECALL_HOME_POSITION] = {HOST_CMD_RECALL_HOME_POSITION, X3G_LENGTH(recall_home_position), -1, "recall home position"},
+     /* 145 */  [HOST_CMD_SET_POT_VALUE] = {HOST_CMD_SET_POT_VALUE, X3G_LENGTH(set_pot_value), -1, "digital potentiometer"},
+     /* 146 */  [HOST_CMD_SET_RGB_LED] = {HOST_CMD_SET_RGB_LED, X3G_LENGTH(set_rgb_led), -1, "RGB LED"},
+     /* 147 */  [HOST_CMD_SET_BEEP] = {HOST_CMD_SET_BEEP, X3G_LENGTH(set_beep), -1, "buzzer beep"},
+     /* 148 */  [HOST_CMD_PAUSE_FOR_BUTTON] = {HOST_CMD_PAUSE_FOR_BUTTON, X3G_LENGTH(pause_for_button), -1, "pause for button"},
+     /* 149 */  [HOST_CMD_DISPLAY_MESSAGE] = {HOST_CMD_DISPLAY_MESSAGE, -1, -1, "display message"},
+     /* 150 */  [HOST_CMD_SET_BUILD_PERCENT] = {HOST_CMD_SET_BUILD_PERCENT, X3G_LENGTH(set_build_percent), 0, "build percentage"},
+     /* 151 */  [HOST_CMD_QUEUE_SONG] = {HOST_CMD_QUEUE_SONG, X3G_LENGTH(queue_song), -1, "queue song"},
+     /* 152 */  [HOST_CMD_RESET_TO_FACTORY] = {HOST_CMD_RESET_TO_FACTORY, X3G_LENGTH(reset_to_factory), -1, "restore to factory settings"},
+     /* 153 */  [HOST_CMD_BUILD_START_NOTIFICATION] = {HOST_CMD_BUILD_START_NOTIFICATION, X3G_LENGTH(build_start), -1, "build start notification"},
+     /* 154 */  [HOST_CMD_BUILD_END_NOTIFICATION] = {HOST_CMD_BUILD_END_NOTIFICATION, X3G_LENGTH(build_end), -1, "build end notification"},
+     /* 155 */  [HOST_CMD_QUEUE_POINT_NEW_EXT] = {HOST_CMD_QUEUE_POINT_NEW_EXT, X3G_LENGTH(queue_point_new_ext), 0, "queue point new extended"},
+     /* 156 */  [HOST_CMD_SET_ACCELERATION_TOGGLE] = {HOST_CMD_SET_ACCELERATION_TOGGLE, X3G_LENGTH(set_acceleration_toggle), -1, "set segment acceleration"},
+     /* 157 */  [HOST_CMD_STREAM_VERSION] = {HOST_CMD_STREAM_VERSION, X3G_LENGTH(stream_version), 0, "stream version"},
+     /* 158 */  [HOST_CMD_PAUSE_AT_ZPOS] = {HOST_CMD_PAUSE_AT_ZPOS, X3G_LENGTH(pause_at_zpos), 0, "pause at Z position"}
      /* ... */  // DO NOT EXIST
 };
 
-static const s3g_command_info_t tool_command_table_raw[] = {
-     /*   0 */  {TOOL_CMD_VERSION, 0, 0, "version"},
-     /*   1 */  {TOOL_CMD_INIT, 0, -1, "initialize"},
-     /*   2 */  {TOOL_CMD_GET_TEMP, 0, 0, "query current extruder temperature"},
-     /*   3 */  {TOOL_CMD_SET_TEMP, 0, 0, "set extruder target temperature"},
-     /*   4 */  {TOOL_CMD_SET_MOTOR_1_PWM, 0, -1, "set motor 1 speed (PWM)"},
-     /*   5 */  {TOOL_CMD_SET_MOTOR_2_PWM, 0, -1, "set motor 2 speed (PWM)"},
-     /*   6 */  {TOOL_CMD_SET_MOTOR_1_RPM, 0, -1, "set motor 1 speed (RPM)"},
-     /*   7 */  {TOOL_CMD_SET_MOTOR_2_RPM, 0, -1, "set motor 2 speed (RPM)"},
-     /*   8 */  {TOOL_CMD_SET_MOTOR_1_DIR, 0, -1, "set motor 1 direction"},
-     /*   9 */  {TOOL_CMD_SET_MOTOR_2_DIR, 0, -1, "set motor 2 direction"},
-     /*  10 */  {TOOL_CMD_TOGGLE_MOTOR_1, 0, -1, "set motor 1 state"},
-     /*  11 */  {TOOL_CMD_TOGGLE_MOTOR_2, 0, -1, "set motor 2 state"},
-     /*  12 */  {TOOL_CMD_TOGGLE_FAN, 0, 0, "set heatsink cooling fan state"},
-     /*  13 */  {TOOL_CMD_TOGGLE_VALVE, 0, 0, "set print cooling fan state"},
-     /*  14 */  {TOOL_CMD_SET_SERVO_1_POS, 0, -1, "set servo 1 position"},
-     /*  15 */  {TOOL_CMD_SET_SERVO_2_POS, 0, -1, "set servo 2 position"},
-     /*  16 */  {TOOL_CMD_FILAMENT_STATUS, 0, 0, "query filament status"},
-     /*  17 */  {TOOL_CMD_GET_MOTOR_1_RPM, 0, 0, "query motor 1 speed (RPM)"},
-     /*  18 */  {TOOL_CMD_GET_MOTOR_2_RPM, 0, 0, "query motor 2 speed (RPM)"},
-     /*  19 */  {TOOL_CMD_GET_MOTOR_1_PWM, 0, 0, "query motor 1 speed (PWM)"},
-     /*  20 */  {TOOL_CMD_GET_MOTOR_2_PWM, 0, 0, "query motor 2 speed (PWM)"},
-     /*  21 */  {TOOL_CMD_SELECT_TOOL, 0, -1, "switch tool"},
-     /*  22 */  {TOOL_CMD_IS_TOOL_READY, 0, -1, "query tool ready"},
-     /*  23 */  {TOOL_CMD_PAUSE_UNPAUSE, 0, -1, "toggle pause state"},
-     /*  24 */  {TOOL_CMD_ABORT, 0, -1, "abort"},
-     /*  25 */  {TOOL_CMD_READ_FROM_EEPROM, 0, 0, "read EEPROM"},
-     /*  26 */  {TOOL_CMD_WRITE_TO_EEPROM, 0, 0, "write EEPROM"},
-     /*  30 */  {TOOL_CMD_GET_PLATFORM_TEMP, 0, 0, "query current platform temperature"},
-     /*  31 */  {TOOL_CMD_SET_PLATFORM_TEMP, 0, 0, "set platform target temperature"},
-     /*  32 */  {TOOL_CMD_GET_SP, 0, 0, "query extruder target temperature"},
-     /*  33 */  {TOOL_CMD_GET_PLATFORM_SP, 0, 0, "query platform target temperature"},
-     /*  34 */  {TOOL_CMD_GET_BUILD_NAME, 0, 0, "query build name"},
-     /*  35 */  {TOOL_CMD_IS_PLATFORM_READY, 0, -1, "query platform ready"},
-     /*  36 */  {TOOL_CMD_GET_TOOL_STATUS, 0, 0, "query tool status"},
-     /*  37 */  {TOOL_CMD_GET_PID_STATE, 0, 0, "query PID state"},
-     /*  40 */  {TOOL_CMD_LIGHT_INDICATOR_LED, 0, -1, "set LED state"}
+static const s3g_command_info_t tool_command_table[256] = {
+     /*   0 */  [TOOL_CMD_VERSION] = {TOOL_CMD_VERSION, 0, 0, "version"},
+     /*   1 */  [TOOL_CMD_INIT] = {TOOL_CMD_INIT, 0, -1, "initialize"},
+     /*   2 */  [TOOL_CMD_GET_TEMP] = {TOOL_CMD_GET_TEMP, 0, 0, "query current extruder temperature"},
+     /*   3 */  [TOOL_CMD_SET_TEMP] = {TOOL_CMD_SET_TEMP, 0, 0, "set extruder target temperature"},
+     /*   4 */  [TOOL_CMD_SET_MOTOR_1_PWM] = {TOOL_CMD_SET_MOTOR_1_PWM, 0, -1, "set motor 1 speed (PWM)"},
+     /*   5 */  [TOOL_CMD_SET_MOTOR_2_PWM] = {TOOL_CMD_SET_MOTOR_2_PWM, 0, -1, "set motor 2 speed (PWM)"},
+     /*   6 */  [TOOL_CMD_SET_MOTOR_1_RPM] = {TOOL_CMD_SET_MOTOR_1_RPM, 0, -1, "set motor 1 speed (RPM)"},
+     /*   7 */  [TOOL_CMD_SET_MOTOR_2_RPM] = {TOOL_CMD_SET_MOTOR_2_RPM, 0, -1, "set motor 2 speed (RPM)"},
+     /*   8 */  [TOOL_CMD_SET_MOTOR_1_DIR] = {TOOL_CMD_SET_MOTOR_1_DIR, 0, -1, "set motor 1 direction"},
+     /*   9 */  [TOOL_CMD_SET_MOTOR_2_DIR] = {TOOL_CMD_SET_MOTOR_2_DIR, 0, -1, "set motor 2 direction"},
+     /*  10 */  [TOOL_CMD_TOGGLE_MOTOR_1] = {TOOL_CMD_TOGGLE_MOTOR_1, 0, -1, "set motor 1 state"},
+     /*  11 */  [TOOL_CMD_TOGGLE_MOTOR_2] = {TOOL_CMD_TOGGLE_MOTOR_2, 0, -1, "set motor 2 state"},
+     /*  12 */  [TOOL_CMD_TOGGLE_FAN] = {TOOL_CMD_TOGGLE_FAN, 0, 0, "set heatsink cooling fan state"},
+     /*  13 */  [TOOL_CMD_TOGGLE_VALVE] = {TOOL_CMD_TOGGLE_VALVE, 0, 0, "set print cooling fan state"},
+     /*  14 */  [TOOL_CMD_SET_SERVO_1_POS] = {TOOL_CMD_SET_SERVO_1_POS, 0, -1, "set servo 1 position"},
+     /*  15 */  [TOOL_CMD_SET_SERVO_2_POS] = {TOOL_CMD_SET_SERVO_2_POS, 0, -1, "set servo 2 position"},
+     /*  16 */  [TOOL_CMD_FILAMENT_STATUS] = {TOOL_CMD_FILAMENT_STATUS, 0, 0, "query filament status"},
+     /*  17 */  [TOOL_CMD_GET_MOTOR_1_RPM] = {TOOL_CMD_GET_MOTOR_1_RPM, 0, 0, "query motor 1 speed (RPM)"},
+     /*  18 */  [TOOL_CMD_GET_MOTOR_2_RPM] = {TOOL_CMD_GET_MOTOR_2_RPM, 0, 0, "query motor 2 speed (RPM)"},
+     /*  19 */  [TOOL_CMD_GET_MOTOR_1_PWM] = {TOOL_CMD_GET_MOTOR_1_PWM, 0, 0, "query motor 1 speed (PWM)"},
+     /*  20 */  [TOOL_CMD_GET_MOTOR_2_PWM] = {TOOL_CMD_GET_MOTOR_2_PWM, 0, 0, "query motor 2 speed (PWM)"},
+     /*  21 */  [TOOL_CMD_SELECT_TOOL] = {TOOL_CMD_SELECT_TOOL, 0, -1, "switch tool"},
+     /*  22 */  [TOOL_CMD_IS_TOOL_READY] = {TOOL_CMD_IS_TOOL_READY, 0, -1, "query tool ready"},
+     /*  23 */  [TOOL_CMD_PAUSE_UNPAUSE] = {TOOL_CMD_PAUSE_UNPAUSE, 0, -1, "toggle pause state"},
+     /*  24 */  [TOOL_CMD_ABORT] = {TOOL_CMD_ABORT, 0, -1, "abort"},
+     /*  25 */  [TOOL_CMD_READ_FROM_EEPROM] = {TOOL_CMD_READ_FROM_EEPROM, 0, 0, "read EEPROM"},
+     /*  26 */  [TOOL_CMD_WRITE_TO_EEPROM] = {TOOL_CMD_WRITE_TO_EEPROM, 0, 0, "write EEPROM"},
+     /*  30 */  [TOOL_CMD_GET_PLATFORM_TEMP] = {TOOL_CMD_GET_PLATFORM_TEMP, 0, 0, "query current platform temperature"},
+     /*  31 */  [TOOL_CMD_SET_PLATFORM_TEMP] = {TOOL_CMD_SET_PLATFORM_TEMP, 0, 0, "set platform target temperature"},
+     /*  32 */  [TOOL_CMD_GET_SP] = {TOOL_CMD_GET_SP, 0, 0, "query extruder target temperature"},
+     /*  33 */  [TOOL_CMD_GET_PLATFORM_SP] = {TOOL_CMD_GET_PLATFORM_SP, 0, 0, "query platform target temperature"},
+     /*  34 */  [TOOL_CMD_GET_BUILD_NAME] = {TOOL_CMD_GET_BUILD_NAME, 0, 0, "query build name"},
+     /*  35 */  [TOOL_CMD_IS_PLATFORM_READY] = {TOOL_CMD_IS_PLATFORM_READY, 0, -1, "query platform ready"},
+     /*  36 */  [TOOL_CMD_GET_TOOL_STATUS] = {TOOL_CMD_GET_TOOL_STATUS, 0, 0, "query tool status"},
+     /*  37 */  [TOOL_CMD_GET_PID_STATE] = {TOOL_CMD_GET_PID_STATE, 0, 0, "query PID state"},
+     /*  40 */  [TOOL_CMD_LIGHT_INDICATOR_LED] = {TOOL_CMD_LIGHT_INDICATOR_LED, 0, -1, "set LED state"}
 };
 
-static s3g_command_info_t command_table[256];
-static s3g_command_info_t tool_command_table[256];
-
-// Not thread safe
-
-static int tables_initialized = 0;
-
-static int s3g_init(void)
-{
-     int i, istat;
-     const s3g_command_info_t *p;
-
-     if (tables_initialized != 0)
-	  return(0);
-
-     // Initialize the indexed command tables
-     memset(command_table,      0, sizeof(command_table));
-     memset(tool_command_table, 0, sizeof(tool_command_table));
-
-     // Force all unrecognized commands to be blocking
-     for (i = 0; i < 256; i++)
-     {
-	  command_table[i].cmd_blocking      = -1;
-	  tool_command_table[i].cmd_blocking = -1;
-     }
-
-     istat = 0;
-     p = command_table_raw;
-
-     // Load the indexed command table, looking for conflicts
-     for (i = 0; i < sizeof(command_table_raw) / sizeof(s3g_command_info_t); i++, p++)
-     {
-	  if ((command_table[p->cmd_id].cmd_len != 0 ||
-	       command_table[p->cmd_id].cmd_desc != NULL))
-	  {
-	       // Table already has an entry for this command id
-	       // Make sure that the lengths don't conflict
-	       if (command_table[p->cmd_id].cmd_len != p->cmd_len)
-	       {
-		    fprintf(stderr,
-			    "s3g_init(%d): Two commands with identical ids (%d) but "
-			    "different lengths encountered; ignoring \"%s\"\n",
-			    __LINE__, p->cmd_id, p->cmd_desc ? p->cmd_desc : "<no name>");
-		    istat = -1;
-		    continue;
-	       }
-	  }
-	  command_table[p->cmd_id].cmd_id       = p->cmd_id;
-	  command_table[p->cmd_id].cmd_len      = p->cmd_len;
-	  command_table[p->cmd_id].cmd_desc     = p->cmd_desc;
-	  command_table[p->cmd_id].cmd_blocking = p->cmd_blocking;
-     }
-
-     p = tool_command_table_raw;
-
-     // Load the indexed command table, looking for conflicts
-     for (i = 0; i < sizeof(tool_command_table_raw) / sizeof(s3g_command_info_t); i++, p++)
-     {
-	  if ((tool_command_table[p->cmd_id].cmd_len != 0 ||
-	       tool_command_table[p->cmd_id].cmd_desc != NULL))
-	  {
-	       // Table already has an entry for this command id
-	       // Make sure that the lengths don't conflict
-	       if (tool_command_table[p->cmd_id].cmd_len != p->cmd_len)
-	       {
-		    fprintf(stderr,
-			    "s3g_init(%d): Two tool commands with identical ids (%d) but "
-			    "different lengths encountered; ignoring \"%s\"\n",
-			    __LINE__, p->cmd_id, p->cmd_desc ? p->cmd_desc : "<no description>");
-		    istat = -1;
-		    continue;
-	       }
-	  }
-	  tool_command_table[p->cmd_id].cmd_id       = p->cmd_id;
-	  tool_command_table[p->cmd_id].cmd_len      = p->cmd_len;
-	  tool_command_table[p->cmd_id].cmd_desc     = p->cmd_desc;
-	  tool_command_table[p->cmd_id].cmd_blocking = p->cmd_blocking;
-     }
-
-     tables_initialized = -1;
-
-     return(istat);
-}
-
-
 s3g_context_t *s3g_open(int type, const char *src, int flags, int mode)
 {
      s3g_context_t *ctx;
@@ -280,14 +182,19 @@ int s3g_close(s3g_context_t *ctx)
 
 int s3g_command_isblocking(s3g_command_t *cmd)
 {
+     const s3g_command_info_t *ct;
+
      if (!cmd)
 	  // Bad call: claim the worst case which is blocking true;
 	  return(-1);
 
      if (cmd->cmd_id != HOST_CMD_TOOL_COMMAND)
-	  return (command_table[cmd->cmd_id].cmd_blocking);
+	  ct = command_table + cmd->cmd_id;
      else
-	  return(tool_command_table[cmd->t.tool.subcmd_id].cmd_blocking);
+	  ct = tool_command_table + cmd->t.tool.subcmd_id;
+
+     // Force all unrecognized commands to be blocking
+     return(ct->cmd_desc ? ct->cmd_blocking : -1);
 
 }
 
@@ -296,12 +203,9 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 {
      unsigned char *buf0 = buf;
      ssize_t bytes_expected, bytes_read;
-     s3g_command_info_t *ct;
+     const s3g_command_info_t *ct;
      s3g_command_t dummy;
-     foo_16_t f16;
-     foo_32_t f32;
      int iret;
-     uint8_t ui8arg;
 
      iret = -1;
 
@@ -332,9 +236,6 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  return(-1);
      }
 
-     // Initialize command table
-     s3g_init();
-
      if (1 != (bytes_expected = (*ctx->read)(ctx->r_ctx, buf0, maxbuf, 1)))
      {
 	  // End of file condition?
@@ -369,97 +270,31 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  goto done;
      }
 
-#define GET_INT32(v) \
-	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
-	       goto io_error; \
-	  memcpy(&f32.u.c, buf, 4); \
-	  buf    += bytes_read; \
-	  maxbuf -= bytes_read; \
-	  f32.u.u = le32toh(f32.u.u); \
-	  cmd->t.v = f32.u.i
-
-#define GET_UINT32(v) \
-	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
-	       goto io_error; \
-	  memcpy(&f32.u.c, buf, 4); \
-	  buf    += bytes_read; \
-	  maxbuf -= bytes_read; \
-	  cmd->t.v = le32toh(f32.u.u)
-
-#define GET_FLOAT32(v) \
-	  if (maxbuf < 4) goto trunc; \
-	  if (4 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 4))) \
-	       goto io_error; \
-	  memcpy(&f32.u.c, buf, 4); \
-	  buf    += bytes_read; \
-	  maxbuf -= bytes_read; \
-	  f32.u.u = le32toh(f32.u.u); \
-	  cmd->t.v = f32.u.f;
-
-#define GET_UINT8(v) \
-	  if (maxbuf < 1) goto trunc; \
-	  if (1 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 1))) \
-	       goto io_error; \
-	  ui8arg = buf[0]; \
-	  buf    += bytes_read; \
-	  maxbuf -= bytes_read; \
-	  cmd->t.v = ui8arg
-
-#define GET_INT16(v) \
-	  if (maxbuf < 2) goto trunc; \
-	  if (2 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 2))) \
-	       goto io_error; \
-	  memcpy(&f16.u.c, buf, 2); \
-	  buf    += bytes_read; \
-	  maxbuf -= bytes_read; \
-	  f16.u.u = le16toh(f16.u.u); \
-	  cmd->t.v = f16.u.i
+// Read the rest of a command with a fixed layout in one go and decode it
+// into the member of cmd->t the schema says it decodes into
 
-#define GET_UINT16(v) \
-	  if (maxbuf < 2) goto trunc; \
-	  if (2 != (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, 2))) \
+#define X3G_READ(name) \
+	  if (maxbuf < X3G_LENGTH(name)) goto trunc; \
+	  if ((ssize_t)X3G_LENGTH(name) != \
+	      (bytes_read = (*ctx->read)(ctx->r_ctx, buf, maxbuf, X3G_LENGTH(name)))) \
 	       goto io_error; \
-	  memcpy(&f16.u.c, buf, 2); \
 	  buf    += bytes_read; \
 	  maxbuf -= bytes_read; \
-	  cmd->t.v = le16toh(f16.u.u)
+	  memcpy(&packed, buf0, sizeof(packed))
 
-#define ZERO(v,c) cmd->t.v = (c)0
+#define X3G_DECODE(id, name, member, layout) \
+     case id : \
+	  { \
+	       x3g_##name##_t packed; \
+	       X3G_READ(name); \
+	       memset(&cmd->t.member, 0, sizeof(cmd->t.member)); \
+	       X3G_UNPACK(cmd->t.member, layout) \
+	  } \
+	  break;
 
      switch(cmd->cmd_id)
      {
-     case HOST_CMD_DELAY :
-	  GET_UINT32(delay.millis);
-	  break;
-
-     case HOST_CMD_FIND_AXES_MINIMUM :
-     case HOST_CMD_FIND_AXES_MAXIMUM :
-	  GET_UINT8(find_axes_minmax.flags);
-	  GET_UINT32(find_axes_minmax.feedrate);
-	  GET_UINT16(find_axes_minmax.timeout);
-	  break;
-
-     case HOST_CMD_WAIT_FOR_TOOL :
-	  GET_UINT8(wait_for_tool.index);
-	  GET_UINT16(wait_for_tool.ping_delay);
-	  GET_UINT16(wait_for_tool.timeout);
-	  break;
-
-     case HOST_CMD_WAIT_FOR_PLATFORM :
-	  GET_UINT8(wait_for_platform.index);
-	  GET_UINT16(wait_for_platform.ping_delay);
-	  GET_UINT16(wait_for_platform.timeout);
-	  break;
-
-     case HOST_CMD_STORE_HOME_POSITION :
-	  GET_UINT8(store_home_position.axes);
-	  break;
-
-     case HOST_CMD_RECALL_HOME_POSITION :
-	  GET_UINT8(recall_home_position.axes);
-	  break;
+     X3G_COMMANDS(X3G_DECODE)
 
      default :
 	  // Just read the data
@@ -501,84 +336,12 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	       cmd->t.tool.subcmd_desc = "unknown tool subcommand";
 	  break;
 
-     case HOST_CMD_SET_POSITION_EXT :
-	  // x4, y4, z4, a4, b4 = 20 bytes
-	  GET_INT32(set_position_ext.x);
-	  GET_INT32(set_position_ext.y);
-	  GET_INT32(set_position_ext.z);
-	  GET_INT32(set_position_ext.a);
-	  GET_INT32(set_position_ext.b);
-	  break;
-
-     case HOST_CMD_QUEUE_POINT_EXT :
-	  // x4, y4, z4, a4, b4, dda4 = 24 bytes
-	  GET_INT32(queue_point_ext.x);
-	  GET_INT32(queue_point_ext.y);
-	  GET_INT32(queue_point_ext.z);
-	  GET_INT32(queue_point_ext.a);
-	  GET_INT32(queue_point_ext.b);
-	  GET_INT32(queue_point_ext.dda);
-	  ZERO(queue_point_ext.dummy_rel, uint8_t);
-	  ZERO(queue_point_ext.dummy_distance, float);
-	  ZERO(queue_point_ext.dummy_feedrate_mult_64, uint16_t);
-	  break;
-
-     case HOST_CMD_QUEUE_POINT_NEW :
-	  // x4, y4, z4, a4, b4, us4, relative = 25 bytes
-	  GET_INT32(queue_point_new.x);
-	  GET_INT32(queue_point_new.y);
-	  GET_INT32(queue_point_new.z);
-	  GET_INT32(queue_point_new.a);
-	  GET_INT32(queue_point_new.b);
-	  GET_INT32(queue_point_new.us);
-	  GET_UINT8(queue_point_new.rel);
-	  ZERO(queue_point_ext.dummy_distance, float);
-	  ZERO(queue_point_ext.dummy_feedrate_mult_64, uint16_t);
-	  break;
-
-     case HOST_CMD_QUEUE_POINT_NEW_EXT :
-	  // x4, y4, z4, a4, b4, dda_rate4, relative, distance 4, feedrate_mult64 2 = 31 bytes
-	  GET_INT32(queue_point_new_ext.x);
-	  GET_INT32(queue_point_new_ext.y);
-	  GET_INT32(queue_point_new_ext.z);
-	  GET_INT32(queue_point_new_ext.a);
-	  GET_INT32(queue_point_new_ext.b);
-	  GET_INT32(queue_point_new_ext.dda_rate);
-	  GET_UINT8(queue_point_new_ext.rel);
-	  GET_FLOAT32(queue_point_new_ext.distance);
-	  GET_INT16(queue_point_new_ext.feedrate_mult_64);
-	  break;
-
-     case HOST_CMD_SET_POT_VALUE :
-	  GET_UINT8(digi_pot.axis);
-	  GET_UINT8(digi_pot.value);
-	  break;
-
-     case HOST_CMD_SET_RGB_LED :
-	  GET_UINT8(rgb_led.red);
-	  GET_UINT8(rgb_led.green);
-	  GET_UINT8(rgb_led.blue);
-	  GET_UINT8(rgb_led.blink_rate);
-	  GET_UINT8(rgb_led.effect);
-	  break;
-
-     case HOST_CMD_SET_BEEP :
-	  GET_UINT16(beep.frequency);
-	  GET_UINT16(beep.duration);
-	  GET_UINT8(beep.effect);
-	  break;
-
-     case HOST_CMD_PAUSE_FOR_BUTTON :
-	  GET_UINT8(button_pause.mask);
-	  GET_UINT16(button_pause.timeout);
-	  GET_UINT8(button_pause.timeout_behavior);
-	  break;
-
      case HOST_CMD_DISPLAY_MESSAGE :
-	  GET_UINT8(display_message.options);
-	  GET_UINT8(display_message.x);
-	  GET_UINT8(display_message.y);
-	  GET_UINT8(display_message.timeout);
+	  {
+	       x3g_display_message_t packed;
+	       X3G_READ(display_message);
+	       X3G_UNPACK(cmd->t.display_message, X3G_DISPLAY_MESSAGE)
+	  }
 	  cmd->t.display_message.message_len = 0;
 	  if (maxbuf < 1) goto trunc;
 	  for (;;)
@@ -598,21 +361,12 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  cmd->t.display_message.message[cmd->t.display_message.message_len] = '\0';
 	  break;
 
-     case HOST_CMD_SET_BUILD_PERCENT :
-	  GET_UINT8(build_percentage.percentage);
-	  GET_UINT8(build_percentage.reserved);
-	  break;
-
-     case HOST_CMD_QUEUE_SONG :
-	  GET_UINT8(queue_song.song_id);
-	  break;
-
-     case HOST_CMD_RESET_TO_FACTORY :
-	  GET_UINT8(factory_reset.options);
-	  break;
-
      case HOST_CMD_BUILD_START_NOTIFICATION :
-	  GET_INT32(build_start.steps);
+	  {
+	       x3g_build_start_t packed;
+	       X3G_READ(build_start);
+	       X3G_UNPACK(cmd->t.build_start, X3G_BUILD_START)
+	  }
 	  cmd->t.build_start.message_len = 0;
 	  if (maxbuf < 1) goto trunc;
 	  for (;;)
@@ -631,42 +385,10 @@ int s3g_command_read_ext(s3g_context_t *ctx, s3g_command_t *cmd,
 	  cmd->t.build_start.message[cmd->t.build_start.message_len] = '\0';
 	  break;
 
-     case HOST_CMD_BUILD_END_NOTIFICATION :
-	  GET_UINT8(build_end.flags);
-	  break;
-
-     case HOST_CMD_CHANGE_TOOL :
-	  GET_UINT8(change_tool.index);
-          break;
-
-     case HOST_CMD_ENABLE_AXES :
-	  GET_UINT8(enable_axes.axes);
-          break;
-
-     case HOST_CMD_SET_ACCELERATION_TOGGLE:
-	  GET_UINT8(set_segment_acceleration.s);
-	  break;
-
-     case HOST_CMD_STREAM_VERSION:
-	  GET_UINT8(x3g_version.version_high);
-	  GET_UINT8(x3g_version.version_low);
-	  GET_UINT8(x3g_version.reserved1);
-	  GET_UINT32(x3g_version.reserved2);
-	  GET_UINT16(x3g_version.bot_type);
-	  GET_UINT16(x3g_version.reserved3);
-	  GET_UINT32(x3g_version.reserved4);
-	  GET_UINT32(x3g_version.reserved5);
-	  GET_UINT8(x3g_version.reserved6);
-	  break;
-
-     case HOST_CMD_PAUSE_AT_ZPOS:
-	  GET_FLOAT32(pause_at_zpos.zpos);
-	  break;
      }
 
-#undef ZERO
-#undef GET_UINT8
-#undef GET_INT32
+#undef X3G_DECODE
+#undef X3G_READ
 
      iret = 0;
      goto done;
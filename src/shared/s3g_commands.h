@@ -120,6 +120,169 @@ extern "C" {
 #define TOOL_CMD_GET_PID_STATE			37
 #define TOOL_CMD_LIGHT_INDICATOR_LED		40
 
+// Command schema
+//
+// The payload layout of each host command with a fixed layout is written
+// down once, here.  s3g_pack.h generates the packed structs, encoders and
+// lengths from it, gpx encodes with them and the s3g library decodes with
+// them, so the two can't disagree about a layout.
+//
+// A layout X3G_<NAME>(F, d) expands F(d, type, field) for each field in
+// the order it is sent, where type is one of U8, U16, U32, I32 or F32 and
+// field is the name of the member of the s3g library's structure for the
+// command that it decodes into.  d is passed through for the generator.
+
+#define X3G_FIND_AXES(F, d) \
+     F(d, U8,  flags) \
+     F(d, U32, feedrate) \
+     F(d, U16, timeout)
+
+#define X3G_DELAY(F, d) \
+     F(d, U32, millis)
+
+#define X3G_CHANGE_TOOL(F, d) \
+     F(d, U8,  index)
+
+#define X3G_WAIT_FOR(F, d) \
+     F(d, U8,  index) \
+     F(d, U16, ping_delay) \
+     F(d, U16, timeout)
+
+#define X3G_AXES(F, d) \
+     F(d, U8,  axes)
+
+#define X3G_QUEUE_POINT_EXT(F, d) \
+     F(d, I32, x) \
+     F(d, I32, y) \
+     F(d, I32, z) \
+     F(d, I32, a) \
+     F(d, I32, b) \
+     F(d, I32, dda)
+
+#define X3G_SET_POSITION_EXT(F, d) \
+     F(d, I32, x) \
+     F(d, I32, y) \
+     F(d, I32, z) \
+     F(d, I32, a) \
+     F(d, I32, b)
+
+#define X3G_QUEUE_POINT_NEW(F, d) \
+     F(d, I32, x) \
+     F(d, I32, y) \
+     F(d, I32, z) \
+     F(d, I32, a) \
+     F(d, I32, b) \
+     F(d, I32, us) \
+     F(d, U8,  rel)
+
+#define X3G_SET_POT_VALUE(F, d) \
+     F(d, U8,  axis) \
+     F(d, U8,  value)
+
+#define X3G_SET_RGB_LED(F, d) \
+     F(d, U8,  red) \
+     F(d, U8,  green) \
+     F(d, U8,  blue) \
+     F(d, U8,  blink_rate) \
+     F(d, U8,  effect)
+
+#define X3G_SET_BEEP(F, d) \
+     F(d, U16, frequency) \
+     F(d, U16, duration) \
+     F(d, U8,  effect)
+
+#define X3G_PAUSE_FOR_BUTTON(F, d) \
+     F(d, U8,  mask) \
+     F(d, U16, timeout) \
+     F(d, U8,  timeout_behavior)
+
+#define X3G_DISPLAY_MESSAGE(F, d) \
+     F(d, U8,  options) \
+     F(d, U8,  x) \
+     F(d, U8,  y) \
+     F(d, U8,  timeout)
+
+#define X3G_SET_BUILD_PERCENT(F, d) \
+     F(d, U8,  percentage) \
+     F(d, U8,  reserved)
+
+#define X3G_QUEUE_SONG(F, d) \
+     F(d, U8,  song_id)
+
+#define X3G_RESET_TO_FACTORY(F, d) \
+     F(d, U8,  options)
+
+#define X3G_BUILD_START(F, d) \
+     F(d, U32, steps)
+
+#define X3G_BUILD_END(F, d) \
+     F(d, U8,  flags)
+
+#define X3G_QUEUE_POINT_NEW_EXT(F, d) \
+     F(d, I32, x) \
+     F(d, I32, y) \
+     F(d, I32, z) \
+     F(d, I32, a) \
+     F(d, I32, b) \
+     F(d, I32, dda_rate) \
+     F(d, U8,  rel) \
+     F(d, F32, distance) \
+     F(d, U16, feedrate_mult_64)
+
+#define X3G_SET_ACCELERATION_TOGGLE(F, d) \
+     F(d, U8,  s)
+
+#define X3G_STREAM_VERSION(F, d) \
+     F(d, U8,  version_high) \
+     F(d, U8,  version_low) \
+     F(d, U8,  reserved1) \
+     F(d, U32, reserved2) \
+     F(d, U16, bot_type) \
+     F(d, U16, reserved3) \
+     F(d, U32, reserved4) \
+     F(d, U32, reserved5) \
+     F(d, U8,  reserved6)
+
+#define X3G_PAUSE_AT_ZPOS(F, d) \
+     F(d, F32, zpos)
+
+// X3G_COMMANDS(C) expands C(id, name, member, layout) for each command
+// with a fixed layout.  name names the generated struct and encoder, and
+// member is the member of the s3g_command_t union the command decodes into.
+
+#define X3G_COMMANDS(C) \
+     C(HOST_CMD_FIND_AXES_MINIMUM, find_axes_minimum, find_axes_minmax, X3G_FIND_AXES) \
+     C(HOST_CMD_FIND_AXES_MAXIMUM, find_axes_maximum, find_axes_minmax, X3G_FIND_AXES) \
+     C(HOST_CMD_DELAY, delay, delay, X3G_DELAY) \
+     C(HOST_CMD_CHANGE_TOOL, change_tool, change_tool, X3G_CHANGE_TOOL) \
+     C(HOST_CMD_WAIT_FOR_TOOL, wait_for_tool, wait_for_tool, X3G_WAIT_FOR) \
+     C(HOST_CMD_ENABLE_AXES, enable_axes, enable_axes, X3G_AXES) \
+     C(HOST_CMD_QUEUE_POINT_EXT, queue_point_ext, queue_point_ext, X3G_QUEUE_POINT_EXT) \
+     C(HOST_CMD_SET_POSITION_EXT, set_position_ext, set_position_ext, X3G_SET_POSITION_EXT) \
+     C(HOST_CMD_WAIT_FOR_PLATFORM, wait_for_platform, wait_for_platform, X3G_WAIT_FOR) \
+     C(HOST_CMD_QUEUE_POINT_NEW, queue_point_new, queue_point_new, X3G_QUEUE_POINT_NEW) \
+     C(HOST_CMD_STORE_HOME_POSITION, store_home_position, store_home_position, X3G_AXES) \
+     C(HOST_CMD_RECALL_HOME_POSITION, recall_home_position, recall_home_position, X3G_AXES) \
+     C(HOST_CMD_SET_POT_VALUE, set_pot_value, digi_pot, X3G_SET_POT_VALUE) \
+     C(HOST_CMD_SET_RGB_LED, set_rgb_led, rgb_led, X3G_SET_RGB_LED) \
+     C(HOST_CMD_SET_BEEP, set_beep, beep, X3G_SET_BEEP) \
+     C(HOST_CMD_PAUSE_FOR_BUTTON, pause_for_button, button_pause, X3G_PAUSE_FOR_BUTTON) \
+     C(HOST_CMD_SET_BUILD_PERCENT, set_build_percent, build_percentage, X3G_SET_BUILD_PERCENT) \
+     C(HOST_CMD_QUEUE_SONG, queue_song, queue_song, X3G_QUEUE_SONG) \
+     C(HOST_CMD_RESET_TO_FACTORY, reset_to_factory, factory_reset, X3G_RESET_TO_FACTORY) \
+     C(HOST_CMD_BUILD_END_NOTIFICATION, build_end, build_end, X3G_BUILD_END) \
+     C(HOST_CMD_QUEUE_POINT_NEW_EXT, queue_point_new_ext, queue_point_new_ext, X3G_QUEUE_POINT_NEW_EXT) \
+     C(HOST_CMD_SET_ACCELERATION_TOGGLE, set_acceleration_toggle, set_segment_acceleration, X3G_SET_ACCELERATION_TOGGLE) \
+     C(HOST_CMD_STREAM_VERSION, stream_version, x3g_version, X3G_STREAM_VERSION) \
+     C(HOST_CMD_PAUSE_AT_ZPOS, pause_at_zpos, pause_at_zpos, X3G_PAUSE_AT_ZPOS)
+
+// X3G_STRING_COMMANDS(C) does the same for the commands whose fixed
+// layout is followed by a NUL terminated string
+
+#define X3G_STRING_COMMANDS(C) \
+     C(HOST_CMD_DISPLAY_MESSAGE, display_message, display_message, X3G_DISPLAY_MESSAGE) \
+     C(HOST_CMD_BUILD_START_NOTIFICATION, build_start, build_start, X3G_BUILD_START)
+
 #ifdef __cplusplus
 }
 #endif
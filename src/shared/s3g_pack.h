@@ -0,0 +1,152 @@
+// s3g_pack.h
+// Packed layouts and encoders generated from the command schema in
+// s3g_commands.h
+//
+// For each command in X3G_COMMANDS and X3G_STRING_COMMANDS this defines
+//
+//   x3g_<name>_t      the command id and payload as a packed struct whose
+//                     fields hold the little endian wire representation
+//   X3G_LENGTH(name)  the length of the payload in bytes, without the id
+//   x3g_pack_<name>   an encoder that takes the fields in the order they
+//                     are sent, packs the command into the buffer at p
+//                     with one copy and returns the end of what it wrote,
+//                     or NULL if it would have written past end
+//
+// The encoders of the string commands take the string and its length after
+// the fields, and append the string and its NUL terminator.
+//
+// X3G_UNPACK(dst, layout) decodes the fields of the packed struct named
+// packed into the structure dst.
+
+#ifndef S3G_PACK_H_
+
+#define S3G_PACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "portable_endian.h"
+#include "s3g_commands.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How each type in the schema is held on the wire and passed to and from
+// the encoders and decoders
+
+#define X3G_WIRE_U8  uint8_t
+#define X3G_WIRE_U16 uint16_t
+#define X3G_WIRE_U32 uint32_t
+#define X3G_WIRE_I32 uint32_t
+#define X3G_WIRE_F32 uint32_t
+
+#define X3G_ARG_U8  uint8_t
+#define X3G_ARG_U16 uint16_t
+#define X3G_ARG_U32 uint32_t
+#define X3G_ARG_I32 int32_t
+#define X3G_ARG_F32 float
+
+static inline uint8_t  x3g_htole_U8(uint8_t v)   { return v; }
+static inline uint16_t x3g_htole_U16(uint16_t v) { return htole16(v); }
+static inline uint32_t x3g_htole_U32(uint32_t v) { return htole32(v); }
+static inline uint32_t x3g_htole_I32(int32_t v)  { return htole32((uint32_t)v); }
+static inline uint32_t x3g_htole_F32(float v)
+{
+     union {
+	  float    f;
+	  uint32_t u;
+     } u;
+     u.f = v;
+     return htole32(u.u);
+}
+
+static inline uint8_t  x3g_letoh_U8(uint8_t v)   { return v; }
+static inline uint16_t x3g_letoh_U16(uint16_t v) { return le16toh(v); }
+static inline uint32_t x3g_letoh_U32(uint32_t v) { return le32toh(v); }
+static inline int32_t  x3g_letoh_I32(uint32_t v) { return (int32_t)le32toh(v); }
+static inline float    x3g_letoh_F32(uint32_t v)
+{
+     union {
+	  float    f;
+	  uint32_t u;
+     } u;
+     u.u = le32toh(v);
+     return u.f;
+}
+
+// Packed structs
+
+#define X3G_WIRE_FIELD(d, type, field) X3G_WIRE_##type field;
+#define X3G_FIELD_SIZE(d, type, field) + sizeof(X3G_WIRE_##type)
+
+#define X3G_STRUCT(id, name, member, layout) \
+     typedef struct { \
+	  uint8_t cmd_id; \
+	  layout(X3G_WIRE_FIELD, _) \
+     } x3g_##name##_t;
+
+#pragma pack(push, 1)
+X3G_COMMANDS(X3G_STRUCT)
+X3G_STRING_COMMANDS(X3G_STRUCT)
+#pragma pack(pop)
+
+#define X3G_LENGTH(name) (sizeof(x3g_##name##_t) - 1)
+
+// Fail to compile if a struct wasn't packed
+#define X3G_CHECK_SIZE(id, name, member, layout) \
+     typedef char x3g_##name##_is_packed[sizeof(x3g_##name##_t) == 1 layout(X3G_FIELD_SIZE, _) ? 1 : -1];
+
+X3G_COMMANDS(X3G_CHECK_SIZE)
+X3G_STRING_COMMANDS(X3G_CHECK_SIZE)
+
+// Encoders
+
+#define X3G_PARAM(d, type, field) , X3G_ARG_##type field
+#define X3G_STORE(d, type, field) packed.field = x3g_htole_##type(field);
+
+#define X3G_ENCODER(id, name, member, layout) \
+     static inline unsigned char *x3g_pack_##name(unsigned char *p, const unsigned char *end \
+						  layout(X3G_PARAM, _)) \
+     { \
+	  x3g_##name##_t packed; \
+	  if (!p || p > end || (size_t)(end - p) < sizeof(packed)) \
+	       return(NULL); \
+	  packed.cmd_id = (id); \
+	  layout(X3G_STORE, _) \
+	  memcpy(p, &packed, sizeof(packed)); \
+	  return(p + sizeof(packed)); \
+     }
+
+#define X3G_STRING_ENCODER(id, name, member, layout) \
+     static inline unsigned char *x3g_pack_##name(unsigned char *p, const unsigned char *end \
+						  layout(X3G_PARAM, _), \
+						  const char *string, size_t length) \
+     { \
+	  x3g_##name##_t packed; \
+	  if (!p || p > end || (size_t)(end - p) < sizeof(packed) + length + 1) \
+	       return(NULL); \
+	  packed.cmd_id = (id); \
+	  layout(X3G_STORE, _) \
+	  memcpy(p, &packed, sizeof(packed)); \
+	  p += sizeof(packed); \
+	  memcpy(p, string, length); \
+	  p[length] = '\0'; \
+	  return(p + length + 1); \
+     }
+
+X3G_COMMANDS(X3G_ENCODER)
+X3G_STRING_COMMANDS(X3G_STRING_ENCODER)
+
+// Decoding
+
+#define X3G_LOAD(dst, type, field) (dst).field = x3g_letoh_##type(packed.field);
+
+#define X3G_UNPACK(dst, layout) layout(X3G_LOAD, dst)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+//  sertrace.c
+//
+//  Binary trace of the packets sent to a printer and the bytes it answered
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "sertrace.h"
+
+#define TRACE_MAGIC "GPXTRACE"
+#define TRACE_HEADER 12
+#define TRACE_BUFFER 65536      // bytes of records buffered between flushes
+#define TRACE_FLUSH 0.5         // seconds between flushes
+
+static double trace_clock(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+    return (double)time(NULL);
+}
+
+// RECORDING
+
+int trace_create(SerialTrace *trace, const char *filename)
+{
+    unsigned char header[TRACE_HEADER] = {0};
+    trace->file = fopen(filename, "wb");
+    if(trace->file == NULL) return -1;
+    setvbuf(trace->file, NULL, _IOFBF, TRACE_BUFFER);
+    memcpy(header, TRACE_MAGIC, 8);
+    header[8] = TRACE_VERSION;
+    if(fwrite(header, 1, TRACE_HEADER, trace->file) != TRACE_HEADER) {
+        fclose(trace->file);
+        trace->file = NULL;
+        return -1;
+    }
+    trace->last = trace->flushed = trace_clock();
+    trace->records = 0;
+    return 0;
+}
+
+int trace_record(SerialTrace *trace, int kind, const void *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    double now = trace_clock();
+    double delay = (now - trace->last) * 1000000.0;
+    unsigned long us = delay < 0.0 ? 0 : delay > 4294967295.0 ? 4294967295UL : (unsigned long)delay;
+    trace->last = now;
+    do {
+        size_t n = length > TRACE_RECORD_MAX ? TRACE_RECORD_MAX : length;
+        unsigned char head[7] = {
+            (unsigned char)kind,
+            us & 0xFF, (us >> 8) & 0xFF, (us >> 16) & 0xFF, (us >> 24) & 0xFF,
+            n & 0xFF, (n >> 8) & 0xFF
+        };
+        if(fwrite(head, 1, 7, trace->file) != 7 || fwrite(p, 1, n, trace->file) != n) return -1;
+        trace->records++;
+        p += n;
+        length -= n;
+        us = 0;
+    } while(length);
+    if(now - trace->flushed >= TRACE_FLUSH) {
+        trace->flushed = now;
+        if(fflush(trace->file)) return -1;
+    }
+    return 0;
+}
+
+// REPLAYING
+
+int trace_open(SerialTrace *trace, const char *filename)
+{
+    unsigned char header[TRACE_HEADER];
+    trace->file = fopen(filename, "rb");
+    if(trace->file == NULL) return -1;
+    if(fread(header, 1, TRACE_HEADER, trace->file) != TRACE_HEADER
+            || memcmp(header, TRACE_MAGIC, 8) != 0 || header[8] != TRACE_VERSION) {
+        fclose(trace->file);
+        trace->file = NULL;
+        return -2;
+    }
+    trace->last = trace->flushed = 0.0;
+    trace->records = 0;
+    return 0;
+}
+
+int trace_next(SerialTrace *trace, TraceRecord *record)
+{
+    unsigned char head[7];
+    size_t n = fread(head, 1, 7, trace->file);
+    if(n == 0 && feof(trace->file)) return 0;
+    if(n != 7 || (head[0] != TRACE_SENT && head[0] != TRACE_RECEIVED)) return -1;
+    record->kind = head[0];
+    record->delay = (head[1] | (head[2] << 8) | ((unsigned long)head[3] << 16) | ((unsigned long)head[4] << 24)) / 1000000.0;
+    record->length = head[5] | (head[6] << 8);
+    if(fread(record->data, 1, record->length, trace->file) != record->length) return -1;
+    trace->last += record->delay;
+    trace->records++;
+    return 1;
+}
+
+// EITHER
+
+int trace_close(SerialTrace *trace)
+{
+    int rval = 0;
+    if(trace->file) {
+        if(ferror(trace->file)) rval = -1;
+        if(fclose(trace->file)) rval = -1;
+        trace->file = NULL;
+    }
+    return rval;
+}
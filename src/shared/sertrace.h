@@ -0,0 +1,87 @@
+//  sertrace.h
+//
+//  Binary trace of the packets sent to a printer and the bytes it answered
+//
+//  A trace starts with an 8 byte "GPXTRACE" magic, a version byte and 3
+//  reserved bytes, followed by one record for each frame written to the
+//  port and each read that returned bytes from it:
+//
+//      uint8   '>' sent or '<' received
+//      uint32  microseconds since the record before, little endian
+//      uint16  the length of the data, little endian
+//      data
+//
+//  Recording buffers the records, flushing them to the file every half a
+//  second, so a session that's killed loses little more than that.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#ifndef SERTRACE_H_
+#define SERTRACE_H_
+
+#include <stdio.h>
+
+#define TRACE_SENT '>'
+#define TRACE_RECEIVED '<'
+#define TRACE_VERSION 1
+#define TRACE_RECORD_MAX 65535  // the most data a record holds
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tSerialTrace {
+    FILE *file;
+    double last;            // when the last record was written or read, in seconds
+    double flushed;         // when the records were last flushed to the file
+    unsigned long records;
+} SerialTrace;
+
+typedef struct tTraceRecord {
+    int kind;               // TRACE_SENT or TRACE_RECEIVED
+    double delay;           // seconds since the record before
+    size_t length;
+    unsigned char data[TRACE_RECORD_MAX];
+} TraceRecord;
+
+// RECORDING
+
+// create filename and write the header, returns 0 or -1 with errno set
+int trace_create(SerialTrace *trace, const char *filename);
+
+// append length bytes that were sent or received now, data longer than a
+// record holds is split over several, returns 0 or -1 if the write failed
+int trace_record(SerialTrace *trace, int kind, const void *data, size_t length);
+
+// REPLAYING
+
+// open filename and check the header, returns 0, -1 with errno set or -2
+// if it isn't a trace gpx can read
+int trace_open(SerialTrace *trace, const char *filename);
+
+// read the next record, returns 1, 0 at the end of the trace or -1 if the
+// trace is truncated or corrupt
+int trace_next(SerialTrace *trace, TraceRecord *record);
+
+// EITHER
+
+// close the trace, returns 0 or -1 if the records couldn't all be written
+int trace_close(SerialTrace *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
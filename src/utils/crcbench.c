@@ -0,0 +1,161 @@
+//  crcbench.c
+//
+//  Microbenchmark for the x3g packet CRC
+//
+//      crcbench [seconds]
+//
+//  Checks the table driven CRC variants against the bitwise CRC they
+//  replaced, then times each of them over packets of typical x3g sizes and
+//  over a large buffer. The variant gpx is built with is marked with a *.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc8.h"
+
+#define BUFFER_SIZE 65536
+
+typedef unsigned char (*crc_function)(unsigned char crc, const void *p, size_t length);
+
+// the bit at a time CRC gpx used before the tables
+
+static unsigned char crc8_bitwise(unsigned char crc, const void *p, size_t length)
+{
+    const unsigned char *s = (const unsigned char *)p;
+    int i;
+    while(length--) {
+        crc ^= *s++;
+        for(i = 0; i < 8; i++) {
+            if(crc & 0x01) crc = (crc >> 1) ^ 0x8C;
+            else crc >>= 1;
+        }
+    }
+    return crc;
+}
+
+static const struct {
+    const char *name;
+    crc_function fn;
+    int slices;
+} variant[] = {
+    {"bitwise", crc8_bitwise, 0},
+    {"table", crc8_bytewise, 1},
+    {"slice-by-4", crc8_sliced4, 4},
+    {"slice-by-8", crc8_sliced8, 8},
+};
+
+#define VARIANTS (sizeof(variant) / sizeof(variant[0]))
+
+// payload sizes of a queue point, a short command and the largest packet,
+// and a large buffer
+static const size_t sizes[] = {5, 32, 255, BUFFER_SIZE};
+
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static double now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// check every variant against the bitwise CRC at every length and
+// alignment a packet can have, continuing from every starting CRC
+// returns the number of mismatches
+
+static int check(const unsigned char *buffer)
+{
+    int errors = 0;
+    size_t v, offset, length;
+    unsigned seed;
+
+    for(v = 1; v < VARIANTS; v++) {
+        for(offset = 0; offset < 8; offset++) {
+            for(length = 0; length <= 300; length++) {
+                for(seed = 0; seed < 256; seed += 51) {
+                    unsigned char expected = crc8_bitwise(seed, buffer + offset, length);
+                    if(variant[v].fn(seed, buffer + offset, length) != expected) {
+                        if(errors++ < 10) {
+                            fprintf(stderr, "%s: CRC mismatch at offset %u length %u seed %u\n",
+                                    variant[v].name, (unsigned)offset, (unsigned)length, seed);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if(crc8_update(0, buffer, BUFFER_SIZE) != crc8_bitwise(0, buffer, BUFFER_SIZE)) {
+        fputs("crc8_update: CRC mismatch\n", stderr);
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 0.25;
+    unsigned char *buffer = malloc(BUFFER_SIZE + 8);
+    volatile unsigned char sink = 0;
+    size_t i, v;
+
+    if(buffer == NULL) {
+        fputs("crcbench: insufficient memory\n", stderr);
+        return 1;
+    }
+    srand(1);
+    for(i = 0; i < BUFFER_SIZE + 8; i++) {
+        buffer[i] = (unsigned char)rand();
+    }
+
+    if(check(buffer)) {
+        free(buffer);
+        return 1;
+    }
+
+    printf("%-12s %8s %12s %10s\n", "variant", "bytes", "ns/packet", "MB/s");
+    for(i = 0; i < SIZES; i++) {
+        for(v = 0; v < VARIANTS; v++) {
+            unsigned long packets = 0;
+            unsigned long batch = BUFFER_SIZE / sizes[i] + 1;
+            double start = now(), elapsed;
+            // rotate through the buffer so every packet isn't the same
+            size_t offset = 0;
+            do {
+                unsigned long n;
+                for(n = 0; n < batch; n++) {
+                    sink ^= variant[v].fn(0, buffer + offset, sizes[i]);
+                    offset += sizes[i];
+                    if(offset + sizes[i] > BUFFER_SIZE) offset = 0;
+                }
+                packets += batch;
+                elapsed = now() - start;
+            } while(elapsed < seconds);
+            printf("%-11s%c %8u %12.1f %10.1f\n", variant[v].name,
+                   variant[v].slices == CRC8_SLICES ? '*' : ' ',
+                   (unsigned)sizes[i], elapsed * 1e9 / packets,
+                   packets * (double)sizes[i] / elapsed / 1e6);
+        }
+    }
+
+    free(buffer);
+    return 0;
+}
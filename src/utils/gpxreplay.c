@@ -0,0 +1,312 @@
+//  gpxreplay.c
+//
+//  Replay a serial trace recorded with gpx -R on a pseudo-terminal
+//
+//      gpxreplay [-t] [-l link] [-v] trace
+//
+//  Opens a pseudo-terminal, prints the name of its slave end and answers
+//  each packet written to it with the bytes the printer answered the same
+//  packet with when the trace was recorded. The responses are played back
+//  in the order they were recorded, whatever the host sends, so a host
+//  that sends the same packets goes through the same session again,
+//  failures and all, and a host that sends different ones is told at which
+//  packet it went another way.
+//
+//  The responses are sent as soon as the packet they answer arrives, so
+//  the host runs as fast as it can, or with -t after as long as the
+//  printer took to send them.
+//
+//  It runs until interrupted, then prints how the replay went to stderr.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sertrace.h"
+
+#define GETOPTS_END -1
+
+#define PACKET_MAX 255          // the longest payload a packet can carry
+
+typedef struct tReplay {
+    SerialTrace trace;
+    TraceRecord record;     // the next record, a packet sent unless the trace ended
+    int ended;
+    int timing;             // wait as long as the printer took before each response
+    int verbose;
+
+    unsigned char rx[2 * (PACKET_MAX + 3)];
+    size_t rxLength;
+    struct {
+        unsigned long packets;
+        unsigned long differed;     // packets that weren't the ones recorded
+        unsigned long firstDiffered;
+        unsigned long responses;
+        unsigned long bytesOut;
+        unsigned long unanswered;   // packets sent after the trace ended
+    } stats;
+} Replay;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static void usage(FILE *f, const char *prog)
+{
+    fprintf(f,
+"Usage: %s [-t] [-l link] [-v] trace\n"
+"   trace     -- a serial trace recorded with gpx -R\n"
+"   -t        -- wait as long as the printer did before sending each response\n"
+"   -l link   -- make link a symlink to the pseudo-terminal\n"
+"   -v        -- list the packets that differ from the trace\n"
+"   ?, -h     -- This help message\n",
+            prog ? prog : "gpxreplay");
+}
+
+// read records up to the next packet sent, or the end of the trace
+
+static int next_record(Replay *replay)
+{
+    int rval = trace_next(&replay->trace, &replay->record);
+    if(rval < 0) fprintf(stderr, "gpxreplay: the trace is truncated after %lu records\n", replay->trace.records);
+    if(rval <= 0) replay->ended = 1;
+    return rval;
+}
+
+static void write_all(int fd, const unsigned char *p, size_t n)
+{
+    while(n) {
+        ssize_t written = write(fd, p, n);
+        if(written < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            perror("gpxreplay: write");
+            return;
+        }
+        p += written;
+        n -= written;
+    }
+}
+
+// answer a packet with the responses recorded after the packet sent in its
+// place
+
+static void answer(Replay *replay, int fd, const unsigned char *packet, size_t length)
+{
+    replay->stats.packets++;
+    if(replay->ended) {
+        replay->stats.unanswered++;
+        return;
+    }
+    if(replay->record.length != length || memcmp(replay->record.data, packet, length) != 0) {
+        if(replay->stats.differed++ == 0) replay->stats.firstDiffered = replay->stats.packets;
+        if(replay->verbose) {
+            printf("packet %lu differs from the trace, command %u was recorded and %u sent\n",
+                   replay->stats.packets, replay->record.length > 2 ? replay->record.data[2] : 0,
+                   length > 2 ? packet[2] : 0);
+        }
+    }
+    while(next_record(replay) > 0 && replay->record.kind == TRACE_RECEIVED) {
+        if(replay->timing && replay->record.delay > 0.0) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)replay->record.delay;
+            ts.tv_nsec = (long)((replay->record.delay - ts.tv_sec) * 1000000000.0);
+            nanosleep(&ts, NULL);
+        }
+        write_all(fd, replay->record.data, replay->record.length);
+        replay->stats.responses++;
+        replay->stats.bytesOut += replay->record.length;
+    }
+}
+
+// answer the packets in the bytes received, keeping any partial packet
+// for the next read
+
+static void receive(Replay *replay, int fd)
+{
+    size_t i = 0;
+    while(i < replay->rxLength) {
+        unsigned char *p = replay->rx + i;
+        size_t left = replay->rxLength - i;
+        if(p[0] != 0xD5) {
+            i++;
+            continue;
+        }
+        if(left < 2 || left < (size_t)p[1] + 3) break;
+        answer(replay, fd, p, (size_t)p[1] + 3);
+        i += p[1] + 3;
+    }
+    replay->rxLength -= i;
+    memmove(replay->rx, replay->rx + i, replay->rxLength);
+}
+
+static int open_pty(const char *link, int *slave)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0) {
+        perror("gpxreplay: posix_openpt");
+        return -1;
+    }
+    if(grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("gpxreplay: unable to unlock the pseudo-terminal");
+        close(fd);
+        return -1;
+    }
+    char *name = ptsname(fd);
+    if(name == NULL) {
+        perror("gpxreplay: ptsname");
+        close(fd);
+        return -1;
+    }
+
+    // hold the slave end open, so the pseudo-terminal outlives each host
+    // that opens and closes it
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if(*slave < 0) {
+        perror("gpxreplay: unable to open the slave end");
+        close(fd);
+        return -1;
+    }
+    struct termios ti;
+    if(tcgetattr(*slave, &ti) == 0) {
+        cfmakeraw(&ti);
+        tcsetattr(*slave, TCSANOW, &ti);
+    }
+
+    if(link) {
+        if(unlink(link) < 0 && errno != ENOENT) {
+            fprintf(stderr, "gpxreplay: %s already exists and can't be removed\n", link);
+        }
+        else if(symlink(name, link) < 0) {
+            fprintf(stderr, "gpxreplay: unable to create the symlink %s\n", link);
+        }
+    }
+    printf("%s\n", name);
+    fflush(stdout);
+    return fd;
+}
+
+static void report(const Replay *replay)
+{
+    fprintf(stderr, "gpxreplay: %lu packets answered with %lu responses, %lu bytes, from %lu trace records\n",
+            replay->stats.packets - replay->stats.unanswered, replay->stats.responses,
+            replay->stats.bytesOut, replay->trace.records);
+    if(replay->stats.differed) {
+        fprintf(stderr, "gpxreplay: %lu packets differed from the trace, the first was packet %lu\n",
+                replay->stats.differed, replay->stats.firstDiffered);
+    }
+    if(replay->stats.unanswered) {
+        fprintf(stderr, "gpxreplay: %lu packets were sent after the trace ended\n", replay->stats.unanswered);
+    }
+    else if(!replay->ended) {
+        fprintf(stderr, "gpxreplay: the host stopped before the end of the trace\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static Replay replay;
+    const char *link = NULL;
+    int c, fd, slave;
+
+    memset(&replay, 0, sizeof(replay));
+    while((c = getopt(argc, argv, ":tl:vh?")) != GETOPTS_END) {
+        switch(c) {
+            case 't':
+                replay.timing = 1;
+                break;
+            case 'l':
+                link = optarg;
+                break;
+            case 'v':
+                replay.verbose = 1;
+                setvbuf(stdout, NULL, _IOLBF, 0);
+                break;
+            case 'h':
+            case '?':
+                usage(stdout, argv[0]);
+                return 0;
+            default:
+                goto L_USAGE;
+        }
+    }
+    if(optind != argc - 1) goto L_USAGE;
+
+    switch(trace_open(&replay.trace, argv[optind])) {
+        case -1:
+            perror("gpxreplay: unable to open the trace");
+            return 1;
+        case -2:
+            fprintf(stderr, "gpxreplay: %s isn't a serial trace recorded with gpx -R\n", argv[optind]);
+            return 1;
+    }
+    // the session starts with the host sending a packet
+    while(next_record(&replay) > 0 && replay.record.kind != TRACE_SENT);
+
+    if((fd = open_pty(link, &slave)) < 0) return 1;
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    while(!stopping) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, -1);
+        if(ready < 0) {
+            if(errno == EINTR) continue;
+            perror("gpxreplay: poll");
+            break;
+        }
+        if(pfd.revents & POLLIN) {
+            ssize_t n = read(fd, replay.rx + replay.rxLength, sizeof(replay.rx) - replay.rxLength);
+            if(n < 0 && errno != EINTR && errno != EAGAIN) {
+                perror("gpxreplay: read");
+                break;
+            }
+            if(n > 0) {
+                replay.rxLength += n;
+                receive(&replay, fd);
+                // a full buffer that holds no packet is noise
+                if(replay.rxLength == sizeof(replay.rx)) replay.rxLength = 0;
+            }
+        }
+    }
+
+    report(&replay);
+    trace_close(&replay.trace);
+    if(link) unlink(link);
+    close(slave);
+    close(fd);
+    return 0;
+
+L_USAGE:
+    usage(stderr, argv[0]);
+    return 1;
+}
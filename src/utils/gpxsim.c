@@ -0,0 +1,899 @@
+//  gpxsim.c
+//
+//  Simulated Sailfish printer on a pseudo-terminal
+//
+//      gpxsim [-b bytes] [-x factor] [-r seconds] [-L ms] [-c n] [-o n] [-k n] [-l link] [-v]
+//
+//  Opens a pseudo-terminal, prints the name of its slave end and answers
+//  the s3g packets written to it the way a Sailfish Mightyboard would, so
+//  gpx -s, the daemon and the python module can be run, tested and timed
+//  without a printer. The answers to the version, buffer size, tool,
+//  position, build, SD card and EEPROM queries come from a model of the
+//  printer. The actions are decoded with the s3g library and queued in a
+//  buffer of the firmware's size, which empties as the moves, delays and
+//  heating waits at its head take their time, so a host that sends faster
+//  than the printer prints sees the buffer fill just as it would on a real
+//  machine. Nobody is there to press the button when the build is paused,
+//  so the pause is ended after a while instead.
+//
+//  Faults can be injected to exercise the host's error handling: a latency
+//  before every response, a corrupt CRC on every nth response, a buffer
+//  overflow on every nth action and a cancelled build at the nth packet.
+//
+//  It runs until interrupted, then prints what it was sent and how it
+//  answered to stderr.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc8.h"
+#include "s3g_private.h"
+#include "s3g.h"
+#include "s3g_commands.h"
+
+#define GETOPTS_END -1
+
+#define FIRMWARE_VERSION 707    // Sailfish 7.7, which gpx has an eeprom map for
+#define FIRMWARE_VARIANT 0x80   // Sailfish
+
+#define PACKET_MAX 255          // the longest payload a packet can carry
+#define QUEUE_MAX 1024          // actions buffered, a power of two
+#define BUFFER_DEFAULT 512      // bytes of actions the firmware buffers
+#define EEPROM_SIZE 4096
+#define SD_FILES 32
+#define SD_NAME_MAX 64
+
+#define AMBIENT 25.0            // degrees C
+#define HEAT_RATE 4.0           // degrees C a second a heater warms up by
+#define COOL_RATE 1.0           // and cools down by
+#define HOME_SECONDS 5.0        // how long homing takes
+
+#define BUILD_NONE 0
+#define BUILD_RUNNING 1
+#define BUILD_FINISHED 2
+#define BUILD_PAUSED 3
+#define BUILD_CANCELLED 4
+
+typedef struct tHeater {
+    double current;
+    double target;
+} Heater;
+
+typedef struct tAction {
+    size_t length;
+    unsigned char payload[PACKET_MAX];
+} Action;
+
+typedef struct tPrinter {
+    // options
+    long bufferSize;
+    double factor;          // simulated seconds for every real one, 0 for no time at all
+    double resume;          // real seconds until a pause is ended, < 0 to wait for the host
+    long latency;           // ms before each response
+    long corruptEvery;      // responses
+    long overflowEvery;     // actions
+    long cancelAt;          // packet
+    int verbose;
+
+    // the action buffer, the action at the head is executing
+    Action queue[QUEUE_MAX];
+    unsigned head, tail;
+    long used;              // bytes of actions buffered
+    int executing;          // the head action has started
+    double done;            // when it finishes, in simulated seconds
+
+    // simulated time
+    double now;
+    double real;            // the real time it was last brought up to date
+    int paused;
+    double pausedAt;        // the real time the build was paused
+
+    // the machine
+    int32_t position[5];
+    Heater tool[2];
+    Heater platform;
+    int buildState;
+    char buildName[SD_NAME_MAX];
+    double buildStarted;
+    unsigned long buildLines;   // actions executed since the build started
+    int sdBuild;                // printing from the SD card
+    int capturing;
+    char captureName[SD_NAME_MAX];
+    unsigned long captured;
+    char sdFile[SD_FILES][SD_NAME_MAX];
+    int sdFiles;
+    int sdNext;
+    unsigned char eeprom[EEPROM_SIZE];
+
+    // the link
+    unsigned char rx[2 * (PACKET_MAX + 3)];
+    size_t rxLength;
+    struct {
+        unsigned long packets;
+        unsigned long actions;
+        unsigned long queries;
+        unsigned long bytesIn;
+        unsigned long bytesOut;
+        unsigned long crcErrors;    // packets that arrived corrupt
+        unsigned long full;         // 0x82 because the buffer was full
+        unsigned long overflows;    // 0x82 injected
+        unsigned long corrupted;    // responses sent with a bad CRC
+        unsigned long cancels;
+        unsigned long executed;
+        unsigned long highWater;    // most bytes buffered
+    } stats;
+} Printer;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(FILE *f, const char *prog)
+{
+    fprintf(f,
+"Usage: %s [-b bytes] [-x factor] [-r seconds] [-L ms] [-c n] [-o n] [-k n] [-l link] [-v]\n"
+"   -b bytes  -- size of the firmware's action buffer, default %d\n"
+"   -x factor -- print factor times faster than real time, 0 for no time at all\n"
+"   -r secs   -- end a pause after secs, default 0, -1 to wait for the host to end it\n"
+"   -L ms     -- wait ms before sending each response\n"
+"   -c n      -- corrupt the CRC of every nth response\n"
+"   -o n      -- answer every nth action with a buffer overflow (0x82)\n"
+"   -k n      -- cancel the build (0x89) at the nth packet\n"
+"   -l link   -- make link a symlink to the pseudo-terminal\n"
+"   -v        -- list the packets received\n"
+"   ?, -h     -- This help message\n",
+            prog ? prog : "gpxsim", BUFFER_DEFAULT);
+}
+
+// DECODING
+
+// an s3g read procedure that reads an action's payload out of memory
+
+typedef struct tPayload {
+    const unsigned char *data;
+    size_t length;
+} Payload;
+
+static ssize_t payload_read(void *ctx, void *buf, size_t maxbuf, size_t nbytes)
+{
+    Payload *payload = (Payload *)ctx;
+    if(nbytes > maxbuf) nbytes = maxbuf;
+    if(nbytes > payload->length) nbytes = payload->length;
+    memcpy(buf, payload->data, nbytes);
+    payload->data += nbytes;
+    payload->length -= nbytes;
+    return nbytes;
+}
+
+static int decode(const Action *action, s3g_command_t *cmd)
+{
+    unsigned char raw[PACKET_MAX + 1];
+    Payload payload = {action->payload, action->length};
+    s3g_context_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.read = payload_read;
+    ctx.r_ctx = &payload;
+    return s3g_command_read_ext(&ctx, cmd, raw, sizeof(raw), NULL);
+}
+
+static unsigned get_16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned char *put_16(unsigned char *p, unsigned value)
+{
+    *p++ = value;
+    *p++ = value >> 8;
+    return p;
+}
+
+static unsigned char *put_32(unsigned char *p, unsigned long value)
+{
+    p = put_16(p, value & 0xFFFF);
+    return put_16(p, (value >> 16) & 0xFFFF);
+}
+
+// THE MACHINE
+
+static Heater *heater(Printer *printer, unsigned index)
+{
+    return printer->tool + (index & 1);
+}
+
+static void warm(Heater *heater, double dt)
+{
+    double target = heater->target > AMBIENT ? heater->target : AMBIENT;
+    if(heater->current < target) {
+        heater->current += HEAT_RATE * dt;
+        if(heater->current > target) heater->current = target;
+    }
+    else if(heater->current > target) {
+        heater->current -= COOL_RATE * dt;
+        if(heater->current < target) heater->current = target;
+    }
+}
+
+static int heater_ready(const Heater *heater)
+{
+    return heater->target == 0 || fabs(heater->current - heater->target) < 1.0;
+}
+
+// the simulated seconds until a heater reaches its target
+
+static double heating_time(const Heater *heater)
+{
+    if(heater_ready(heater)) return 0.0;
+    double change = heater->target - heater->current;
+    return change > 0.0 ? change / HEAT_RATE : -change / COOL_RATE;
+}
+
+static void move_to(Printer *printer, const int32_t target[5], unsigned relative)
+{
+    int k;
+    for(k = 0; k < 5; k++) {
+        printer->position[k] = relative & (1 << k) ? printer->position[k] + target[k] : target[k];
+    }
+}
+
+// start the action at the head of the buffer, returns how long it takes
+// in simulated seconds
+
+static double start_action(Printer *printer, const Action *action)
+{
+    s3g_command_t cmd;
+    double duration = 0.0;
+
+    if(decode(action, &cmd) != 0) return 0.0;
+    if(printer->verbose) printf("  (%d) %s\n", cmd.cmd_id, cmd.cmd_desc);
+
+    switch(cmd.cmd_id) {
+        case HOST_CMD_QUEUE_POINT_EXT: {
+            const s3g_queue_point_ext *p = &cmd.t.queue_point_ext;
+            int32_t target[5] = {p->x, p->y, p->z, p->a, p->b};
+            long steps = 0;
+            int k;
+            for(k = 0; k < 5; k++) {
+                long delta = labs((long)target[k] - printer->position[k]);
+                if(delta > steps) steps = delta;
+            }
+            duration = (double)p->dda * steps / 1000000.0;
+            move_to(printer, target, 0);
+            break;
+        }
+        case HOST_CMD_QUEUE_POINT_NEW: {
+            const s3g_queue_point_new *p = &cmd.t.queue_point_new;
+            int32_t target[5] = {p->x, p->y, p->z, p->a, p->b};
+            duration = p->us / 1000000.0;
+            move_to(printer, target, p->rel);
+            break;
+        }
+        case HOST_CMD_QUEUE_POINT_NEW_EXT: {
+            const s3g_queue_point_new_ext *p = &cmd.t.queue_point_new_ext;
+            int32_t target[5] = {p->x, p->y, p->z, p->a, p->b};
+            if(p->feedrate_mult_64) duration = p->distance * 64.0 / p->feedrate_mult_64;
+            move_to(printer, target, p->rel);
+            break;
+        }
+        case HOST_CMD_SET_POSITION_EXT: {
+            const s3g_set_position_ext *p = &cmd.t.set_position_ext;
+            int32_t target[5] = {p->x, p->y, p->z, p->a, p->b};
+            move_to(printer, target, 0);
+            break;
+        }
+        case HOST_CMD_FIND_AXES_MINIMUM:
+        case HOST_CMD_FIND_AXES_MAXIMUM: {
+            int k;
+            for(k = 0; k < 5; k++) {
+                if(cmd.t.find_axes_minmax.flags & (1 << k)) printer->position[k] = 0;
+            }
+            duration = HOME_SECONDS;
+            break;
+        }
+        case HOST_CMD_DELAY:
+            duration = cmd.t.delay.millis / 1000.0;
+            break;
+        case HOST_CMD_WAIT_FOR_TOOL:
+            duration = heating_time(heater(printer, cmd.t.wait_for_tool.index));
+            break;
+        case HOST_CMD_WAIT_FOR_PLATFORM:
+            duration = heating_time(&printer->platform);
+            break;
+        case HOST_CMD_TOOL_COMMAND:
+            switch(cmd.t.tool.subcmd_id) {
+                case TOOL_CMD_SET_TEMP:
+                    heater(printer, cmd.t.tool.index)->target = cmd.t.tool.subcmd_value;
+                    break;
+                case TOOL_CMD_SET_PLATFORM_TEMP:
+                    printer->platform.target = cmd.t.tool.subcmd_value;
+                    break;
+            }
+            break;
+        case HOST_CMD_BUILD_START_NOTIFICATION:
+            snprintf(printer->buildName, sizeof(printer->buildName), "%s", (char *)cmd.t.build_start.message);
+            printer->buildState = BUILD_RUNNING;
+            printer->buildStarted = printer->now;
+            printer->buildLines = 0;
+            break;
+        case HOST_CMD_BUILD_END_NOTIFICATION:
+            printer->buildState = BUILD_FINISHED;
+            break;
+    }
+    return printer->factor > 0.0 ? duration : 0.0;
+}
+
+static void pause_build(Printer *printer, int paused)
+{
+    printer->paused = paused;
+    printer->pausedAt = printer->real;
+    if(printer->buildState == BUILD_RUNNING || printer->buildState == BUILD_PAUSED) {
+        printer->buildState = paused ? BUILD_PAUSED : BUILD_RUNNING;
+    }
+}
+
+static void clear_queue(Printer *printer)
+{
+    printer->head = printer->tail = 0;
+    printer->used = 0;
+    printer->executing = 0;
+}
+
+// bring the simulation up to the real time now, executing the actions
+// whose time has come
+
+static void advance(Printer *printer, double now)
+{
+    double dt = printer->factor > 0.0 ? (now - printer->real) * printer->factor : 0.0;
+    printer->real = now;
+    printer->now += dt;
+    if(printer->paused && printer->resume >= 0.0 && now - printer->pausedAt >= printer->resume) {
+        pause_build(printer, 0);
+    }
+    warm(printer->tool, dt);
+    warm(printer->tool + 1, dt);
+    warm(&printer->platform, dt);
+    if(printer->paused) {
+        // the action at the head waits as long as the printer is paused
+        printer->done += dt;
+        return;
+    }
+    while(printer->head != printer->tail) {
+        Action *action = printer->queue + (printer->head & (QUEUE_MAX - 1));
+        if(!printer->executing) {
+            printer->done = printer->now + start_action(printer, action);
+            printer->executing = 1;
+        }
+        if(printer->done > printer->now) break;
+        printer->used -= action->length;
+        printer->head++;
+        printer->executing = 0;
+        printer->stats.executed++;
+        printer->buildLines++;
+    }
+}
+
+// the ms until the action at the head finishes, -1 if nothing is buffered
+
+static int next_timeout(const Printer *printer)
+{
+    if(printer->head == printer->tail) return -1;
+    if(printer->paused) {
+        if(printer->resume < 0.0) return -1;
+        double ms = (printer->pausedAt + printer->resume - printer->real) * 1000.0;
+        return ms < 1.0 ? 1 : ms > 1000.0 ? 1000 : (int)ms;
+    }
+    if(printer->factor <= 0.0) return 0;
+    double ms = (printer->done - printer->now) / printer->factor * 1000.0;
+    return ms < 1.0 ? 1 : ms > 1000.0 ? 1000 : (int)ms;
+}
+
+// THE LINK
+
+static void respond(Printer *printer, int fd, unsigned char code, const unsigned char *data, size_t length)
+{
+    unsigned char packet[PACKET_MAX + 3];
+    if(length > PACKET_MAX - 1) length = PACKET_MAX - 1;
+    packet[0] = 0xD5;
+    packet[1] = length + 1;
+    packet[2] = code;
+    memcpy(packet + 3, data, length);
+    packet[length + 3] = crc8(packet + 2, length + 1);
+    if(printer->corruptEvery && (printer->stats.packets % printer->corruptEvery) == 0) {
+        packet[length + 3] ^= 0xFF;
+        printer->stats.corrupted++;
+    }
+    if(printer->latency) {
+        struct timespec ts = {printer->latency / 1000, (printer->latency % 1000) * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+    size_t n = length + 4;
+    const unsigned char *p = packet;
+    while(n) {
+        ssize_t written = write(fd, p, n);
+        if(written < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            perror("gpxsim: write");
+            return;
+        }
+        p += written;
+        n -= written;
+    }
+    printer->stats.bytesOut += length + 4;
+}
+
+static const char *next_sd_file(Printer *printer, int restart)
+{
+    if(restart) printer->sdNext = 0;
+    if(printer->sdNext >= printer->sdFiles) return "";
+    return printer->sdFile[printer->sdNext++];
+}
+
+static void add_sd_file(Printer *printer, const char *name)
+{
+    int i;
+    for(i = 0; i < printer->sdFiles; i++) {
+        if(strcmp(printer->sdFile[i], name) == 0) return;
+    }
+    if(printer->sdFiles < SD_FILES) {
+        snprintf(printer->sdFile[printer->sdFiles++], SD_NAME_MAX, "%s", name);
+    }
+}
+
+static void stop_build(Printer *printer, int state)
+{
+    clear_queue(printer);
+    printer->sdBuild = 0;
+    printer->paused = 0;
+    if(printer->buildState == BUILD_RUNNING || printer->buildState == BUILD_PAUSED) {
+        printer->buildState = state;
+    }
+}
+
+static void tool_query(Printer *printer, int fd, const unsigned char *payload, size_t length)
+{
+    unsigned char data[16], *p = data;
+    if(length < 3) {
+        respond(printer, fd, 0x80, NULL, 0);
+        return;
+    }
+    Heater *tool = heater(printer, payload[1]);
+    switch(payload[2]) {
+        case TOOL_CMD_VERSION:
+            p = put_16(p, FIRMWARE_VERSION);
+            break;
+        case TOOL_CMD_GET_TEMP:
+            p = put_16(p, (unsigned)lround(tool->current));
+            break;
+        case TOOL_CMD_GET_SP:
+            p = put_16(p, (unsigned)lround(tool->target));
+            break;
+        case TOOL_CMD_IS_TOOL_READY:
+            *p++ = heater_ready(tool);
+            break;
+        case TOOL_CMD_GET_PLATFORM_TEMP:
+            p = put_16(p, (unsigned)lround(printer->platform.current));
+            break;
+        case TOOL_CMD_GET_PLATFORM_SP:
+            p = put_16(p, (unsigned)lround(printer->platform.target));
+            break;
+        case TOOL_CMD_IS_PLATFORM_READY:
+            *p++ = heater_ready(&printer->platform);
+            break;
+        case TOOL_CMD_GET_TOOL_STATUS:
+            *p++ = heater_ready(tool);
+            break;
+        case TOOL_CMD_GET_PID_STATE:
+            memset(p, 0, 12);
+            p += 12;
+            break;
+        default:
+            respond(printer, fd, 0x85, NULL, 0);
+            return;
+    }
+    respond(printer, fd, 0x81, data, p - data);
+}
+
+static void query(Printer *printer, int fd, const unsigned char *payload, size_t length)
+{
+    unsigned char data[PACKET_MAX], *p = data;
+    const char *s;
+    int k;
+
+    if(printer->verbose) printf("query %u\n", payload[0]);
+    printer->stats.queries++;
+    switch(payload[0]) {
+        case HOST_CMD_VERSION:
+            p = put_16(p, FIRMWARE_VERSION);
+            break;
+        case HOST_CMD_INIT:
+        case HOST_CMD_CLEAR_BUFFER:
+            clear_queue(printer);
+            break;
+        case HOST_CMD_GET_BUFFER_SIZE:
+            p = put_32(p, printer->bufferSize - printer->used);
+            break;
+        case HOST_CMD_ABORT:
+        case HOST_CMD_RESET:
+            stop_build(printer, BUILD_CANCELLED);
+            break;
+        case HOST_CMD_EXTENDED_STOP:
+            stop_build(printer, BUILD_CANCELLED);
+            *p++ = 0;
+            break;
+        case HOST_CMD_PAUSE:
+            pause_build(printer, !printer->paused);
+            break;
+        case HOST_CMD_TOOL_QUERY:
+            tool_query(printer, fd, payload, length);
+            return;
+        case HOST_CMD_IS_FINISHED:
+            *p++ = printer->head == printer->tail;
+            break;
+        case HOST_CMD_READ_EEPROM:
+        case HOST_CMD_WRITE_EEPROM: {
+            if(length < 4) goto L_MALFORMED;
+            unsigned offset = get_16(payload + 1);
+            unsigned count = payload[3];
+            if(offset + count > EEPROM_SIZE || count > PACKET_MAX - 1) goto L_MALFORMED;
+            if(payload[0] == HOST_CMD_READ_EEPROM) {
+                memcpy(p, printer->eeprom + offset, count);
+                p += count;
+            }
+            else {
+                if(length < 4 + count) goto L_MALFORMED;
+                memcpy(printer->eeprom + offset, payload + 4, count);
+                *p++ = count;
+            }
+            break;
+        }
+        case HOST_CMD_CAPTURE_TO_FILE:
+            snprintf(printer->captureName, sizeof(printer->captureName), "%.*s", (int)(length - 1), (const char *)payload + 1);
+            printer->capturing = 1;
+            printer->captured = 0;
+            *p++ = 0;
+            break;
+        case HOST_CMD_END_CAPTURE:
+            if(printer->capturing) add_sd_file(printer, printer->captureName);
+            printer->capturing = 0;
+            p = put_32(p, printer->captured);
+            break;
+        case HOST_CMD_PLAYBACK_CAPTURE: {
+            char name[SD_NAME_MAX];
+            int i, found = 0;
+            snprintf(name, sizeof(name), "%.*s", (int)(length - 1), (const char *)payload + 1);
+            for(i = 0; i < printer->sdFiles; i++) {
+                if(strcmp(printer->sdFile[i], name) == 0) found = 1;
+            }
+            if(found) {
+                // the host is locked out until the build is stopped
+                snprintf(printer->buildName, sizeof(printer->buildName), "%s", name);
+                printer->buildState = BUILD_RUNNING;
+                printer->buildStarted = printer->now;
+                printer->buildLines = 0;
+                printer->sdBuild = 1;
+            }
+            *p++ = found ? 0 : 1;
+            break;
+        }
+        case HOST_CMD_NEXT_FILENAME:
+            *p++ = 0;
+            s = next_sd_file(printer, length > 1 && payload[1]);
+            strcpy((char *)p, s);
+            p += strlen(s) + 1;
+            break;
+        case HOST_CMD_GET_BUILD_NAME:
+            strcpy((char *)p, printer->buildName);
+            p += strlen(printer->buildName) + 1;
+            break;
+        case HOST_CMD_GET_POSITION_EXT:
+            for(k = 0; k < 5; k++) {
+                p = put_32(p, (uint32_t)printer->position[k]);
+            }
+            p = put_16(p, 0);
+            break;
+        case HOST_CMD_BOARD_STATUS:
+            *p++ = 0;
+            break;
+        case HOST_CMD_GET_BUILD_STATS: {
+            unsigned long minutes = 0;
+            if(printer->buildState != BUILD_NONE) {
+                minutes = (unsigned long)((printer->now - printer->buildStarted) / 60.0);
+            }
+            *p++ = printer->buildState;
+            *p++ = minutes / 60;
+            *p++ = minutes % 60;
+            p = put_32(p, printer->buildLines);
+            p = put_32(p, 0);
+            break;
+        }
+        case HOST_CMD_ADVANCED_VERSION:
+            p = put_16(p, FIRMWARE_VERSION);
+            p = put_16(p, 0);
+            *p++ = FIRMWARE_VARIANT;
+            *p++ = 0;
+            p = put_16(p, 0);
+            break;
+        default:
+            respond(printer, fd, 0x85, NULL, 0);
+            return;
+    }
+    respond(printer, fd, 0x81, data, p - data);
+    return;
+
+L_MALFORMED:
+    respond(printer, fd, 0x80, NULL, 0);
+}
+
+static void action(Printer *printer, int fd, const unsigned char *payload, size_t length)
+{
+    printer->stats.actions++;
+    if(printer->sdBuild) {
+        respond(printer, fd, 0x8A, NULL, 0);
+        return;
+    }
+    if(printer->overflowEvery && (printer->stats.actions % printer->overflowEvery) == 0) {
+        printer->stats.overflows++;
+        respond(printer, fd, 0x82, NULL, 0);
+        return;
+    }
+    if(printer->capturing) {
+        // captured to the SD card instead of being executed
+        printer->captured += length;
+        respond(printer, fd, 0x81, NULL, 0);
+        return;
+    }
+    if(printer->used + (long)length > printer->bufferSize || printer->tail - printer->head == QUEUE_MAX) {
+        printer->stats.full++;
+        respond(printer, fd, 0x82, NULL, 0);
+        return;
+    }
+    Action *queued = printer->queue + (printer->tail & (QUEUE_MAX - 1));
+    memcpy(queued->payload, payload, length);
+    queued->length = length;
+    printer->tail++;
+    printer->used += length;
+    if(printer->used > (long)printer->stats.highWater) printer->stats.highWater = printer->used;
+    respond(printer, fd, 0x81, NULL, 0);
+}
+
+static void packet(Printer *printer, int fd, const unsigned char *payload, size_t length)
+{
+    printer->stats.packets++;
+    advance(printer, seconds());
+    if(printer->cancelAt && printer->stats.packets == (unsigned long)printer->cancelAt) {
+        printer->stats.cancels++;
+        stop_build(printer, BUILD_CANCELLED);
+        respond(printer, fd, 0x89, NULL, 0);
+        return;
+    }
+    if(length == 0) {
+        respond(printer, fd, 0x80, NULL, 0);
+    }
+    else if(payload[0] & 0x80) {
+        action(printer, fd, payload, length);
+    }
+    else {
+        query(printer, fd, payload, length);
+    }
+}
+
+// answer the packets in the bytes received, keeping any partial packet
+// for the next read
+
+static void receive(Printer *printer, int fd)
+{
+    size_t i = 0;
+    while(i < printer->rxLength) {
+        unsigned char *p = printer->rx + i;
+        size_t left = printer->rxLength - i;
+        if(p[0] != 0xD5) {
+            i++;
+            continue;
+        }
+        if(left < 2 || left < (size_t)p[1] + 3) break;
+        size_t length = p[1];
+        if(crc8(p + 2, length) != p[length + 2]) {
+            printer->stats.packets++;
+            printer->stats.crcErrors++;
+            respond(printer, fd, 0x83, NULL, 0);
+        }
+        else {
+            packet(printer, fd, p + 2, length);
+        }
+        i += length + 3;
+    }
+    printer->rxLength -= i;
+    memmove(printer->rx, printer->rx + i, printer->rxLength);
+}
+
+static int open_pty(const char *link, int *slave)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0) {
+        perror("gpxsim: posix_openpt");
+        return -1;
+    }
+    if(grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("gpxsim: unable to unlock the pseudo-terminal");
+        close(fd);
+        return -1;
+    }
+    char *name = ptsname(fd);
+    if(name == NULL) {
+        perror("gpxsim: ptsname");
+        close(fd);
+        return -1;
+    }
+
+    // hold the slave end open, so the pseudo-terminal outlives each host
+    // that opens and closes it
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if(*slave < 0) {
+        perror("gpxsim: unable to open the slave end");
+        close(fd);
+        return -1;
+    }
+    struct termios ti;
+    if(tcgetattr(*slave, &ti) == 0) {
+        cfmakeraw(&ti);
+        tcsetattr(*slave, TCSANOW, &ti);
+    }
+
+    if(link) {
+        if(unlink(link) < 0 && errno != ENOENT) {
+            fprintf(stderr, "gpxsim: %s already exists and can't be removed\n", link);
+        }
+        else if(symlink(name, link) < 0) {
+            fprintf(stderr, "gpxsim: unable to create the symlink %s\n", link);
+        }
+    }
+    printf("%s\n", name);
+    fflush(stdout);
+    return fd;
+}
+
+static void report(const Printer *printer)
+{
+    fprintf(stderr,
+            "gpxsim: %lu packets, %lu actions, %lu queries, %lu bytes in, %lu bytes out\n"
+            "gpxsim: %lu actions executed in %0.1f simulated seconds, %lu of %ld buffer bytes used at most\n"
+            "gpxsim: %lu overflows (%lu injected), %lu CRC errors received, %lu responses corrupted, %lu cancels\n",
+            printer->stats.packets, printer->stats.actions, printer->stats.queries,
+            printer->stats.bytesIn, printer->stats.bytesOut,
+            printer->stats.executed, printer->now, printer->stats.highWater, printer->bufferSize,
+            printer->stats.full + printer->stats.overflows, printer->stats.overflows,
+            printer->stats.crcErrors, printer->stats.corrupted, printer->stats.cancels);
+}
+
+int main(int argc, char *argv[])
+{
+    static Printer printer;
+    const char *link = NULL;
+    int c, fd, slave;
+
+    memset(&printer, 0, sizeof(printer));
+    printer.bufferSize = BUFFER_DEFAULT;
+    printer.factor = 1.0;
+    printer.tool[0].current = printer.tool[1].current = printer.platform.current = AMBIENT;
+    memset(printer.eeprom, 0xFF, sizeof(printer.eeprom));
+
+    while((c = getopt(argc, argv, ":b:x:r:L:c:o:k:l:vh?")) != GETOPTS_END) {
+        switch(c) {
+            case 'b':
+                printer.bufferSize = strtol(optarg, NULL, 0);
+                if(printer.bufferSize < 1) goto L_USAGE;
+                break;
+            case 'x':
+                printer.factor = strtod(optarg, NULL);
+                if(printer.factor < 0.0) goto L_USAGE;
+                break;
+            case 'r':
+                printer.resume = strtod(optarg, NULL);
+                break;
+            case 'L':
+                printer.latency = strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                printer.corruptEvery = strtol(optarg, NULL, 0);
+                break;
+            case 'o':
+                printer.overflowEvery = strtol(optarg, NULL, 0);
+                break;
+            case 'k':
+                printer.cancelAt = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                link = optarg;
+                break;
+            case 'v':
+                printer.verbose = 1;
+                setvbuf(stdout, NULL, _IOLBF, 0);
+                break;
+            case 'h':
+            case '?':
+                usage(stdout, argv[0]);
+                return 0;
+            default:
+                goto L_USAGE;
+        }
+    }
+    if(optind != argc) goto L_USAGE;
+
+    if((fd = open_pty(link, &slave)) < 0) return 1;
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    printer.real = seconds();
+    while(!stopping) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, next_timeout(&printer));
+        if(ready < 0 && errno != EINTR) {
+            perror("gpxsim: poll");
+            break;
+        }
+        advance(&printer, seconds());
+        if(ready > 0 && (pfd.revents & POLLIN)) {
+            ssize_t n = read(fd, printer.rx + printer.rxLength, sizeof(printer.rx) - printer.rxLength);
+            if(n < 0 && errno != EINTR && errno != EAGAIN) {
+                perror("gpxsim: read");
+                break;
+            }
+            if(n > 0) {
+                printer.stats.bytesIn += n;
+                printer.rxLength += n;
+                receive(&printer, fd);
+                // a full buffer that holds no packet is noise
+                if(printer.rxLength == sizeof(printer.rx)) printer.rxLength = 0;
+            }
+        }
+    }
+
+    report(&printer);
+    if(link) unlink(link);
+    close(slave);
+    close(fd);
+    return 0;
+
+L_USAGE:
+    usage(stderr, argv[0]);
+    return 1;
+}